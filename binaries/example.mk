@@ -11,8 +11,14 @@ ASAN:=n
 TSAN:=n
 UBSAN:=n
 
+# CPU profiler instrumentation, see utils/Profiler.h
+PROFILING:=n
+
 RENDERER:=vulkan
 
+# OpenGL through EGL, needed for --headless with RENDERER:=opengl
+OPENGL_EGL:=n
+
 
 INTERNAL_glslang:=y
 LDLIBS_glslang:=
@@ -53,6 +59,7 @@ LDFLAGS+=-Wl,--gc-sections
 LDLIBS:=-lpthread
 LDLIBS_sdl2:=$(shell sdl2-config --libs)
 LDLIBS_opengl:=-lGL
+LDLIBS_egl:=-lEGL
 LDLIBS_vulkan:=-lvulkan
 
 LTOCFLAGS:=-flto -fuse-linker-plugin -fno-fat-lto-objects
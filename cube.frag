@@ -25,14 +25,22 @@ THE SOFTWARE.
 
 #include "shaderDefines.h"
 
+#ifndef PACKED_CUBES
+
 readonly restrict layout(std430, set = 1, binding = 0) buffer cubeData {
     Cube cubes[];
 };
 
+#endif  // PACKED_CUBES
+
 
 layout(location = 0) flat in int instance;
 layout(location = 1) in vec3 currPos;
 layout(location = 2) in vec3 prevPos;
+#ifdef PACKED_CUBES
+// decoded in vertex shader
+layout(location = 3) flat in vec3 cubeColor;
+#endif  // PACKED_CUBES
 
 
 layout (location = 0) out vec4 outColor;
@@ -41,9 +49,13 @@ layout (location = 1) out vec2 outVelocity;
 
 void main(void)
 {
+#ifdef PACKED_CUBES
+    vec4 color = vec4(cubeColor, 0.0);
+#else  // PACKED_CUBES
     Cube cube = cubes[instance];
 
     vec4 color = vec4(cube.color, 0.0);
+#endif  // PACKED_CUBES
 
     color.w = dot(color.xyz, vec3(0.299, 0.587, 0.114));
     outColor = color;
@@ -29,31 +29,59 @@ THE SOFTWARE.
 layout(location = ATTR_POS) in vec3 position;
 
 
+#ifdef PACKED_CUBES
+
+readonly restrict layout(std430, set = 1, binding = 0) buffer cubeData {
+    PackedCube cubes[];
+};
+
+#else  // PACKED_CUBES
+
 readonly restrict layout(std430, set = 1, binding = 0) buffer cubeData {
     Cube cubes[];
 };
 
+#endif  // PACKED_CUBES
+
 
 layout(location = 0) flat out int instance;
 layout(location = 1) out vec3 currPos;
 layout(location = 2) out vec3 prevPos;
+#ifdef PACKED_CUBES
+layout(location = 3) flat out vec3 cubeColor;
+#endif  // PACKED_CUBES
 
 
 void main(void)
 {
+#ifdef PACKED_CUBES
+
+    uvec4 cubeBits = cubes[gl_InstanceIndex].data;
+
+    vec3 rotationQuat = vec3(unpackSnorm2x16(cubeBits.x), unpackSnorm2x16(cubeBits.y).x);
+    float qw = sqrt(max(0.0, 1.0 - dot(rotationQuat, rotationQuat)));
+    uvec3 gridIndex = uvec3(cubeBits.y >> 16, cubeBits.z & 0xFFFFu, cubeBits.z >> 16);
+    vec3 cubePosition = vec3(gridIndex) * cubeGrid.x + cubeGrid.y;
+    cubeColor = vec3((uvec3(cubeBits.w) >> uvec3(0u, 10u, 20u)) & 0x3FFu) / 1023.0;
+
+#else  // PACKED_CUBES
+
     Cube cube = cubes[gl_InstanceIndex];
+    vec3 rotationQuat = cube.rotation.xyz;
+    float qw = cube.rotation.w;
+    vec3 cubePosition = cube.position;
+
+#endif  // PACKED_CUBES
 
     // rotate
     // this is quaternion multiplication from glm
     vec3 v = position;
-    vec3 rotationQuat = cube.rotation.xyz;
-    float qw = cube.rotation.w;
     vec3 uv = cross(rotationQuat, v);
     vec3 uuv = cross(rotationQuat, uv);
     uv *= (2.0 * qw);
     uuv *= 2.0;
     vec3 rotatedPos = v + uv + uuv;
-    vec4 worldPos = vec4(rotatedPos + cube.position, 1.0);
+    vec4 worldPos = vec4(rotatedPos + cubePosition, 1.0);
 
     gl_Position = viewProj * worldPos;
     currPos     = gl_Position.xyw;
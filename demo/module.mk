@@ -10,8 +10,12 @@ FILES:= \
 smaaDemo_MODULES:=imgui renderer utils
 smaaDemo_SRC:=$(foreach f, smaaDemo.cpp, $(dir)/$(f))
 
+rendererReplay_MODULES:=renderer utils
+rendererReplay_SRC:=$(foreach f, rendererReplay.cpp, $(dir)/$(f))
+
 
 PROGRAMS+= \
+	rendererReplay \
 	smaaDemo \
 	# empty line
 
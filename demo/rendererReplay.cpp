@@ -0,0 +1,164 @@
+/*
+Copyright (c) 2015-2018 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include <tclap/CmdLine.h>
+
+#include "renderer/Renderer.h"
+#include "renderer/RendererTrace.h"
+#include "utils/JobSystem.h"
+#include "utils/Utils.h"
+
+
+using namespace renderer;
+
+
+static bool shouldQuit() {
+	SDL_Event event;
+	memset(&event, 0, sizeof(SDL_Event));
+	while (SDL_PollEvent(&event)) {
+		if (event.type == SDL_QUIT) {
+			return true;
+		}
+		if (event.type == SDL_KEYDOWN && event.key.keysym.scancode == SDL_SCANCODE_ESCAPE) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+static int replay(int argc, char *argv[]) {
+	std::string   traceFile;
+	bool          vsync = false;
+	bool          debug = false;
+	unsigned int  loops = 1;
+
+	try {
+		TCLAP::CmdLine cmd("Renderer trace replay", ' ', "1.0");
+
+		TCLAP::SwitchArg                  debugSwitch("",  "debug", "Enable renderer debugging",          cmd, false);
+		TCLAP::SwitchArg                  vsyncSwitch("",  "vsync", "Enable vsync",                       cmd, false);
+		TCLAP::ValueArg<unsigned int>     loopsSwitch("",  "loops", "Number of times to replay the trace", false, 1, "count", cmd);
+		TCLAP::UnlabeledValueArg<std::string>  traceArg("trace", "Trace file recorded with --record", true, "", "trace file", cmd);
+
+		cmd.parse(argc, argv);
+
+		traceFile = traceArg.getValue();
+		vsync     = vsyncSwitch.getValue();
+		debug     = debugSwitch.getValue();
+		loops     = std::max(1U, loopsSwitch.getValue());
+	} catch (TCLAP::ArgException &e) {
+		LOG("parseCommandLine exception: %s for arg %s\n", e.error().c_str(), e.argId().c_str());
+		fprintf(stderr, "%s for arg %s\n", e.error().c_str(), e.argId().c_str());
+		return 1;
+	}
+
+	uint64_t freq = SDL_GetPerformanceFrequency();
+
+	for (unsigned int loop = 0; loop < loops; loop++) {
+		// resources are created by the trace so every loop needs a fresh renderer
+		TraceReplayer replayer(traceFile);
+
+		RendererDesc &desc = replayer.getRendererDesc();
+		desc.debug         = debug;
+		if (vsync) {
+			desc.swapchain.vsync = VSync::On;
+		}
+
+		Renderer renderer = Renderer::createRenderer(desc);
+
+		// first frame creates most resources, report it separately
+		std::vector<uint64_t> frameTimes;
+		uint64_t firstFrame = 0;
+		uint64_t start      = SDL_GetPerformanceCounter();
+		bool     more       = true;
+		while (more) {
+			uint64_t frameStart = SDL_GetPerformanceCounter();
+			more = replayer.replayFrame(renderer);
+			uint64_t frameEnd = SDL_GetPerformanceCounter();
+
+			if (!more) {
+				// commands after the last presentFrame, only teardown
+				break;
+			}
+
+			if (firstFrame == 0) {
+				firstFrame = frameEnd - frameStart;
+			} else {
+				frameTimes.push_back(frameEnd - frameStart);
+			}
+
+			if (shouldQuit()) {
+				loop = loops;
+				break;
+			}
+		}
+		uint64_t total = SDL_GetPerformanceCounter() - start;
+
+		double toMs = 1000.0 / double(freq);
+		printf("%u frames, %u commands in %.2f ms\n", static_cast<unsigned int>(frameTimes.size() + (firstFrame ? 1 : 0)), replayer.getNumCommands(), double(total) * toMs);
+		printf("first frame: %.3f ms\n", double(firstFrame) * toMs);
+		if (!frameTimes.empty()) {
+			uint64_t sum = 0;
+			for (uint64_t t : frameTimes) {
+				sum += t;
+			}
+			auto minmax = std::minmax_element(frameTimes.begin(), frameTimes.end());
+			printf("rest: mean %.3f ms, min %.3f ms, max %.3f ms\n", double(sum) * toMs / frameTimes.size(), double(*minmax.first) * toMs, double(*minmax.second) * toMs);
+		}
+		LOG("Replayed \"%s\": %u commands, %.2f ms\n", traceFile.c_str(), replayer.getNumCommands(), double(total) * toMs);
+	}
+
+	return 0;
+}
+
+
+int main(int argc, char *argv[]) {
+	int retval = 0;
+	try {
+		logInit();
+		// software renderer rasterizes with jobs
+		jobSystemInit(0, false);
+
+		retval = replay(argc, argv);
+	} catch (std::exception &e) {
+		LOG_ERROR("caught std::exception \"%s\"\n", e.what());
+		fprintf(stderr, "%s\n", e.what());
+		retval = 1;
+	} catch (...) {
+		LOG_ERROR("unknown exception\n");
+		retval = 1;
+	}
+	jobSystemShutdown();
+	logShutdown();
+
+	return retval;
+}
@@ -24,17 +24,26 @@ THE SOFTWARE.
 #include <cassert>
 #include <cfloat>
 #include <cinttypes>
+#include <climits>
 #include <cstdio>
 
 #include <thread>
 #include <chrono>
+#include <condition_variable>
+#include <mutex>
 
 #include <algorithm>
+#include <deque>
 #include <limits>
 #include <memory>
 #include <stdexcept>
 #include <vector>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2 1
+#include <emmintrin.h>
+#endif
+
 #include <imgui.h>
 #include <imgui_internal.h>
 
@@ -45,7 +54,12 @@ THE SOFTWARE.
 
 #include <pcg_random.hpp>
 
+#include <xxhash.h>
+
 #include "renderer/Renderer.h"
+#include "utils/Allocations.h"
+#include "utils/JobSystem.h"
+#include "utils/Profiler.h"
 #include "utils/Utils.h"
 
 #include "AreaTex.h"
@@ -60,6 +74,8 @@ THE SOFTWARE.
 #if defined(__GNUC__) && defined(_WIN32)
 
 #include <mingw.thread.h>
+#include <mingw.mutex.h>
+#include <mingw.condition_variable.h>
 
 #endif  // defined(__GNUC__) && defined(_WIN32)
 
@@ -116,6 +132,10 @@ const char *smaaDebugModes[3] = { "None", "Edges", "Weights" };
 static const unsigned int inputTextBufferSize = 1024;
 
 
+// how often statistics in the GUI are refreshed
+static const uint64_t guiStatsInterval = 250ULL * 1000000ULL;
+
+
 const char* GetClipboardText(void* user_data) {
 	char *clipboard = SDL_GetClipboardText();
 	if (clipboard) {
@@ -152,6 +172,13 @@ public:
 	}
 
 
+	// independent sequence for each stream so work can be split without changing results
+	RandomGen(uint64_t seed, uint64_t stream)
+	: rng(seed, stream)
+	{
+	}
+
+
 	float randFloat() {
 		uint32_t u = randU32();
 		// because 24 bits mantissa
@@ -240,16 +267,32 @@ enum class SMAAEdgeMethod : uint8_t {
 };
 
 
+enum class ImageState : uint8_t {
+	  Loading   // queued, being decoded or having mips written by a loader thread
+	, Resident
+	, Evicted   // texture deleted to stay within memory budget, reloaded when shown
+	, Failed
+};
+
+
 struct Image {
 	std::string    filename;
 	std::string    shortName;
 	TextureHandle  tex;
 	unsigned int   width, height;
+	// all mip levels, counted against the image memory budget
+	uint64_t       sizeBytes;
+	ImageState     state;
+	// nanoseconds, for evicting the least recently shown image
+	uint64_t       lastUsed;
 
 
 	Image()
 	: width(0)
 	, height(0)
+	, sizeBytes(0)
+	, state(ImageState::Loading)
+	, lastUsed(0)
 	{
 	}
 
@@ -264,6 +307,402 @@ struct Image {
 };
 
 
+// decoded by a loader thread, then the main thread begins a texture upload
+// and a second loader job writes the mip levels straight into it
+struct ImageLoadJob {
+	unsigned int   index;
+	std::string    filename;
+	// sRGBA8, or sBC1 to compress on the loader thread
+	Format         format;
+	// from stbi_load, sRGBA8 mip level 0
+	unsigned char  *data;
+	int            width, height;
+	// 0 if decoding failed
+	unsigned int   numMips;
+	// begun by the main thread once decoded, can stay open over frames
+	TextureUpload  upload;
+	// all mip levels are in upload, main thread can end it
+	bool           built;
+
+
+	ImageLoadJob()
+	: index(0)
+	, format(Format::sRGBA8)
+	, data(nullptr)
+	, width(0)
+	, height(0)
+	, numMips(0)
+	, built(false)
+	{
+	}
+};
+
+
+static float sRGB2linear(float v) {
+    if (v <= 0.04045f) {
+        return v / 12.92f;
+    } else {
+        return powf((v + 0.055f) / 1.055f, 2.4f);
+    }
+}
+
+
+static float linear2sRGB(float v) {
+	if (v <= 0.0031308f) {
+		return v * 12.92f;
+	} else {
+		return 1.055f * powf(v, 1.0f / 2.4f) - 0.055f;
+	}
+}
+
+
+// lookup tables so downsampling can average in linear space
+struct SRGBTables {
+	// 8-bit sRGB to 16-bit linear
+	std::array<uint16_t, 256>    toLinear;
+	// 16-bit linear to 8-bit sRGB
+	std::array<uint8_t, 65536>   fromLinear;
+
+
+	SRGBTables() {
+		for (unsigned int i = 0; i < toLinear.size(); i++) {
+			toLinear[i]   = static_cast<uint16_t>(std::round(sRGB2linear(i / 255.0f) * 65535.0f));
+		}
+		for (unsigned int i = 0; i < fromLinear.size(); i++) {
+			fromLinear[i] = static_cast<uint8_t>(std::round(linear2sRGB(i / 65535.0f) * 255.0f));
+		}
+	}
+};
+
+
+static const SRGBTables &srgbTables() {
+	static const SRGBTables tables;
+	return tables;
+}
+
+
+// 2x2 box filter of an sRGBA8 image, odd edges are clamped
+static void downsampleSRGBA8(const unsigned char *src, unsigned int srcWidth, unsigned int srcHeight, unsigned char *dst) {
+	const SRGBTables &tables = srgbTables();
+	unsigned int width  = std::max(srcWidth  / 2, 1u);
+	unsigned int height = std::max(srcHeight / 2, 1u);
+
+	for (unsigned int y = 0; y < height; y++) {
+		const unsigned char *row0 = src + std::min(y * 2,     srcHeight - 1) * srcWidth * 4;
+		const unsigned char *row1 = src + std::min(y * 2 + 1, srcHeight - 1) * srcWidth * 4;
+
+		for (unsigned int x = 0; x < width; x++) {
+			unsigned int x0 = std::min(x * 2,     srcWidth - 1) * 4;
+			unsigned int x1 = std::min(x * 2 + 1, srcWidth - 1) * 4;
+
+			for (unsigned int c = 0; c < 3; c++) {
+				uint32_t sum = tables.toLinear[row0[x0 + c]] + tables.toLinear[row0[x1 + c]]
+				             + tables.toLinear[row1[x0 + c]] + tables.toLinear[row1[x1 + c]];
+				dst[c] = tables.fromLinear[(sum + 2) / 4];
+			}
+			// alpha is linear already
+			dst[3] = static_cast<unsigned char>((row0[x0 + 3] + row0[x1 + 3] + row1[x0 + 3] + row1[x1 + 3] + 2) / 4);
+
+			dst += 4;
+		}
+	}
+}
+
+
+static uint16_t packRGB565(const unsigned char *rgb) {
+	return static_cast<uint16_t>(((rgb[0] >> 3) << 11) | ((rgb[1] >> 2) << 5) | (rgb[2] >> 3));
+}
+
+
+static void unpackRGB565(uint16_t c, int *rgb) {
+	int r = (c >> 11) & 0x1F;
+	int g = (c >> 5)  & 0x3F;
+	int b =  c        & 0x1F;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+
+// fast BC1 encoder, endpoints from a diagonal of the inset bounding box of the block
+// always uses the opaque 4 color mode
+static void compressBC1Block(const unsigned char *texels, unsigned char *dst) {
+	unsigned char minColor[3] = { 255, 255, 255 };
+	unsigned char maxColor[3] = { 0,   0,   0   };
+	for (unsigned int i = 0; i < 16; i++) {
+		for (unsigned int c = 0; c < 3; c++) {
+			minColor[c] = std::min(minColor[c], texels[i * 4 + c]);
+			maxColor[c] = std::max(maxColor[c], texels[i * 4 + c]);
+		}
+	}
+
+	// pick the bounding box diagonal along which the colors vary
+	// by flipping channels which go against the one with the largest range
+	unsigned int ref = 0;
+	for (unsigned int c = 1; c < 3; c++) {
+		if (maxColor[c] - minColor[c] > maxColor[ref] - minColor[ref]) {
+			ref = c;
+		}
+	}
+	int mid[3];
+	for (unsigned int c = 0; c < 3; c++) {
+		mid[c] = (minColor[c] + maxColor[c] + 1) / 2;
+	}
+	for (unsigned int c = 0; c < 3; c++) {
+		if (c == ref) {
+			continue;
+		}
+		int covariance = 0;
+		for (unsigned int i = 0; i < 16; i++) {
+			covariance += (texels[i * 4 + ref] - mid[ref]) * (texels[i * 4 + c] - mid[c]);
+		}
+		if (covariance < 0) {
+			std::swap(minColor[c], maxColor[c]);
+		}
+	}
+
+	// move endpoints towards each other by 1/16 of the range to reduce error
+	for (unsigned int c = 0; c < 3; c++) {
+		int inset = (maxColor[c] - minColor[c]) / 16;
+		minColor[c] = static_cast<unsigned char>(minColor[c] + inset);
+		maxColor[c] = static_cast<unsigned char>(maxColor[c] - inset);
+	}
+
+	uint16_t color0 = packRGB565(maxColor);
+	uint16_t color1 = packRGB565(minColor);
+	uint32_t indices = 0;
+
+	if (color0 < color1) {
+		std::swap(color0, color1);
+	}
+
+	if (color0 != color1) {
+		int palette[4][3];
+		unpackRGB565(color0, palette[0]);
+		unpackRGB565(color1, palette[1]);
+		for (unsigned int c = 0; c < 3; c++) {
+			palette[2][c] = (2 * palette[0][c] +     palette[1][c]) / 3;
+			palette[3][c] = (    palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		for (unsigned int i = 0; i < 16; i++) {
+			const unsigned char *t = texels + i * 4;
+			unsigned int best      = 0;
+			int          bestDist  = std::numeric_limits<int>::max();
+			for (unsigned int p = 0; p < 4; p++) {
+				int dr = t[0] - palette[p][0];
+				int dg = t[1] - palette[p][1];
+				int db = t[2] - palette[p][2];
+				int dist = dr * dr + dg * dg + db * db;
+				if (dist < bestDist) {
+					bestDist = dist;
+					best     = p;
+				}
+			}
+			indices |= best << (i * 2);
+		}
+	}
+	// else all texels use color0 and indices stay 0
+
+	dst[0] = static_cast<unsigned char>(color0 & 0xFF);
+	dst[1] = static_cast<unsigned char>(color0 >> 8);
+	dst[2] = static_cast<unsigned char>(color1 & 0xFF);
+	dst[3] = static_cast<unsigned char>(color1 >> 8);
+	dst[4] = static_cast<unsigned char>(indices         & 0xFF);
+	dst[5] = static_cast<unsigned char>((indices >>  8) & 0xFF);
+	dst[6] = static_cast<unsigned char>((indices >> 16) & 0xFF);
+	dst[7] = static_cast<unsigned char>(indices >> 24);
+}
+
+
+// compress an RGBA8 image to BC1, partial blocks at the edges repeat the last texels
+static void compressBC1(const unsigned char *src, unsigned int width, unsigned int height, unsigned char *dst) {
+	unsigned char block[16 * 4];
+	for (unsigned int by = 0; by < height; by += 4) {
+		for (unsigned int bx = 0; bx < width; bx += 4) {
+			for (unsigned int y = 0; y < 4; y++) {
+				const unsigned char *row = src + std::min(by + y, height - 1) * width * 4;
+				for (unsigned int x = 0; x < 4; x++) {
+					memcpy(block + (y * 4 + x) * 4, row + std::min(bx + x, width - 1) * 4, 4);
+				}
+			}
+
+			compressBC1Block(block, dst);
+			dst += 8;
+		}
+	}
+}
+
+
+static unsigned int imageMipCount(unsigned int width, unsigned int height) {
+	unsigned int maxDim  = std::max(width, height);
+	unsigned int numMips = 1;
+	while ((maxDim >> numMips) > 0 && numMips < MAX_TEXTURE_MIPLEVELS) {
+		numMips++;
+	}
+	return numMips;
+}
+
+
+// full mip chain of a decoded image written into its texture upload,
+// compressed if the job asks for it
+// upload memory can be write-combined so levels are downsampled from a
+// cached copy and the upload is only written to
+static void buildImageMips(ImageLoadJob &job) {
+	assert(job.data);
+	assert(job.format == Format::sRGBA8 || job.format == Format::sBC1);
+	assert(job.numMips > 0);
+	assert(job.upload.numMips == job.numMips);
+
+	unsigned int width  = static_cast<unsigned int>(job.width);
+	unsigned int height = static_cast<unsigned int>(job.height);
+
+	// uncompressed levels after 0
+	std::vector<unsigned char> levels;
+	{
+		size_t size = 0;
+		unsigned int w = width, h = height;
+		for (unsigned int i = 1; i < job.numMips; i++) {
+			w = std::max(w / 2, 1u);
+			h = std::max(h / 2, 1u);
+			size += mipLevelSize(Format::sRGBA8, w, h);
+		}
+		levels.resize(size);
+	}
+
+	{
+		PROFILE_SCOPE("downsample");
+		const unsigned char *src = job.data;
+		unsigned int w = width, h = height;
+		size_t offset = 0;
+		for (unsigned int i = 1; i < job.numMips; i++) {
+			unsigned char *dst = &levels[offset];
+			downsampleSRGBA8(src, w, h, dst);
+
+			src = dst;
+			w   = std::max(w / 2, 1u);
+			h   = std::max(h / 2, 1u);
+			offset += mipLevelSize(Format::sRGBA8, w, h);
+		}
+	}
+
+	{
+		PROFILE_SCOPE("write upload");
+		unsigned int w = width, h = height;
+		size_t srcOffset = 0;
+		for (unsigned int i = 0; i < job.numMips; i++) {
+			const unsigned char *src = (i == 0) ? job.data : &levels[srcOffset];
+			unsigned char *dst = static_cast<unsigned char *>(job.upload.mips[i].data);
+			assert(mipLevelSize(job.format, w, h) <= job.upload.mips[i].size);
+
+			if (job.format == Format::sBC1) {
+				compressBC1(src, w, h, dst);
+			} else {
+				memcpy(dst, src, mipLevelSize(Format::sRGBA8, w, h));
+			}
+
+			if (i > 0) {
+				srcOffset += mipLevelSize(Format::sRGBA8, w, h);
+			}
+			w = std::max(w / 2, 1u);
+			h = std::max(h / 2, 1u);
+		}
+	}
+
+	// the original is no longer needed
+	stbi_image_free(job.data);
+	job.data = nullptr;
+}
+
+
+// dimensions of benchmark matrix as given in the matrix file
+// empty dimension means use the current setting
+struct BenchmarkMatrix {
+	std::vector<std::string>   methods;
+	std::vector<unsigned int>  smaaQualities;
+	std::vector<unsigned int>  fxaaQualities;
+	std::vector<unsigned int>  msaaSamples;
+	std::vector<bool>          temporal;
+	std::vector<glm::uvec2>    resolutions;
+	std::vector<unsigned int>  cubesPerSide;
+	std::vector<bool>          packedCubes;
+	std::vector<std::string>   scenes;
+	unsigned int               warmupFrames;
+	unsigned int               measuredFrames;
+
+
+	BenchmarkMatrix()
+	: warmupFrames(60)
+	, measuredFrames(300)
+	{
+	}
+};
+
+
+struct BenchmarkConfig {
+	bool          antialiasing;
+	AAMethod      method;
+	// SMAA, FXAA or MSAA quality depending on method
+	unsigned int  quality;
+	bool          temporal;
+	glm::uvec2    resolution;
+	unsigned int  cubesPerSide;
+	bool          packedCubes;
+	unsigned int  scene;
+
+
+	BenchmarkConfig()
+	: antialiasing(true)
+	, method(AAMethod::SMAA)
+	, quality(0)
+	, temporal(false)
+	, resolution(0, 0)
+	, cubesPerSide(0)
+	, packedCubes(false)
+	, scene(0)
+	{
+	}
+};
+
+
+struct BenchmarkResult {
+	BenchmarkConfig        config;
+	// actual drawable size might differ from requested
+	glm::uvec2             drawableSize;
+	// sorted
+	std::vector<uint64_t>  frameTimes;
+	MemoryStats            memStats;
+	// last measured frame
+	FrameStats             frameStats;
+	// most allocations by the main thread in a single measured frame
+	uint64_t               maxFrameAllocations;
+
+
+	BenchmarkResult()
+	: drawableSize(0, 0)
+	, maxFrameAllocations(0)
+	{
+	}
+
+
+	double percentile(unsigned int p) const {
+		assert(!frameTimes.empty());
+		size_t idx = std::min(frameTimes.size() - 1, (frameTimes.size() * p) / 100);
+		return double(frameTimes[idx]) / 1000000.0;
+	}
+
+
+	double mean() const {
+		assert(!frameTimes.empty());
+		uint64_t total = 0;
+		for (auto t : frameTimes) {
+			total += t;
+		}
+		return double(total) / double(frameTimes.size()) / 1000000.0;
+	}
+};
+
+
 struct FXAAKey {
 	unsigned int quality;
 	// TODO: more options
@@ -397,7 +836,17 @@ class SMAADemo {
 	bool            noShaderCache;
 	bool            noShaderOpt;
 	bool            noTransferQueue;
+	bool            headless;
 	std::vector<std::string> imageFiles;
+	std::string     timingsFile;
+	std::string     profileFile;
+	std::string     recordFile;
+	std::string     benchmarkFile;
+	std::string     benchmarkOutput;
+	std::string     benchmarkCapture;
+	BenchmarkMatrix benchmarkMatrix;
+	// if not empty the current frame is read back and written here
+	std::string     captureFilename;
 
 	// global window things
 	unsigned int    windowWidth, windowHeight;
@@ -434,6 +883,8 @@ class SMAADemo {
 	float         predicationStrength;
 
 	// timing things
+	bool            benchmarkMode;
+	// fail the benchmark if a measured frame allocates on the main thread
 	bool            fpsLimitActive;
 	uint32_t        fpsLimit;
 	uint64_t        sleepFudge;
@@ -441,6 +892,11 @@ class SMAADemo {
 	uint64_t      lastTime;
 	uint64_t      freqMult;
 	uint64_t      freqDiv;
+	FILE         *timingsOut;
+	uint32_t      lastTimingsFrame;
+	// main thread allocations during previous frame, zero in steady state
+	uint64_t      lastAllocationCount;
+	uint64_t      frameAllocations;
 
 	// scene things
 	// 0 for cubes
@@ -456,7 +912,43 @@ class SMAADemo {
 	unsigned int  rotationPeriodSeconds;
 	RandomGen     random;
 	std::vector<Image> images;
+	TextureHandle placeholderTex;
+	uint64_t      imageMemoryBudget;
+	uint64_t      residentImageBytes;
+	// BC1 compress images when the renderer supports it
+	bool          compressImages;
+
+	// images are decoded by background jobs
+	// each job decodes or builds the mips of whatever is first in loadQueue
+	JobCounter                    imageJobs;
+	std::mutex                    loaderMutex;
+	// signaled when a job is added to decodedImages
+	std::condition_variable       decodedCond;
+	std::deque<ImageLoadJob>      loadQueue;
+	// loadQueue entries which don't have a job yet
+	// because the background queue was full, main thread only
+	unsigned int                  unstartedImageJobs;
+	std::vector<ImageLoadJob>     decodedImages;
+	// remaining jobs skip decoding when set
+	bool                          loaderQuit;
+	// 0 is one per hardware thread
+	unsigned int                  numThreads;
+	bool                          pinThreads;
 	std::vector<ShaderDefines::Cube> cubes;
+	// cubes inside the view frustum this frame, in drawing order
+	std::vector<ShaderDefines::Cube> visibleCubes;
+	bool          frustumCullCubes;
+	bool          sortCubesFrontToBack;
+	// cube positions as structure of arrays for culling, same order as cubes
+	std::vector<float>     cubePosX, cubePosY, cubePosZ;
+	// culling output and radix sort scratch
+	std::vector<uint32_t>  cullKeys, cullIndices, cullKeysTmp, cullIndicesTmp;
+	uint64_t      cullNanoseconds;
+	// draw with 16 byte PackedCube instances instead of Cube
+	bool          packedCubeLayout;
+	// same order as cubes
+	std::vector<ShaderDefines::PackedCube> packedCubes;
+	std::vector<ShaderDefines::PackedCube> visiblePackedCubes;
 
 	glm::mat4 currViewProj;
 	glm::mat4 prevViewProj;
@@ -468,6 +960,7 @@ class SMAADemo {
 	PipelineHandle     imagePipeline;
 	PipelineHandle     blitPipeline;
 	PipelineHandle     guiPipeline;
+	PipelineHandle     guiCompositePipeline;
 	PipelineHandle                                separatePipeline;
 	std::array<PipelineHandle, 2>                 temporalAAPipelines;
 
@@ -477,6 +970,7 @@ class SMAADemo {
 	RenderTargetHandle edgesRT;
 	RenderTargetHandle blendWeightsRT;
 	RenderTargetHandle finalRenderRT;
+	RenderTargetHandle guiOverlayRT;
 	std::array<RenderTargetHandle, 2>  resolveRTs;
 
 	std::array<RenderTargetHandle, 2>  subsampleRTs;
@@ -490,7 +984,9 @@ class SMAADemo {
 	RenderPassHandle   smaaBlendRenderPass;  // for temporal aa, otherwise it's part of final render pass
 	std::array<RenderPassHandle, 2>   smaa2XBlendRenderPasses;
 	RenderPassHandle   guiOnlyRenderPass;
+	RenderPassHandle   guiOverlayRenderPass;
 	FramebufferHandle  finalFramebuffer;
+	FramebufferHandle  guiOverlayFramebuffer;
 	std::array<FramebufferHandle, 2>  resolveFBs;
 
 	BufferHandle       cubeVBO;
@@ -511,6 +1007,21 @@ class SMAADemo {
 	// gui / input things
 	TextureHandle imguiFontsTex;
 	ImGuiContext *imGuiContext;
+	// all draw lists of a frame concatenated for a single upload
+	std::vector<ImDrawVert>  guiVertices;
+	std::vector<ImDrawIdx>   guiIndices;
+	bool          guiVisible;
+	// guiOverlayRT holds the draw data with this hash
+	// only redrawn when it changes, composited over the frame every frame
+	bool          guiOverlayValid;
+	uint64_t      guiOverlayHash;
+	// statistics shown in the GUI, refreshed a few times a second
+	// so they don't force an overlay redraw every frame
+	uint64_t      guiStatsElapsed;
+	float         guiFramerate;
+	uint64_t      guiCullNanoseconds;
+	uint64_t      guiFrameAllocations;
+	FrameTimings  guiTimings;
 	bool          textInputActive;
 	bool          rightShift, leftShift;
 	char          imageFileName[inputTextBufferSize];
@@ -551,12 +1062,24 @@ public:
 
 	void colorCubes();
 
+	void updateCubeInstances();
+
+	void cullCubes(const glm::mat4 &viewProj);
+
 	void mainLoopIteration();
 
 	bool shouldKeepGoing() const {
 		return keepGoing;
 	}
 
+	void writeProfile();
+
+	bool isBenchmark() const {
+		return benchmarkMode;
+	}
+
+	void runBenchmark();
+
 	void render();
 
 	void doSMAA(RenderTargetHandle input, RenderPassHandle renderPass, FramebufferHandle outputFB, int pass);
@@ -565,8 +1088,36 @@ public:
 
 	void drawGUI(uint64_t elapsed);
 
+	void writeTimings();
+
+	void parseBenchmarkMatrix(const std::string &filename);
+
+	std::vector<BenchmarkConfig> expandBenchmarkMatrix() const;
+
+	void applyBenchmarkConfig(const BenchmarkConfig &config);
+
+	std::string benchmarkQualityName(const BenchmarkConfig &config) const;
+
+	std::string benchmarkSceneName(const BenchmarkConfig &config) const;
+
+	void writeBenchmarkResults(const std::vector<BenchmarkResult> &results);
+
 	void loadImage(const std::string &filename);
 
+	void decodeQueuedImage();
+
+	void startImageJobs();
+
+	void discardImageJob(ImageLoadJob &job);
+
+	void requestImage(unsigned int index);
+
+	void processDecodedImages();
+
+	void waitForImage(unsigned int index);
+
+	void evictImages();
+
 	uint64_t getNanoseconds() {
 		return (SDL_GetPerformanceCounter() - tickBase) * freqMult / freqDiv;
 	}
@@ -580,6 +1131,7 @@ SMAADemo::SMAADemo()
 , noShaderCache(false)
 , noShaderOpt(false)
 , noTransferQueue(false)
+, headless(false)
 
 , windowWidth(1280)
 , windowHeight(720)
@@ -608,6 +1160,7 @@ SMAADemo::SMAADemo()
 , predicationScale(2.0f)
 , predicationStrength(0.4f)
 
+, benchmarkMode(false)
 , fpsLimitActive(true)
 , fpsLimit(0)
 , sleepFudge(0)
@@ -615,6 +1168,10 @@ SMAADemo::SMAADemo()
 , lastTime(0)
 , freqMult(0)
 , freqDiv(0)
+, timingsOut(nullptr)
+, lastTimingsFrame(0)
+, lastAllocationCount(0)
+, frameAllocations(0)
 
 , activeScene(0)
 , cubesPerSide(8)
@@ -626,10 +1183,28 @@ SMAADemo::SMAADemo()
 , rotationTime(0)
 , rotationPeriodSeconds(30)
 , random(1)
+, imageMemoryBudget(1024ULL * 1048576ULL)
+, residentImageBytes(0)
+, compressImages(false)
+, unstartedImageJobs(0)
+, loaderQuit(false)
+, numThreads(0)
+, pinThreads(false)
+, frustumCullCubes(false)
+, sortCubesFrontToBack(false)
+, cullNanoseconds(0)
+, packedCubeLayout(false)
 
 , depthFormat(Format::Invalid)
 
 , imGuiContext(nullptr)
+, guiVisible(true)
+, guiOverlayValid(false)
+, guiOverlayHash(0)
+, guiStatsElapsed(guiStatsInterval)
+, guiFramerate(0.0f)
+, guiCullNanoseconds(0)
+, guiFrameAllocations(0)
 , textInputActive(false)
 , rightShift(false)
 , leftShift(false)
@@ -668,6 +1243,27 @@ SMAADemo::SMAADemo()
 
 
 SMAADemo::~SMAADemo() {
+	{
+		std::unique_lock<std::mutex> lock(loaderMutex);
+		loaderQuit = true;
+	}
+	jobWait(imageJobs);
+
+	for (auto &job : loadQueue) {
+		discardImageJob(job);
+	}
+	loadQueue.clear();
+
+	for (auto &job : decodedImages) {
+		discardImageJob(job);
+	}
+	decodedImages.clear();
+
+	if (timingsOut) {
+		fclose(timingsOut);
+		timingsOut = nullptr;
+	}
+
 	if (imGuiContext) {
 		ImGui::DestroyContext(imGuiContext);
 		imGuiContext = nullptr;
@@ -697,6 +1293,8 @@ SMAADemo::~SMAADemo() {
 
 		assert(guiOnlyRenderPass);
 		renderer.deleteRenderPass(guiOnlyRenderPass);
+		assert(guiOverlayRenderPass);
+		renderer.deleteRenderPass(guiOverlayRenderPass);
 		assert(smaaEdgesRenderPass);
 		renderer.deleteRenderPass(smaaEdgesRenderPass);
 		assert(smaaWeightsRenderPass);
@@ -728,6 +1326,13 @@ SMAADemo::~SMAADemo() {
 		renderer.deleteTexture(searchTex);
 		searchTex = TextureHandle();
 	}
+
+	if (placeholderTex) {
+		renderer.deleteTexture(placeholderTex);
+		placeholderTex = TextureHandle();
+	}
+
+	jobSystemShutdown();
 }
 
 
@@ -794,14 +1399,28 @@ void SMAADemo::parseCommandLine(int argc, char *argv[]) {
 		TCLAP::SwitchArg                       fullscreenSwitch("f",  "fullscreen", "Start in fullscreen mode",      cmd, false);
 		TCLAP::SwitchArg                       noVsyncSwitch("",      "novsync",    "Disable vsync",                 cmd, false);
 		TCLAP::SwitchArg                       noTransferQSwitch("",  "no-transfer-queue", "Disable transfer queue", cmd, false);
+		TCLAP::SwitchArg                       headlessSwitch("",     "headless",   "Render offscreen without a window", cmd, false);
+		TCLAP::SwitchArg                       compressImagesSwitch("", "compress-images", "Compress images to BC1 when loading", cmd, false);
+		TCLAP::SwitchArg                       packedCubesSwitch("", "packed-cubes", "Use 16 byte cube instances", cmd, false);
+		TCLAP::SwitchArg                       cullCubesSwitch("", "cull-cubes", "Frustum cull cubes on the CPU", cmd, false);
+		TCLAP::SwitchArg                       sortCubesSwitch("", "sort-cubes", "Sort cubes front to back on the CPU", cmd, false);
+		TCLAP::SwitchArg                       pinThreadsSwitch("", "pin-threads", "Pin job threads to cores", cmd, false);
 
 		TCLAP::ValueArg<unsigned int>          windowWidthSwitch("",  "width",      "Window width",  false, windowWidth,  "width",  cmd);
 		TCLAP::ValueArg<unsigned int>          windowHeightSwitch("", "height",     "Window height", false, windowHeight, "height", cmd);
 
 		TCLAP::ValueArg<unsigned int>          rotateSwitch("",       "rotate",     "Rotation period", false, 0,          "seconds", cmd);
+		TCLAP::ValueArg<unsigned int>          imageMemSwitch("",     "image-memory", "Memory budget for image textures", false, 1024, "MB", cmd);
+		TCLAP::ValueArg<unsigned int>          threadsSwitch("",      "threads",    "Job threads including main thread, 0 for one per core", false, 0, "threads", cmd);
 
 		TCLAP::ValueArg<std::string>           aaMethodSwitch("m",    "method",     "AA Method",     false, "SMAA",        "SMAA/FXAA/MSAA", cmd);
 		TCLAP::ValueArg<std::string>           aaQualitySwitch("q",   "quality",    "AA Quality",    false, "",            "", cmd);
+		TCLAP::ValueArg<std::string>           benchmarkSwitch("",    "benchmark",  "Run benchmark matrix from file and exit", false, "", "file", cmd);
+		TCLAP::ValueArg<std::string>           benchmarkOutSwitch("", "benchmark-output", "Benchmark result file, .json or .csv", false, "benchmark.json", "file", cmd);
+		TCLAP::ValueArg<std::string>           benchmarkCapSwitch("", "benchmark-capture", "Write last frame of each benchmark configuration as PPM to directory", false, "", "dir", cmd);
+		TCLAP::ValueArg<std::string>           profileSwitch("",      "profile",    "Write CPU profile as Chrome trace JSON", false, "", "file", cmd);
+		TCLAP::ValueArg<std::string>           timingsSwitch("",      "timings",    "Write per-pass GPU timings to CSV file", false, "", "file", cmd);
+		TCLAP::ValueArg<std::string>           recordSwitch("",       "record",     "Record renderer calls for rendererReplay", false, "", "file", cmd);
 
 		TCLAP::UnlabeledMultiArg<std::string>  imagesArg("images",    "image files", false, "image file", cmd, true, nullptr);
 
@@ -812,10 +1431,21 @@ void SMAADemo::parseCommandLine(int argc, char *argv[]) {
 		noShaderCache = noCacheSwitch.getValue();
 		noShaderOpt   = noOptSwitch.getValue();
 		noTransferQueue = noTransferQSwitch.getValue();
+		headless      = headlessSwitch.getValue();
 		fullscreen    = fullscreenSwitch.getValue();
 		windowWidth   = windowWidthSwitch.getValue();
 		windowHeight  = windowHeightSwitch.getValue();
 		vsync         = noVsyncSwitch.getValue() ? VSync::Off : VSync::On;
+		timingsFile   = timingsSwitch.getValue();
+		profileFile   = profileSwitch.getValue();
+		recordFile    = recordSwitch.getValue();
+		numThreads    = threadsSwitch.getValue();
+		pinThreads    = pinThreadsSwitch.getValue();
+#ifndef PROFILING
+		if (!profileFile.empty()) {
+			LOG("Built without PROFILING, --profile does nothing\n");
+		}
+#endif  // PROFILING
 
 		unsigned int r = rotateSwitch.getValue();
 		if (r != 0) {
@@ -881,6 +1511,21 @@ void SMAADemo::parseCommandLine(int argc, char *argv[]) {
 		}
 
 		imageFiles    = imagesArg.getValue();
+		imageMemoryBudget = uint64_t(imageMemSwitch.getValue()) * 1048576ULL;
+		compressImages    = compressImagesSwitch.getValue();
+		packedCubeLayout  = packedCubesSwitch.getValue();
+		frustumCullCubes     = cullCubesSwitch.getValue();
+		sortCubesFrontToBack = sortCubesSwitch.getValue();
+
+		benchmarkFile   = benchmarkSwitch.getValue();
+		benchmarkOutput = benchmarkOutSwitch.getValue();
+		benchmarkCapture = benchmarkCapSwitch.getValue();
+		if (!benchmarkFile.empty()) {
+			parseBenchmarkMatrix(benchmarkFile);
+			benchmarkMode = true;
+			// measure the renderer, not the display
+			vsync         = VSync::Off;
+		}
 
 	} catch (TCLAP::ArgException &e) {
 		LOG("parseCommandLine exception: %s for arg %s\n", e.error().c_str(), e.argId().c_str());
@@ -1041,7 +1686,20 @@ static const std::array<Format, numDepths> depths
   = { { Format::Depth24X8, Format::Depth24S8, Format::Depth32Float, Format::Depth16, Format::Depth16S8 } };
 
 
+static void *imGuiAlloc(size_t size, void * /* userData */) {
+	return countedMalloc(size);
+}
+
+
+static void imGuiFree(void *ptr, void * /* userData */) {
+	countedFree(ptr);
+}
+
+
 void SMAADemo::initRender() {
+	// before the renderer, software renderer rasterizes with jobs
+	jobSystemInit(numThreads, pinThreads);
+
 	RendererDesc desc;
 	desc.debug                = renderDebug;
 	desc.tracing              = tracing;
@@ -1052,12 +1710,15 @@ void SMAADemo::initRender() {
 	desc.swapchain.width      = windowWidth;
 	desc.swapchain.height     = windowHeight;
 	desc.swapchain.vsync      = vsync;
+	desc.headless             = headless;
+	desc.recordFile           = recordFile;
 
 	renderer = Renderer::createRenderer(desc);
 	const auto &features = renderer.getFeatures();
 	LOG("Max MSAA samples: %u\n",  features.maxMSAASamples);
 	LOG("sRGB frame buffer: %s\n", features.sRGBFramebuffer ? "yes" : "no");
 	LOG("SSBO support: %s\n",      features.SSBOSupported ? "yes" : "no");
+	LOG("BC texture compression: %s\n", features.textureCompressionBC ? "yes" : "no");
 	maxMSAAQuality = msaaSamplesToQuality(features.maxMSAASamples) + 1;
 	if (msaaQuality >= maxMSAAQuality) {
 		msaaQuality = maxMSAAQuality - 1;
@@ -1136,6 +1797,13 @@ void SMAADemo::initRender() {
 		guiOnlyRenderPass     = renderer.createRenderPass(rpDesc.name("GUI only"));
 	}
 
+	{
+		// cleared to transparent, gui pipeline writes premultiplied alpha
+		RenderPassDesc rpDesc;
+		rpDesc.color(0, Format::sRGBA8, PassBegin::Clear, Layout::Undefined, Layout::ShaderRead);
+		guiOverlayRenderPass  = renderer.createRenderPass(rpDesc.name("GUI overlay"));
+	}
+
 	{
 		RenderPassDesc rpDesc;
 		rpDesc.color(0, Format::RGBA8, PassBegin::Clear, Layout::Undefined, Layout::ShaderRead);
@@ -1188,14 +1856,14 @@ void SMAADemo::initRender() {
 	{
 		ShaderMacros macros;
 		PipelineDesc plDesc;
-		plDesc.renderPass(guiOnlyRenderPass)
+		plDesc.renderPass(guiOverlayRenderPass)
 		      .descriptorSetLayout<GlobalDS>(0)
 		      .descriptorSetLayout<ColorTexDS>(1)
 		      .vertexShader("gui")
 		      .fragmentShader("gui")
 		      .shaderMacros(macros)
 		      .blending(true)
-		      .sourceBlend(BlendFunc::SrcAlpha)
+		      .sourceBlend(BlendFunc::One)
 		      .destinationBlend(BlendFunc::OneMinusSrcAlpha)
 		      .scissorTest(true)
 		      .vertexAttrib(ATTR_POS,   0, 2, VtxFormat::Float,  offsetof(ImDrawVert, pos))
@@ -1207,6 +1875,23 @@ void SMAADemo::initRender() {
 		guiPipeline = renderer.createPipeline(plDesc);
 	}
 
+	{
+		ShaderMacros macros;
+		PipelineDesc plDesc;
+		plDesc.renderPass(guiOnlyRenderPass)
+		      .descriptorSetLayout<GlobalDS>(0)
+		      .descriptorSetLayout<ColorTexDS>(1)
+		      .vertexShader("blit")
+		      .fragmentShader("blit")
+		      .shaderMacros(macros)
+		      .blending(true)
+		      .sourceBlend(BlendFunc::One)
+		      .destinationBlend(BlendFunc::OneMinusSrcAlpha)
+		      .name("gui composite");
+
+		guiCompositePipeline = renderer.createPipeline(plDesc);
+	}
+
 	{
 		ShaderMacros macros;
 
@@ -1241,7 +1926,8 @@ void SMAADemo::initRender() {
 		separatePipeline = renderer.createPipeline(plDesc);
 	}
 
-	linearSampler  = renderer.createSampler(SamplerDesc().minFilter(FilterMode::Linear). magFilter(FilterMode::Linear) .name("linear"));
+	// mipmapped for minifying large images
+	linearSampler  = renderer.createSampler(SamplerDesc().minFilter(FilterMode::Linear). magFilter(FilterMode::Linear) .mipmaps(true).name("linear"));
 	nearestSampler = renderer.createSampler(SamplerDesc().minFilter(FilterMode::Nearest).magFilter(FilterMode::Nearest).name("nearest"));
 
 	cubeVBO = renderer.createBuffer(BufferType::Vertex, sizeof(vertices), &vertices[0]);
@@ -1264,14 +1950,16 @@ void SMAADemo::initRender() {
 	texDesc.name("SMAA area texture");
 
 	if (flipSMAATextures) {
-		std::vector<unsigned char> tempBuffer(AREATEX_SIZE);
+		// flip straight into upload memory
+		TextureUpload upload = renderer.beginTextureUpload(texDesc);
+		assert(upload.mips[0].size == AREATEX_SIZE);
+		unsigned char *dest = reinterpret_cast<unsigned char *>(upload.mips[0].data);
 		for (unsigned int y = 0; y < AREATEX_HEIGHT; y++) {
 			unsigned int srcY = AREATEX_HEIGHT - 1 - y;
 			//unsigned int srcY = y;
-			memcpy(&tempBuffer[y * AREATEX_PITCH], areaTexBytes + srcY * AREATEX_PITCH, AREATEX_PITCH);
+			memcpy(dest + y * AREATEX_PITCH, areaTexBytes + srcY * AREATEX_PITCH, AREATEX_PITCH);
 		}
-		texDesc.mipLevelData(0, &tempBuffer[0], AREATEX_SIZE);
-		areaTex = renderer.createTexture(texDesc);
+		areaTex = renderer.endTextureUpload(upload);
 	} else {
 		texDesc.mipLevelData(0, areaTexBytes, AREATEX_SIZE);
 		areaTex = renderer.createTexture(texDesc);
@@ -1282,19 +1970,36 @@ void SMAADemo::initRender() {
 	       .format(Format::R8);
 	texDesc.name("SMAA search texture");
 	if (flipSMAATextures) {
-		std::vector<unsigned char> tempBuffer(SEARCHTEX_SIZE);
+		// flip straight into upload memory
+		TextureUpload upload = renderer.beginTextureUpload(texDesc);
+		assert(upload.mips[0].size == SEARCHTEX_SIZE);
+		unsigned char *dest = reinterpret_cast<unsigned char *>(upload.mips[0].data);
 		for (unsigned int y = 0; y < SEARCHTEX_HEIGHT; y++) {
 			unsigned int srcY = SEARCHTEX_HEIGHT - 1 - y;
 			//unsigned int srcY = y;
-			memcpy(&tempBuffer[y * SEARCHTEX_PITCH], searchTexBytes + srcY * SEARCHTEX_PITCH, SEARCHTEX_PITCH);
+			memcpy(dest + y * SEARCHTEX_PITCH, searchTexBytes + srcY * SEARCHTEX_PITCH, SEARCHTEX_PITCH);
 		}
-		texDesc.mipLevelData(0, &tempBuffer[0], SEARCHTEX_SIZE);
-		searchTex = renderer.createTexture(texDesc);
+		searchTex = renderer.endTextureUpload(upload);
 	} else {
 		texDesc.mipLevelData(0, searchTexBytes, SEARCHTEX_SIZE);
 		searchTex = renderer.createTexture(texDesc);
 	}
 
+	// shown until an image has been loaded
+	{
+		const uint32_t dark = 0xFF404040, light = 0xFF808080;
+		const std::array<uint32_t, 4> pixels = { { dark, light, light, dark } };
+
+		TextureDesc placeholderDesc;
+		placeholderDesc.width(2)
+		               .height(2)
+		               .name("placeholder")
+		               .format(Format::sRGBA8);
+		placeholderDesc.mipLevelData(0, &pixels[0], sizeof(pixels));
+		placeholderTex = renderer.createTexture(placeholderDesc);
+	}
+
+	// decoded in the background, first frame doesn't wait for them
 	images.reserve(imageFiles.size());
 	for (const auto &filename : imageFiles) {
 		loadImage(filename);
@@ -1302,6 +2007,8 @@ void SMAADemo::initRender() {
 
 	// imgui setup
 	{
+		// route through counted malloc so GUI allocations are counted too
+		ImGui::SetAllocatorFunctions(imGuiAlloc, imGuiFree);
 		imGuiContext = ImGui::CreateContext();
 		ImGuiIO& io = ImGui::GetIO();
 		io.IniFilename                 = nullptr;
@@ -1377,7 +2084,9 @@ RenderPassHandle SMAADemo::getSceneRenderPass(unsigned int n, Layout l) {
 
 
 PipelineHandle SMAADemo::getCubePipeline(unsigned int n) {
-	auto it = cubePipelines.find(n);
+	// low bit of the key is instance layout
+	unsigned int key = (n << 1) | (packedCubeLayout ? 1 : 0);
+	auto it = cubePipelines.find(key);
 
 	if (it == cubePipelines.end()) {
 		std::string name = "cubes";
@@ -1385,6 +2094,12 @@ PipelineHandle SMAADemo::getCubePipeline(unsigned int n) {
 			name += " MSAA x" + std::to_string(n);
 		}
 
+		ShaderMacros macros;
+		if (packedCubeLayout) {
+			name += " packed";
+			macros.emplace("PACKED_CUBES", "1");
+		}
+
 		/*
 		 Vulkan spec says:
 		 Two render passes are compatible if their corresponding color, input,
@@ -1400,6 +2115,7 @@ PipelineHandle SMAADemo::getCubePipeline(unsigned int n) {
 		plDesc.name(name)
 		      .vertexShader("cube")
 		      .fragmentShader("cube")
+		      .shaderMacros(macros)
 		      .renderPass(getSceneRenderPass(n, Layout::ShaderRead))
 		      .numSamples(n)
 		      .descriptorSetLayout<GlobalDS>(0)
@@ -1410,7 +2126,7 @@ PipelineHandle SMAADemo::getCubePipeline(unsigned int n) {
 		      .depthTest(true)
 		      .cullFaces(true);
 		bool inserted = false;
-		std::tie(it, inserted) = cubePipelines.emplace(n, renderer.createPipeline(plDesc));
+		std::tie(it, inserted) = cubePipelines.emplace(key, renderer.createPipeline(plDesc));
 		assert(inserted);
 	}
 
@@ -1514,11 +2230,8 @@ const PipelineHandle &SMAADemo::getFXAAPipeline(unsigned int q) {
 
 
 void SMAADemo::loadImage(const std::string &filename) {
-	int width = 0, height = 0;
-	unsigned char *imageData = stbi_load(filename.c_str(), &width, &height, NULL, 4);
-	LOG(" %s : %p  %dx%d\n", filename.c_str(), imageData, width, height);
-	if (!imageData) {
-		LOG("Bad image: %s\n", stbi_failure_reason());
+	if (!fileExists(filename)) {
+		LOG("Bad image: \"%s\" does not exist\n", filename.c_str());
 		return;
 	}
 
@@ -1532,63 +2245,278 @@ void SMAADemo::loadImage(const std::string &filename) {
 	else {
 		img.shortName = filename;
 	}
+	img.state      = ImageState::Evicted;
 
-	TextureDesc texDesc;
-	texDesc.width(width)
-	       .height(height)
-	       .name(img.shortName)
-	       .format(Format::sRGBA8);
+	unsigned int index = static_cast<unsigned int>(images.size() - 1);
+	requestImage(index);
+
+	activeScene = index + 1;
+}
 
-	texDesc.mipLevelData(0, imageData, width * height * 4);
-	img.width  = width;
-	img.height = height;
-	img.tex    = renderer.createTexture(texDesc);
 
-	stbi_image_free(imageData);
+void SMAADemo::decodeQueuedImage() {
+	PROFILE_FUNCTION();
 
-	activeScene = static_cast<unsigned int>(images.size());
-}
+	std::unique_lock<std::mutex> lock(loaderMutex);
+	// one job per queued image so there's always something here unless quitting
+	if (loaderQuit || loadQueue.empty()) {
+		return;
+	}
 
+	ImageLoadJob job = std::move(loadQueue.front());
+	loadQueue.pop_front();
 
-void SMAADemo::createFramebuffers() {
-	if (sceneFramebuffer) {
-		deleteFramebuffers();
+	lock.unlock();
+	if (job.upload.numMips != 0) {
+		// second pass, main thread has begun the upload
+		buildImageMips(job);
+		job.built = true;
+
+		lock.lock();
+		decodedImages.push_back(std::move(job));
+		decodedCond.notify_all();
+		return;
 	}
 
-	if (antialiasing && aaMethod == AAMethod::MSAA) {
-		numSamples = msaaQualityToSamples(msaaQuality);
-		assert(numSamples > 1);
-	} else if (antialiasing && aaMethod == AAMethod::SMAA2X) {
-		numSamples = 2;
+	{
+		PROFILE_SCOPE("stbi_load");
+		// decode straight from the page cache instead of through stdio
+		try {
+			MappedFile file(job.filename);
+			if (!file.empty() && file.size() <= static_cast<size_t>(INT_MAX)) {
+				job.data = stbi_load_from_memory(reinterpret_cast<const stbi_uc *>(file.data()), static_cast<int>(file.size()), &job.width, &job.height, NULL, 4);
+			}
+		} catch (std::exception &e) {
+			LOG("Failed to map \"%s\": %s\n", job.filename.c_str(), e.what());
+		}
+	}
+	LOG(" %s : %p  %dx%d\n", job.filename.c_str(), job.data, job.width, job.height);
+	if (!job.data) {
+		// TODO: stbi_failure_reason is not thread safe
+		LOG("Bad image: %s\n", job.filename.c_str());
 	} else {
-		numSamples = 1;
+		job.numMips = imageMipCount(job.width, job.height);
 	}
+	lock.lock();
 
-	{
-		RenderTargetDesc rtDesc;
-		rtDesc.name("main color")
-		      .numSamples(numSamples)
-		      .format(Format::sRGBA8)
-		      .additionalViewFormat(Format::RGBA8)
-		      .width(windowWidth)
-		      .height(windowHeight);
-		mainColorRT = renderer.createRenderTarget(rtDesc);
+	decodedImages.push_back(std::move(job));
+	decodedCond.notify_all();
+}
+
+
+void SMAADemo::discardImageJob(ImageLoadJob &job) {
+	if (job.data) {
+		stbi_image_free(job.data);
+		job.data = nullptr;
 	}
 
-	{
-		RenderTargetDesc rtDesc;
-		rtDesc.name("velocity")
-		      .numSamples(numSamples)
-		      .format(Format::RG16Float)
-		      .width(windowWidth)
-		      .height(windowHeight);
-		velocityRT = renderer.createRenderTarget(rtDesc);
+	if (job.upload.numMips != 0) {
+		// can't abandon an upload, end it and throw the texture away
+		renderer.deleteTexture(renderer.endTextureUpload(job.upload));
+		job.upload = TextureUpload();
 	}
+}
 
-	{
-		RenderTargetDesc rtDesc;
+
+void SMAADemo::requestImage(unsigned int index) {
+	assert(index < images.size());
+	auto &img = images[index];
+	assert(img.state == ImageState::Evicted);
+	img.state = ImageState::Loading;
+
+	ImageLoadJob job;
+	job.index    = index;
+	job.filename = img.filename;
+	if (compressImages && renderer.getFeatures().textureCompressionBC) {
+		job.format = Format::sBC1;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(loaderMutex);
+		loadQueue.push_back(std::move(job));
+	}
+	unstartedImageJobs++;
+	startImageJobs();
+}
+
+
+void SMAADemo::startImageJobs() {
+	while (unstartedImageJobs > 0) {
+		// background queue is full, stays in loadQueue until next frame
+		if (!jobRunBackground(imageJobs, [this] () { decodeQueuedImage(); })) {
+			break;
+		}
+		unstartedImageJobs--;
+	}
+}
+
+
+void SMAADemo::processDecodedImages() {
+	PROFILE_FUNCTION();
+
+	std::vector<ImageLoadJob> jobs;
+	{
+		std::unique_lock<std::mutex> lock(loaderMutex);
+		if (decodedImages.empty()) {
+			return;
+		}
+		std::swap(jobs, decodedImages);
+	}
+
+	for (auto &job : jobs) {
+		assert(job.index < images.size());
+		auto &img = images[job.index];
+		assert(img.state == ImageState::Loading);
+
+		if (job.numMips == 0) {
+			img.state = ImageState::Failed;
+			continue;
+		}
+
+		if (job.built) {
+			// size was already counted when the upload was begun
+			img.tex      = renderer.endTextureUpload(job.upload);
+			img.state    = ImageState::Resident;
+			img.lastUsed = getNanoseconds();
+			continue;
+		}
+
+		uint64_t size       = 0;
+		{
+			unsigned int w = job.width, h = job.height;
+			for (unsigned int i = 0; i < job.numMips; i++) {
+				size += mipLevelSize(job.format, w, h);
+				w = std::max(w / 2, 1u);
+				h = std::max(h / 2, 1u);
+			}
+		}
+		bool     active     = (activeScene == job.index + 1);
+		if (!active && residentImageBytes + size > imageMemoryBudget) {
+			// not worth evicting anything for, load again when shown
+			LOG("Image \"%s\" does not fit in memory budget, not uploading\n", img.shortName.c_str());
+			img.state = ImageState::Evicted;
+			discardImageJob(job);
+			continue;
+		}
+
+		TextureDesc texDesc;
+		texDesc.width(job.width)
+		       .height(job.height)
+		       .name(img.shortName)
+		       .format(job.format)
+		       .numMips(job.numMips);
+
+		img.width     = job.width;
+		img.height    = job.height;
+		// counted now so images still being built can't overcommit the budget
+		img.sizeBytes = size;
+		residentImageBytes += size;
+
+		// a loader job writes the mips, ended in a later frame when it's done
+		job.upload = renderer.beginTextureUpload(texDesc);
+		{
+			std::unique_lock<std::mutex> lock(loaderMutex);
+			// ahead of new decodes so staging memory is released sooner
+			loadQueue.push_front(std::move(job));
+		}
+		unstartedImageJobs++;
+		startImageJobs();
+	}
+
+	evictImages();
+}
+
+
+void SMAADemo::waitForImage(unsigned int index) {
+	assert(index < images.size());
+	if (images[index].state == ImageState::Evicted) {
+		requestImage(index);
+	}
+
+	while (images[index].state == ImageState::Loading) {
+		startImageJobs();
+		{
+			std::unique_lock<std::mutex> lock(loaderMutex);
+			decodedCond.wait(lock, [this] () { return !decodedImages.empty(); } );
+		}
+		processDecodedImages();
+	}
+}
+
+
+void SMAADemo::evictImages() {
+	while (residentImageBytes > imageMemoryBudget) {
+		// least recently shown resident image, never the active one
+		unsigned int victim = static_cast<unsigned int>(images.size());
+		for (unsigned int i = 0; i < images.size(); i++) {
+			const auto &img = images[i];
+			if (img.state != ImageState::Resident || activeScene == i + 1) {
+				continue;
+			}
+			if (victim == images.size() || img.lastUsed < images[victim].lastUsed) {
+				victim = i;
+			}
+		}
+
+		if (victim == images.size()) {
+			// only the active image left
+			break;
+		}
+
+		auto &img = images[victim];
+		LOG("Evicting image \"%s\"\n", img.shortName.c_str());
+		renderer.deleteTexture(img.tex);
+		img.tex   = TextureHandle();
+		img.state = ImageState::Evicted;
+
+		assert(residentImageBytes >= img.sizeBytes);
+		residentImageBytes -= img.sizeBytes;
+		img.sizeBytes = 0;
+	}
+}
+
+
+void SMAADemo::createFramebuffers() {
+	if (sceneFramebuffer) {
+		deleteFramebuffers();
+	}
+
+	if (antialiasing && aaMethod == AAMethod::MSAA) {
+		numSamples = msaaQualityToSamples(msaaQuality);
+		assert(numSamples > 1);
+	} else if (antialiasing && aaMethod == AAMethod::SMAA2X) {
+		numSamples = 2;
+	} else {
+		numSamples = 1;
+	}
+
+	{
+		RenderTargetDesc rtDesc;
+		rtDesc.name("main color")
+		      .numSamples(numSamples)
+		      .format(Format::sRGBA8)
+		      .additionalViewFormat(Format::RGBA8)
+		      .width(windowWidth)
+		      .height(windowHeight);
+		mainColorRT = renderer.createRenderTarget(rtDesc);
+	}
+
+	{
+		RenderTargetDesc rtDesc;
+		rtDesc.name("velocity")
+		      .numSamples(numSamples)
+		      .format(Format::RG16Float)
+		      .width(windowWidth)
+		      .height(windowHeight);
+		velocityRT = renderer.createRenderTarget(rtDesc);
+	}
+
+	{
+		// render straight into the swapchain when possible
+		RenderTargetDesc rtDesc;
 		rtDesc.name("final")
 		      .format(Format::sRGBA8)
+		      .swapchain(true)
 		      .width(windowWidth)
 		      .height(windowHeight);
 		finalRenderRT = renderer.createRenderTarget(rtDesc);
@@ -1622,6 +2550,22 @@ void SMAADemo::createFramebuffers() {
 		finalFramebuffer = renderer.createFramebuffer(fbDesc);
 	}
 
+	{
+		RenderTargetDesc rtDesc;
+		rtDesc.name("GUI overlay")
+		      .format(Format::sRGBA8)
+		      .width(windowWidth)
+		      .height(windowHeight);
+		guiOverlayRT = renderer.createRenderTarget(rtDesc);
+
+		FramebufferDesc fbDesc;
+		fbDesc.name("GUI overlay")
+		      .renderPass(guiOverlayRenderPass)
+		      .color(0, guiOverlayRT);
+		guiOverlayFramebuffer = renderer.createFramebuffer(fbDesc);
+		guiOverlayValid = false;
+	}
+
 	// SMAA edges texture and FBO
 	{
 		RenderTargetDesc rtDesc;
@@ -1706,6 +2650,9 @@ void SMAADemo::deleteFramebuffers() {
 	assert(finalFramebuffer);
 	renderer.deleteFramebuffer(finalFramebuffer);
 
+	assert(guiOverlayFramebuffer);
+	renderer.deleteFramebuffer(guiOverlayFramebuffer);
+
 	assert(smaaEdgesFramebuffer);
 	renderer.deleteFramebuffer(smaaEdgesFramebuffer);
 
@@ -1730,6 +2677,9 @@ void SMAADemo::deleteFramebuffers() {
 	assert(finalRenderRT);
 	renderer.deleteRenderTarget(finalRenderRT);
 
+	assert(guiOverlayRT);
+	renderer.deleteRenderTarget(guiOverlayRT);
+
 	if (resolveRTs[0]) {
 		assert(resolveRTs[1]);
 		renderer.deleteRenderTarget(resolveRTs[0]);
@@ -1758,7 +2708,44 @@ void SMAADemo::deleteFramebuffers() {
 }
 
 
+// how many slices to split count items into
+// small jobs aren't worth splitting
+static unsigned int numWorkerThreads(unsigned int count) {
+	if (count < 65536) {
+		return 1;
+	}
+
+	return std::max(1U, std::min(jobSystemNumThreads(), 8U));
+}
+
+
+// calls fn(slice, begin, end) for numSlices contiguous slices of [0, count)
+// as jobs, slice 0 runs on the calling thread, returns when all are done
+template <typename F> static void runSlices(unsigned int count, unsigned int numSlices, const F &fn) {
+	assert(numSlices > 0);
+
+	unsigned int sliceSize = (count + numSlices - 1) / numSlices;
+	auto runSlice = [&] (unsigned int slice) {
+		unsigned int begin = std::min(slice * sliceSize, count);
+		unsigned int end   = std::min(begin + sliceSize, count);
+		fn(slice, begin, end);
+	};
+
+	JobCounter counter;
+	const auto *runSlicePtr = &runSlice;
+	for (unsigned int t = 1; t < numSlices; t++) {
+		jobRun(counter, [runSlicePtr, t] () {
+			(*runSlicePtr)(t);
+		});
+	}
+	runSlice(0);
+	jobWait(counter);
+}
+
+
 void SMAADemo::createCubes() {
+	PROFILE_FUNCTION();
+
 	// cube of cubes, n^3 cubes total
 	const unsigned int numCubes = static_cast<unsigned int>(pow(cubesPerSide, 3));
 
@@ -1767,38 +2754,81 @@ void SMAADemo::createCubes() {
 
 	const float bigCubeSide = cubeDistance * cubesPerSide;
 
-	cubes.clear();
-	cubes.reserve(numCubes);
-
-	unsigned int order = 0;
-	for (unsigned int x = 0; x < cubesPerSide; x++) {
-		for (unsigned int y = 0; y < cubesPerSide; y++) {
-			for (unsigned int z = 0; z < cubesPerSide; z++) {
-				float qx = random.randFloat();
-				float qy = random.randFloat();
-				float qz = random.randFloat();
-				float qw = random.randFloat();
-				float reciprocLen = 1.0f / sqrtf(qx*qx + qy*qy + qz*qz + qw*qw);
-				qx *= reciprocLen;
-				qy *= reciprocLen;
-				qz *= reciprocLen;
-				qw *= reciprocLen;
+	cubes.resize(numCubes);
+	cubePosX.resize(numCubes);
+	cubePosY.resize(numCubes);
+	cubePosZ.resize(numCubes);
+	packedCubes.resize(numCubes);
+
+	// every cube has its own random stream so thread count doesn't change the result
+	const uint64_t seed = random.randU32();
+	const unsigned int n = cubesPerSide;
+	auto generate = [&] (unsigned int /* slice */, unsigned int begin, unsigned int end) {
+		unsigned int i = begin;
+
+#ifdef USE_SSE2
+
+		// normalize four quaternions at once
+		for (; i + 4 <= end; i += 4) {
+			alignas(16) float q[4][4];
+			for (unsigned int lane = 0; lane < 4; lane++) {
+				RandomGen rng(seed, i + lane);
+				for (unsigned int c = 0; c < 4; c++) {
+					q[c][lane] = rng.randFloat();
+				}
+			}
 
-				ShaderDefines::Cube cube;
-				cube.position = glm::vec3((x * cubeDistance) - (bigCubeSide / 2.0f)
-				                        , (y * cubeDistance) - (bigCubeSide / 2.0f)
-				                        , (z * cubeDistance) - (bigCubeSide / 2.0f));
+			__m128 qx = _mm_load_ps(q[0]);
+			__m128 qy = _mm_load_ps(q[1]);
+			__m128 qz = _mm_load_ps(q[2]);
+			__m128 qw = _mm_load_ps(q[3]);
+			// same operation order as the scalar version so results match
+			__m128 lenSq = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(qx, qx), _mm_mul_ps(qy, qy)), _mm_mul_ps(qz, qz)), _mm_mul_ps(qw, qw));
+			__m128 reciprocLen = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(lenSq));
+			_mm_store_ps(q[0], _mm_mul_ps(qx, reciprocLen));
+			_mm_store_ps(q[1], _mm_mul_ps(qy, reciprocLen));
+			_mm_store_ps(q[2], _mm_mul_ps(qz, reciprocLen));
+			_mm_store_ps(q[3], _mm_mul_ps(qw, reciprocLen));
+
+			for (unsigned int lane = 0; lane < 4; lane++) {
+				cubes[i + lane].rotation = glm::vec4(q[0][lane], q[1][lane], q[2][lane], q[3][lane]);
+			}
+		}
 
-				cube.order    = order;
-				order++;
+#endif  // USE_SSE2
+
+		// remainder, or everything without SSE2
+		for (; i < end; i++) {
+			RandomGen rng(seed, i);
+			float qx = rng.randFloat();
+			float qy = rng.randFloat();
+			float qz = rng.randFloat();
+			float qw = rng.randFloat();
+			float reciprocLen = 1.0f / sqrtf(qx*qx + qy*qy + qz*qz + qw*qw);
+			cubes[i].rotation = glm::vec4(qx * reciprocLen, qy * reciprocLen, qz * reciprocLen, qw * reciprocLen);
+		}
 
-				cube.rotation = glm::vec4(qx, qy, qz, qw);
-				cube.color    = glm::vec3(1.0f, 1.0f, 1.0f);
-				cubes.emplace_back(cube);
-			}
+		// order is x, y, z loop order, packCube depends on that
+		for (i = begin; i < end; i++) {
+			unsigned int x = i / (n * n);
+			unsigned int y = (i / n) % n;
+			unsigned int z = i % n;
+
+			ShaderDefines::Cube &cube = cubes[i];
+			cube.position = glm::vec3((x * cubeDistance) - (bigCubeSide / 2.0f)
+			                        , (y * cubeDistance) - (bigCubeSide / 2.0f)
+			                        , (z * cubeDistance) - (bigCubeSide / 2.0f));
+			cube.order    = i;
+			cube.color    = glm::vec3(1.0f, 1.0f, 1.0f);
+
+			cubePosX[i]   = cube.position.x;
+			cubePosY[i]   = cube.position.y;
+			cubePosZ[i]   = cube.position.z;
 		}
-	}
+	};
+	runSlices(numCubes, numWorkerThreads(numCubes), generate);
 
+	// also packs the instances
 	colorCubes();
 }
 
@@ -1809,6 +2839,7 @@ void SMAADemo::shuffleCubeRendering() {
 		unsigned int victim = random.range(i, numCubes);
 		std::swap(cubes[i], cubes[victim]);
 	}
+	updateCubeInstances();
 }
 
 
@@ -1817,48 +2848,304 @@ void SMAADemo::reorderCubeRendering() {
 		return a.order < b.order;
 	};
 	std::sort(cubes.begin(), cubes.end(), cubeCompare);
+	updateCubeInstances();
 }
 
 
-static float sRGB2linear(float v) {
-    if (v <= 0.04045f) {
-        return v / 12.92f;
-    } else {
-        return powf((v + 0.055f) / 1.055f, 2.4f);
-    }
+// float bits reordered so that unsigned comparison matches float comparison
+static uint32_t floatSortKey(float f) {
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	uint32_t mask = (bits & 0x80000000U) ? 0xFFFFFFFFU : 0x80000000U;
+	return bits ^ mask;
 }
 
 
-void SMAADemo::colorCubes() {
-	if (colorMode == 0) {
-		for (auto &cube : cubes) {
-			// random RGB
-			cube.color.x = sRGB2linear(random.randFloat());
-			cube.color.y = sRGB2linear(random.randFloat());
-			cube.color.z = sRGB2linear(random.randFloat());
+// frustum side planes and the depth row of viewProj, see SMAADemo::cullCubes
+struct CullPlanes {
+	glm::vec4  planes[4];
+	glm::vec4  depth;
+	float      radius;
+	bool       cull;
+};
+
+
+// tests cubes [begin, end) against the planes
+// writes the sort key and index of each survivor to keys and cubeIndices, returns their count
+static unsigned int cullCubeRange(const CullPlanes &c, const float *xs, const float *ys, const float *zs, unsigned int begin, unsigned int end, uint32_t *keys, uint32_t *cubeIndices) {
+	unsigned int count = 0;
+	unsigned int i     = begin;
+
+#ifdef USE_SSE2
+
+	const __m128 negRadius = _mm_set1_ps(-c.radius);
+	__m128 planeX[4], planeY[4], planeZ[4], planeW[4];
+	for (unsigned int p = 0; p < 4; p++) {
+		planeX[p] = _mm_set1_ps(c.planes[p].x);
+		planeY[p] = _mm_set1_ps(c.planes[p].y);
+		planeZ[p] = _mm_set1_ps(c.planes[p].z);
+		planeW[p] = _mm_set1_ps(c.planes[p].w);
+	}
+	const __m128 depthX = _mm_set1_ps(c.depth.x);
+	const __m128 depthY = _mm_set1_ps(c.depth.y);
+	const __m128 depthZ = _mm_set1_ps(c.depth.z);
+	const __m128 depthW = _mm_set1_ps(c.depth.w);
+
+	for ( ; i + 4 <= end; i += 4) {
+		__m128 x = _mm_loadu_ps(xs + i);
+		__m128 y = _mm_loadu_ps(ys + i);
+		__m128 z = _mm_loadu_ps(zs + i);
+
+		int mask = 0xF;
+		if (c.cull) {
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (unsigned int p = 0; p < 4; p++) {
+				__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)), _mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+				inside   = _mm_and_ps(inside, _mm_cmpge_ps(d, negRadius));
+			}
+			mask = _mm_movemask_ps(inside);
+			if (!mask) {
+				continue;
+			}
 		}
-	} else {
-		for (auto &cube : cubes) {
-			// YCbCr, fixed luma, random chroma, alpha = 1.0
-			// worst case scenario for luma edge detection
-			// TODO: use the same luma as shader
 
-			float y = 0.3f;
-			const float c_red   = 0.299f
-			          , c_green = 0.587f
-			          , c_blue  = 0.114f;
-			float cb = random.randFloat() * 2.0f - 1.0f;
-			float cr = random.randFloat() * 2.0f - 1.0f;
+		float depth[4];
+		_mm_storeu_ps(depth, _mm_add_ps(_mm_add_ps(_mm_mul_ps(depthX, x), _mm_mul_ps(depthY, y)), _mm_add_ps(_mm_mul_ps(depthZ, z), depthW)));
+		for (unsigned int lane = 0; lane < 4; lane++) {
+			if (mask & (1 << lane)) {
+				keys[count]    = floatSortKey(depth[lane]);
+				cubeIndices[count] = i + lane;
+				count++;
+			}
+		}
+	}
+
+#endif  // USE_SSE2
+
+	// remainder, or everything without SSE2
+	for ( ; i < end; i++) {
+		glm::vec4 center(xs[i], ys[i], zs[i], 1.0f);
+		bool visible = true;
+		if (c.cull) {
+			for (const auto &plane : c.planes) {
+				if (glm::dot(plane, center) < -c.radius) {
+					visible = false;
+					break;
+				}
+			}
+		}
+
+		if (visible) {
+			keys[count]    = floatSortKey(glm::dot(c.depth, center));
+			cubeIndices[count] = i;
+			count++;
+		}
+	}
+
+	return count;
+}
+
+
+// LSD radix sort of 32-bit keys with values, 8 bits per pass
+// tmp arrays are scratch space of the same size
+// returns true if the result ended up in the tmp arrays
+static bool radixSort(uint32_t *keys, uint32_t *values, uint32_t *keysTmp, uint32_t *valuesTmp, unsigned int count) {
+	bool inTmp = false;
+	for (unsigned int shift = 0; shift < 32; shift += 8) {
+		std::array<unsigned int, 256> histogram;
+		histogram.fill(0);
+		for (unsigned int i = 0; i < count; i++) {
+			histogram[(keys[i] >> shift) & 0xFF]++;
+		}
+
+		// all keys have the same digit, nothing to do
+		if (histogram[(keys[0] >> shift) & 0xFF] == count) {
+			continue;
+		}
+
+		unsigned int sum = 0;
+		for (auto &h : histogram) {
+			unsigned int n = h;
+			h              = sum;
+			sum           += n;
+		}
+
+		for (unsigned int i = 0; i < count; i++) {
+			unsigned int dst = histogram[(keys[i] >> shift) & 0xFF]++;
+			keysTmp[dst]     = keys[i];
+			valuesTmp[dst]   = values[i];
+		}
+
+		std::swap(keys,   keysTmp);
+		std::swap(values, valuesTmp);
+		inTmp = !inTmp;
+	}
+
+	return inTmp;
+}
+
+
+// see PackedCube in shaderDefines.h
+// grid index comes from order which createCubes assigns in x, y, z loop order
+static ShaderDefines::PackedCube packCube(const ShaderDefines::Cube &cube, unsigned int cubesPerSide) {
+	assert(cubesPerSide <= 65536);
+
+	// q and -q are the same rotation, keep w non-negative so it can be reconstructed
+	glm::vec4 q = cube.rotation;
+	if (q.w < 0.0f) {
+		q = -q;
+	}
+
+	uint32_t gridX = cube.order / (cubesPerSide * cubesPerSide);
+	uint32_t gridY = (cube.order / cubesPerSide) % cubesPerSide;
+	uint32_t gridZ = cube.order % cubesPerSide;
+
+	auto unorm10 = [] (float f) {
+		return static_cast<uint32_t>(glm::clamp(f, 0.0f, 1.0f) * 1023.0f + 0.5f);
+	};
+
+	ShaderDefines::PackedCube packed;
+	packed.data.x = glm::packSnorm2x16(glm::vec2(q.x, q.y));
+	packed.data.y = (glm::packSnorm2x16(glm::vec2(q.z, 0.0f)) & 0xFFFFU) | (gridX << 16);
+	packed.data.z = gridY | (gridZ << 16);
+	packed.data.w = unorm10(cube.color.x) | (unorm10(cube.color.y) << 10) | (unorm10(cube.color.z) << 20);
+
+	return packed;
+}
+
+
+void SMAADemo::updateCubeInstances() {
+	unsigned int numCubes = static_cast<unsigned int>(cubes.size());
+	cubePosX.resize(numCubes);
+	cubePosY.resize(numCubes);
+	cubePosZ.resize(numCubes);
+	packedCubes.resize(numCubes);
+	for (unsigned int i = 0; i < numCubes; i++) {
+		cubePosX[i]    = cubes[i].position.x;
+		cubePosY[i]    = cubes[i].position.y;
+		cubePosZ[i]    = cubes[i].position.z;
+		packedCubes[i] = packCube(cubes[i], cubesPerSide);
+	}
+}
+
+
+void SMAADemo::cullCubes(const glm::mat4 &viewProj) {
+	PROFILE_FUNCTION();
+
+	uint64_t startTime = getNanoseconds();
+
+	// side planes of the frustum from the rows of viewProj, pointing inwards
+	// near and far planes are placed to enclose the whole scene
+	glm::mat4 rows = glm::transpose(viewProj);
+	CullPlanes c;
+	c.planes[0] = rows[3] + rows[0];
+	c.planes[1] = rows[3] - rows[0];
+	c.planes[2] = rows[3] + rows[1];
+	c.planes[3] = rows[3] - rows[1];
+	for (auto &plane : c.planes) {
+		plane /= glm::length(glm::vec3(plane));
+	}
+	// clip space w is the distance along the view direction
+	c.depth  = rows[3];
+	// bounding sphere of a cube
+	c.radius = coord * sqrtf(3.0f);
+	c.cull   = frustumCullCubes;
+
+	unsigned int numCubes = static_cast<unsigned int>(cubes.size());
+	assert(cubePosX.size() == numCubes);
+	cullKeys.resize(numCubes);
+	cullIndices.resize(numCubes);
+
+	// split big scenes across threads, each compacts into its own slice
+	unsigned int numSlices = numWorkerThreads(numCubes);
+	std::vector<unsigned int> begins(numSlices, 0);
+	std::vector<unsigned int> counts(numSlices, 0);
+	auto cullSlice = [&] (unsigned int slice, unsigned int begin, unsigned int end) {
+		begins[slice] = begin;
+		counts[slice] = cullCubeRange(c, &cubePosX[0], &cubePosY[0], &cubePosZ[0], begin, end, &cullKeys[begin], &cullIndices[begin]);
+	};
+	runSlices(numCubes, numSlices, cullSlice);
 
-			float r = cr * (2 - 2 * c_red) + y;
-			float g = (y - c_blue * cb - c_red * cr) / c_green;
-			float b = cb * (2 - 2 * c_blue) + y;
+	unsigned int visible = 0;
+	for (unsigned int t = 0; t < numSlices; t++) {
+		if (visible != begins[t] && counts[t] > 0) {
+			memmove(&cullKeys[visible],    &cullKeys[begins[t]],    counts[t] * sizeof(uint32_t));
+			memmove(&cullIndices[visible], &cullIndices[begins[t]], counts[t] * sizeof(uint32_t));
+		}
+		visible += counts[t];
+	}
 
-			cube.color.x = sRGB2linear(r);
-			cube.color.y = sRGB2linear(g);
-			cube.color.z = sRGB2linear(b);
+	const uint32_t *order = &cullIndices[0];
+	if (sortCubesFrontToBack && visible > 1) {
+		cullKeysTmp.resize(numCubes);
+		cullIndicesTmp.resize(numCubes);
+		if (radixSort(&cullKeys[0], &cullIndices[0], &cullKeysTmp[0], &cullIndicesTmp[0], visible)) {
+			order = &cullIndicesTmp[0];
 		}
 	}
+
+	if (packedCubeLayout) {
+		visiblePackedCubes.resize(visible);
+		for (unsigned int i = 0; i < visible; i++) {
+			visiblePackedCubes[i] = packedCubes[order[i]];
+		}
+	} else {
+		visibleCubes.resize(visible);
+		for (unsigned int i = 0; i < visible; i++) {
+			visibleCubes[i] = cubes[order[i]];
+		}
+	}
+
+	cullNanoseconds = getNanoseconds() - startTime;
+}
+
+
+void SMAADemo::colorCubes() {
+	PROFILE_FUNCTION();
+
+	const unsigned int numCubes = static_cast<unsigned int>(cubes.size());
+	assert(packedCubes.size() == numCubes);
+
+	// streams follow order so colors stay with the same grid cell after shuffling
+	const uint64_t seed = random.randU32();
+	const SRGBTables &tables = srgbTables();
+	auto color = [&] (unsigned int /* slice */, unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			ShaderDefines::Cube &cube = cubes[i];
+			RandomGen rng(seed, cube.order);
+
+			if (colorMode == 0) {
+				// random RGB
+				// 8 bits per channel is all the render target has so decode from table instead of pow
+				uint32_t bits = rng.randU32();
+				cube.color.x = tables.toLinear[ bits        & 0xFF] / 65535.0f;
+				cube.color.y = tables.toLinear[(bits >>  8) & 0xFF] / 65535.0f;
+				cube.color.z = tables.toLinear[(bits >> 16) & 0xFF] / 65535.0f;
+			} else {
+				// YCbCr, fixed luma, random chroma, alpha = 1.0
+				// worst case scenario for luma edge detection
+				// TODO: use the same luma as shader
+
+				float y = 0.3f;
+				const float c_red   = 0.299f
+				          , c_green = 0.587f
+				          , c_blue  = 0.114f;
+				float cb = rng.randFloat() * 2.0f - 1.0f;
+				float cr = rng.randFloat() * 2.0f - 1.0f;
+
+				float r = cr * (2 - 2 * c_red) + y;
+				float g = (y - c_blue * cb - c_red * cr) / c_green;
+				float b = cb * (2 - 2 * c_blue) + y;
+
+				cube.color.x = sRGB2linear(r);
+				cube.color.y = sRGB2linear(g);
+				cube.color.z = sRGB2linear(b);
+			}
+
+			packedCubes[i] = packCube(cube, cubesPerSide);
+		}
+	};
+	runSlices(numCubes, numWorkerThreads(numCubes), color);
 }
 
 
@@ -1867,8 +3154,10 @@ static void printHelp() {
 	printf(" c                - re-color cubes\n");
 	printf(" d                - cycle through debug visualizations\n");
 	printf(" f                - toggle fullscreen\n");
+	printf(" g                - toggle GUI\n");
 	printf(" h                - print help\n");
 	printf(" m                - change antialiasing method\n");
+	printf(" p                - write CPU profile\n");
 	printf(" q                - cycle through AA quality levels\n");
 	printf(" t                - toggle temporal antialiasing on/off\n");
 	printf(" v                - toggle vsync\n");
@@ -1879,6 +3168,8 @@ static void printHelp() {
 
 
 void SMAADemo::mainLoopIteration() {
+	PROFILE_FUNCTION();
+
 	ImGuiIO& io = ImGui::GetIO();
 
 	// TODO: timing
@@ -1942,10 +3233,18 @@ void SMAADemo::mainLoopIteration() {
 				}
 				break;
 
+			case SDL_SCANCODE_G:
+				guiVisible = !guiVisible;
+				break;
+
 			case SDL_SCANCODE_H:
 				printHelp();
 				break;
 
+			case SDL_SCANCODE_P:
+				writeProfile();
+				break;
+
 			case SDL_SCANCODE_M:
 				// if moving either to or from MSAA or SMAA2X need to recreate framebuffers
 				if (aaMethod == AAMethod::MSAA || aaMethod == AAMethod::SMAA2X) {
@@ -2134,7 +3433,44 @@ void SMAADemo::mainLoopIteration() {
 }
 
 
+static void writePPM(const std::string &filename, const ReadbackResult &result) {
+	if (result.format != Format::sRGBA8 && result.format != Format::RGBA8) {
+		LOG("Can't write \"%s\", unsupported format\n", filename.c_str());
+		return;
+	}
+
+	std::unique_ptr<FILE, int (*)(FILE *)> f(fopen(filename.c_str(), "wb"), fclose);
+	if (!f) {
+		LOG("Failed to open capture file \"%s\"\n", filename.c_str());
+		return;
+	}
+
+	fprintf(f.get(), "P6\n%u %u\n255\n", result.width, result.height);
+
+	// drop alpha
+	const unsigned int numPixels = result.width * result.height;
+	std::vector<uint8_t> rgb(numPixels * 3);
+	const uint8_t *src = reinterpret_cast<const uint8_t *>(result.data);
+	for (unsigned int i = 0; i < numPixels; i++) {
+		rgb[i * 3 + 0] = src[i * 4 + 0];
+		rgb[i * 3 + 1] = src[i * 4 + 1];
+		rgb[i * 3 + 2] = src[i * 4 + 2];
+	}
+	fwrite(&rgb[0], 1, rgb.size(), f.get());
+
+	LOG("Wrote frame %u to \"%s\"\n", result.frameNum, filename.c_str());
+}
+
+
 void SMAADemo::render() {
+	PROFILE_FUNCTION();
+
+	startImageJobs();
+	processDecodedImages();
+	if (activeScene != 0 && images[activeScene - 1].state == ImageState::Evicted) {
+		requestImage(activeScene - 1);
+	}
+
 	if (recreateSwapchain) {
 		SwapchainDesc desc;
 		desc.fullscreen = fullscreen;
@@ -2162,12 +3498,23 @@ void SMAADemo::render() {
 
 	lastTime = ticks;
 
+	// loader and worker threads allocate as they please
+	uint64_t allocations = threadAllocationCount();
+	frameAllocations     = allocations - lastAllocationCount;
+	lastAllocationCount  = allocations;
+
 	renderer.beginFrame();
+	// swapchain can also change size behind our back when it goes out of date
+	// final rendertarget has to follow it
+	glm::uvec2 size = renderer.getDrawableSize();
+	if (size.x != windowWidth || size.y != windowHeight) {
+		recreateFramebuffers = true;
+	}
+
 	if (recreateSwapchain || recreateFramebuffers) {
 		recreateSwapchain = false;
 		recreateFramebuffers = false;
 
-		glm::uvec2 size = renderer.getDrawableSize();
 		LOG("drawable size: %ux%u\n", size.x, size.y);
 		windowWidth  = size.x;
 		windowHeight = size.y;
@@ -2236,8 +3583,6 @@ void SMAADemo::render() {
 	renderer.beginRenderPass(getSceneRenderPass(numSamples, l), sceneFramebuffer);
 
 	if (activeScene == 0) {
-		renderer.bindPipeline(getCubePipeline(numSamples));
-
 		if (rotateCubes) {
 			rotationTime += elapsed;
 
@@ -2251,6 +3596,9 @@ void SMAADemo::render() {
 		const float cubeDiameter = sqrtf(3.0f);
 		const float cubeDistance = cubeDiameter + 1.0f;
 
+		// same as createCubes
+		globals.cubeGrid = glm::vec4(cubeDistance, -(cubeDistance * cubesPerSide) / 2.0f, 0.0f, 0.0f);
+
 		float farPlane  = cameraDistance + cubeDistance * float(cubesPerSide + 1);
 		float nearPlane = std::max(0.1f, cameraDistance - cubeDistance * float(cubesPerSide + 1));
 
@@ -2286,33 +3634,59 @@ void SMAADemo::render() {
 		globals.viewProj     = currViewProj;
 		globals.prevViewProj = prevViewProj;
 
-		renderer.setViewport(0, 0, windowWidth, windowHeight);
+		if (frustumCullCubes || sortCubesFrontToBack) {
+			cullCubes(currViewProj);
+		} else {
+			cullNanoseconds = 0;
+		}
 
-		GlobalDS globalDS;
-		globalDS.globalUniforms = renderer.createEphemeralBuffer(BufferType::Uniform, sizeof(ShaderDefines::Globals), &globals);
-		globalDS.linearSampler  = linearSampler;
-		globalDS.nearestSampler = nearestSampler;
-		renderer.bindDescriptorSet(0, globalDS);
+		const bool culled = frustumCullCubes || sortCubesFrontToBack;
+		unsigned int numCubes;
+		uint32_t     instanceSize;
+		const void  *instances;
+		if (packedCubeLayout) {
+			const auto &drawCubes = culled ? visiblePackedCubes : packedCubes;
+			numCubes     = static_cast<unsigned int>(drawCubes.size());
+			instanceSize = sizeof(ShaderDefines::PackedCube);
+			instances    = drawCubes.data();
+		} else {
+			const auto &drawCubes = culled ? visibleCubes : cubes;
+			numCubes     = static_cast<unsigned int>(drawCubes.size());
+			instanceSize = sizeof(ShaderDefines::Cube);
+			instances    = drawCubes.data();
+		}
 
-		renderer.bindVertexBuffer(0, cubeVBO);
-		renderer.bindIndexBuffer(cubeIBO, false);
+		// nothing to draw when every cube was culled
+		if (numCubes > 0) {
+			renderer.bindPipeline(getCubePipeline(numSamples));
 
-		CubeSceneDS cubeDS;
-		cubeDS.instances = renderer.createEphemeralBuffer(BufferType::Storage, static_cast<uint32_t>(sizeof(ShaderDefines::Cube) * cubes.size()), &cubes[0]);
-		renderer.bindDescriptorSet(1, cubeDS);
+			renderer.setViewport(0, 0, windowWidth, windowHeight);
 
-		unsigned int numCubes = static_cast<unsigned int>(cubes.size());
-		if (visualizeCubeOrder) {
-			cubeOrderNum = cubeOrderNum % numCubes;
-			cubeOrderNum++;
-			numCubes     = cubeOrderNum;
-		}
+			GlobalDS globalDS;
+			globalDS.globalUniforms = renderer.createEphemeralBuffer(BufferType::Uniform, sizeof(ShaderDefines::Globals), &globals);
+			globalDS.linearSampler  = linearSampler;
+			globalDS.nearestSampler = nearestSampler;
+			renderer.bindDescriptorSet(0, globalDS);
+
+			renderer.bindVertexBuffer(0, cubeVBO);
+			renderer.bindIndexBuffer(cubeIBO, false);
+
+			CubeSceneDS cubeDS;
+			cubeDS.instances = renderer.createEphemeralBuffer(BufferType::Storage, instanceSize * numCubes, instances);
+			renderer.bindDescriptorSet(1, cubeDS);
 
-		renderer.drawIndexedInstanced(3 * 2 * 6, numCubes);
+			if (visualizeCubeOrder) {
+				cubeOrderNum = cubeOrderNum % numCubes;
+				cubeOrderNum++;
+				numCubes     = cubeOrderNum;
+			}
+
+			renderer.drawIndexedInstanced(3 * 2 * 6, numCubes);
+		}
 	} else {
 		renderer.bindPipeline(imagePipeline);
 
-		const auto &image = images.at(activeScene - 1);
+		auto &image = images.at(activeScene - 1);
 
 		renderer.setViewport(0, 0, windowWidth, windowHeight);
 
@@ -2324,7 +3698,12 @@ void SMAADemo::render() {
 
 		assert(activeScene - 1 < images.size());
 		ColorTexDS colorDS;
-		colorDS.color = image.tex;
+		if (image.state == ImageState::Resident) {
+			colorDS.color  = image.tex;
+			image.lastUsed = getNanoseconds();
+		} else {
+			colorDS.color  = placeholderTex;
+		}
 		renderer.bindDescriptorSet(1, colorDS);
 		renderer.draw(0, 3);
 	}
@@ -2363,11 +3742,13 @@ void SMAADemo::render() {
 		} break;
 
 		case AAMethod::SMAA: {
+			renderer.beginTimingScope("SMAA");
 			if (temporalAA) {
 				doSMAA(mainColorRT, smaaBlendRenderPass, resolveFBs[temporalFrame], 0);
 			} else {
 				doSMAA(mainColorRT, finalRenderPass, finalFramebuffer, 0);
 			}
+			renderer.endTimingScope();
 
 			if (temporalAA) {
 				doTemporalAA();
@@ -2422,10 +3803,623 @@ void SMAADemo::render() {
 		renderer.layoutTransition(finalRenderRT, Layout::TransferDst, Layout::ColorAttachment);
 	}
 
-	drawGUI(elapsed);
+	if (benchmarkMode || !guiVisible) {
+		// no GUI, do the transition its render pass would have done
+		renderer.layoutTransition(finalRenderRT, Layout::ColorAttachment, Layout::TransferSrc);
+	} else {
+		renderer.beginTimingScope("GUI");
+		drawGUI(elapsed);
+		renderer.endTimingScope();
+	}
+
+	if (!captureFilename.empty()) {
+		std::string filename;
+		std::swap(filename, captureFilename);
+		renderer.readbackRenderTarget(finalRenderRT, [filename] (const ReadbackResult &result) {
+			writePPM(filename, result);
+		});
+	}
 
 	renderer.presentFrame(finalRenderRT);
 
+	if (!timingsFile.empty()) {
+		writeTimings();
+	}
+}
+
+
+void SMAADemo::writeProfile() {
+	if (!profileFile.empty()) {
+		profilerWrite(profileFile);
+	}
+}
+
+
+void SMAADemo::writeTimings() {
+	const FrameTimings &timings = renderer.getFrameTimings();
+	// results only change when an older frame has been synced
+	if (timings.frameNum == lastTimingsFrame || timings.passes.empty()) {
+		return;
+	}
+	lastTimingsFrame = timings.frameNum;
+
+	if (!timingsOut) {
+		timingsOut = fopen(timingsFile.c_str(), "w");
+		if (!timingsOut) {
+			LOG("Failed to open timings file \"%s\"\n", timingsFile.c_str());
+			throw std::runtime_error("Failed to open timings file");
+		}
+		fprintf(timingsOut, "frame,pass,depth,milliseconds\n");
+	}
+
+	for (const auto &pass : timings.passes) {
+		fprintf(timingsOut, "%u,\"%s\",%u,%.4f\n", timings.frameNum, pass.name, pass.depth, double(pass.nanoseconds) / 1000000.0);
+	}
+}
+
+
+static std::string trimString(const std::string &str) {
+	const char *whitespace = " \t\r\n";
+	auto begin = str.find_first_not_of(whitespace);
+	if (begin == std::string::npos) {
+		return std::string();
+	}
+	auto end = str.find_last_not_of(whitespace);
+	return str.substr(begin, end - begin + 1);
+}
+
+
+static std::string upperString(std::string str) {
+	std::transform(str.begin(), str.end(), str.begin(), ::toupper);
+	return str;
+}
+
+
+static void benchmarkMatrixError(const std::string &filename, unsigned int line, const std::string &message) {
+	LOG("%s:%u: %s\n", filename.c_str(), line, message.c_str());
+	fprintf(stderr, "%s:%u: %s\n", filename.c_str(), line, message.c_str());
+	exit(1);
+}
+
+
+static unsigned int parseBenchmarkNumber(const std::string &filename, unsigned int line, const std::string &value) {
+	char *end = nullptr;
+	unsigned long n = strtoul(value.c_str(), &end, 10);
+	if (value.empty() || *end != '\0') {
+		benchmarkMatrixError(filename, line, "Bad number \"" + value + "\"");
+	}
+	return static_cast<unsigned int>(n);
+}
+
+
+static std::string jsonEscape(const std::string &str) {
+	std::string result;
+	result.reserve(str.size());
+	for (char c : str) {
+		if (c == '"' || c == '\\') {
+			result.push_back('\\');
+		}
+		result.push_back(c);
+	}
+	return result;
+}
+
+
+// one "key = value, value, ..." per line, # starts a comment
+void SMAADemo::parseBenchmarkMatrix(const std::string &filename) {
+	if (!fileExists(filename)) {
+		LOG("Benchmark matrix \"%s\" not found\n", filename.c_str());
+		fprintf(stderr, "Benchmark matrix \"%s\" not found\n", filename.c_str());
+		exit(1);
+	}
+
+	std::vector<char> contents = readTextFile(filename);
+	std::string text(&contents[0]);
+
+	BenchmarkMatrix &m = benchmarkMatrix;
+	unsigned int lineNum = 0;
+	size_t pos = 0;
+	while (pos < text.size()) {
+		size_t eol = text.find('\n', pos);
+		if (eol == std::string::npos) {
+			eol = text.size();
+		}
+		std::string line = text.substr(pos, eol - pos);
+		pos = eol + 1;
+		lineNum++;
+
+		auto comment = line.find('#');
+		if (comment != std::string::npos) {
+			line.resize(comment);
+		}
+		line = trimString(line);
+		if (line.empty()) {
+			continue;
+		}
+
+		auto eq = line.find('=');
+		if (eq == std::string::npos) {
+			benchmarkMatrixError(filename, lineNum, "Expected \"key = values\"");
+		}
+		std::string key = upperString(trimString(line.substr(0, eq)));
+
+		std::vector<std::string> values;
+		std::string rest = line.substr(eq + 1);
+		size_t start = 0;
+		while (start <= rest.size()) {
+			size_t comma = rest.find(',', start);
+			if (comma == std::string::npos) {
+				comma = rest.size();
+			}
+			std::string v = trimString(rest.substr(start, comma - start));
+			if (v.empty()) {
+				benchmarkMatrixError(filename, lineNum, "Empty value for \"" + key + "\"");
+			}
+			values.push_back(v);
+			start = comma + 1;
+		}
+
+		if (key == "METHOD") {
+			for (const auto &v : values) {
+				std::string method = upperString(v);
+				if (method != "NONE" && method != "MSAA" && method != "FXAA" && method != "SMAA" && method != "SMAA2X") {
+					benchmarkMatrixError(filename, lineNum, "Bad AA method \"" + v + "\"");
+				}
+				m.methods.push_back(method);
+			}
+		} else if (key == "SMAAQUALITY") {
+			for (const auto &v : values) {
+				std::string q = upperString(v);
+				unsigned int i;
+				for (i = 0; i < maxSMAAQuality; i++) {
+					if (q == smaaQualityLevels[i]) {
+						break;
+					}
+				}
+				if (i == maxSMAAQuality) {
+					benchmarkMatrixError(filename, lineNum, "Bad SMAA quality \"" + v + "\"");
+				}
+				m.smaaQualities.push_back(i);
+			}
+		} else if (key == "FXAAQUALITY") {
+			for (const auto &v : values) {
+				unsigned int i;
+				for (i = 0; i < maxFXAAQuality; i++) {
+					if (v == fxaaQualityLevels[i]) {
+						break;
+					}
+				}
+				if (i == maxFXAAQuality) {
+					benchmarkMatrixError(filename, lineNum, "Bad FXAA quality \"" + v + "\"");
+				}
+				m.fxaaQualities.push_back(i);
+			}
+		} else if (key == "MSAASAMPLES") {
+			for (const auto &v : values) {
+				unsigned int n = parseBenchmarkNumber(filename, lineNum, v);
+				if (n < 2 || !isPow2(n)) {
+					benchmarkMatrixError(filename, lineNum, "Bad MSAA sample count \"" + v + "\"");
+				}
+				m.msaaSamples.push_back(n);
+			}
+		} else if (key == "TEMPORAL") {
+			for (const auto &v : values) {
+				std::string t = upperString(v);
+				if (t == "ON" || t == "YES" || t == "TRUE" || t == "1") {
+					m.temporal.push_back(true);
+				} else if (t == "OFF" || t == "NO" || t == "FALSE" || t == "0") {
+					m.temporal.push_back(false);
+				} else {
+					benchmarkMatrixError(filename, lineNum, "Bad temporal value \"" + v + "\"");
+				}
+			}
+		} else if (key == "RESOLUTION") {
+			for (const auto &v : values) {
+				auto x = upperString(v).find('X');
+				if (x == std::string::npos) {
+					benchmarkMatrixError(filename, lineNum, "Bad resolution \"" + v + "\", expected WIDTHxHEIGHT");
+				}
+				unsigned int w = parseBenchmarkNumber(filename, lineNum, trimString(v.substr(0, x)));
+				unsigned int h = parseBenchmarkNumber(filename, lineNum, trimString(v.substr(x + 1)));
+				if (w == 0 || h == 0) {
+					benchmarkMatrixError(filename, lineNum, "Bad resolution \"" + v + "\"");
+				}
+				m.resolutions.push_back(glm::uvec2(w, h));
+			}
+		} else if (key == "CUBES") {
+			for (const auto &v : values) {
+				unsigned int n = parseBenchmarkNumber(filename, lineNum, v);
+				// same limit as the GUI
+				if (n == 0 || n >= 55) {
+					benchmarkMatrixError(filename, lineNum, "Bad cubes per side \"" + v + "\"");
+				}
+				m.cubesPerSide.push_back(n);
+			}
+		} else if (key == "CUBELAYOUT") {
+			for (const auto &v : values) {
+				std::string layout = upperString(v);
+				if (layout == "FULL") {
+					m.packedCubes.push_back(false);
+				} else if (layout == "PACKED") {
+					m.packedCubes.push_back(true);
+				} else {
+					benchmarkMatrixError(filename, lineNum, "Bad cube layout \"" + v + "\", expected full or packed");
+				}
+			}
+		} else if (key == "SCENE") {
+			for (const auto &v : values) {
+				std::string scene = upperString(v);
+				if (scene == "CUBES" || scene == "IMAGES") {
+					m.scenes.push_back(scene);
+				} else if (std::find(imageFiles.begin(), imageFiles.end(), v) != imageFiles.end()) {
+					m.scenes.push_back(v);
+				} else {
+					benchmarkMatrixError(filename, lineNum, "Scene \"" + v + "\" is not cubes, images or an image given on the command line");
+				}
+			}
+		} else if (key == "WARMUP") {
+			if (values.size() != 1) {
+				benchmarkMatrixError(filename, lineNum, "warmup takes one value");
+			}
+			m.warmupFrames = parseBenchmarkNumber(filename, lineNum, values[0]);
+		} else if (key == "FRAMES") {
+			if (values.size() != 1) {
+				benchmarkMatrixError(filename, lineNum, "frames takes one value");
+			}
+			m.measuredFrames = parseBenchmarkNumber(filename, lineNum, values[0]);
+			if (m.measuredFrames == 0) {
+				benchmarkMatrixError(filename, lineNum, "frames must be positive");
+			}
+		} else {
+			benchmarkMatrixError(filename, lineNum, "Unknown key \"" + key + "\"");
+		}
+	}
+}
+
+
+std::vector<BenchmarkConfig> SMAADemo::expandBenchmarkMatrix() const {
+	const BenchmarkMatrix &m = benchmarkMatrix;
+
+	// missing dimensions use current settings
+	std::vector<unsigned int> scenes;
+	if (m.scenes.empty()) {
+		scenes.push_back(activeScene);
+	}
+	for (const auto &s : m.scenes) {
+		if (s == "CUBES") {
+			scenes.push_back(0);
+		} else if (s == "IMAGES") {
+			for (unsigned int i = 0; i < images.size(); i++) {
+				scenes.push_back(i + 1);
+			}
+		} else {
+			bool found = false;
+			for (unsigned int i = 0; i < images.size(); i++) {
+				if (images[i].filename == s) {
+					scenes.push_back(i + 1);
+					found = true;
+					break;
+				}
+			}
+			if (!found) {
+				LOG("Image \"%s\" failed to load, skipping\n", s.c_str());
+			}
+		}
+	}
+
+	std::vector<unsigned int> cubeCounts = m.cubesPerSide;
+	if (cubeCounts.empty()) {
+		cubeCounts.push_back(cubesPerSide);
+	}
+
+	std::vector<bool> cubeLayouts = m.packedCubes;
+	if (cubeLayouts.empty()) {
+		cubeLayouts.push_back(packedCubeLayout);
+	}
+
+	std::vector<glm::uvec2> resolutions = m.resolutions;
+	if (resolutions.empty()) {
+		resolutions.push_back(glm::uvec2(windowWidth, windowHeight));
+	}
+
+	std::vector<std::string> methods = m.methods;
+	if (methods.empty()) {
+		methods.push_back(antialiasing ? name(aaMethod) : "NONE");
+	}
+
+	std::vector<bool> temporals = m.temporal;
+	if (temporals.empty()) {
+		temporals.push_back(temporalAA);
+	}
+
+	std::vector<BenchmarkConfig> configs;
+	for (unsigned int scene : scenes) {
+		// cube count and layout don't matter for images
+		unsigned int numCubeCounts  = (scene == 0) ? static_cast<unsigned int>(cubeCounts.size()) : 1;
+		unsigned int numCubeLayouts = (scene == 0) ? static_cast<unsigned int>(cubeLayouts.size()) : 1;
+		for (unsigned int c = 0; c < numCubeCounts; c++) {
+			for (unsigned int l = 0; l < numCubeLayouts; l++) {
+				for (const auto &res : resolutions) {
+					for (const auto &method : methods) {
+						BenchmarkConfig config;
+						config.scene        = scene;
+						config.cubesPerSide = (scene == 0) ? cubeCounts[c] : cubesPerSide;
+						config.packedCubes  = (scene == 0) ? cubeLayouts[l] : packedCubeLayout;
+						config.resolution   = res;
+
+						std::vector<unsigned int> qualities;
+						if (method == "NONE") {
+							config.antialiasing = false;
+							qualities.push_back(0);
+						} else if (method == "MSAA") {
+							config.method = AAMethod::MSAA;
+							if (m.msaaSamples.empty()) {
+								qualities.push_back(msaaQuality);
+							}
+							for (unsigned int n : m.msaaSamples) {
+								unsigned int q = msaaSamplesToQuality(n);
+								if (q < maxMSAAQuality) {
+									qualities.push_back(q);
+								} else {
+									LOG("%ux MSAA not supported, skipping\n", n);
+								}
+							}
+						} else if (method == "FXAA") {
+							config.method = AAMethod::FXAA;
+							qualities = m.fxaaQualities;
+							if (qualities.empty()) {
+								qualities.push_back(fxaaQuality);
+							}
+						} else {
+							config.method = (method == "SMAA2X") ? AAMethod::SMAA2X : AAMethod::SMAA;
+							qualities = m.smaaQualities;
+							if (qualities.empty()) {
+								qualities.push_back(smaaKey.quality);
+							}
+						}
+
+						// temporal AA is not used without AA or with MSAA
+						bool temporalUsed = config.antialiasing && config.method != AAMethod::MSAA;
+						for (unsigned int q : qualities) {
+							config.quality = q;
+							if (temporalUsed) {
+								for (bool t : temporals) {
+									config.temporal = t;
+									configs.push_back(config);
+								}
+							} else {
+								config.temporal = false;
+								configs.push_back(config);
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	return configs;
+}
+
+
+void SMAADemo::applyBenchmarkConfig(const BenchmarkConfig &config) {
+	if (windowWidth != config.resolution.x || windowHeight != config.resolution.y) {
+		windowWidth       = config.resolution.x;
+		windowHeight      = config.resolution.y;
+		recreateSwapchain = true;
+	}
+
+	antialiasing = config.antialiasing;
+	aaMethod     = config.method;
+	switch (config.method) {
+	case AAMethod::MSAA:
+		msaaQuality = config.quality;
+		break;
+
+	case AAMethod::FXAA:
+		fxaaQuality = config.quality;
+		break;
+
+	case AAMethod::SMAA:
+	case AAMethod::SMAA2X:
+		smaaKey.quality = config.quality;
+		if (config.quality != 0) {
+			smaaParameters = defaultSMAAParameters[config.quality];
+		}
+		break;
+	}
+
+	temporalAA           = config.temporal;
+	temporalAAFirstFrame = config.temporal;
+	// sample count might change
+	recreateFramebuffers = true;
+
+	if (config.scene == 0 && cubesPerSide != config.cubesPerSide) {
+		cubesPerSide = config.cubesPerSide;
+		createCubes();
+	}
+	packedCubeLayout = config.packedCubes;
+	activeScene = config.scene;
+
+	// benchmark measures the image, not the placeholder
+	if (activeScene != 0) {
+		waitForImage(activeScene - 1);
+	}
+}
+
+
+std::string SMAADemo::benchmarkQualityName(const BenchmarkConfig &config) const {
+	if (!config.antialiasing) {
+		return std::string();
+	}
+
+	switch (config.method) {
+	case AAMethod::MSAA:
+		return msaaQualityLevels[config.quality];
+
+	case AAMethod::FXAA:
+		return fxaaQualityLevels[config.quality];
+
+	case AAMethod::SMAA:
+	case AAMethod::SMAA2X:
+		return smaaQualityLevels[config.quality];
+	}
+
+	UNREACHABLE();
+}
+
+
+std::string SMAADemo::benchmarkSceneName(const BenchmarkConfig &config) const {
+	if (config.scene == 0) {
+		return "cubes";
+	}
+
+	assert(config.scene - 1 < images.size());
+	return images[config.scene - 1].shortName;
+}
+
+
+void SMAADemo::runBenchmark() {
+	fpsLimitActive = false;
+
+	std::vector<BenchmarkConfig> configs = expandBenchmarkMatrix();
+	const unsigned int warmupFrames   = benchmarkMatrix.warmupFrames;
+	const unsigned int measuredFrames = benchmarkMatrix.measuredFrames;
+	LOG("Running %u benchmark configurations, %u warmup and %u measured frames each\n", static_cast<unsigned int>(configs.size()), warmupFrames, measuredFrames);
+
+	std::vector<BenchmarkResult> results;
+	results.reserve(configs.size());
+	for (unsigned int c = 0; c < configs.size(); c++) {
+		const auto &config = configs[c];
+		applyBenchmarkConfig(config);
+
+		BenchmarkResult result;
+		result.config = config;
+		result.frameTimes.reserve(measuredFrames);
+
+		uint64_t prevTime = getNanoseconds();
+		for (unsigned int i = 0; i < warmupFrames + measuredFrames; i++) {
+			// only quitting is allowed during benchmark
+			SDL_Event event;
+			memset(&event, 0, sizeof(SDL_Event));
+			while (SDL_PollEvent(&event)) {
+				if (event.type == SDL_QUIT
+				 || (event.type == SDL_KEYDOWN && event.key.keysym.scancode == SDL_SCANCODE_ESCAPE)) {
+					keepGoing = false;
+				}
+			}
+
+			if (!keepGoing) {
+				LOG("Benchmark aborted\n");
+				writeBenchmarkResults(results);
+				return;
+			}
+
+			bool capturing = !benchmarkCapture.empty() && i + 1 == warmupFrames + measuredFrames;
+			if (capturing) {
+				captureFilename = benchmarkCapture + "/" + std::to_string(c) + "_" + (config.antialiasing ? name(config.method) : "none");
+				if (config.antialiasing) {
+					captureFilename += "_" + benchmarkQualityName(config);
+				}
+				if (config.temporal) {
+					captureFilename += "_temporal";
+				}
+				captureFilename += "_" + std::to_string(windowWidth) + "x" + std::to_string(windowHeight) + "_" + benchmarkSceneName(config);
+				if (config.scene == 0 && config.packedCubes) {
+					captureFilename += "_packed";
+				}
+				captureFilename += ".ppm";
+			}
+
+			uint64_t allocations = threadAllocationCount();
+			render();
+			allocations = threadAllocationCount() - allocations;
+
+			uint64_t now = getNanoseconds();
+			if (i >= warmupFrames) {
+				result.frameTimes.push_back(now - prevTime);
+				// writing the capture allocates, it's not a steady state frame
+				if (!capturing) {
+					result.maxFrameAllocations = std::max(result.maxFrameAllocations, allocations);
+				}
+			}
+			prevTime = now;
+		}
+
+		result.drawableSize = glm::uvec2(windowWidth, windowHeight);
+		result.memStats     = renderer.getMemStats();
+		result.frameStats   = renderer.getFrameStats();
+		std::sort(result.frameTimes.begin(), result.frameTimes.end());
+
+		LOG("%s %s %s%ux%u %s: mean %.3f ms, median %.3f ms, 99th percentile %.3f ms\n"
+		   , config.antialiasing ? name(config.method) : "none", benchmarkQualityName(config).c_str(), config.temporal ? "temporal " : ""
+		   , windowWidth, windowHeight, benchmarkSceneName(config).c_str()
+		   , result.mean(), result.percentile(50), result.percentile(99));
+
+		results.push_back(std::move(result));
+	}
+
+	writeBenchmarkResults(results);
+	keepGoing = false;
+}
+
+
+void SMAADemo::writeBenchmarkResults(const std::vector<BenchmarkResult> &results) {
+#if defined(RENDERER_VULKAN)
+	const char *rendererName = "vulkan";
+#elif defined(RENDERER_OPENGL)
+	const char *rendererName = "opengl";
+#elif defined(RENDERER_SOFTWARE)
+	const char *rendererName = "software";
+#else
+	const char *rendererName = "null";
+#endif
+
+	std::unique_ptr<FILE, int (*)(FILE *)> f(fopen(benchmarkOutput.c_str(), "wb"), fclose);
+	if (!f) {
+		LOG("Failed to open benchmark output \"%s\"\n", benchmarkOutput.c_str());
+		throw std::runtime_error("Failed to open benchmark output");
+	}
+
+	bool csv = benchmarkOutput.size() >= 4 && upperString(benchmarkOutput.substr(benchmarkOutput.size() - 4)) == ".CSV";
+	if (csv) {
+		fprintf(f.get(), "renderer,method,quality,temporal,width,height,cubesPerSide,cubeLayout,scene,frames,meanMs,minMs,p50Ms,p90Ms,p95Ms,p99Ms,maxMs,allocationCount,subAllocationCount,usedBytes,unusedBytes,passes,blits,draws,pipelineBinds,redundantPipelineBinds,descriptorSetBinds,redundantDescriptorSetBinds,uploadBytes,ringBufferHighWater,maxFrameAllocations\n");
+	} else {
+		fprintf(f.get(), "{\n\"renderer\": \"%s\",\n\"warmupFrames\": %u,\n\"results\": [\n", rendererName, benchmarkMatrix.warmupFrames);
+	}
+
+	for (unsigned int i = 0; i < results.size(); i++) {
+		const BenchmarkResult &r = results[i];
+		const BenchmarkConfig &c = r.config;
+		const FrameStats &fs     = r.frameStats;
+		std::string scene = benchmarkSceneName(c);
+		const char *cubeLayout   = c.packedCubes ? "packed" : "full";
+		if (csv) {
+			fprintf(f.get(), "%s,%s,\"%s\",%u,%u,%u,%u,%s,\"%s\",%u,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%u,%u,%" PRIu64 ",%" PRIu64 ",%u,%u,%u,%u,%u,%u,%u,%" PRIu64 ",%u,%" PRIu64 "\n"
+			       , rendererName, c.antialiasing ? name(c.method) : "none", benchmarkQualityName(c).c_str(), c.temporal ? 1 : 0
+			       , r.drawableSize.x, r.drawableSize.y, c.cubesPerSide, cubeLayout, scene.c_str(), static_cast<unsigned int>(r.frameTimes.size())
+			       , r.mean(), r.percentile(0), r.percentile(50), r.percentile(90), r.percentile(95), r.percentile(99), r.percentile(100)
+			       , r.memStats.allocationCount, r.memStats.subAllocationCount, r.memStats.usedBytes, r.memStats.unusedBytes
+			       , fs.passes, fs.blits, fs.draws, fs.pipelineBinds, fs.redundantPipelineBinds, fs.descriptorSetBinds, fs.redundantDescriptorSetBinds, fs.uploadBytes, fs.ringBufferHighWater, r.maxFrameAllocations);
+		} else {
+			fprintf(f.get(), "  { \"method\": \"%s\", \"quality\": \"%s\", \"temporal\": %s, \"width\": %u, \"height\": %u, \"cubesPerSide\": %u, \"cubeLayout\": \"%s\", \"scene\": \"%s\", \"frames\": %u"
+			       , c.antialiasing ? name(c.method) : "none", benchmarkQualityName(c).c_str(), c.temporal ? "true" : "false"
+			       , r.drawableSize.x, r.drawableSize.y, c.cubesPerSide, cubeLayout, jsonEscape(scene).c_str(), static_cast<unsigned int>(r.frameTimes.size()));
+			fprintf(f.get(), ", \"meanMs\": %.4f, \"minMs\": %.4f, \"p50Ms\": %.4f, \"p90Ms\": %.4f, \"p95Ms\": %.4f, \"p99Ms\": %.4f, \"maxMs\": %.4f"
+			       , r.mean(), r.percentile(0), r.percentile(50), r.percentile(90), r.percentile(95), r.percentile(99), r.percentile(100));
+			fprintf(f.get(), ", \"allocationCount\": %u, \"subAllocationCount\": %u, \"usedBytes\": %" PRIu64 ", \"unusedBytes\": %" PRIu64
+			       , r.memStats.allocationCount, r.memStats.subAllocationCount, r.memStats.usedBytes, r.memStats.unusedBytes);
+			fprintf(f.get(), ", \"passes\": %u, \"blits\": %u, \"draws\": %u, \"pipelineBinds\": %u, \"redundantPipelineBinds\": %u, \"descriptorSetBinds\": %u, \"redundantDescriptorSetBinds\": %u, \"uploadBytes\": %" PRIu64 ", \"ringBufferHighWater\": %u, \"maxFrameAllocations\": %" PRIu64 " }%s\n"
+			       , fs.passes, fs.blits, fs.draws, fs.pipelineBinds, fs.redundantPipelineBinds, fs.descriptorSetBinds, fs.redundantDescriptorSetBinds, fs.uploadBytes, fs.ringBufferHighWater, r.maxFrameAllocations
+			       , (i + 1 < results.size()) ? "," : "");
+		}
+	}
+
+	if (!csv) {
+		fprintf(f.get(), "]\n}\n");
+	}
+
+	LOG("Wrote %u benchmark results to \"%s\"\n", static_cast<unsigned int>(results.size()), benchmarkOutput.c_str());
 }
 
 
@@ -2526,6 +4520,8 @@ void SMAADemo::doTemporalAA() {
 
 
 void SMAADemo::drawGUI(uint64_t elapsed) {
+	PROFILE_FUNCTION();
+
 	ImGuiIO& io    = ImGui::GetIO();
 	io.DeltaTime   = float(double(elapsed) / double(1000000000ULL));
 	io.DisplaySize = ImVec2(static_cast<float>(windowWidth), static_cast<float>(windowHeight));
@@ -2533,6 +4529,17 @@ void SMAADemo::drawGUI(uint64_t elapsed) {
 
 	ImGui::NewFrame();
 
+	guiStatsElapsed += elapsed;
+	if (guiStatsElapsed >= guiStatsInterval) {
+		guiStatsElapsed    = 0;
+		guiFramerate       = io.Framerate;
+		guiCullNanoseconds = cullNanoseconds;
+		guiFrameAllocations = frameAllocations;
+		if (renderer.getFeatures().timestamps) {
+			guiTimings     = renderer.getFrameTimings();
+		}
+	}
+
 	if (io.WantTextInput != textInputActive) {
 		textInputActive = io.WantTextInput;
 		if (textInputActive) {
@@ -2776,6 +4783,17 @@ void SMAADemo::drawGUI(uint64_t elapsed) {
 			}
 
 			ImGui::Checkbox("Visualize cube order", &visualizeCubeOrder);
+
+			ImGui::Separator();
+			ImGui::Checkbox("Frustum cull cubes", &frustumCullCubes);
+			ImGui::Checkbox("Sort cubes front to back", &sortCubesFrontToBack);
+			ImGui::Checkbox("Packed cube instances", &packedCubeLayout);
+			unsigned int drawnCubes = static_cast<unsigned int>(cubes.size());
+			if (frustumCullCubes || sortCubesFrontToBack) {
+				drawnCubes = static_cast<unsigned int>(packedCubeLayout ? visiblePackedCubes.size() : visibleCubes.size());
+			}
+			ImGui::LabelText("Cubes drawn", "%u / %u", drawnCubes, static_cast<unsigned int>(cubes.size()));
+			ImGui::LabelText("Cull and sort ms", "%.3f", double(guiCullNanoseconds) / 1000000.0);
 		}
 
 		if (ImGui::CollapsingHeader("Swapchain properties", ImGuiTreeNodeFlags_DefaultOpen)) {
@@ -2809,8 +4827,22 @@ void SMAADemo::drawGUI(uint64_t elapsed) {
 
 			ImGui::Separator();
 			// TODO: measure actual GPU time
-			ImGui::LabelText("FPS", "%.1f", io.Framerate);
-			ImGui::LabelText("Frame time ms", "%.1f", 1000.0f / io.Framerate);
+			ImGui::LabelText("FPS", "%.1f", guiFramerate);
+			ImGui::LabelText("Frame time ms", "%.1f", 1000.0f / guiFramerate);
+			ImGui::LabelText("Allocations per frame", "%" PRIu64, guiFrameAllocations);
+
+			if (ImGui::CollapsingHeader("GPU timings")) {
+				if (renderer.getFeatures().timestamps) {
+					ImGui::Text("Frame %u", guiTimings.frameNum);
+					for (const auto &pass : guiTimings.passes) {
+						ImGui::Text("%*s%s", static_cast<int>(2 * pass.depth), "", pass.name);
+						ImGui::SameLine(250.0f);
+						ImGui::Text("%7.3f ms", double(pass.nanoseconds) / 1000000.0);
+					}
+				} else {
+					ImGui::Text("Timestamps not supported");
+				}
+			}
 
 #ifdef RENDERER_VULKAN
 			ImGui::Separator();
@@ -2847,44 +4879,85 @@ void SMAADemo::drawGUI(uint64_t elapsed) {
 
 	auto drawData = ImGui::GetDrawData();
 	assert(drawData->Valid);
-	renderer.beginRenderPass(guiOnlyRenderPass, finalFramebuffer);
 
 	if (drawData->CmdListsCount > 0) {
 		assert(drawData->CmdLists      != nullptr);
 		assert(drawData->TotalVtxCount >  0);
 		assert(drawData->TotalIdxCount >  0);
 
-		renderer.bindPipeline(guiPipeline);
-		ColorTexDS colorDS;
-		colorDS.color = imguiFontsTex;
-		renderer.bindDescriptorSet(1, colorDS);
-		// TODO: upload all buffers first, render after
-		// and one buffer each vertex/index
+		// one vertex and one index buffer for all lists
+		// indices stay relative to their own list and each draw gets a base vertex
+		guiVertices.resize(drawData->TotalVtxCount);
+		guiIndices.resize(drawData->TotalIdxCount);
+		unsigned int vtxCount = 0, idxCount = 0;
+		for (int n = 0; n < drawData->CmdListsCount; n++) {
+			const ImDrawList* cmd_list = drawData->CmdLists[n];
+			memcpy(&guiVertices[vtxCount], cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
+			memcpy(&guiIndices[idxCount],  cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
+			vtxCount += cmd_list->VtxBuffer.Size;
+			idxCount += cmd_list->IdxBuffer.Size;
+		}
+		assert(vtxCount == guiVertices.size());
+		assert(idxCount == guiIndices.size());
 
+		// vertices include positions so this also catches moved windows
+		// clip rects and command sizes decide how the same data is drawn
+		uint64_t hash = XXH64(&guiVertices[0], vtxCount * sizeof(ImDrawVert), 0);
+		hash = XXH64(&guiIndices[0], idxCount * sizeof(ImDrawIdx), hash);
 		for (int n = 0; n < drawData->CmdListsCount; n++) {
 			const ImDrawList* cmd_list = drawData->CmdLists[n];
+			for (const ImDrawCmd &cmd : cmd_list->CmdBuffer) {
+				hash = XXH64(&cmd.ClipRect, sizeof(cmd.ClipRect), hash);
+				hash = XXH64(&cmd.ElemCount, sizeof(cmd.ElemCount), hash);
+			}
+		}
+
+		if (!guiOverlayValid || hash != guiOverlayHash) {
+			PROFILE_SCOPE("GUI overlay");
+
+			renderer.beginRenderPass(guiOverlayRenderPass, guiOverlayFramebuffer);
+			renderer.bindPipeline(guiPipeline);
+			ColorTexDS colorDS;
+			colorDS.color = imguiFontsTex;
+			renderer.bindDescriptorSet(1, colorDS);
 
-			BufferHandle vtxBuf = renderer.createEphemeralBuffer(BufferType::Vertex, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert), cmd_list->VtxBuffer.Data);
-			BufferHandle idxBuf = renderer.createEphemeralBuffer(BufferType::Index, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx), cmd_list->IdxBuffer.Data);
+			BufferHandle vtxBuf = renderer.createEphemeralBuffer(BufferType::Vertex, vtxCount * sizeof(ImDrawVert), &guiVertices[0]);
+			BufferHandle idxBuf = renderer.createEphemeralBuffer(BufferType::Index,  idxCount * sizeof(ImDrawIdx),  &guiIndices[0]);
 			renderer.bindIndexBuffer(idxBuf, true);
 			renderer.bindVertexBuffer(0, vtxBuf);
 
-			unsigned int idx_buffer_offset = 0;
-			for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++) {
-				const ImDrawCmd* pcmd = &cmd_list->CmdBuffer[cmd_i];
-				if (pcmd->UserCallback) {
-					// TODO: this probably does nothing useful for us
-					assert(false);
+			// consecutive commands mostly share a clip rect, only set it when it changes
+			ImVec4 currentClipRect(-1.0f, -1.0f, -1.0f, -1.0f);
+			unsigned int baseVertex = 0, firstIndex = 0;
+			for (int n = 0; n < drawData->CmdListsCount; n++) {
+				const ImDrawList* cmd_list = drawData->CmdLists[n];
 
-					pcmd->UserCallback(cmd_list, pcmd);
-				} else {
-					assert(pcmd->TextureId == 0);
-					renderer.setScissorRect(static_cast<unsigned int>(pcmd->ClipRect.x), static_cast<unsigned int>(pcmd->ClipRect.y),
-						static_cast<unsigned int>(pcmd->ClipRect.z - pcmd->ClipRect.x), static_cast<unsigned int>(pcmd->ClipRect.w - pcmd->ClipRect.y));
-					renderer.drawIndexedOffset(pcmd->ElemCount, idx_buffer_offset);
+				for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++) {
+					const ImDrawCmd* pcmd = &cmd_list->CmdBuffer[cmd_i];
+					if (pcmd->UserCallback) {
+						// TODO: this probably does nothing useful for us
+						assert(false);
+
+						pcmd->UserCallback(cmd_list, pcmd);
+					} else {
+						assert(pcmd->TextureId == 0);
+						const ImVec4 &clip = pcmd->ClipRect;
+						if (clip.x != currentClipRect.x || clip.y != currentClipRect.y || clip.z != currentClipRect.z || clip.w != currentClipRect.w) {
+							renderer.setScissorRect(static_cast<unsigned int>(clip.x), static_cast<unsigned int>(clip.y),
+								static_cast<unsigned int>(clip.z - clip.x), static_cast<unsigned int>(clip.w - clip.y));
+							currentClipRect = clip;
+						}
+						renderer.drawIndexedBaseVertex(pcmd->ElemCount, firstIndex, baseVertex);
+					}
+					firstIndex += pcmd->ElemCount;
 				}
-				idx_buffer_offset += pcmd->ElemCount;
+				baseVertex += cmd_list->VtxBuffer.Size;
 			}
+
+			renderer.endRenderPass();
+
+			guiOverlayValid = true;
+			guiOverlayHash  = hash;
 		}
 #if 0
 		LOG("CmdListsCount: %d\n", drawData->CmdListsCount);
@@ -2897,6 +4970,17 @@ void SMAADemo::drawGUI(uint64_t elapsed) {
 		assert(drawData->TotalIdxCount == 0);
 	}
 
+	renderer.beginRenderPass(guiOnlyRenderPass, finalFramebuffer);
+
+	if (drawData->CmdListsCount > 0) {
+		assert(guiOverlayValid);
+		renderer.bindPipeline(guiCompositePipeline);
+		ColorTexDS colorDS;
+		colorDS.color = renderer.getRenderTargetTexture(guiOverlayRT);
+		renderer.bindDescriptorSet(1, colorDS);
+		renderer.draw(0, 3);
+	}
+
 	renderer.endRenderPass();
 }
 
@@ -2904,6 +4988,7 @@ void SMAADemo::drawGUI(uint64_t elapsed) {
 int main(int argc, char *argv[]) {
 	try {
 		logInit();
+		profilerSetThreadName("main");
 
 		auto demo = std::make_unique<SMAADemo>();
 
@@ -2911,28 +4996,34 @@ int main(int argc, char *argv[]) {
 
 		demo->initRender();
 		demo->createCubes();
-		printHelp();
+		if (demo->isBenchmark()) {
+			demo->runBenchmark();
+		} else {
+			printHelp();
+		}
 
 		while (demo->shouldKeepGoing()) {
 			try {
 				demo->mainLoopIteration();
 			} catch (std::exception &e) {
-				LOG("caught std::exception: \"%s\"\n", e.what());
+				LOG_ERROR("caught std::exception: \"%s\"\n", e.what());
 				break;
 			} catch (...) {
-				LOG("caught unknown exception\n");
+				LOG_ERROR("caught unknown exception\n");
 				break;
 			}
 		}
+
+		demo->writeProfile();
 	} catch (std::exception &e) {
-		LOG("caught std::exception \"%s\"\n", e.what());
+		LOG_ERROR("caught std::exception \"%s\"\n", e.what());
 #ifndef _MSC_VER
 		logShutdown();
 		// so native dumps core
 		throw;
 #endif
 	} catch (...) {
-		LOG("unknown exception\n");
+		LOG_ERROR("unknown exception\n");
 #ifndef _MSC_VER
 		logShutdown();
 		// so native dumps core
@@ -38,5 +38,7 @@ layout (location = 0) out vec4 outColor;
 
 void main(void)
 {
-    outColor = color * texture(sampler2D(colorTex, linearSampler), uv);
+    vec4 c = color * texture(sampler2D(colorTex, linearSampler), uv);
+    // premultiplied so the cached overlay can be composited with a single blend
+    outColor = vec4(c.rgb * c.a, c.a);
 }
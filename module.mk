@@ -40,6 +40,13 @@ LDFLAGS+=-fsanitize=undefined -fno-sanitize-recover=all
 endif  # UBSAN
 
 
+ifeq ($(PROFILING),y)
+
+CFLAGS+=-DPROFILING
+
+endif  # PROFILING
+
+
 ifeq ($(LTO),y)
 
 CFLAGS+=$(LTOCFLAGS)
@@ -23,7 +23,10 @@ THE SOFTWARE.
 
 #ifdef RENDERER_NULL
 
+#include <chrono>
+
 #include "RendererInternal.h"
+#include "utils/Profiler.h"
 #include "utils/Utils.h"
 
 
@@ -38,6 +41,15 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 	currentRefreshRate = 60;
 	maxRefreshRate     = 60;
 
+	// nothing is actually rendered so pretend to support everything
+	features.maxMSAASamples       = 16;
+	features.sRGBFramebuffer      = true;
+	features.SSBOSupported        = true;
+	// timing scopes measure CPU time
+	features.timestamps           = true;
+	// nothing is decoded, any format can be modeled
+	features.textureCompressionBC = true;
+
 	recreateRingBuffer(desc.ephemeralRingBufSize);
 	drawableSize   = glm::uvec2(desc.swapchain.width, desc.swapchain.height);
 
@@ -87,6 +99,9 @@ BufferHandle RendererImpl::createBuffer(BufferType /* type */, uint32_t size, co
 	buffer.size            = size;
 
 	// TODO: store contents into buffer
+	currentStats.buffers++;
+	currentStats.bufferBytes += size;
+	currentStats.uploadBytes += size;
 
 	return result.second;
 }
@@ -109,6 +124,9 @@ BufferHandle RendererImpl::createEphemeralBuffer(BufferType /* type */, uint32_t
 
 	frames.at(currentFrameIdx).ephemeralBuffers.push_back(result.second);
 
+	currentStats.uploadBytes         += size;
+	currentStats.ringBufferHighWater  = std::max(currentStats.ringBufferHighWater, ringBufPtr - lastSyncedRingBufPtr);
+
 	return result.second;
 }
 
@@ -116,7 +134,9 @@ BufferHandle RendererImpl::createEphemeralBuffer(BufferType /* type */, uint32_t
 FramebufferHandle RendererImpl::createFramebuffer(const FramebufferDesc &desc) {
 	auto result = framebuffers.add();
 	auto &fb = result.first;
-	fb.renderPass = desc.renderPass_;
+	fb.desc     = desc;
+
+	currentStats.framebuffers++;
 
 	return result.second;
 }
@@ -127,14 +147,21 @@ RenderPassHandle RendererImpl::createRenderPass(const RenderPassDesc &desc) {
 	auto &rp    = result.first;
 	rp.desc     = desc;
 
+	currentStats.renderPasses++;
+
 	return result.second;
 }
 
 
 PipelineHandle RendererImpl::createPipeline(const PipelineDesc &desc) {
+	PROFILE_FUNCTION();
+
 	auto result = pipelines.add();
 	auto &pipeline = result.first;
 	pipeline.desc = desc;
+
+	currentStats.pipelines++;
+
 	return result.second;
 }
 
@@ -147,6 +174,10 @@ RenderTargetHandle RendererImpl::createRenderTarget(const RenderTargetDesc &desc
 	auto result = rendertargets.add();
 	auto &rendertarget = result.first;
 	rendertarget.desc = desc;
+
+	currentStats.renderTargets++;
+	currentStats.renderTargetBytes += modeledSize(desc);
+
 	return result.second;
 }
 
@@ -157,6 +188,8 @@ SamplerHandle RendererImpl::createSampler(const SamplerDesc &desc) {
 	// TODO: check desc
 	sampler.desc = desc;
 
+	currentStats.samplers++;
+
 	return result.second;
 }
 
@@ -195,16 +228,35 @@ TextureHandle RendererImpl::createTexture(const TextureDesc &desc) {
 	// TODO: check desc
 	texture.desc = desc;
 
+	currentStats.textures++;
+	currentStats.textureBytes += modeledSize(desc);
+	for (unsigned int i = 0; i < desc.numMips_; i++) {
+		currentStats.uploadBytes += desc.mipData_[i].size;
+	}
+
 	return result.second;
 }
 
 
+// contents are ignored but the caller still needs memory to write to
+TextureUpload RendererImpl::beginTextureUpload(const TextureDesc &desc) {
+	return beginScratchTextureUpload(desc);
+}
+
+
+TextureHandle RendererImpl::endTextureUpload(TextureUpload & /* upload */) {
+	// scratch uploads are finished by Renderer::endTextureUpload
+	UNREACHABLE();
+}
+
+
 DSLayoutHandle RendererImpl::createDescriptorSetLayout(const DescriptorLayout *layout) {
 	auto result = dsLayouts.add();
 	DescriptorSetLayout &dsLayout = result.first;
 
 	while (layout->type != DescriptorType::End) {
 		dsLayout.layout.push_back(*layout);
+		dsLayout.size = std::max(dsLayout.size, layout->offset + descriptorSize(layout->type));
 		layout++;
 	}
 	assert(layout->offset == 0);
@@ -227,27 +279,59 @@ TextureHandle RendererImpl::getRenderTargetView(RenderTargetHandle /* handle */,
 }
 
 
-void RendererImpl::deleteBuffer(BufferHandle /* handle */) {
+void RendererImpl::deleteBuffer(BufferHandle handle) {
+	buffers.removeWith(handle, [this](Buffer &b) {
+		assert(!b.ringBufferAlloc);
+		assert(b.size != 0);
+
+		assert(currentStats.buffers > 0);
+		currentStats.buffers--;
+		currentStats.bufferBytes -= b.size;
+
+		b.size = 0;
+	} );
 }
 
 
-void RendererImpl::deleteFramebuffer(FramebufferHandle /*  */) {
+void RendererImpl::deleteFramebuffer(FramebufferHandle handle) {
+	framebuffers.remove(handle);
+
+	assert(currentStats.framebuffers > 0);
+	currentStats.framebuffers--;
 }
 
 
-void RendererImpl::deleteRenderPass(RenderPassHandle /* fbo */) {
+void RendererImpl::deleteRenderPass(RenderPassHandle handle) {
+	renderpasses.remove(handle);
+
+	assert(currentStats.renderPasses > 0);
+	currentStats.renderPasses--;
 }
 
 
-void RendererImpl::deleteRenderTarget(RenderTargetHandle &) {
+void RendererImpl::deleteRenderTarget(RenderTargetHandle &handle) {
+	rendertargets.removeWith(handle, [this](RenderTarget &rt) {
+		assert(currentStats.renderTargets > 0);
+		currentStats.renderTargets--;
+		currentStats.renderTargetBytes -= modeledSize(rt.desc);
+	} );
 }
 
 
-void RendererImpl::deleteSampler(SamplerHandle /* handle */) {
+void RendererImpl::deleteSampler(SamplerHandle handle) {
+	samplers.remove(handle);
+
+	assert(currentStats.samplers > 0);
+	currentStats.samplers--;
 }
 
 
-void RendererImpl::deleteTexture(TextureHandle /* handle */) {
+void RendererImpl::deleteTexture(TextureHandle handle) {
+	textures.removeWith(handle, [this](Texture &tex) {
+		assert(currentStats.textures > 0);
+		currentStats.textures--;
+		currentStats.textureBytes -= modeledSize(tex.desc);
+	} );
 }
 
 
@@ -259,11 +343,32 @@ void RendererImpl::setSwapchainDesc(const SwapchainDesc &desc) {
 
 MemoryStats RendererImpl::getMemStats() const {
 	MemoryStats stats;
+	// every resource is its own allocation, plus the ringbuffer
+	stats.allocationCount = currentStats.buffers + currentStats.renderTargets + currentStats.textures + 1;
+	stats.usedBytes       = currentStats.bufferBytes + currentStats.renderTargetBytes + currentStats.textureBytes + ringBufSize;
 	return stats;
 }
 
 
+uint64_t RendererImpl::modeledSize(const RenderTargetDesc &desc) const {
+	return uint64_t(desc.width_) * desc.height_ * desc.numSamples_ * formatSize(desc.format_);
+}
+
+
+uint64_t RendererImpl::modeledSize(const TextureDesc &desc) const {
+	uint64_t size = 0;
+	for (unsigned int i = 0; i < desc.numMips_; i++) {
+		unsigned int w = std::max(1U, desc.width_  >> i);
+		unsigned int h = std::max(1U, desc.height_ >> i);
+		size += mipLevelSize(desc.format_, w, h);
+	}
+	return size;
+}
+
+
 void RendererImpl::beginFrame() {
+	PROFILE_FUNCTION();
+
 	assert(!inFrame);
 	inFrame       = true;
 	inRenderPass  = false;
@@ -284,8 +389,11 @@ void RendererImpl::beginFrame() {
 
 
 void RendererImpl::presentFrame(RenderTargetHandle /* rt */) {
+	PROFILE_FUNCTION();
+
 	assert(inFrame);
 	inFrame = false;
+	assert(openTimingScopes.empty());
 
 	auto &frame = frames.at(currentFrameIdx);
 
@@ -293,11 +401,23 @@ void RendererImpl::presentFrame(RenderTargetHandle /* rt */) {
 	frame.outstanding    = true;
 	frame.lastFrameNum   = frameNum;
 
+	frameStats = currentStats;
+	currentStats.uploadBytes                  = 0;
+	currentStats.passes                       = 0;
+	currentStats.blits                        = 0;
+	currentStats.draws                        = 0;
+	currentStats.pipelineBinds                = 0;
+	currentStats.redundantPipelineBinds       = 0;
+	currentStats.descriptorSetBinds           = 0;
+	currentStats.redundantDescriptorSetBinds  = 0;
+
 	frameNum++;
 }
 
 
 void RendererImpl::waitForFrame(unsigned int frameIdx) {
+	PROFILE_FUNCTION();
+
 	assert(frameIdx < frames.size());
 
 	Frame &frame = frames.at(frameIdx);
@@ -316,9 +436,23 @@ void RendererImpl::waitForFrame(unsigned int frameIdx) {
 		buffers.remove(handle);
 	}
 	frame.ephemeralBuffers.clear();
+
+	if (!frame.timingScopes.empty()) {
+		resolveTimingScopes(frame.lastFrameNum, frame.timingScopes, frame.timestamps);
+		frame.timingScopes.clear();
+	}
+	frame.timestamps.clear();
+
 	frame.outstanding    = false;
 	lastSyncedFrame      = std::max(lastSyncedFrame, frame.lastFrameNum);
 	lastSyncedRingBufPtr = std::max(lastSyncedRingBufPtr, frame.usedRingBufPtr);
+	retireFrameArena(frameIdx);
+
+	for (auto &r : frame.readbacks) {
+		r.result.data = &r.data[0];
+		r.callback(r.result);
+	}
+	frame.readbacks.clear();
 }
 
 
@@ -327,6 +461,56 @@ void RendererImpl::deleteFrameInternal(Frame &f) {
 }
 
 
+unsigned int RendererImpl::writeTimestamp(bool /* begin */) {
+	auto &frame = frames.at(currentFrameIdx);
+
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	unsigned int index = static_cast<unsigned int>(frame.timestamps.size());
+	frame.timestamps.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+
+	return index;
+}
+
+
+bool RendererImpl::isRenderPassCompatible(const RenderPass &pass, const Framebuffer &fb) {
+	if (fb.desc.depthStencil_) {
+		const auto &depthRT = rendertargets.get(fb.desc.depthStencil_);
+
+		if (pass.desc.depthStencilFormat_ != depthRT.desc.format_) {
+			return false;
+		}
+
+		if (pass.desc.numSamples_ != depthRT.desc.numSamples_) {
+			return false;
+		}
+	} else {
+		if (pass.desc.depthStencilFormat_ != Format::Invalid) {
+			return false;
+		}
+	}
+
+	for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
+		if (fb.desc.colors_[i]) {
+			const auto &colorRT = rendertargets.get(fb.desc.colors_[i]);
+
+			if (pass.desc.colorRTs_[i].format != colorRT.desc.format_) {
+				return false;
+			}
+
+			if (pass.desc.numSamples_ != colorRT.desc.numSamples_) {
+				return false;
+			}
+		} else {
+			if (pass.desc.colorRTs_[i].format != Format::Invalid) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+
 void RendererImpl::beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle) {
 	assert(inFrame);
 	assert(!inRenderPass);
@@ -336,8 +520,19 @@ void RendererImpl::beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle
 	assert(fbHandle);
 	const auto &fb = framebuffers.get(fbHandle);
 
+	const auto &rp = renderpasses.get(rpHandle);
+
 	// make sure renderpass and framebuffer match
-	assert(fb.renderPass == rpHandle);
+	assert(fb.desc.renderPass_ == rpHandle || isRenderPassCompatible(rp, fb));
+
+	currentStats.passes++;
+	currentPipelineHandle = PipelineHandle();
+	for (unsigned int i = 0; i < MAX_DESCRIPTOR_SETS; i++) {
+		boundDSLayouts[i] = DSLayoutHandle();
+		boundDSData[i].clear();
+	}
+
+	beginTimingScope(rp.desc.name_);
 }
 
 
@@ -345,6 +540,8 @@ void RendererImpl::endRenderPass() {
 	assert(inFrame);
 	assert(inRenderPass);
 	inRenderPass = false;
+
+	endTimingScope();
 }
 
 
@@ -364,7 +561,11 @@ void RendererImpl::bindPipeline(PipelineHandle pipeline) {
 	validPipeline = true;
 	scissorSet = false;
 
-	currentPipeline = pipelines.get(pipeline).desc;
+	currentStats.pipelineBinds++;
+	if (pipeline == currentPipelineHandle) {
+		currentStats.redundantPipelineBinds++;
+	}
+	currentPipelineHandle = pipeline;
 }
 
 
@@ -380,8 +581,21 @@ void RendererImpl::bindVertexBuffer(unsigned int /* binding */, BufferHandle /*
 }
 
 
-void RendererImpl::bindDescriptorSet(unsigned int /* index */, DSLayoutHandle /* layout */, const void * /* data_ */) {
+void RendererImpl::bindDescriptorSet(unsigned int index, DSLayoutHandle layout, const void *data_) {
 	assert(validPipeline);
+	assert(index < MAX_DESCRIPTOR_SETS);
+
+	const DescriptorSetLayout &dsLayout = dsLayouts.get(layout);
+	const char *data = reinterpret_cast<const char *>(data_);
+
+	currentStats.descriptorSetBinds++;
+	auto &bound = boundDSData[index];
+	if (boundDSLayouts[index] == layout && bound.size() == dsLayout.size && memcmp(bound.data(), data, dsLayout.size) == 0) {
+		currentStats.redundantDescriptorSetBinds++;
+	} else {
+		boundDSLayouts[index] = layout;
+		bound.assign(data, data + dsLayout.size);
+	}
 }
 
 
@@ -392,7 +606,7 @@ void RendererImpl::setViewport(unsigned int /* x */, unsigned int /* y */, unsig
 
 void RendererImpl::setScissorRect(unsigned int /* x */, unsigned int /* y */, unsigned int /* width */, unsigned int /* height */) {
 	assert(validPipeline);
-	assert(currentPipeline.scissorTest_);
+	assert(pipelines.get(currentPipelineHandle).desc.scissorTest_);
 	scissorSet = true;
 }
 
@@ -403,6 +617,7 @@ void RendererImpl::blit(FramebufferHandle source, FramebufferHandle target, unsi
 	assert(n == 0);
 
 	assert(!inRenderPass);
+	currentStats.blits++;
 }
 
 
@@ -412,6 +627,39 @@ void RendererImpl::resolveMSAA(FramebufferHandle source, FramebufferHandle targe
 	assert(n == 0);
 
 	assert(!inRenderPass);
+	currentStats.blits++;
+}
+
+
+void RendererImpl::readbackRenderTarget(RenderTargetHandle handle, unsigned int x, unsigned int y, unsigned int width, unsigned int height, ReadbackCallback callback) {
+	assert(inFrame);
+	assert(!inRenderPass);
+	assert(callback);
+
+	const auto &rt = rendertargets.get(handle);
+	assert(rt.desc.numSamples_ == 1);
+	assert(!isDepthFormat(rt.desc.format_));
+
+	if (width == 0 && height == 0) {
+		width  = rt.desc.width_;
+		height = rt.desc.height_;
+	}
+	assert(x + width  <= rt.desc.width_);
+	assert(y + height <= rt.desc.height_);
+
+	Readback readback;
+	readback.result.frameNum = frameNum;
+	readback.result.x        = x;
+	readback.result.y        = y;
+	readback.result.width    = width;
+	readback.result.height   = height;
+	readback.result.format   = rt.desc.format_;
+	readback.result.size     = width * height * formatSize(rt.desc.format_);
+	readback.callback        = std::move(callback);
+	// nothing is rendered so contents are zeros
+	readback.data.resize(readback.result.size, 0);
+
+	frames.at(currentFrameIdx).readbacks.push_back(std::move(readback));
 }
 
 
@@ -419,8 +667,10 @@ void RendererImpl::draw(unsigned int /* firstVertex */, unsigned int vertexCount
 	assert(inRenderPass);
 	assert(validPipeline);
 	assert(vertexCount > 0);
-	assert(!currentPipeline.scissorTest_ || scissorSet);
+	assert(!pipelines.get(currentPipelineHandle).desc.scissorTest_ || scissorSet);
 	pipelineDrawn = true;
+
+	currentStats.draws++;
 }
 
 
@@ -429,8 +679,10 @@ void RendererImpl::drawIndexedInstanced(unsigned int vertexCount, unsigned int i
 	assert(validPipeline);
 	assert(vertexCount > 0);
 	assert(instanceCount > 0);
-	assert(!currentPipeline.scissorTest_ || scissorSet);
+	assert(!pipelines.get(currentPipelineHandle).desc.scissorTest_ || scissorSet);
 	pipelineDrawn = true;
+
+	currentStats.draws++;
 }
 
 
@@ -438,8 +690,21 @@ void RendererImpl::drawIndexedOffset(unsigned int vertexCount, unsigned int /* f
 	assert(inRenderPass);
 	assert(validPipeline);
 	assert(vertexCount > 0);
-	assert(!currentPipeline.scissorTest_ || scissorSet);
+	assert(!pipelines.get(currentPipelineHandle).desc.scissorTest_ || scissorSet);
 	pipelineDrawn = true;
+
+	currentStats.draws++;
+}
+
+
+void RendererImpl::drawIndexedBaseVertex(unsigned int vertexCount, unsigned int /* firstIndex */, int /* baseVertex */) {
+	assert(inRenderPass);
+	assert(validPipeline);
+	assert(vertexCount > 0);
+	assert(!pipelines.get(currentPipelineHandle).desc.scissorTest_ || scissorSet);
+	pipelineDrawn = true;
+
+	currentStats.draws++;
 }
 
 
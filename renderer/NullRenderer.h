@@ -78,17 +78,23 @@ struct Buffer {
 
 struct DescriptorSetLayout {
 	std::vector<DescriptorLayout> layout;
+	// size of the struct described by layout
+	unsigned int                  size;
 
 
-	DescriptorSetLayout() {}
+	DescriptorSetLayout()
+	: size(0)
+	{}
 
 	DescriptorSetLayout(const DescriptorSetLayout &)            = delete;
 	DescriptorSetLayout &operator=(const DescriptorSetLayout &) = delete;
 
 	DescriptorSetLayout(DescriptorSetLayout &&other)
 	: layout(std::move(other.layout))
+	, size(other.size)
 	{
 		assert(other.layout.empty());
+		other.size = 0;
 	}
 
 	DescriptorSetLayout &operator=(DescriptorSetLayout &&other) {
@@ -100,6 +106,9 @@ struct DescriptorSetLayout {
 		layout = std::move(other.layout);
 		assert(other.layout.empty());
 
+		size       = other.size;
+		other.size = 0;
+
 		return *this;
 	}
 
@@ -142,16 +151,16 @@ struct FragmentShader {
 
 
 struct Framebuffer {
-	RenderPassHandle  renderPass;
+	FramebufferDesc  desc;
 
 
 	Framebuffer(const Framebuffer &)            = delete;
 	Framebuffer &operator=(const Framebuffer &) = delete;
 
 	Framebuffer(Framebuffer &&other)
-	: renderPass(other.renderPass)
+	: desc(other.desc)
 	{
-		other.renderPass = RenderPassHandle();
+		other.desc = FramebufferDesc();
 	}
 
 	Framebuffer &operator=(Framebuffer &&other) {
@@ -159,11 +168,9 @@ struct Framebuffer {
 			return *this;
 		}
 
-		assert(!renderPass);
-
-		renderPass       = other.renderPass;
+		desc       = other.desc;
 
-		other.renderPass = RenderPassHandle();
+		other.desc = FramebufferDesc();
 
 		return *this;
 	}
@@ -366,11 +373,22 @@ struct VertexShader {
 };
 
 
+// readback waiting for its frame to complete
+struct Readback {
+	ReadbackResult     result;
+	ReadbackCallback   callback;
+	std::vector<char>  data;
+};
+
+
 struct Frame {
 	bool                      outstanding;
 	uint32_t                  lastFrameNum;
 	unsigned int              usedRingBufPtr;
 	std::vector<BufferHandle> ephemeralBuffers;
+	std::vector<TimingScope>  timingScopes;
+	std::vector<uint64_t>     timestamps;
+	std::vector<Readback>     readbacks;
 
 
 	Frame()
@@ -381,6 +399,7 @@ struct Frame {
 
 	~Frame() {
 		assert(ephemeralBuffers.empty());
+		assert(readbacks.empty());
 		assert(!outstanding);
 	}
 
@@ -392,6 +411,9 @@ struct Frame {
 	, lastFrameNum(other.lastFrameNum)
 	, usedRingBufPtr(other.usedRingBufPtr)
 	, ephemeralBuffers(std::move(other.ephemeralBuffers))
+	, timingScopes(std::move(other.timingScopes))
+	, timestamps(std::move(other.timestamps))
+	, readbacks(std::move(other.readbacks))
 	{
 		other.outstanding      = false;
 		other.lastFrameNum     = 0;
@@ -412,6 +434,12 @@ struct Frame {
 		usedRingBufPtr       = other.usedRingBufPtr;
 		other.usedRingBufPtr = 0;
 
+		timingScopes = std::move(other.timingScopes);
+		timestamps   = std::move(other.timestamps);
+
+		assert(readbacks.empty());
+		readbacks    = std::move(other.readbacks);
+
 		return *this;
 	}
 };
@@ -433,7 +461,14 @@ struct RendererImpl : public RendererBase {
 	ResourceContainer<Texture>             textures;
 	ResourceContainer<VertexShader>          vertexShaders;
 
-	PipelineDesc  currentPipeline;
+	PipelineHandle  currentPipelineHandle;
+
+	// for detecting redundant binds, reset at start of render pass
+	std::array<DSLayoutHandle, MAX_DESCRIPTOR_SETS>     boundDSLayouts;
+	std::array<std::vector<char>, MAX_DESCRIPTOR_SETS>  boundDSData;
+
+	// accumulated until presentFrame copies it to frameStats
+	FrameStats      currentStats;
 
 
 	void recreateRingBuffer(unsigned int newSize);
@@ -442,6 +477,13 @@ struct RendererImpl : public RendererBase {
 	void waitForFrame(unsigned int frameIdx);
 	void deleteFrameInternal(Frame &f);
 
+	// begin is true for the start of a timing scope
+	unsigned int writeTimestamp(bool begin);
+
+	// memory the resource would take on a real GPU
+	uint64_t modeledSize(const RenderTargetDesc &desc) const;
+	uint64_t modeledSize(const TextureDesc &desc) const;
+
 	explicit RendererImpl(const RendererDesc &desc);
 
 	~RendererImpl();
@@ -449,6 +491,8 @@ struct RendererImpl : public RendererBase {
 
 	bool isRenderTargetFormatSupported(Format format) const;
 
+	bool isRenderPassCompatible(const RenderPass &pass, const Framebuffer &fb);
+
 	RenderTargetHandle   createRenderTarget(const RenderTargetDesc &desc);
 	VertexShaderHandle   createVertexShader(const std::string &name, const ShaderMacros &macros);
 	FragmentShaderHandle createFragmentShader(const std::string &name, const ShaderMacros &macros);
@@ -459,6 +503,8 @@ struct RendererImpl : public RendererBase {
 	BufferHandle         createEphemeralBuffer(BufferType type, uint32_t size, const void *contents);
 	SamplerHandle        createSampler(const SamplerDesc &desc);
 	TextureHandle        createTexture(const TextureDesc &desc);
+	TextureUpload        beginTextureUpload(const TextureDesc &desc);
+	TextureHandle        endTextureUpload(TextureUpload &upload);
 
 	DSLayoutHandle       createDescriptorSetLayout(const DescriptorLayout *layout);
 
@@ -482,6 +528,9 @@ struct RendererImpl : public RendererBase {
 	void beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle);
 	void endRenderPass();
 
+	void beginTimingScope(const std::string &name);
+	void endTimingScope();
+
 	void layoutTransition(RenderTargetHandle image, Layout src, Layout dest);
 
 	void setViewport(unsigned int x, unsigned int y, unsigned int width, unsigned int height);
@@ -496,9 +545,12 @@ struct RendererImpl : public RendererBase {
 	void blit(FramebufferHandle source, FramebufferHandle target, unsigned int n);
 	void resolveMSAA(FramebufferHandle source, FramebufferHandle target, unsigned int n);
 
+	void readbackRenderTarget(RenderTargetHandle handle, unsigned int x, unsigned int y, unsigned int width, unsigned int height, ReadbackCallback callback);
+
 	void draw(unsigned int firstVertex, unsigned int vertexCount);
 	void drawIndexedInstanced(unsigned int vertexCount, unsigned int instanceCount);
 	void drawIndexedOffset(unsigned int vertexCount, unsigned int firstIndex);
+	void drawIndexedBaseVertex(unsigned int vertexCount, unsigned int firstIndex, int baseVertex);
 };
 
 
@@ -34,6 +34,7 @@ THE SOFTWARE.
 #include <spirv_glsl.hpp>
 
 #include "Renderer.h"
+#include "utils/Profiler.h"
 #include "utils/Utils.h"
 #include "RendererInternal.h"
 
@@ -191,6 +192,24 @@ static GLenum glTexFormat(Format format) {
 	case Format::Depth32Float:
 		return GL_DEPTH_COMPONENT32F;
 
+	case Format::BC1:
+		return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+
+	case Format::sBC1:
+		return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT;
+
+	case Format::BC3:
+		return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+
+	case Format::sBC3:
+		return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+
+	case Format::BC7:
+		return GL_COMPRESSED_RGBA_BPTC_UNORM;
+
+	case Format::sBC7:
+		return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+
 	}
 
 	UNREACHABLE();
@@ -245,6 +264,57 @@ static GLenum glTexBaseFormat(Format format) {
 		assert(false);
 		return GL_NONE;
 
+	case Format::BC1:
+	case Format::sBC1:
+	case Format::BC3:
+	case Format::sBC3:
+	case Format::BC7:
+	case Format::sBC7:
+		// compressed, uploaded with glCompressedTextureSubImage2D
+		assert(false);
+		return GL_NONE;
+
+	}
+
+	UNREACHABLE();
+}
+
+
+// type for pixel transfers
+static GLenum glTexType(Format format) {
+	switch (format) {
+	case Format::Invalid:
+		UNREACHABLE();
+
+	case Format::R8:
+	case Format::RG8:
+	case Format::RGB8:
+	case Format::RGBA8:
+	case Format::sRGBA8:
+		return GL_UNSIGNED_BYTE;
+
+	case Format::RG16Float:
+	case Format::RGBA16Float:
+		return GL_HALF_FLOAT;
+
+	case Format::RGBA32Float:
+		return GL_FLOAT;
+
+	case Format::Depth16:
+	case Format::Depth16S8:
+	case Format::Depth24S8:
+	case Format::Depth24X8:
+	case Format::Depth32Float:
+	case Format::BC1:
+	case Format::sBC1:
+	case Format::BC3:
+	case Format::sBC3:
+	case Format::BC7:
+	case Format::sBC7:
+		// not supposed to use this format here
+		assert(false);
+		return GL_NONE;
+
 	}
 
 	UNREACHABLE();
@@ -346,11 +416,11 @@ void GLAPIENTRY glDebugCallback(GLenum source, GLenum type, GLuint id, GLenum se
 	switch (severity)
 	{
 	case GL_DEBUG_SEVERITY_HIGH_ARB:
-		LOG("GL error from %s type %s: (%d) %s\n", errorSource(source), errorType(type), id, message);
+		LOG_ERROR("GL error from %s type %s: (%d) %s\n", errorSource(source), errorType(type), id, message);
 		break;
 
 	case GL_DEBUG_SEVERITY_MEDIUM_ARB:
-		LOG("GL warning from %s type %s: (%d) %s\n", errorSource(source), errorType(type), id, message);
+		LOG_WARNING("GL warning from %s type %s: (%d) %s\n", errorSource(source), errorType(type), id, message);
 		break;
 
 	case GL_DEBUG_SEVERITY_LOW_ARB:
@@ -371,7 +441,7 @@ void mergeShaderResources(ShaderResources &first, const ShaderResources &second)
 		if (i < first.ubos.size()) {
 			DSIndex other = first.ubos.at(i);
 			if (idx != other) {
-				LOG("ERROR: mismatch when merging shader UBOs, %u is (%u, %u) when expecting (%u, %u)\n", i, idx.set, idx.binding, other.set, other.binding);
+				LOG_ERROR("mismatch when merging shader UBOs, %u is (%u, %u) when expecting (%u, %u)\n", i, idx.set, idx.binding, other.set, other.binding);
 				throw std::runtime_error("resource mismatch");
 			}
 		} else {
@@ -384,7 +454,7 @@ void mergeShaderResources(ShaderResources &first, const ShaderResources &second)
 		if (i < first.ssbos.size()) {
 			DSIndex other = first.ssbos.at(i);
 			if (idx != other) {
-				LOG("ERROR: mismatch when merging shader SSBOs, %u is (%u, %u) when expecting (%u, %u)\n", i, idx.set, idx.binding, other.set, other.binding);
+				LOG_ERROR("mismatch when merging shader SSBOs, %u is (%u, %u) when expecting (%u, %u)\n", i, idx.set, idx.binding, other.set, other.binding);
 				throw std::runtime_error("resource mismatch");
 			}
 		} else {
@@ -397,7 +467,7 @@ void mergeShaderResources(ShaderResources &first, const ShaderResources &second)
 		if (i < first.textures.size()) {
 			DSIndex other = first.textures.at(i);
 			if (idx != other) {
-				LOG("ERROR: mismatch when merging shader textures, %u is (%u, %u) when expecting (%u, %u)\n", i, idx.set, idx.binding, other.set, other.binding);
+				LOG_ERROR("mismatch when merging shader textures, %u is (%u, %u) when expecting (%u, %u)\n", i, idx.set, idx.binding, other.set, other.binding);
 				throw std::runtime_error("resource mismatch");
 			}
 		} else {
@@ -410,7 +480,7 @@ void mergeShaderResources(ShaderResources &first, const ShaderResources &second)
 		if (i < first.samplers.size()) {
 			DSIndex other = first.samplers.at(i);
 			if (idx != other) {
-				LOG("ERROR: mismatch when merging shader textures, %u is (%u, %u) when expecting (%u, %u)\n", i, idx.set, idx.binding, other.set, other.binding);
+				LOG_ERROR("mismatch when merging shader textures, %u is (%u, %u) when expecting (%u, %u)\n", i, idx.set, idx.binding, other.set, other.binding);
 				throw std::runtime_error("resource mismatch");
 			}
 		} else {
@@ -424,6 +494,11 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 : RendererBase(desc)
 , window(nullptr)
 , context(nullptr)
+, headless(desc.headless)
+#ifdef GLEW_EGL
+, eglDisplay(EGL_NO_DISPLAY)
+, eglContext(EGL_NO_CONTEXT)
+#endif  // GLEW_EGL
 , ringBuffer(0)
 , persistentMapInUse(false)
 , persistentMapping(nullptr)
@@ -436,7 +511,15 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 {
 
 	// TODO: check return value
-	SDL_Init(SDL_INIT_TIMER | SDL_INIT_VIDEO);
+	if (headless) {
+		SDL_Init(SDL_INIT_TIMER | SDL_INIT_EVENTS);
+	} else {
+#if defined(GLEW_EGL) && defined(SDL_HINT_VIDEO_X11_FORCE_EGL)
+		// GLEW loads functions with eglGetProcAddress, window context must be EGL too
+		SDL_SetHint(SDL_HINT_VIDEO_X11_FORCE_EGL, "1");
+#endif  // GLEW_EGL
+		SDL_Init(SDL_INIT_TIMER | SDL_INIT_VIDEO);
+	}
 
 	// TODO: highdpi
 	// TODO: check errors
@@ -444,95 +527,109 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 	unsigned int glMajor = 4;
 	unsigned int glMinor = 5;
 
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, glMajor);
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, glMinor);
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
-	SDL_GL_SetAttribute(SDL_GL_FRAMEBUFFER_SRGB_CAPABLE, 1);
 	bool wantKHRDebug = debug || tracing;
-	if (wantKHRDebug) {
-		SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
-	}
 
-	SDL_DisplayMode mode;
-	memset(&mode, 0, sizeof(mode));
-	int numDisplays = SDL_GetNumVideoDisplays();
-	LOG("Number of displays detected: %i\n", numDisplays);
+	if (headless) {
+#ifdef GLEW_EGL
+		createHeadlessContext(glMajor, glMinor, wantKHRDebug);
+#else  // GLEW_EGL
+		LOG("Headless OpenGL needs EGL, build with OPENGL_EGL:=y\n");
+		throw std::runtime_error("Headless OpenGL needs EGL");
+#endif  // GLEW_EGL
+	} else {
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, glMajor);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, glMinor);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+		SDL_GL_SetAttribute(SDL_GL_FRAMEBUFFER_SRGB_CAPABLE, 1);
+		if (wantKHRDebug) {
+			SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
+		}
+
+		SDL_DisplayMode mode;
+		memset(&mode, 0, sizeof(mode));
+		int numDisplays = SDL_GetNumVideoDisplays();
+		LOG("Number of displays detected: %i\n", numDisplays);
 
-	for (int i = 0; i < numDisplays; i++) {
-		int retval = SDL_GetDesktopDisplayMode(i, &mode);
-		if (retval == 0) {
-			LOG("Desktop mode for display %d: %dx%d, refresh %d Hz\n", i, mode.w, mode.h, mode.refresh_rate);
-			currentRefreshRate = mode.refresh_rate;
-		} else {
-			LOG("Failed to get desktop display mode for display %d\n", i);
+		for (int i = 0; i < numDisplays; i++) {
+			int retval = SDL_GetDesktopDisplayMode(i, &mode);
+			if (retval == 0) {
+				LOG("Desktop mode for display %d: %dx%d, refresh %d Hz\n", i, mode.w, mode.h, mode.refresh_rate);
+				currentRefreshRate = mode.refresh_rate;
+			} else {
+				LOG("Failed to get desktop display mode for display %d\n", i);
+			}
+
+			int numModes = SDL_GetNumDisplayModes(i);
+			LOG("Number of display modes for display %i : %i\n", i, numModes);
+
+			for (int j = 0; j < numModes; j++) {
+				SDL_GetDisplayMode(i, j, &mode);
+				LOG("Display mode %i : width %i, height %i, BPP %i, refresh %u Hz\n", j, mode.w, mode.h, SDL_BITSPERPIXEL(mode.format), mode.refresh_rate);
+				maxRefreshRate = std::max(static_cast<unsigned int>(mode.refresh_rate), maxRefreshRate);
+			}
 		}
 
-		int numModes = SDL_GetNumDisplayModes(i);
-		LOG("Number of display modes for display %i : %i\n", i, numModes);
+		int flags = SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE;
 
-		for (int j = 0; j < numModes; j++) {
-			SDL_GetDisplayMode(i, j, &mode);
-			LOG("Display mode %i : width %i, height %i, BPP %i, refresh %u Hz\n", j, mode.w, mode.h, SDL_BITSPERPIXEL(mode.format), mode.refresh_rate);
-			maxRefreshRate = std::max(static_cast<unsigned int>(mode.refresh_rate), maxRefreshRate);
+		if (desc.swapchain.fullscreen) {
+			flags |= SDL_WINDOW_FULLSCREEN_DESKTOP;
 		}
-	}
 
-	int flags = SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE;
+		window = SDL_CreateWindow("SMAA Demo", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, desc.swapchain.width, desc.swapchain.height, flags);
 
-	if (desc.swapchain.fullscreen) {
-		flags |= SDL_WINDOW_FULLSCREEN_DESKTOP;
-	}
+		if (!window) {
+			LOG("SDL_CreateWindow failed: %s\n", SDL_GetError());
+			throw std::runtime_error("SDL_CreateWindow failed");
+		}
 
-	window = SDL_CreateWindow("SMAA Demo", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, desc.swapchain.width, desc.swapchain.height, flags);
+		context = SDL_GL_CreateContext(window);
 
-	if (!window) {
-		LOG("SDL_CreateWindow failed: %s\n", SDL_GetError());
-		throw std::runtime_error("SDL_CreateWindow failed");
-	}
+		{
+			int value = -1;
+			SDL_GL_GetAttribute(SDL_GL_FRAMEBUFFER_SRGB_CAPABLE, &value);
+			LOG("sRGB framebuffer: %d\n", value);
+			features.sRGBFramebuffer = value;
+		}
 
-	context = SDL_GL_CreateContext(window);
+		bool vsync = false;
+		int retval = 0;
+		switch (desc.swapchain.vsync) {
+		case VSync::LateSwapTear:
+			retval = SDL_GL_SetSwapInterval(-1);
+			if (retval != 0) {
+				LOG("Failed to set late swap tearing vsync: %s\n", SDL_GetError());
+			} else {
+				vsync = true;
+				break;
+			}
+			// fallthrough
 
-	{
-		int value = -1;
-		SDL_GL_GetAttribute(SDL_GL_FRAMEBUFFER_SRGB_CAPABLE, &value);
-		LOG("sRGB framebuffer: %d\n", value);
-		features.sRGBFramebuffer = value;
-	}
-
-	bool vsync = false;
-	int retval = 0;
-	switch (desc.swapchain.vsync) {
-	case VSync::LateSwapTear:
-		retval = SDL_GL_SetSwapInterval(-1);
-		if (retval != 0) {
-			LOG("Failed to set late swap tearing vsync: %s\n", SDL_GetError());
-		} else {
-			vsync = true;
+		case VSync::On:
+			retval = SDL_GL_SetSwapInterval(1);
+			if (retval != 0) {
+				LOG("Failed to set vsync: %s\n", SDL_GetError());
+			} else {
+				vsync = true;
+			}
 			break;
-		}
-		// fallthrough
 
-	case VSync::On:
-		retval = SDL_GL_SetSwapInterval(1);
-		if (retval != 0) {
-			LOG("Failed to set vsync: %s\n", SDL_GetError());
-		} else {
-			vsync = true;
-		}
-		break;
+		case VSync::Off:
+			// nothing here
+			break;
 
-	case VSync::Off:
-		// nothing here
-		break;
+		}
 
+		LOG("VSync is %s\n", vsync ? "on" : "off");
 	}
 
-	LOG("VSync is %s\n", vsync ? "on" : "off");
-
 	// TODO: call SDL_GL_GetDrawableSize, log GL attributes etc.
 
 	glewExperimental = true;
-	glewInit();
+	GLenum glewResult = glewInit();
+	if (glewResult != GLEW_OK) {
+		LOG("glewInit failed: %s\n", glewGetErrorString(glewResult));
+		throw std::runtime_error("glewInit failed");
+	}
 
 	// TODO: check extensions
 	// at least direct state access, texture storage
@@ -545,6 +642,18 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 		LOG("Shader storage buffer not supported\n");
 	}
 
+	if (GLEW_VERSION_3_3 || GLEW_ARB_timer_query) {
+		GLint bits = 0;
+		glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+		features.timestamps = (bits > 0);
+	}
+	LOG("Timestamp queries %s\n", features.timestamps ? "supported" : "not supported");
+
+	// BC1 and BC3 come from S3TC, their sRGB versions from EXT_texture_sRGB and BC7 from BPTC
+	features.textureCompressionBC = GLEW_EXT_texture_compression_s3tc && GLEW_EXT_texture_sRGB
+	                             && (GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc);
+	LOG("BC texture compression %s\n", features.textureCompressionBC ? "supported" : "not supported");
+
 	if (!GLEW_ARB_direct_state_access) {
 		LOG("ARB_direct_state_access not found\n");
 		throw std::runtime_error("ARB_direct_state_access not found");
@@ -613,9 +722,115 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 	recreateSwapchain();
 	recreateRingBuffer(desc.ephemeralRingBufSize);
 
-	// swap once to get better traces
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-	SDL_GL_SwapWindow(window);
+	if (!headless) {
+		// swap once to get better traces
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+		SDL_GL_SwapWindow(window);
+	}
+}
+
+
+#ifdef GLEW_EGL
+
+
+void RendererImpl::createHeadlessContext(unsigned int glMajor, unsigned int glMinor, bool wantKHRDebug) {
+	// prefer surfaceless platform, doesn't need any display server
+	const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	if (clientExtensions && strstr(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+		auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+		if (getPlatformDisplay) {
+			eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+		}
+	}
+
+	if (eglDisplay == EGL_NO_DISPLAY) {
+		LOG("Surfaceless EGL platform not available, using default display\n");
+		eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		if (eglDisplay == EGL_NO_DISPLAY) {
+			LOG("eglGetDisplay failed\n");
+			throw std::runtime_error("eglGetDisplay failed");
+		}
+	}
+
+	EGLint eglMajor = 0, eglMinor = 0;
+	if (!eglInitialize(eglDisplay, &eglMajor, &eglMinor)) {
+		LOG("eglInitialize failed: 0x%04x\n", eglGetError());
+		throw std::runtime_error("eglInitialize failed");
+	}
+	LOG("EGL version %d.%d, vendor \"%s\"\n", eglMajor, eglMinor, eglQueryString(eglDisplay, EGL_VENDOR));
+
+	const char *displayExtensions = eglQueryString(eglDisplay, EGL_EXTENSIONS);
+	if (!displayExtensions || !strstr(displayExtensions, "EGL_KHR_create_context")) {
+		LOG("EGL_KHR_create_context not found\n");
+		throw std::runtime_error("EGL_KHR_create_context not found");
+	}
+
+	// without this we'd need a pbuffer surface which is never used anyway
+	if (!strstr(displayExtensions, "EGL_KHR_surfaceless_context")) {
+		LOG("EGL_KHR_surfaceless_context not found\n");
+		throw std::runtime_error("EGL_KHR_surfaceless_context not found");
+	}
+
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		LOG("eglBindAPI failed: 0x%04x\n", eglGetError());
+		throw std::runtime_error("eglBindAPI failed");
+	}
+
+	const EGLint configAttribs[] = {
+		  EGL_SURFACE_TYPE,    EGL_PBUFFER_BIT
+		, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT
+		, EGL_NONE
+	};
+
+	EGLConfig config   = nullptr;
+	EGLint numConfigs  = 0;
+	if (!eglChooseConfig(eglDisplay, configAttribs, &config, 1, &numConfigs) || numConfigs == 0) {
+		LOG("eglChooseConfig failed: 0x%04x\n", eglGetError());
+		throw std::runtime_error("eglChooseConfig failed");
+	}
+
+	const EGLint contextAttribs[] = {
+		  EGL_CONTEXT_MAJOR_VERSION_KHR,       static_cast<EGLint>(glMajor)
+		, EGL_CONTEXT_MINOR_VERSION_KHR,       static_cast<EGLint>(glMinor)
+		, EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR
+		, EGL_CONTEXT_FLAGS_KHR,               wantKHRDebug ? EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR : 0
+		, EGL_NONE
+	};
+
+	eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttribs);
+	if (eglContext == EGL_NO_CONTEXT) {
+		LOG("eglCreateContext failed: 0x%04x\n", eglGetError());
+		throw std::runtime_error("eglCreateContext failed");
+	}
+
+	if (!eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext)) {
+		LOG("eglMakeCurrent failed: 0x%04x\n", eglGetError());
+		throw std::runtime_error("eglMakeCurrent failed");
+	}
+
+	// nothing is displayed so this only affects what presentFrame would do
+	features.sRGBFramebuffer = true;
+
+	LOG("Headless EGL context created\n");
+}
+
+
+#endif  // GLEW_EGL
+
+
+glm::uvec2 RendererImpl::getDrawableSize(const SwapchainDesc &desc) const {
+	if (headless) {
+		// no window, use whatever size was asked for
+		return glm::uvec2(desc.width, desc.height);
+	}
+
+	int w = -1, h = -1;
+	SDL_GL_GetDrawableSize(window, &w, &h);
+	if (w <= 0 || h <= 0) {
+		throw std::runtime_error("drawable size is negative");
+	}
+
+	return glm::uvec2(w, h);
 }
 
 
@@ -698,6 +913,12 @@ RendererImpl::~RendererImpl() {
 	}
 	frames.clear();
 
+	for (auto &r : freeReadbacks) {
+		assert(r.pbo != 0);
+		glDeleteBuffers(1, &r.pbo);
+		r.pbo = 0;
+	}
+	freeReadbacks.clear();
 
 	if (persistentMapInUse) {
 		glUnmapNamedBuffer(ringBuffer);
@@ -710,10 +931,12 @@ RendererImpl::~RendererImpl() {
 	ringBuffer = 0;
 
 	framebuffers.clearWith([](Framebuffer &fb) {
-		assert(fb.fbo != 0);
+		assert(fb.fbo != 0 || fb.swapchain);
 		assert(fb.numSamples > 0);
-		glDeleteFramebuffers(1, &fb.fbo);
-		fb.fbo = 0;
+		if (fb.fbo != 0) {
+			glDeleteFramebuffers(1, &fb.fbo);
+			fb.fbo = 0;
+		}
 		fb.numSamples = 0;
 	} );
 
@@ -721,6 +944,11 @@ RendererImpl::~RendererImpl() {
 	} );
 
 	renderTargets.clearWith([this](RenderTarget &rt) {
+		if (rt.swapchain) {
+			assert(!rt.texture);
+			rt.swapchain = false;
+			return;
+		}
 		assert(rt.texture);
 
 		if (rt.readFBO != 0) {
@@ -784,8 +1012,18 @@ RendererImpl::~RendererImpl() {
 	glBindVertexArray(0);
 	glDeleteVertexArrays(1, &vao);
 
-	SDL_GL_DeleteContext(context);
-	SDL_DestroyWindow(window);
+	if (headless) {
+#ifdef GLEW_EGL
+		eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(eglDisplay, eglContext);
+		eglContext = EGL_NO_CONTEXT;
+		eglTerminate(eglDisplay);
+		eglDisplay = EGL_NO_DISPLAY;
+#endif  // GLEW_EGL
+	} else {
+		SDL_GL_DeleteContext(context);
+		SDL_DestroyWindow(window);
+	}
 
 	SDL_Quit();
 }
@@ -985,7 +1223,7 @@ static void checkShaderResources(const std::string &name, const ShaderResources
 	for (const auto &r : resources.ubos) {
 		auto type = layoutMap.at(r);
 		if (type != DescriptorType::UniformBuffer) {
-			LOG("ERROR: set %u binding %u type %s in shader \"%s\" doesn't match ds layout (%s)\n", r.set, r.binding, descriptorTypeName(DescriptorType::UniformBuffer), name.c_str(), descriptorTypeName(type));
+			LOG_ERROR("set %u binding %u type %s in shader \"%s\" doesn't match ds layout (%s)\n", r.set, r.binding, descriptorTypeName(DescriptorType::UniformBuffer), name.c_str(), descriptorTypeName(type));
 			throw std::runtime_error("descriptor set layout mismatch");
 		}
 	}
@@ -993,7 +1231,7 @@ static void checkShaderResources(const std::string &name, const ShaderResources
 	for (const auto &r : resources.ssbos) {
 		auto type = layoutMap.at(r);
 		if (type != DescriptorType::StorageBuffer) {
-			LOG("ERROR: set %u binding %u type %s in shader \"%s\" doesn't match ds layout (%s)\n", r.set, r.binding, descriptorTypeName(DescriptorType::StorageBuffer), name.c_str(), descriptorTypeName(type));
+			LOG_ERROR("set %u binding %u type %s in shader \"%s\" doesn't match ds layout (%s)\n", r.set, r.binding, descriptorTypeName(DescriptorType::StorageBuffer), name.c_str(), descriptorTypeName(type));
 			throw std::runtime_error("descriptor set layout mismatch");
 		}
 	}
@@ -1001,7 +1239,7 @@ static void checkShaderResources(const std::string &name, const ShaderResources
 	for (const auto &r : resources.textures) {
 		auto type = layoutMap.at(r);
 		if (type != DescriptorType::Texture && type != DescriptorType::CombinedSampler) {
-			LOG("ERROR: set %u binding %u type texture in shader \"%s\" doesn't match ds layout (%s)\n", r.set, r.binding, name.c_str(), descriptorTypeName(type));
+			LOG_ERROR("set %u binding %u type texture in shader \"%s\" doesn't match ds layout (%s)\n", r.set, r.binding, name.c_str(), descriptorTypeName(type));
 			throw std::runtime_error("descriptor set layout mismatch");
 		}
 	}
@@ -1009,7 +1247,7 @@ static void checkShaderResources(const std::string &name, const ShaderResources
 	for (const auto &r : resources.samplers) {
 		auto type = layoutMap.at(r);
 		if (type != DescriptorType::Sampler && type != DescriptorType::CombinedSampler) {
-			LOG("ERROR: set %u binding %u type sampler in shader \"%s\" doesn't match ds layout (%s)\n", r.set, r.binding, name.c_str(), descriptorTypeName(type));
+			LOG_ERROR("set %u binding %u type sampler in shader \"%s\" doesn't match ds layout (%s)\n", r.set, r.binding, name.c_str(), descriptorTypeName(type));
 			throw std::runtime_error("descriptor set layout mismatch");
 		}
 	}
@@ -1041,6 +1279,8 @@ static GLenum blendFunc(BlendFunc b) {
 
 
 PipelineHandle RendererImpl::createPipeline(const PipelineDesc &desc) {
+	PROFILE_FUNCTION();
+
 	assert(!desc.vertexShaderName.empty());
 	assert(!desc.fragmentShaderName.empty());
 	assert(desc.renderPass_);
@@ -1152,9 +1392,19 @@ FramebufferHandle RendererImpl::createFramebuffer(const FramebufferDesc &desc) {
 	auto &renderPass = renderPasses.get(desc.renderPass_);
 #endif  // NDEBUG
 
+	// the default framebuffer has its own depth buffer, can't attach ours
+	bool swapchain = desc.colors_[0] && renderTargets.get(desc.colors_[0]).swapchain;
+	if (swapchain && (desc.colors_[1] || desc.depthStencil_)) {
+		LOG("Framebuffer \"%s\" has other attachments besides swapchain\n", desc.name_.c_str());
+		throw std::runtime_error("Swapchain framebuffer can't have other attachments");
+	}
+
 	auto result = framebuffers.add();
 	Framebuffer &fb = result.first;
-	glCreateFramebuffers(1, &fb.fbo);
+	fb.swapchain = swapchain;
+	if (!swapchain) {
+		glCreateFramebuffers(1, &fb.fbo);
+	}
 
 	unsigned int width UNUSED = 0, height UNUSED = 0;
 
@@ -1181,7 +1431,7 @@ FramebufferHandle RendererImpl::createFramebuffer(const FramebufferDesc &desc) {
 		assert(colorRT.numSamples > 0);
 		assert(colorRT.numSamples <= static_cast<unsigned int>(glValues[GL_MAX_COLOR_TEXTURE_SAMPLES]));
 		assert(colorRT.numSamples == renderPass.numSamples);
-		assert(colorRT.texture);
+		assert(colorRT.texture || colorRT.swapchain);
 		assert(colorRT.format == renderPass.desc.colorRTs_[i].format);
 		fb.renderPass = desc.renderPass_;
 		fb.numSamples = colorRT.numSamples;
@@ -1192,6 +1442,10 @@ FramebufferHandle RendererImpl::createFramebuffer(const FramebufferDesc &desc) {
 		fb.width      = colorRT.width;
 		fb.height     = colorRT.height;
 
+		if (colorRT.swapchain) {
+			continue;
+		}
+
 		const auto &colorRTtex = textures.get(colorRT.texture);
 		assert(colorRTtex.renderTarget);
 		assert(colorRTtex.tex != 0);
@@ -1199,7 +1453,9 @@ FramebufferHandle RendererImpl::createFramebuffer(const FramebufferDesc &desc) {
 		glNamedFramebufferTexture(fb.fbo, GL_COLOR_ATTACHMENT0 + i, colorRTtex.tex, 0);
 	}
 
-	glNamedFramebufferDrawBuffers(fb.fbo, numColorAttachments, drawBuffers);
+	if (!swapchain) {
+		glNamedFramebufferDrawBuffers(fb.fbo, numColorAttachments, drawBuffers);
+	}
 
 	if (desc.depthStencil_) {
 		const auto &depthRT = renderTargets.get(desc.depthStencil_);
@@ -1222,7 +1478,7 @@ FramebufferHandle RendererImpl::createFramebuffer(const FramebufferDesc &desc) {
 
 	assert(isRenderPassCompatible(renderPass, fb));
 
-	if (tracing) {
+	if (tracing && !swapchain) {
 		glObjectLabel(GL_FRAMEBUFFER, fb.fbo, desc.name_.size(), desc.name_.c_str());
 	}
 
@@ -1273,6 +1529,30 @@ RenderTargetHandle RendererImpl::createRenderTarget(const RenderTargetDesc &desc
 	assert(isPow2(desc.numSamples_));
 	assert(!desc.name_.empty());
 
+	if (desc.swapchain_) {
+		// default framebuffer only matches a plain sRGB target of window size
+		if (!headless && !swapchainRT
+		    && desc.format_ == Format::sRGBA8 && features.sRGBFramebuffer
+		    && desc.numSamples_ == 1
+		    && desc.additionalViewFormat_ == Format::Invalid
+		    && desc.width_  == drawableSize.x
+		    && desc.height_ == drawableSize.y)
+		{
+			auto result = renderTargets.add();
+			RenderTarget &rt = result.first;
+			rt.width      = desc.width_;
+			rt.height     = desc.height_;
+			rt.format     = desc.format_;
+			rt.numSamples = 1;
+			rt.swapchain  = true;
+			swapchainRT   = result.second;
+
+			return result.second;
+		}
+
+		LOG("Rendertarget \"%s\" can't use the default framebuffer, presentFrame will copy it\n", desc.name_.c_str());
+	}
+
 	GLuint id = 0;
 	GLenum target;
 	if (desc.numSamples_ > 1) {
@@ -1330,7 +1610,11 @@ SamplerHandle RendererImpl::createSampler(const SamplerDesc &desc) {
 	Sampler &sampler = result.first;
 	glCreateSamplers(1, &sampler.sampler);
 
-	glSamplerParameteri(sampler.sampler, GL_TEXTURE_MIN_FILTER, (desc.min == FilterMode::Nearest) ? GL_NEAREST: GL_LINEAR);
+	if (desc.mipmaps_) {
+		glSamplerParameteri(sampler.sampler, GL_TEXTURE_MIN_FILTER, (desc.min == FilterMode::Nearest) ? GL_NEAREST_MIPMAP_NEAREST : GL_LINEAR_MIPMAP_LINEAR);
+	} else {
+		glSamplerParameteri(sampler.sampler, GL_TEXTURE_MIN_FILTER, (desc.min == FilterMode::Nearest) ? GL_NEAREST: GL_LINEAR);
+	}
 	glSamplerParameteri(sampler.sampler, GL_TEXTURE_MAG_FILTER, (desc.mag == FilterMode::Nearest) ? GL_NEAREST: GL_LINEAR);
 	glSamplerParameteri(sampler.sampler, GL_TEXTURE_WRAP_S,     (desc.wrapMode == WrapMode::Clamp) ? GL_CLAMP_TO_EDGE : GL_REPEAT);
 	glSamplerParameteri(sampler.sampler, GL_TEXTURE_WRAP_T,     (desc.wrapMode == WrapMode::Clamp) ? GL_CLAMP_TO_EDGE : GL_REPEAT);
@@ -1344,21 +1628,104 @@ SamplerHandle RendererImpl::createSampler(const SamplerDesc &desc) {
 
 
 TextureHandle RendererImpl::createTexture(const TextureDesc &desc) {
+	std::array<const void *, MAX_TEXTURE_MIPLEVELS> mipData;
+	mipData.fill(nullptr);
+	for (unsigned int i = 0; i < desc.numMips_; i++) {
+		assert(desc.mipData_[i].data != nullptr);
+		assert(desc.mipData_[i].size != 0);
+		mipData[i] = desc.mipData_[i].data;
+	}
+
+	return createTextureInternal(desc, mipData);
+}
+
+
+TextureUpload RendererImpl::beginTextureUpload(const TextureDesc &desc) {
+	if (isBlockFormat(desc.format_) && !features.textureCompressionBC) {
+		LOG("Texture \"%s\" has format %s but BC texture compression is not supported\n", desc.name_.c_str(), formatName(desc.format_));
+		throw std::runtime_error("BC texture compression not supported");
+	}
+
+	TextureUpload upload;
+	initTextureUpload(upload, desc);
+
+	unsigned int totalSize = 0;
+	for (unsigned int i = 0; i < upload.numMips; i++) {
+		totalSize += upload.mips[i].size;
+	}
+
+	GLuint pbo = 0;
+	glCreateBuffers(1, &pbo);
+	glNamedBufferStorage(pbo, totalSize, nullptr, GL_MAP_WRITE_BIT);
+	char *mapping = reinterpret_cast<char *>(glMapNamedBufferRange(pbo, 0, totalSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+	if (!mapping) {
+		LOG("Failed to map texture upload buffer of %u bytes\n", totalSize);
+		glDeleteBuffers(1, &pbo);
+		throw std::runtime_error("Failed to map texture upload buffer");
+	}
+
+	unsigned int offset = 0;
+	for (unsigned int i = 0; i < upload.numMips; i++) {
+		upload.mips[i].data = mapping + offset;
+		offset             += upload.mips[i].size;
+	}
+	upload.id_ = pbo;
+
+	return upload;
+}
+
+
+TextureHandle RendererImpl::endTextureUpload(TextureUpload &upload) {
+	GLuint pbo = upload.id_;
+	assert(pbo != 0);
+	glUnmapNamedBuffer(pbo);
+
+	// with an unpack buffer bound the data pointers are offsets into it
+	std::array<const void *, MAX_TEXTURE_MIPLEVELS> offsets;
+	offsets.fill(nullptr);
+	const char *base = reinterpret_cast<const char *>(upload.mips[0].data);
+	for (unsigned int i = 0; i < upload.numMips; i++) {
+		uintptr_t offset = reinterpret_cast<const char *>(upload.mips[i].data) - base;
+		offsets[i]       = reinterpret_cast<const void *>(offset);
+		upload.mips[i].data = nullptr;
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	TextureHandle handle = createTextureInternal(upload.desc_, offsets);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	// driver keeps it alive until the copies are done
+	glDeleteBuffers(1, &pbo);
+	upload.id_ = 0;
+
+	return handle;
+}
+
+
+TextureHandle RendererImpl::createTextureInternal(const TextureDesc &desc, const std::array<const void *, MAX_TEXTURE_MIPLEVELS> &mipData) {
 	assert(desc.width_   > 0);
 	assert(desc.height_  > 0);
 	assert(desc.numMips_ > 0);
 
+	bool compressed = isBlockFormat(desc.format_);
+	if (compressed && !features.textureCompressionBC) {
+		LOG("Texture \"%s\" has format %s but BC texture compression is not supported\n", desc.name_.c_str(), formatName(desc.format_));
+		throw std::runtime_error("BC texture compression not supported");
+	}
+
 	GLuint texture = 0;
 	GLenum target = GL_TEXTURE_2D;
 	glCreateTextures(target, 1, &texture);
-	glTextureStorage2D(texture, 1, glTexFormat(desc.format_), desc.width_, desc.height_);
+	glTextureStorage2D(texture, desc.numMips_, glTexFormat(desc.format_), desc.width_, desc.height_);
 	glTextureParameteri(texture, GL_TEXTURE_MAX_LEVEL, desc.numMips_ - 1);
 	unsigned int w = desc.width_, h = desc.height_;
 
 	for (unsigned int i = 0; i < desc.numMips_; i++) {
-		assert(desc.mipData_[i].data != nullptr);
-		assert(desc.mipData_[i].size != 0);
-		glTextureSubImage2D(texture, i, 0, 0, w, h, glTexBaseFormat(desc.format_), GL_UNSIGNED_BYTE, desc.mipData_[i].data);
+		if (compressed) {
+			glCompressedTextureSubImage2D(texture, i, 0, 0, w, h, glTexFormat(desc.format_), mipLevelSize(desc.format_, w, h), mipData[i]);
+		} else {
+			glTextureSubImage2D(texture, i, 0, 0, w, h, glTexBaseFormat(desc.format_), GL_UNSIGNED_BYTE, mipData[i]);
+		}
 
 		w = std::max(w / 2, 1u);
 		h = std::max(h / 2, 1u);
@@ -1396,6 +1763,7 @@ DSLayoutHandle RendererImpl::createDescriptorSetLayout(const DescriptorLayout *l
 
 TextureHandle RendererImpl::getRenderTargetTexture(RenderTargetHandle handle) {
 	const auto &rt = renderTargets.get(handle);
+	assert(!rt.swapchain);
 
 #ifndef NDEBUG
 	const auto &tex = textures.get(rt.texture);
@@ -1436,10 +1804,12 @@ void RendererImpl::deleteBuffer(BufferHandle handle) {
 
 void RendererImpl::deleteFramebuffer(FramebufferHandle handle) {
 	framebuffers.removeWith(handle, [](Framebuffer &fb) {
-		assert(fb.fbo != 0);
+		assert(fb.fbo != 0 || fb.swapchain);
 		assert(fb.numSamples > 0);
-		glDeleteFramebuffers(1, &fb.fbo);
-		fb.fbo = 0;
+		if (fb.fbo != 0) {
+			glDeleteFramebuffers(1, &fb.fbo);
+			fb.fbo = 0;
+		}
 		fb.numSamples = 0;
 	} );
 }
@@ -1453,10 +1823,19 @@ void RendererImpl::deleteRenderPass(RenderPassHandle handle) {
 
 void RendererImpl::deleteRenderTarget(RenderTargetHandle &handle) {
 	renderTargets.removeWith(handle, [this](RenderTarget &rt) {
-		assert(rt.texture);
 		assert(rt.numSamples > 0);
-
 		rt.numSamples = 0;
+
+		if (rt.swapchain) {
+			// nothing allocated
+			assert(!rt.texture);
+			assert(rt.readFBO == 0);
+			this->swapchainRT = RenderTargetHandle();
+			rt.swapchain      = false;
+			return;
+		}
+
+		assert(rt.texture);
 		if (rt.readFBO != 0) {
 			glDeleteFramebuffers(1, &rt.readFBO);
 			rt.readFBO = 0;
@@ -1519,7 +1898,9 @@ void RendererImpl::setSwapchainDesc(const SwapchainDesc &desc) {
 
 	if (swapchainDesc.fullscreen != desc.fullscreen) {
 		changed = true;
-		if (desc.fullscreen) {
+		if (headless) {
+			// nothing to do
+		} else if (desc.fullscreen) {
 			// TODO: check return val?
 			SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN_DESKTOP);
 			LOG("Fullscreen\n");
@@ -1532,7 +1913,8 @@ void RendererImpl::setSwapchainDesc(const SwapchainDesc &desc) {
 	if (swapchainDesc.vsync != desc.vsync) {
 		changed = true;
 		int retval = 0;
-		switch (desc.vsync) {
+		// headless never waits for display
+		switch (headless ? VSync::Off : desc.vsync) {
 		case VSync::LateSwapTear:
 			// enable vsync, using late swap tearing if possible
 			retval = SDL_GL_SetSwapInterval(-1);
@@ -1561,21 +1943,15 @@ void RendererImpl::setSwapchainDesc(const SwapchainDesc &desc) {
 		changed = true;
 	}
 
-	int w = -1, h = -1;
-	SDL_GL_GetDrawableSize(window, &w, &h);
-	if (w <= 0 || h <= 0) {
-		throw std::runtime_error("drawable size is negative");
-	}
-
-	if (static_cast<unsigned int>(w) != drawableSize.x
-	 || static_cast<unsigned int>(h) != drawableSize.y) {
+	glm::uvec2 size = getDrawableSize(desc);
+	if (size != drawableSize) {
 		changed = true;
 	}
 
 	if (changed) {
 		wantedSwapchain = desc;
 		swapchainDirty  = true;
-		drawableSize    = glm::uvec2(w, h);
+		drawableSize    = size;
 	}
 }
 
@@ -1583,16 +1959,14 @@ void RendererImpl::setSwapchainDesc(const SwapchainDesc &desc) {
 void RendererImpl::recreateSwapchain() {
 	assert(swapchainDirty);
 
-	int w = -1, h = -1;
-	SDL_GL_GetDrawableSize(window, &w, &h);
-	if (w <= 0 || h <= 0) {
-		throw std::runtime_error("drawable size is negative");
+	drawableSize = getDrawableSize(wantedSwapchain);
+	if (drawableSize.x == 0 || drawableSize.y == 0) {
+		LOG("Swapchain size is zero\n");
+		throw std::runtime_error("Swapchain size is zero");
 	}
 
-	drawableSize = glm::uvec2(w, h);
-
-	swapchainDesc.width  = w;
-	swapchainDesc.height = h;
+	swapchainDesc.width  = drawableSize.x;
+	swapchainDesc.height = drawableSize.y;
 
 	unsigned int numImages = wantedSwapchain.numFrames;
 	numImages = std::max(numImages, 1U);
@@ -1635,6 +2009,8 @@ MemoryStats RendererImpl::getMemStats() const {
 
 
 void RendererImpl::beginFrame() {
+	PROFILE_FUNCTION();
+
 #ifndef NDEBUG
 	assert(!inFrame);
 	inFrame       = true;
@@ -1678,48 +2054,53 @@ void RendererImpl::beginFrame() {
 
 
 void RendererImpl::presentFrame(RenderTargetHandle image) {
+	PROFILE_FUNCTION();
+
 #ifndef NDEBUG
 	assert(inFrame);
 	inFrame = false;
 #endif //  NDEBUG
+	assert(openTimingScopes.empty());
 
 	auto &frame = frames.at(currentFrameIdx);
 
 	auto &rt = renderTargets.get(image);
 	assert(rt.currentLayout == Layout::TransferSrc);
 
-	unsigned int width  = rt.width;
-	unsigned int height = rt.height;
+	// headless has nothing to show, caller reads back rendertargets it wants
+	if (!headless) {
+		unsigned int width  = rt.width;
+		unsigned int height = rt.height;
 
-	// TODO: only if enabled
-	glDisable(GL_SCISSOR_TEST);
-	if (features.sRGBFramebuffer) {
-		glEnable(GL_FRAMEBUFFER_SRGB);
-	} else {
-		glDisable(GL_FRAMEBUFFER_SRGB);
-	}
+		// TODO: only if enabled
+		glDisable(GL_SCISSOR_TEST);
+		if (features.sRGBFramebuffer) {
+			glEnable(GL_FRAMEBUFFER_SRGB);
+		} else {
+			glDisable(GL_FRAMEBUFFER_SRGB);
+		}
 
 
-	// TODO: necessary? should do linear blit?
-	assert(width  == swapchainDesc.width);
-	assert(height == swapchainDesc.height);
+		// TODO: necessary? should do linear blit?
+		assert(width  == swapchainDesc.width);
+		assert(height == swapchainDesc.height);
 
-	assert(width > 0);
-	assert(height > 0);
+		assert(width > 0);
+		assert(height > 0);
 
-	if (rt.readFBO == 0) {
-		glCreateFramebuffers(1, &rt.readFBO);
-		const auto &colorTex = textures.get(rt.texture);
-		assert(colorTex.renderTarget);
-		assert(colorTex.tex != 0);
-		glNamedFramebufferTexture(rt.readFBO, GL_COLOR_ATTACHMENT0, colorTex.tex, 0);
-	}
-	glBindFramebuffer(GL_READ_FRAMEBUFFER, rt.readFBO);
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		// already rendered to the default framebuffer, nothing to copy
+		if (!rt.swapchain) {
+			if (rt.readFBO == 0) {
+				createReadFBO(rt);
+			}
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, rt.readFBO);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
 
-	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+			glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		}
 
-	SDL_GL_SwapWindow(window);
+		SDL_GL_SwapWindow(window);
+	}
 
 	frame.fence        = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 	frame.usedRingBufPtr = ringBufPtr;
@@ -1731,6 +2112,8 @@ void RendererImpl::presentFrame(RenderTargetHandle image) {
 
 
 void RendererImpl::waitForFrame(unsigned int frameIdx) {
+	PROFILE_FUNCTION();
+
 	assert(frameIdx < frames.size());
 
 	Frame &frame = frames.at(frameIdx);
@@ -1748,6 +2131,20 @@ void RendererImpl::waitForFrame(unsigned int frameIdx) {
 	glDeleteSync(frame.fence);
 	frame.fence = nullptr;
 
+	if (frame.numTimestamps > 0) {
+		// fence has signaled so this shouldn't stall
+		auto &timestamps = timestampResults;
+		timestamps.resize(frame.numTimestamps);
+		for (unsigned int i = 0; i < frame.numTimestamps; i++) {
+			GLuint64 t = 0;
+			glGetQueryObjectui64v(frame.timestampQueries.at(i), GL_QUERY_RESULT, &t);
+			timestamps[i] = t;
+		}
+		resolveTimingScopes(frame.lastFrameNum, frame.timingScopes, timestamps);
+		frame.numTimestamps = 0;
+	}
+	frame.timingScopes.clear();
+
 	for (auto handle : frame.ephemeralBuffers) {
 		Buffer &buffer = buffers.get(handle);
 		if (buffer.ringBufferAlloc) {
@@ -1770,11 +2167,91 @@ void RendererImpl::waitForFrame(unsigned int frameIdx) {
 	frame.outstanding = false;
 	lastSyncedFrame = std::max(lastSyncedFrame, frame.lastFrameNum);
 	lastSyncedRingBufPtr = std::max(lastSyncedRingBufPtr, frame.usedRingBufPtr);
+	retireFrameArena(frameIdx);
+
+	// fence has signaled so mapping doesn't stall
+	for (auto &r : frame.readbacks) {
+		const char *mapped = reinterpret_cast<const char *>(glMapNamedBufferRange(r.pbo, 0, r.result.size, GL_MAP_READ_BIT));
+		assert(mapped);
+
+		// GL rows start from the bottom, flip to match other renderers
+		unsigned int rowSize = r.result.width * formatSize(r.result.format);
+		readbackData.resize(r.result.size);
+		for (unsigned int row = 0; row < r.result.height; row++) {
+			memcpy(&readbackData[row * rowSize], mapped + (r.result.height - 1 - row) * rowSize, rowSize);
+		}
+		glUnmapNamedBuffer(r.pbo);
+
+		r.result.data = &readbackData[0];
+		r.callback(r.result);
+
+		r.callback = nullptr;
+		r.result   = ReadbackResult();
+		freeReadbacks.push_back(std::move(r));
+	}
+	frame.readbacks.clear();
 }
 
 
-void RendererImpl::deleteFrameInternal(Frame &f UNUSED) {
+Readback RendererImpl::allocateReadback(unsigned int size) {
+	// reuse a previous buffer if one is big enough
+	for (auto it = freeReadbacks.begin(); it != freeReadbacks.end(); it++) {
+		if (it->bufferSize >= size) {
+			Readback r = std::move(*it);
+			freeReadbacks.erase(it);
+			return r;
+		}
+	}
+
+	Readback r;
+	glCreateBuffers(1, &r.pbo);
+	glNamedBufferStorage(r.pbo, size, nullptr, GL_MAP_READ_BIT | GL_CLIENT_STORAGE_BIT);
+	r.bufferSize = size;
+
+	return r;
+}
+
+
+void RendererImpl::createReadFBO(RenderTarget &rt) {
+	assert(rt.readFBO == 0);
+
+	glCreateFramebuffers(1, &rt.readFBO);
+	const auto &colorTex = textures.get(rt.texture);
+	assert(colorTex.renderTarget);
+	assert(colorTex.tex != 0);
+	glNamedFramebufferTexture(rt.readFBO, GL_COLOR_ATTACHMENT0, colorTex.tex, 0);
+}
+
+
+void RendererImpl::deleteFrameInternal(Frame &f) {
 	assert(!f.outstanding);
+
+	if (!f.timestampQueries.empty()) {
+		glDeleteQueries(f.timestampQueries.size(), &f.timestampQueries[0]);
+		f.timestampQueries.clear();
+	}
+}
+
+
+unsigned int RendererImpl::writeTimestamp(bool /* begin */) {
+	if (!features.timestamps) {
+		return 0;
+	}
+
+	auto &frame = frames.at(currentFrameIdx);
+
+	// queries are kept around and reused on subsequent frames
+	if (frame.numTimestamps == frame.timestampQueries.size()) {
+		GLuint query = 0;
+		glGenQueries(1, &query);
+		frame.timestampQueries.push_back(query);
+	}
+
+	unsigned int index = frame.numTimestamps;
+	glQueryCounter(frame.timestampQueries.at(index), GL_TIMESTAMP);
+	frame.numTimestamps++;
+
+	return index;
 }
 
 
@@ -1788,11 +2265,13 @@ void RendererImpl::beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle
 
 	assert(fbHandle);
 	const auto &fb = framebuffers.get(fbHandle);
-	assert(fb.fbo != 0);
+	assert(fb.fbo != 0 || fb.swapchain);
 
 	assert(rpHandle);
 	const auto &rp = renderPasses.get(rpHandle);
 
+	beginTimingScope(rp.desc.name_);
+
 	if (tracing) {
 		glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 1, -1, rp.desc.name_.c_str());
 	}
@@ -1801,7 +2280,7 @@ void RendererImpl::beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle
 	// OpenGL doesn't care but Vulkan does
 	assert(fb.renderPass == rpHandle || isRenderPassCompatible(rp, fb));
 
-	assert(fb.fbo != 0);
+	assert(fb.fbo != 0 || fb.swapchain);
 	assert(fb.width > 0);
 	assert(fb.height > 0);
 
@@ -1857,6 +2336,8 @@ void RendererImpl::endRenderPass() {
 
 	currentRenderPass = RenderPassHandle();
 	currentFramebuffer = FramebufferHandle();
+
+	endTimingScope();
 }
 
 
@@ -2302,9 +2783,8 @@ void RendererImpl::blit(FramebufferHandle source, FramebufferHandle target, unsi
 	assert(srcFb.height      >  0);
 
 	const auto &destFb = framebuffers.get(target);
-	assert(destFb.fbo        != 0);
+	assert(destFb.fbo        != 0 || destFb.swapchain);
 	assert(destFb.numSamples == 1);
-	assert(destFb.fbo        != 0);
 	assert(destFb.width      >  0);
 	assert(destFb.height     >  0);
 
@@ -2341,9 +2821,8 @@ void RendererImpl::resolveMSAA(FramebufferHandle source, FramebufferHandle targe
 	assert(srcFb.height      >  0);
 
 	const auto &destFb = framebuffers.get(target);
-	assert(destFb.fbo        != 0);
+	assert(destFb.fbo        != 0 || destFb.swapchain);
 	assert(destFb.numSamples == 1);
-	assert(destFb.fbo        != 0);
 	assert(destFb.width      >  0);
 	assert(destFb.height     >  0);
 
@@ -2365,6 +2844,48 @@ void RendererImpl::resolveMSAA(FramebufferHandle source, FramebufferHandle targe
 }
 
 
+void RendererImpl::readbackRenderTarget(RenderTargetHandle handle, unsigned int x, unsigned int y, unsigned int width, unsigned int height, ReadbackCallback callback) {
+	assert(!inRenderPass);
+	assert(callback);
+
+	auto &rt = renderTargets.get(handle);
+	assert(rt.currentLayout == Layout::TransferSrc);
+	assert(rt.numSamples == 1);
+	assert(!isDepthFormat(rt.format));
+
+	if (width == 0 && height == 0) {
+		width  = rt.width;
+		height = rt.height;
+	}
+	assert(x + width  <= rt.width);
+	assert(y + height <= rt.height);
+
+	unsigned int size = width * height * formatSize(rt.format);
+	Readback readback = allocateReadback(size);
+	readback.result.frameNum = frameNum;
+	readback.result.x        = x;
+	readback.result.y        = y;
+	readback.result.width    = width;
+	readback.result.height   = height;
+	readback.result.format   = rt.format;
+	readback.result.size     = size;
+	readback.callback        = std::move(callback);
+
+	// default framebuffer reads from the back buffer
+	if (rt.readFBO == 0 && !rt.swapchain) {
+		createReadFBO(rt);
+	}
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, rt.readFBO);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	// GL rows start from the bottom
+	glReadPixels(x, rt.height - y - height, width, height, glTexBaseFormat(rt.format), glTexType(rt.format), nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	frames.at(currentFrameIdx).readbacks.push_back(std::move(readback));
+}
+
+
 void RendererImpl::draw(unsigned int firstVertex, unsigned int vertexCount) {
 #ifndef NDEBUG
 	assert(inRenderPass);
@@ -2435,6 +2956,29 @@ void RendererImpl::drawIndexedOffset(unsigned int vertexCount, unsigned int firs
 }
 
 
+void RendererImpl::drawIndexedBaseVertex(unsigned int vertexCount, unsigned int firstIndex, int baseVertex) {
+#ifndef NDEBUG
+	assert(inRenderPass);
+	assert(validPipeline);
+	assert(vertexCount > 0);
+	const auto &p = pipelines.get(currentPipeline);
+	assert(!p.desc.scissorTest_ || scissorSet);
+	pipelineDrawn = true;
+#endif //  NDEBUG
+
+	if (decriptorSetsDirty) {
+		rebindDescriptorSets();
+	}
+	assert(!decriptorSetsDirty);
+
+	GLenum format        = idxBuf16Bit ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	unsigned int idxSize = idxBuf16Bit ? 2                 : 4 ;
+	auto ptr = reinterpret_cast<const char *>(firstIndex * idxSize + indexBufByteOffset);
+	// TODO: get primitive from current pipeline
+	glDrawElementsBaseVertex(GL_TRIANGLES, vertexCount, format, ptr, baseVertex);
+}
+
+
 } // namespace renderer
 
 
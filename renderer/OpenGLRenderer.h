@@ -27,6 +27,16 @@ THE SOFTWARE.
 
 #include <GL/glew.h>
 
+#ifdef GLEW_EGL
+
+// don't drag in X11 headers, we only use EGL for headless contexts
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#endif  // GLEW_EGL
+
 // TODO: use std::variant if the compiler has C++17
 #include <boost/variant/variant.hpp>
 #include <boost/variant/apply_visitor.hpp>
@@ -230,6 +240,8 @@ struct Framebuffer {
 	unsigned int                                             width, height;
 	unsigned int                                             numSamples;
 	bool                                                     sRGB;
+	// draws to the default framebuffer, fbo is 0
+	bool                                                     swapchain;
 	GLuint                                                   fbo;
 	RenderTargetHandle                                       depthStencil;
 	std::array<RenderTargetHandle, MAX_COLOR_RENDERTARGETS>  colors;
@@ -244,6 +256,7 @@ struct Framebuffer {
 	, height(other.height)
 	, numSamples(other.numSamples)
 	, sRGB(other.sRGB)
+	, swapchain(other.swapchain)
 	, fbo(other.fbo)
 	, depthStencil(other.depthStencil)
 	, renderPass(other.renderPass)
@@ -252,6 +265,7 @@ struct Framebuffer {
 		other.height       = 0;
 		other.numSamples   = 0;
 		other.sRGB         = false;
+		other.swapchain    = false;
 		other.fbo          = 0;
 		// TODO: use std::move
 		assert(!other.colors[1]);
@@ -268,6 +282,7 @@ struct Framebuffer {
 	, height(0)
 	, numSamples(0)
 	, sRGB(false)
+	, swapchain(false)
 	, fbo(0)
 	{
 	}
@@ -395,6 +410,8 @@ struct RenderTarget {
 	TextureHandle  additionalView;
 	GLuint         readFBO;
 	Format         format;
+	// the default framebuffer, has no texture
+	bool           swapchain;
 
 
 	RenderTarget()
@@ -404,6 +421,7 @@ struct RenderTarget {
 	, currentLayout(Layout::Undefined)
 	, readFBO(0)
 	, format(Format::Invalid)
+	, swapchain(false)
 	{
 	}
 
@@ -419,6 +437,7 @@ struct RenderTarget {
 	, additionalView(other.additionalView)
 	, readFBO(other.readFBO)
 	, format(other.format)
+	, swapchain(other.swapchain)
 	{
 		other.width         = 0;
 		other.height        = 0;
@@ -428,6 +447,7 @@ struct RenderTarget {
 		other.additionalView = TextureHandle();
 		other.readFBO       = 0;
 		other.format        = Format::Invalid;
+		other.swapchain     = false;
 	}
 
 	RenderTarget &operator=(RenderTarget &&other) {
@@ -446,6 +466,7 @@ struct RenderTarget {
 		additionalView = other.additionalView;
 		readFBO       = other.readFBO;
 		format        = other.format;
+		swapchain     = other.swapchain;
 
 		other.width         = 0;
 		other.height        = 0;
@@ -455,6 +476,7 @@ struct RenderTarget {
 		other.additionalView = TextureHandle();
 		other.readFBO       = 0;
 		other.format        = Format::Invalid;
+		other.swapchain     = false;
 
 		return *this;
 	};
@@ -614,12 +636,74 @@ struct VertexShader {
 typedef boost::variant<BufferHandle, CSampler, SamplerHandle, TextureHandle> Descriptor;
 
 
+// pixel pack buffer a rendertarget is read into
+// kept around and reused for later readbacks when done
+struct Readback {
+	GLuint            pbo;
+	unsigned int      bufferSize;
+	ReadbackResult    result;
+	ReadbackCallback  callback;
+
+
+	Readback()
+	: pbo(0)
+	, bufferSize(0)
+	{
+	}
+
+	~Readback() {
+		assert(pbo == 0);
+		assert(!callback);
+	}
+
+	Readback(const Readback &)            = delete;
+	Readback &operator=(const Readback &) = delete;
+
+	Readback(Readback &&other)
+	: pbo(other.pbo)
+	, bufferSize(other.bufferSize)
+	, result(other.result)
+	, callback(std::move(other.callback))
+	{
+		other.pbo        = 0;
+		other.bufferSize = 0;
+		other.result     = ReadbackResult();
+		other.callback   = nullptr;
+	}
+
+	Readback &operator=(Readback &&other) {
+		if (this == &other) {
+			return *this;
+		}
+
+		assert(pbo == 0);
+		assert(!callback);
+
+		pbo              = other.pbo;
+		bufferSize       = other.bufferSize;
+		result           = other.result;
+		callback         = std::move(other.callback);
+
+		other.pbo        = 0;
+		other.bufferSize = 0;
+		other.result     = ReadbackResult();
+		other.callback   = nullptr;
+
+		return *this;
+	}
+};
+
+
 struct Frame {
 	bool                      outstanding;
 	uint32_t                  lastFrameNum;
 	unsigned int              usedRingBufPtr;
 	std::vector<BufferHandle> ephemeralBuffers;
 	GLsync                    fence;
+	std::vector<TimingScope>  timingScopes;
+	std::vector<GLuint>       timestampQueries;
+	unsigned int              numTimestamps;
+	std::vector<Readback>     readbacks;
 
 
 	Frame()
@@ -627,12 +711,15 @@ struct Frame {
 	, lastFrameNum(0)
 	, usedRingBufPtr(0)
 	, fence(nullptr)
+	, numTimestamps(0)
 	{}
 
 	~Frame() {
 		assert(!outstanding);
 		assert(!fence);
 		assert(ephemeralBuffers.empty());
+		assert(timestampQueries.empty());
+		assert(readbacks.empty());
 	}
 
 	Frame(const Frame &)            = delete;
@@ -644,11 +731,18 @@ struct Frame {
 	, usedRingBufPtr(other.usedRingBufPtr)
 	, ephemeralBuffers(std::move(other.ephemeralBuffers))
 	, fence(other.fence)
+	, timingScopes(std::move(other.timingScopes))
+	, timestampQueries(std::move(other.timestampQueries))
+	, numTimestamps(other.numTimestamps)
+	, readbacks(std::move(other.readbacks))
 	{
 		other.outstanding     = false;
 		other.fence           = nullptr;
 		other.usedRingBufPtr  = 0;
+		other.numTimestamps   = 0;
 		assert(other.ephemeralBuffers.empty());
+		assert(other.timestampQueries.empty());
+		assert(other.readbacks.empty());
 	}
 
 	Frame &operator=(Frame &&other) {
@@ -669,6 +763,19 @@ struct Frame {
 		ephemeralBuffers       = std::move(other.ephemeralBuffers);
 		assert(other.ephemeralBuffers.empty());
 
+		timingScopes           = std::move(other.timingScopes);
+
+		assert(timestampQueries.empty());
+		timestampQueries       = std::move(other.timestampQueries);
+		assert(other.timestampQueries.empty());
+
+		numTimestamps          = other.numTimestamps;
+		other.numTimestamps    = 0;
+
+		assert(readbacks.empty());
+		readbacks              = std::move(other.readbacks);
+		assert(other.readbacks.empty());
+
 		return *this;
 	}
 };
@@ -678,6 +785,13 @@ struct RendererImpl : public RendererBase {
 	SDL_Window                               *window;
 	SDL_GLContext                            context;
 
+	// no window, rendertargets are never shown
+	bool                                     headless;
+#ifdef GLEW_EGL
+	EGLDisplay                               eglDisplay;
+	EGLContext                               eglContext;
+#endif  // GLEW_EGL
+
 	std::unordered_map<GLenum, int>          glValues;
 
 	std::vector<Frame>                       frames;
@@ -697,6 +811,14 @@ struct RendererImpl : public RendererBase {
 	bool                                     persistentMapInUse;
 	char                                     *persistentMapping;
 
+	// rendertarget aliasing the default framebuffer, at most one
+	RenderTargetHandle                       swapchainRT;
+
+	// completed readbacks whose buffers can be reused
+	std::vector<Readback>                    freeReadbacks;
+	// readback contents flipped to top row first
+	std::vector<char>                        readbackData;
+
 	PipelineHandle                           currentPipeline;
 	RenderPassHandle                         currentRenderPass;
 	FramebufferHandle                        currentFramebuffer;
@@ -716,12 +838,23 @@ struct RendererImpl : public RendererBase {
 	void rebindDescriptorSets();
 
 	void recreateSwapchain();
+	void createHeadlessContext(unsigned int glMajor, unsigned int glMinor, bool wantKHRDebug);
+	glm::uvec2 getDrawableSize(const SwapchainDesc &desc) const;
 	void recreateRingBuffer(unsigned int newSize);
 	unsigned int ringBufferAllocate(unsigned int size, unsigned int alignPower);
 
 	void waitForFrame(unsigned int frameIdx);
+
+	// with an unpack buffer bound mipData are offsets into it
+	TextureHandle createTextureInternal(const TextureDesc &desc, const std::array<const void *, MAX_TEXTURE_MIPLEVELS> &mipData);
 	void deleteFrameInternal(Frame &f);
 
+	Readback allocateReadback(unsigned int size);
+	void createReadFBO(RenderTarget &rt);
+
+	// begin is true for the start of a timing scope
+	unsigned int writeTimestamp(bool begin);
+
 	explicit RendererImpl(const RendererDesc &desc);
 
 	~RendererImpl();
@@ -739,6 +872,8 @@ struct RendererImpl : public RendererBase {
 	BufferHandle         createEphemeralBuffer(BufferType type, uint32_t size, const void *contents);
 	SamplerHandle        createSampler(const SamplerDesc &desc);
 	TextureHandle        createTexture(const TextureDesc &desc);
+	TextureUpload        beginTextureUpload(const TextureDesc &desc);
+	TextureHandle        endTextureUpload(TextureUpload &upload);
 
 	DSLayoutHandle       createDescriptorSetLayout(const DescriptorLayout *layout);
 
@@ -762,6 +897,9 @@ struct RendererImpl : public RendererBase {
 	void beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle);
 	void endRenderPass();
 
+	void beginTimingScope(const std::string &name);
+	void endTimingScope();
+
 	void layoutTransition(RenderTargetHandle image, Layout src, Layout dest);
 
 	void setViewport(unsigned int x, unsigned int y, unsigned int width, unsigned int height);
@@ -776,9 +914,12 @@ struct RendererImpl : public RendererBase {
 	void blit(FramebufferHandle source, FramebufferHandle target, unsigned int n);
 	void resolveMSAA(FramebufferHandle source, FramebufferHandle target, unsigned int n);
 
+	void readbackRenderTarget(RenderTargetHandle handle, unsigned int x, unsigned int y, unsigned int width, unsigned int height, ReadbackCallback callback);
+
 	void draw(unsigned int firstVertex, unsigned int vertexCount);
 	void drawIndexedInstanced(unsigned int vertexCount, unsigned int instanceCount);
 	void drawIndexedOffset(unsigned int vertexCount, unsigned int firstIndex);
+	void drawIndexedBaseVertex(unsigned int vertexCount, unsigned int firstIndex, int baseVertex);
 };
 
 
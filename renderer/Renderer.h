@@ -25,9 +25,11 @@ THE SOFTWARE.
 #define RENDERER_H
 
 
+#include <functional>
 #include <string>
 #include <unordered_map>
 #include <array>
+#include <vector>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE 1
@@ -47,6 +49,7 @@ namespace renderer {
 #define MAX_DESCRIPTOR_SETS     2  // per pipeline
 #define MAX_TEXTURE_MIPLEVELS   14
 #define MAX_TEXTURE_SIZE        (1 << (MAX_TEXTURE_MIPLEVELS - 1))
+#define MAX_TIMESTAMPS          128  // per frame, two per timing scope
 
 
 struct Buffer;
@@ -61,11 +64,13 @@ struct Texture;
 
 
 template <class T> class ResourceContainer;
+class TraceWriter;
 
 
 template <class T>
 class Handle {
 	friend class ResourceContainer<T>;
+	friend class TraceWriter;
 
 	uint32_t handle;
 
@@ -188,6 +193,13 @@ enum class Format : uint8_t {
 	, Depth24S8
 	, Depth24X8
 	, Depth32Float
+	// 4x4 block compressed, see RendererFeatures::textureCompressionBC
+	, BC1
+	, sBC1
+	, BC3
+	, sBC3
+	, BC7
+	, sBC7
 };
 
 
@@ -266,12 +278,133 @@ struct MemoryStats {
 };
 
 
+// API usage counters
+// currently only modeled by the null renderer, other backends return zeros
+struct FrameStats {
+	// live resources
+	uint32_t  buffers;
+	uint32_t  framebuffers;
+	uint32_t  pipelines;
+	uint32_t  renderPasses;
+	uint32_t  renderTargets;
+	uint32_t  samplers;
+	uint32_t  textures;
+
+	// modeled memory of live resources, from formatSize
+	uint64_t  bufferBytes;
+	uint64_t  renderTargetBytes;
+	uint64_t  textureBytes;
+
+	// most ringbuffer bytes in flight at once since renderer creation
+	uint32_t  ringBufferHighWater;
+
+	// counted from previous presentFrame to this one
+	// includes resource creation between frames
+	uint64_t  uploadBytes;
+	uint32_t  passes;
+	uint32_t  blits;
+	uint32_t  draws;
+	uint32_t  pipelineBinds;
+	uint32_t  redundantPipelineBinds;
+	uint32_t  descriptorSetBinds;
+	uint32_t  redundantDescriptorSetBinds;
+
+
+	FrameStats()
+	: buffers(0)
+	, framebuffers(0)
+	, pipelines(0)
+	, renderPasses(0)
+	, renderTargets(0)
+	, samplers(0)
+	, textures(0)
+	, bufferBytes(0)
+	, renderTargetBytes(0)
+	, textureBytes(0)
+	, ringBufferHighWater(0)
+	, uploadBytes(0)
+	, passes(0)
+	, blits(0)
+	, draws(0)
+	, pipelineBinds(0)
+	, redundantPipelineBinds(0)
+	, descriptorSetBinds(0)
+	, redundantDescriptorSetBinds(0)
+	{
+	}
+};
+
+
+struct PassTiming {
+	// owned by the renderer, valid until it is destroyed
+	const char    *name;
+	unsigned int  depth;
+	uint64_t      nanoseconds;
+
+
+	PassTiming()
+	: name(nullptr)
+	, depth(0)
+	, nanoseconds(0)
+	{
+	}
+};
+
+
+struct FrameTimings {
+	// frame number these timings were recorded on
+	// usually a few frames behind the current one
+	uint32_t                 frameNum;
+	std::vector<PassTiming>  passes;
+
+
+	FrameTimings()
+	: frameNum(0)
+	{
+	}
+};
+
+
+// rendertarget contents copied back to CPU
+struct ReadbackResult {
+	// frame number the readback was issued on
+	uint32_t      frameNum;
+	// rectangle in rendertarget, y = 0 is the top row
+	unsigned int  x, y, width, height;
+	Format        format;
+	// tightly packed rows in format, top row first
+	// only valid during the callback
+	const void   *data;
+	unsigned int  size;
+
+
+	ReadbackResult()
+	: frameNum(0)
+	, x(0)
+	, y(0)
+	, width(0)
+	, height(0)
+	, format(Format::Invalid)
+	, data(nullptr)
+	, size(0)
+	{
+	}
+};
+
+
+typedef std::function<void(const ReadbackResult &)> ReadbackCallback;
+
+
 typedef std::unordered_map<std::string, std::string> ShaderMacros;
 
 
 const char *layoutName(Layout layout);
 const char *formatName(Format format);
+// bytes per texel, or per 4x4 block for block compressed formats
 uint32_t formatSize(Format format);
+bool isBlockFormat(Format format);
+// bytes in one mip level of the given size
+uint32_t mipLevelSize(Format format, unsigned int width, unsigned int height);
 
 
 struct FramebufferDesc {
@@ -318,6 +451,7 @@ private:
 	std::string                                              name_;
 
 	friend struct RendererImpl;
+	friend class TraceWriter;
 };
 
 
@@ -492,6 +626,7 @@ public:
 	PipelineDesc &operator=(PipelineDesc &&desc)      = default;
 
 	friend struct RendererImpl;
+	friend class TraceWriter;
 };
 
 
@@ -571,6 +706,7 @@ private:
 
 
 	friend struct RendererImpl;
+	friend class TraceWriter;
 };
 
 
@@ -581,6 +717,7 @@ struct RenderTargetDesc {
 	, numSamples_(1)
 	, format_(Format::Invalid)
 	, additionalViewFormat_(Format::Invalid)
+	, swapchain_(false)
 	{
 	}
 
@@ -621,6 +758,14 @@ struct RenderTargetDesc {
 		return *this;
 	}
 
+	// render directly into the swapchain image if the backend can
+	// only one at a time, it must have swapchain size and can't be sampled
+	// otherwise a normal rendertarget is created and presentFrame copies it
+	RenderTargetDesc &swapchain(bool s) {
+		swapchain_ = s;
+		return *this;
+	}
+
 	RenderTargetDesc &name(const std::string &str) {
 		name_ = str;
 		return *this;
@@ -632,9 +777,11 @@ private:
 	unsigned int   numSamples_;
 	Format         format_;
 	Format         additionalViewFormat_;
+	bool           swapchain_;
 	std::string    name_;
 
 	friend struct RendererImpl;
+	friend class TraceWriter;
 };
 
 
@@ -643,6 +790,7 @@ struct SamplerDesc {
 	: min(FilterMode::Nearest)
 	, mag(FilterMode::Nearest)
 	, wrapMode(WrapMode::Clamp)
+	, mipmaps_(false)
 	{
 	}
 
@@ -664,6 +812,13 @@ struct SamplerDesc {
 		return *this;
 	}
 
+	// sample all mip levels, using the min filter between levels too
+	// textures with a single level look the same either way
+	SamplerDesc &mipmaps(bool m) {
+		mipmaps_ = m;
+		return *this;
+	}
+
 	SamplerDesc &name(const std::string &str) {
 		name_ = str;
 		return *this;
@@ -673,9 +828,11 @@ private:
 
 	FilterMode  min, mag;
 	WrapMode    wrapMode;
+	bool        mipmaps_;
 	std::string name_;
 
 	friend struct RendererImpl;
+	friend class TraceWriter;
 };
 
 
@@ -733,6 +890,13 @@ struct TextureDesc {
 		return *this;
 	}
 
+	TextureDesc &numMips(unsigned int n) {
+		assert(n > 0);
+		assert(n <= MAX_TEXTURE_MIPLEVELS);
+		numMips_ = n;
+		return *this;
+	}
+
 	TextureDesc &mipLevelData(unsigned int level, const void *data, unsigned int size) {
 		assert(level < numMips_);
 		mipData_[level].data = data;
@@ -766,6 +930,57 @@ private:
 	std::string                                  name_;
 
 	friend struct RendererImpl;
+	friend struct RendererBase;
+	friend class TraceWriter;
+};
+
+
+// writable memory for the mip levels of a texture being created
+// layout is the same as TextureDesc::mipLevelData, tightly packed rows, top row first
+// see Renderer::beginTextureUpload
+struct TextureUpload {
+	struct MipLevel {
+		void          *data;
+		unsigned int   size;
+
+		MipLevel()
+		: data(nullptr)
+		, size(0)
+		{
+		}
+	};
+
+	unsigned int                                 numMips;
+	std::array<MipLevel, MAX_TEXTURE_MIPLEVELS>  mips;
+
+
+	TextureUpload()
+	: numMips(0)
+	, id_(0)
+	{
+	}
+
+	~TextureUpload() { }
+
+	// mip pointers can point into scratch_, moving keeps them valid
+	TextureUpload(const TextureUpload &)            = delete;
+	TextureUpload(TextureUpload &&)                 = default;
+
+	TextureUpload &operator=(const TextureUpload &) = delete;
+	TextureUpload &operator=(TextureUpload &&)      = default;
+
+
+private:
+
+	TextureDesc        desc_;
+	// backend specific, identifies the staging memory
+	uint32_t           id_;
+	// CPU memory when the backend or tracing needs a copy anyway
+	std::vector<char>  scratch_;
+
+	friend class Renderer;
+	friend struct RendererImpl;
+	friend struct RendererBase;
 };
 
 
@@ -777,6 +992,11 @@ struct RendererDesc {
 	bool           transferQueue;
 	unsigned int   ephemeralRingBufSize;
 	SwapchainDesc  swapchain;
+	// no window, render offscreen at swapchain size and make presentFrame
+	// not display anything. use readbackRenderTarget to get the results
+	bool           headless;
+	// if not empty, record all Renderer calls to this file for rendererReplay
+	std::string    recordFile;
 
 
 	RendererDesc()
@@ -786,6 +1006,7 @@ struct RendererDesc {
 	, optimizeShaders(true)
 	, transferQueue(true)
 	, ephemeralRingBufSize(1 * 1048576)
+	, headless(false)
 	{
 	}
 };
@@ -795,12 +1016,16 @@ struct RendererFeatures {
 	uint32_t  maxMSAASamples;
 	bool      sRGBFramebuffer;
 	bool      SSBOSupported;
+	bool      timestamps;
+	bool      textureCompressionBC;
 
 
 	RendererFeatures()
 	: maxMSAASamples(1)
 	, sRGBFramebuffer(false)
 	, SSBOSupported(false)
+	, timestamps(false)
+	, textureCompressionBC(false)
 	{
 	}
 };
@@ -868,6 +1093,14 @@ public:
 	RenderTargetHandle    createRenderTarget(const RenderTargetDesc &desc);
 	SamplerHandle         createSampler(const SamplerDesc &desc);
 	TextureHandle         createTexture(const TextureDesc &desc);
+	// two-phase texture creation which lets the caller write mip levels
+	// straight into staging memory instead of providing a copy
+	// mip data in desc is ignored
+	// memory can be written from any thread until endTextureUpload
+	// which can happen several frames later
+	// begin and end must be called on the rendering thread
+	TextureUpload         beginTextureUpload(const TextureDesc &desc);
+	TextureHandle         endTextureUpload(TextureUpload &upload);
 	// TODO: non-ephemeral descriptor set
 
 	DSLayoutHandle createDescriptorSetLayout(const DescriptorLayout *layout);
@@ -891,6 +1124,8 @@ public:
 	void setSwapchainDesc(const SwapchainDesc &desc);
 	glm::uvec2 getDrawableSize() const;
 	MemoryStats getMemStats() const;
+	// stats of the most recently presented frame
+	const FrameStats &getFrameStats() const;
 
 	// rendering
 	void beginFrame();
@@ -899,6 +1134,13 @@ public:
 	void beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle);
 	void endRenderPass();
 
+	// timing scopes, can be nested
+	// every render pass also gets one implicitly
+	// results are read back without stalling so they lag a few frames behind
+	void beginTimingScope(const std::string &name);
+	void endTimingScope();
+	const FrameTimings &getFrameTimings() const;
+
 	void layoutTransition(RenderTargetHandle image, Layout src, Layout dest);
 
 	void setScissorRect(unsigned int x, unsigned int y, unsigned int width, unsigned int height);
@@ -916,9 +1158,18 @@ public:
 	void blit(FramebufferHandle source, FramebufferHandle target, unsigned int n = 0);
 	void resolveMSAA(FramebufferHandle source, FramebufferHandle target, unsigned int n = 0);
 
+	// copies rendertarget contents to CPU without stalling
+	// callback is called from a later beginFrame once the GPU has finished the frame
+	// rendertarget must be single-sampled, non-depth and in TransferSrc layout
+	// must be called outside render pass
+	void readbackRenderTarget(RenderTargetHandle handle, ReadbackCallback callback);
+	void readbackRenderTarget(RenderTargetHandle handle, unsigned int x, unsigned int y, unsigned int width, unsigned int height, ReadbackCallback callback);
+
 	void draw(unsigned int firstVertex, unsigned int vertexCount);
 	void drawIndexedInstanced(unsigned int vertexCount, unsigned int instanceCount);
 	void drawIndexedOffset(unsigned int vertexCount, unsigned int firstIndex);
+	// baseVertex is added to each index before fetching the vertex
+	void drawIndexedBaseVertex(unsigned int vertexCount, unsigned int firstIndex, int baseVertex);
 };
 
 
@@ -22,11 +22,13 @@ THE SOFTWARE.
 
 
 #include "RendererInternal.h"
+#include "utils/Profiler.h"
 #include "utils/Utils.h"
 
 #include <algorithm>
 #include <sstream>
 #include <boost/algorithm/string/split.hpp>
+#include <boost/range/iterator_range.hpp>
 
 #include <shaderc/shaderc.hpp>
 #include <spirv-tools/optimizer.hpp>
@@ -112,6 +114,14 @@ bool isDepthFormat(Format format) {
 	case Format::Depth32Float:
 		return true;
 
+	case Format::BC1:
+	case Format::sBC1:
+	case Format::BC3:
+	case Format::sBC3:
+	case Format::BC7:
+	case Format::sBC7:
+		return false;
+
 	}
 
 	UNREACHABLE();
@@ -144,6 +154,16 @@ bool issRGBFormat(Format format) {
 	case Format::Depth32Float:
 		return false;
 
+	case Format::BC1:
+	case Format::BC3:
+	case Format::BC7:
+		return false;
+
+	case Format::sBC1:
+	case Format::sBC3:
+	case Format::sBC7:
+		return true;
+
 	}
 
 	UNREACHABLE();
@@ -219,6 +239,24 @@ const char *formatName(Format format) {
 	case Format::Depth32Float:
 		return "Depth32Float";
 
+	case Format::BC1:
+		return "BC1";
+
+	case Format::sBC1:
+		return "sBC1";
+
+	case Format::BC3:
+		return "BC3";
+
+	case Format::sBC3:
+		return "sBC3";
+
+	case Format::BC7:
+		return "BC7";
+
+	case Format::sBC7:
+		return "sBC7";
+
 	}
 
 	UNREACHABLE();
@@ -271,6 +309,16 @@ uint32_t formatSize(Format format) {
 	case Format::Depth32Float:
 		return 4;
 
+	case Format::BC1:
+	case Format::sBC1:
+		return 8;
+
+	case Format::BC3:
+	case Format::sBC3:
+	case Format::BC7:
+	case Format::sBC7:
+		return 16;
+
 	}
 
 	UNREACHABLE();
@@ -278,13 +326,63 @@ uint32_t formatSize(Format format) {
 }
 
 
+bool isBlockFormat(Format format) {
+	switch (format) {
+	case Format::BC1:
+	case Format::sBC1:
+	case Format::BC3:
+	case Format::sBC3:
+	case Format::BC7:
+	case Format::sBC7:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+
+uint32_t mipLevelSize(Format format, unsigned int width, unsigned int height) {
+	if (isBlockFormat(format)) {
+		return ((width + 3) / 4) * ((height + 3) / 4) * formatSize(format);
+	}
+
+	return width * height * formatSize(format);
+}
+
+
+unsigned int descriptorSize(DescriptorType type) {
+	switch (type) {
+	case DescriptorType::End:
+	case DescriptorType::Count:
+		break;
+
+	case DescriptorType::UniformBuffer:
+	case DescriptorType::StorageBuffer:
+		return sizeof(BufferHandle);
+
+	case DescriptorType::Sampler:
+		return sizeof(SamplerHandle);
+
+	case DescriptorType::Texture:
+		return sizeof(TextureHandle);
+
+	case DescriptorType::CombinedSampler:
+		return sizeof(CSampler);
+	}
+
+	UNREACHABLE();
+	return 0;
+}
+
+
 class Includer final : public shaderc::CompileOptions::IncluderInterface {
-	std::unordered_map<std::string, std::vector<char> > &cache;
+	std::unordered_map<std::string, MappedFile> &cache;
 
 
 public:
 
-	explicit Includer(std::unordered_map<std::string, std::vector<char> > &cache_)
+	explicit Includer(std::unordered_map<std::string, MappedFile> &cache_)
 	: cache(cache_)
 	{
 	}
@@ -301,10 +399,9 @@ public:
 	virtual shaderc_include_result* GetInclude(const char* requested_source, shaderc_include_type /* type */, const char* /* requesting_source */, size_t /* include_depth */) {
 		std::string filename(requested_source);
 
-		// std::unordered_map<std::string, std::vector<char> >::iterator it = cache.find(filename);
 		auto it = cache.find(filename);
 		if (it == cache.end()) {
-			auto contents = readFile(requested_source);
+			MappedFile contents(filename);
 			bool inserted = false;
 			std::tie(it, inserted) = cache.emplace(std::move(filename), std::move(contents));
 			// since we just checked it's not there this must succeed
@@ -328,15 +425,9 @@ public:
 };
 
 
-std::vector<char> RendererBase::loadSource(const std::string &name) {
-	auto it = shaderSources.find(name);
-	if (it != shaderSources.end()) {
-		return it->second;
-	} else {
-		auto source = readFile(name);
-		shaderSources.emplace(name, source);
-		return source;
-	}
+MappedFile RendererBase::loadSource(const std::string &name) {
+	// not cached, the mapping goes away when the compile is done
+	return MappedFile(name);
 }
 
 
@@ -366,18 +457,16 @@ struct CacheData {
 	~CacheData() {}
 
 
-	static CacheData parse(const std::vector<char> &cacheStr_) {
+	static CacheData parse(const MappedFile &cacheStr) {
 		std::vector<std::string> split;
 		split.reserve(3);
-		{
-		std::string cacheStr(cacheStr_.begin(), cacheStr_.end());
-			boost::algorithm::split(split, cacheStr, [] (char c) -> bool { return c == ','; });
-		}
+		// split straight from the mapping
+		boost::algorithm::split(split, boost::make_iterator_range(cacheStr.begin(), cacheStr.end()), [] (char c) -> bool { return c == ','; });
 
 		CacheData cacheData;
 		if (split.size() < 2) {
 			// not enough components, parse fails
-            return cacheData;
+			return cacheData;
 		}
 
 		cacheData.version = atoi(split[0].c_str());
@@ -404,7 +493,7 @@ struct CacheData {
 
 	std::string serialize() const {
 		std::stringstream cacheStr;
-        cacheStr << version;
+		cacheStr << version;
 
 		cacheStr << "," << std::hex << hash;
 
@@ -423,7 +512,7 @@ bool RendererBase::loadCachedSPV(const std::string &name, const std::string &sha
 		return false;
 	}
 
-	CacheData cacheData = CacheData::parse(readFile(cacheName));
+	CacheData cacheData = CacheData::parse(MappedFile(cacheName));
 	if (cacheData.version != int(shaderVersion)) {
 		LOG("version mismatch, found %d when expected %u\n", cacheData.version, shaderVersion);
 		return false;
@@ -453,14 +542,14 @@ bool RendererBase::loadCachedSPV(const std::string &name, const std::string &sha
 		}
 	}
 
-	auto temp = readFile(spvName);
-	if (temp.size() % 4 != 0) {
+	MappedFile temp(spvName);
+	if (temp.empty() || temp.size() % 4 != 0) {
 		LOG("Shader \"%s\" has incorrect size\n", spvName.c_str());
 		return false;
 	}
 
 	spirv.resize(temp.size() / 4);
-	memcpy(&spirv[0], &temp[0], temp.size());
+	memcpy(&spirv[0], temp.data(), temp.size());
 	LOG("Loaded shader \"%s\" from cache\n", spvName.c_str());
 
 	return true;
@@ -468,23 +557,28 @@ bool RendererBase::loadCachedSPV(const std::string &name, const std::string &sha
 
 
 std::vector<uint32_t> RendererBase::compileSpirv(const std::string &name, const ShaderMacros &macros, ShaderKind kind_) {
+	PROFILE_FUNCTION();
+
 	// check spir-v cache first
 	std::string shaderName = name;
 	{
-		std::vector<std::string> sorted;
+		// scratch strings come from the frame arena
+		LinearArena &arena = frameArena();
+		ArenaVector<ArenaString> sorted{ArenaAllocator<ArenaString>(arena)};
 		sorted.reserve(macros.size());
 		for (const auto &macro : macros) {
-			std::string s = macro.first;
+			ArenaString s(macro.first.data(), macro.first.size(), ArenaAllocator<char>(arena));
 			if (!macro.second.empty()) {
 				s += "=";
-				s += macro.second;
+				s.append(macro.second.data(), macro.second.size());
 			}
 			sorted.emplace_back(std::move(s));
 		}
 
 		std::sort(sorted.begin(), sorted.end());
 		for (const auto &s : sorted) {
-			shaderName += "_" + s;
+			shaderName += "_";
+			shaderName.append(s.data(), s.size());
 		}
 	}
 
@@ -501,7 +595,7 @@ std::vector<uint32_t> RendererBase::compileSpirv(const std::string &name, const
 	}
 
 	// TODO: cache includes globally
-	std::unordered_map<std::string, std::vector<char> > cache;
+	std::unordered_map<std::string, MappedFile> cache;
 
 	{
 		auto src = loadSource(name);
@@ -526,7 +620,7 @@ std::vector<uint32_t> RendererBase::compileSpirv(const std::string &name, const
 		}
 
 		shaderc::Compiler compiler;
-		auto result = compiler.CompileGlslToSpv(&src[0], src.size(), kind, name.c_str(), options);
+		auto result = compiler.CompileGlslToSpv(src.data(), src.size(), kind, name.c_str(), options);
 		if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
 			LOG("Shader %s compile failed: %s\n", name.c_str(), result.GetErrorMessage().c_str());
 			throw std::runtime_error("Shader compile failed");
@@ -541,7 +635,7 @@ std::vector<uint32_t> RendererBase::compileSpirv(const std::string &name, const
 		spvtools::Optimizer opt(SPV_ENV_UNIVERSAL_1_2);
 
 		opt.SetMessageConsumer([] (spv_message_level_t level, const char *source, const spv_position_t &position, const char *message) {
-			logWrite("%u: %s %u:%u:%u %s\n", level, source, uint32_t(position.line), uint32_t(position.column), uint32_t(position.index), message);
+			LOG("%u: %s %u:%u:%u %s\n", level, source, uint32_t(position.line), uint32_t(position.column), uint32_t(position.index), message);
 		});
 
 		// SPIRV-Tools optimizer
@@ -586,6 +680,71 @@ std::vector<uint32_t> RendererBase::compileSpirv(const std::string &name, const
 }
 
 
+void RendererBase::resolveTimingScopes(uint32_t frame, const std::vector<TimingScope> &scopes, const std::vector<uint64_t> &timestamps) {
+	// frames might sync out of order, don't replace newer results with older
+	if (!frameTimings.passes.empty() && frame < frameTimings.frameNum) {
+		return;
+	}
+
+	frameTimings.frameNum = frame;
+	frameTimings.passes.clear();
+	frameTimings.passes.reserve(scopes.size());
+
+	for (const auto &scope : scopes) {
+		uint64_t begin = timestamps.at(scope.beginTimestamp);
+		uint64_t end   = timestamps.at(scope.endTimestamp);
+
+		PassTiming t;
+		t.name        = scope.name;
+		t.depth       = scope.depth;
+		// counter might have wrapped around
+		t.nanoseconds = (end > begin) ? (end - begin) : 0;
+		frameTimings.passes.push_back(t);
+	}
+}
+
+
+void RendererBase::initTextureUpload(TextureUpload &upload, const TextureDesc &desc) {
+	assert(desc.width_   > 0);
+	assert(desc.height_  > 0);
+	assert(desc.numMips_ > 0);
+
+	upload.desc_   = desc;
+	upload.numMips = desc.numMips_;
+
+	unsigned int w = desc.width_, h = desc.height_;
+	for (unsigned int i = 0; i < desc.numMips_; i++) {
+		upload.mips[i].data = nullptr;
+		upload.mips[i].size = mipLevelSize(desc.format_, w, h);
+
+		w = std::max(w / 2, 1u);
+		h = std::max(h / 2, 1u);
+	}
+}
+
+
+TextureUpload RendererBase::beginScratchTextureUpload(const TextureDesc &desc) {
+	TextureUpload upload;
+	initTextureUpload(upload, desc);
+
+	unsigned int totalSize = 0;
+	for (unsigned int i = 0; i < upload.numMips; i++) {
+		totalSize += upload.mips[i].size;
+	}
+	upload.scratch_.resize(totalSize);
+
+	unsigned int offset = 0;
+	for (unsigned int i = 0; i < upload.numMips; i++) {
+		auto &mip = upload.mips[i];
+		mip.data  = &upload.scratch_[offset];
+		upload.desc_.mipLevelData(i, mip.data, mip.size);
+		offset   += mip.size;
+	}
+
+	return upload;
+}
+
+
 Renderer Renderer::createRenderer(const RendererDesc &desc) {
 	return Renderer(new RendererImpl(desc));
 }
@@ -593,6 +752,8 @@ Renderer Renderer::createRenderer(const RendererDesc &desc) {
 
 Renderer::~Renderer() {
 	if (impl) {
+		// uploads can stay open over frames but not past the renderer
+		assert(impl->numTextureUploads == 0);
 		delete impl;
 		impl = nullptr;
 	}
@@ -620,92 +781,187 @@ const RendererFeatures &Renderer::getFeatures() const {
 
 
 BufferHandle Renderer::createBuffer(BufferType type, uint32_t size, const void *contents) {
-	return impl->createBuffer(type, size, contents);
+	BufferHandle handle = impl->createBuffer(type, size, contents);
+	if (impl->traceWriter) {
+		impl->traceWriter->createBuffer(handle, type, size, contents);
+	}
+	return handle;
 }
 
 
 BufferHandle Renderer::createEphemeralBuffer(BufferType type, uint32_t size, const void *contents) {
-	return impl->createEphemeralBuffer(type, size, contents);
+	BufferHandle handle = impl->createEphemeralBuffer(type, size, contents);
+	if (impl->traceWriter) {
+		impl->traceWriter->createEphemeralBuffer(handle, type, size, contents);
+	}
+	return handle;
 }
 
 
 FramebufferHandle Renderer::createFramebuffer(const FramebufferDesc &desc) {
-	return impl->createFramebuffer(desc);
+	FramebufferHandle handle = impl->createFramebuffer(desc);
+	if (impl->traceWriter) {
+		impl->traceWriter->createFramebuffer(handle, desc);
+	}
+	return handle;
 }
 
 
 PipelineHandle Renderer::createPipeline(const PipelineDesc &desc) {
-	return impl->createPipeline(desc);
+	PipelineHandle handle = impl->createPipeline(desc);
+	if (impl->traceWriter) {
+		impl->traceWriter->createPipeline(handle, desc);
+	}
+	return handle;
 }
 
 
 RenderPassHandle Renderer::createRenderPass(const RenderPassDesc &desc) {
-	return impl->createRenderPass(desc);
+	RenderPassHandle handle = impl->createRenderPass(desc);
+	if (impl->traceWriter) {
+		impl->traceWriter->createRenderPass(handle, desc);
+	}
+	return handle;
 }
 
 
 RenderTargetHandle Renderer::createRenderTarget(const RenderTargetDesc &desc) {
-	return impl->createRenderTarget(desc);
+	RenderTargetHandle handle = impl->createRenderTarget(desc);
+	if (impl->traceWriter) {
+		impl->traceWriter->createRenderTarget(handle, desc);
+	}
+	return handle;
 }
 
 
 SamplerHandle Renderer::createSampler(const SamplerDesc &desc) {
-	return impl->createSampler(desc);
+	SamplerHandle handle = impl->createSampler(desc);
+	if (impl->traceWriter) {
+		impl->traceWriter->createSampler(handle, desc);
+	}
+	return handle;
 }
 
 
 TextureHandle Renderer::createTexture(const TextureDesc &desc) {
-	return impl->createTexture(desc);
+	TextureHandle handle = impl->createTexture(desc);
+	if (impl->traceWriter) {
+		impl->traceWriter->createTexture(handle, desc);
+	}
+	return handle;
+}
+
+
+TextureUpload Renderer::beginTextureUpload(const TextureDesc &desc) {
+#ifndef NDEBUG
+	impl->numTextureUploads++;
+#endif  // NDEBUG
+
+	if (impl->traceWriter) {
+		// trace needs to read the contents, record it as createTexture
+		return impl->beginScratchTextureUpload(desc);
+	}
+
+	return impl->beginTextureUpload(desc);
+}
+
+
+TextureHandle Renderer::endTextureUpload(TextureUpload &upload) {
+#ifndef NDEBUG
+	assert(impl->numTextureUploads > 0);
+	impl->numTextureUploads--;
+#endif  // NDEBUG
+
+	assert(upload.numMips > 0);
+
+	if (!upload.scratch_.empty()) {
+		return createTexture(upload.desc_);
+	}
+
+	return impl->endTextureUpload(upload);
 }
 
 
 DSLayoutHandle Renderer::createDescriptorSetLayout(const DescriptorLayout *layout) {
-	return impl->createDescriptorSetLayout(layout);
+	DSLayoutHandle handle = impl->createDescriptorSetLayout(layout);
+	if (impl->traceWriter) {
+		impl->traceWriter->createDescriptorSetLayout(handle, layout);
+	}
+	return handle;
 }
 
 
 TextureHandle Renderer::getRenderTargetTexture(RenderTargetHandle handle) {
-	return impl->getRenderTargetTexture(handle);
+	TextureHandle result = impl->getRenderTargetTexture(handle);
+	if (impl->traceWriter) {
+		impl->traceWriter->getRenderTargetTexture(result, handle);
+	}
+	return result;
 }
 
 
 TextureHandle Renderer::getRenderTargetView(RenderTargetHandle handle, Format f) {
-	return impl->getRenderTargetView(handle, f);
+	TextureHandle result = impl->getRenderTargetView(handle, f);
+	if (impl->traceWriter) {
+		impl->traceWriter->getRenderTargetView(result, handle, f);
+	}
+	return result;
 }
 
 
 void Renderer::deleteBuffer(BufferHandle handle) {
+	if (impl->traceWriter) {
+		impl->traceWriter->deleteBuffer(handle);
+	}
 	impl->deleteBuffer(handle);
 }
 
 
 void Renderer::deleteFramebuffer(FramebufferHandle handle) {
+	if (impl->traceWriter) {
+		impl->traceWriter->deleteFramebuffer(handle);
+	}
 	impl->deleteFramebuffer(handle);
 }
 
 
 void Renderer::deleteRenderPass(RenderPassHandle handle) {
+	if (impl->traceWriter) {
+		impl->traceWriter->deleteRenderPass(handle);
+	}
 	impl->deleteRenderPass(handle);
 }
 
 
 void Renderer::deleteRenderTarget(RenderTargetHandle &rt) {
+	if (impl->traceWriter) {
+		impl->traceWriter->deleteRenderTarget(rt);
+	}
 	impl->deleteRenderTarget(rt);
 }
 
 
 void Renderer::deleteSampler(SamplerHandle handle) {
+	if (impl->traceWriter) {
+		impl->traceWriter->deleteSampler(handle);
+	}
 	impl->deleteSampler(handle);
 }
 
 
 void Renderer::deleteTexture(TextureHandle handle) {
+	if (impl->traceWriter) {
+		impl->traceWriter->deleteTexture(handle);
+	}
 	impl->deleteTexture(handle);
 }
 
 
 void Renderer::setSwapchainDesc(const SwapchainDesc &desc) {
 	impl->setSwapchainDesc(desc);
+	if (impl->traceWriter) {
+		impl->traceWriter->setSwapchainDesc(desc);
+	}
 }
 
 
@@ -716,91 +972,189 @@ MemoryStats Renderer::getMemStats() const {
 
 void Renderer::beginFrame() {
 	impl->beginFrame();
+	if (impl->traceWriter) {
+		impl->traceWriter->beginFrame();
+	}
 }
 
 
 void Renderer::presentFrame(RenderTargetHandle image) {
 	impl->presentFrame(image);
+	if (impl->traceWriter) {
+		impl->traceWriter->presentFrame(image);
+	}
 }
 
 
 void Renderer::beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle) {
 	impl->beginRenderPass(rpHandle, fbHandle);
+	if (impl->traceWriter) {
+		impl->traceWriter->beginRenderPass(rpHandle, fbHandle);
+	}
 }
 
 
 void Renderer::endRenderPass() {
 	impl->endRenderPass();
+	if (impl->traceWriter) {
+		impl->traceWriter->endRenderPass();
+	}
+}
+
+
+void Renderer::beginTimingScope(const std::string &name) {
+	impl->beginTimingScope(name);
+	if (impl->traceWriter) {
+		impl->traceWriter->beginTimingScope(name);
+	}
+}
+
+
+void Renderer::endTimingScope() {
+	impl->endTimingScope();
+	if (impl->traceWriter) {
+		impl->traceWriter->endTimingScope();
+	}
+}
+
+
+const FrameTimings &Renderer::getFrameTimings() const {
+	return impl->frameTimings;
+}
+
+
+const FrameStats &Renderer::getFrameStats() const {
+	return impl->frameStats;
 }
 
 
 void Renderer::layoutTransition(RenderTargetHandle image, Layout src, Layout dest) {
 	impl->layoutTransition(image, src, dest);
+	if (impl->traceWriter) {
+		impl->traceWriter->layoutTransition(image, src, dest);
+	}
 }
 
 
 void Renderer::bindPipeline(PipelineHandle pipeline) {
 	impl->bindPipeline(pipeline);
+	if (impl->traceWriter) {
+		impl->traceWriter->bindPipeline(pipeline);
+	}
 }
 
 
 void Renderer::bindIndexBuffer(BufferHandle buffer, bool bit16) {
 	impl->bindIndexBuffer(buffer, bit16);
+	if (impl->traceWriter) {
+		impl->traceWriter->bindIndexBuffer(buffer, bit16);
+	}
 }
 
 
 void Renderer::bindVertexBuffer(unsigned int binding, BufferHandle buffer) {
 	impl->bindVertexBuffer(binding, buffer);
+	if (impl->traceWriter) {
+		impl->traceWriter->bindVertexBuffer(binding, buffer);
+	}
 }
 
 
 void Renderer::bindDescriptorSet(unsigned int index, DSLayoutHandle layout, const void *data) {
 	impl->bindDescriptorSet(index, layout, data);
+	if (impl->traceWriter) {
+		impl->traceWriter->bindDescriptorSet(index, layout, data);
+	}
 }
 
 
 void Renderer::setScissorRect(unsigned int x, unsigned int y, unsigned int width, unsigned int height) {
 	impl->setScissorRect(x, y, width, height);
+	if (impl->traceWriter) {
+		impl->traceWriter->setScissorRect(x, y, width, height);
+	}
 }
 
 
 void Renderer::setViewport(unsigned int x, unsigned int y, unsigned int width, unsigned int height) {
 	impl->setViewport(x, y, width, height);
+	if (impl->traceWriter) {
+		impl->traceWriter->setViewport(x, y, width, height);
+	}
 }
 
 
 void Renderer::blit(FramebufferHandle source, FramebufferHandle target, unsigned int n) {
 	impl->blit(source, target, n);
+	if (impl->traceWriter) {
+		impl->traceWriter->blit(source, target, n);
+	}
 }
 
 
 void Renderer::resolveMSAA(FramebufferHandle source, FramebufferHandle target, unsigned int n) {
 	impl->resolveMSAA(source, target, n);
+	if (impl->traceWriter) {
+		impl->traceWriter->resolveMSAA(source, target, n);
+	}
+}
+
+
+// readbacks are not recorded since the callback can't be serialized
+void Renderer::readbackRenderTarget(RenderTargetHandle handle, ReadbackCallback callback) {
+	// zero size means whole rendertarget
+	impl->readbackRenderTarget(handle, 0, 0, 0, 0, std::move(callback));
+}
+
+
+void Renderer::readbackRenderTarget(RenderTargetHandle handle, unsigned int x, unsigned int y, unsigned int width, unsigned int height, ReadbackCallback callback) {
+	assert(width  > 0);
+	assert(height > 0);
+	impl->readbackRenderTarget(handle, x, y, width, height, std::move(callback));
 }
 
 
 void Renderer::draw(unsigned int firstVertex, unsigned int vertexCount) {
 	impl->draw(firstVertex, vertexCount);
+	if (impl->traceWriter) {
+		impl->traceWriter->draw(firstVertex, vertexCount);
+	}
 }
 
 
 void Renderer::drawIndexedInstanced(unsigned int vertexCount, unsigned int instanceCount) {
 	impl->drawIndexedInstanced(vertexCount, instanceCount);
+	if (impl->traceWriter) {
+		impl->traceWriter->drawIndexedInstanced(vertexCount, instanceCount);
+	}
 }
 
 
 void Renderer::drawIndexedOffset(unsigned int vertexCount, unsigned int firstIndex) {
 	impl->drawIndexedOffset(vertexCount, firstIndex);
+	if (impl->traceWriter) {
+		impl->traceWriter->drawIndexedOffset(vertexCount, firstIndex);
+	}
+}
+
+
+void Renderer::drawIndexedBaseVertex(unsigned int vertexCount, unsigned int firstIndex, int baseVertex) {
+	impl->drawIndexedBaseVertex(vertexCount, firstIndex, baseVertex);
+	if (impl->traceWriter) {
+		impl->traceWriter->drawIndexedBaseVertex(vertexCount, firstIndex, baseVertex);
+	}
 }
 
 
 unsigned int RendererImpl::ringBufferAllocate(unsigned int size, unsigned int alignment) {
+	PROFILE_FUNCTION();
+
 	assert(alignment != 0);
 	assert(isPow2(alignment));
 
 	if (size > ringBufSize) {
 		unsigned int newSize = nextPow2(size);
-		LOG("WARNING: out of ringbuffer space, reallocating to %u bytes\n", newSize);
+		LOG_RATELIMITED(LogLevel::Warning, "out of ringbuffer space, reallocating to %u bytes\n", newSize);
 		recreateRingBuffer(newSize);
 
 		assert(ringBufPtr == 0);
@@ -832,7 +1186,7 @@ unsigned int RendererImpl::ringBufferAllocate(unsigned int size, unsigned int al
 		unsigned int newSize = ringBufSize * 2;
 		assert(size < newSize);
 
-		LOG("WARNING: out of ringbuffer space, reallocating to %u bytes\n", newSize);
+		LOG_RATELIMITED(LogLevel::Warning, "out of ringbuffer space, reallocating to %u bytes\n", newSize);
 		recreateRingBuffer(newSize);
 
 		assert(ringBufPtr == 0);
@@ -844,6 +1198,48 @@ unsigned int RendererImpl::ringBufferAllocate(unsigned int size, unsigned int al
 }
 
 
+void RendererImpl::beginTimingScope(const std::string &name) {
+#ifndef NDEBUG
+	assert(inFrame);
+#endif  // NDEBUG
+
+	auto &frame = frames.at(currentFrameIdx);
+
+	// each scope uses two timestamps
+	if (frame.timingScopes.size() * 2 >= MAX_TIMESTAMPS) {
+		LOG_ERROR("too many timing scopes in frame, max is %u\n", MAX_TIMESTAMPS / 2);
+		throw std::runtime_error("too many timing scopes");
+	}
+
+	openTimingScopes.push_back(static_cast<unsigned int>(frame.timingScopes.size()));
+
+	auto it = timingScopeNames.find(name);
+	if (it == timingScopeNames.end()) {
+		it = timingScopeNames.insert(name).first;
+	}
+
+	TimingScope scope;
+	scope.name           = it->c_str();
+	scope.depth          = static_cast<unsigned int>(openTimingScopes.size() - 1);
+	scope.beginTimestamp = writeTimestamp(true);
+	frame.timingScopes.push_back(std::move(scope));
+}
+
+
+void RendererImpl::endTimingScope() {
+#ifndef NDEBUG
+	assert(inFrame);
+#endif  // NDEBUG
+	assert(!openTimingScopes.empty());
+
+	auto &frame = frames.at(currentFrameIdx);
+
+	unsigned int index = openTimingScopes.back();
+	openTimingScopes.pop_back();
+	frame.timingScopes.at(index).endTimestamp = writeTimestamp(false);
+}
+
+
 glm::uvec2 Renderer::getDrawableSize() const {
 	return impl->drawableSize;
 }
@@ -25,7 +25,13 @@ THE SOFTWARE.
 #define RENDERERINTERNAL_H
 
 
+#include <deque>
+#include <memory>
+#include <unordered_set>
+
 #include "Renderer.h"
+#include "RendererTrace.h"
+#include "utils/Arena.h"
 #include "utils/Utils.h"
 
 
@@ -38,15 +44,67 @@ enum class ShaderKind : uint8_t {
 };
 
 
+// size of one descriptor in a descriptor set struct
+unsigned int descriptorSize(DescriptorType type);
+
+
 template <class T>
 class ResourceContainer {
-	std::unordered_map<unsigned int, T> resources;
-	unsigned int                        next;
+	// low bits of a handle are slot index + 1, high bits the slot's generation
+	// so a stale handle to a reused slot doesn't match
+	static const unsigned int indexBits = 20;
+	static const unsigned int indexMask = (1U << indexBits) - 1;
+
+	struct Slot {
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type  storage;
+		unsigned int                                                 generation;
+		bool                                                         used;
+
+
+		Slot()
+		: generation(0)
+		, used(false)
+		{
+		}
+
+		T &resource() {
+			return *reinterpret_cast<T *>(&storage);
+		}
+
+		const T &resource() const {
+			return *reinterpret_cast<const T *>(&storage);
+		}
+	};
+
+	// deque so growing doesn't move live resources
+	// removed slots are reused so adding doesn't allocate in steady state
+	std::deque<Slot>           slots;
+	std::vector<unsigned int>  freeSlots;
+
+
+	unsigned int slotIndex(Handle<T> handle) const {
+		assert(handle.handle != 0);
+
+		unsigned int index = (handle.handle & indexMask) - 1;
+		assert(index < slots.size());
+		assert(slots[index].used);
+		assert(slots[index].generation == (handle.handle >> indexBits));
+
+		return index;
+	}
+
+
+	void release(unsigned int index) {
+		Slot &slot = slots[index];
+		slot.resource().~T();
+		slot.used = false;
+		slot.generation = (slot.generation + 1) & (0xFFFFFFFFU >> indexBits);
+		freeSlots.push_back(index);
+	}
 
 
 public:
 	ResourceContainer()
-	: next(1)
 	{
 	}
 
@@ -56,61 +114,63 @@ public:
 	ResourceContainer(ResourceContainer<T> &&)                 = delete;
 	ResourceContainer &operator=(ResourceContainer<T> &&)      = delete;
 
-	~ResourceContainer() {}
+	~ResourceContainer() {
+		for (auto &slot : slots) {
+			if (slot.used) {
+				slot.resource().~T();
+			}
+		}
+	}
 
 	std::pair<T &, Handle<T> > add() {
-		unsigned int handle = next;
-		next++;
-		auto result = resources.emplace(handle, T());
-		assert(result.second);
-		return std::make_pair(std::ref(result.first->second), Handle<T>(handle));
-	}
+		unsigned int index;
+		if (!freeSlots.empty()) {
+			index = freeSlots.back();
+			freeSlots.pop_back();
+		} else {
+			index = static_cast<unsigned int>(slots.size());
+			assert(index < indexMask);
+			slots.emplace_back();
+		}
 
+		Slot &slot = slots[index];
+		assert(!slot.used);
+		new (&slot.storage) T();
+		slot.used = true;
 
-	const T &get(Handle<T> handle) const {
-		assert(handle.handle != 0);
+		unsigned int handle = (slot.generation << indexBits) | (index + 1);
+		return std::make_pair(std::ref(slot.resource()), Handle<T>(handle));
+	}
 
-		auto it = resources.find(handle.handle);
-		assert(it != resources.end());
 
-		return it->second;
+	const T &get(Handle<T> handle) const {
+		return slots[slotIndex(handle)].resource();
 	}
 
 
 	T &get(Handle<T> handle) {
-		assert(handle.handle != 0);
-
-		auto it = resources.find(handle.handle);
-		assert(it != resources.end());
-
-		return it->second;
+		return slots[slotIndex(handle)].resource();
 	}
 
 
 	void remove(Handle<T> handle) {
-		assert(handle.handle != 0);
-
-		auto it = resources.find(handle.handle);
-		assert(it != resources.end());
-		resources.erase(it);
+		release(slotIndex(handle));
 	}
 
 
 	template <typename F> void removeWith(Handle<T> handle, F &&f) {
-		assert(handle.handle != 0);
-
-		auto it = resources.find(handle.handle);
-		assert(it != resources.end());
-		f(it->second);
-		resources.erase(it);
+		unsigned int index = slotIndex(handle);
+		f(slots[index].resource());
+		release(index);
 	}
 
 
 	template <typename F> void clearWith(F &&f) {
-		auto it = resources.begin();
-		while (it != resources.end()) {
-			f(it->second);
-			it = resources.erase(it);
+		for (unsigned int i = 0; i < slots.size(); i++) {
+			if (slots[i].used) {
+				f(slots[i].resource());
+				release(i);
+			}
 		}
 	}
 };
@@ -131,6 +191,24 @@ bool isDepthFormat(Format format);
 bool issRGBFormat(Format format);
 
 
+struct TimingScope {
+	// interned in RendererBase::timingScopeNames
+	const char    *name;
+	unsigned int  depth;
+	unsigned int  beginTimestamp;
+	unsigned int  endTimestamp;
+
+
+	TimingScope()
+	: name(nullptr)
+	, depth(0)
+	, beginTimestamp(0)
+	, endTimestamp(0)
+	{
+	}
+};
+
+
 struct RendererBase {
 	SwapchainDesc swapchainDesc;
 	SwapchainDesc wantedSwapchain;
@@ -156,7 +234,19 @@ struct RendererBase {
 	// we have synced with the GPU up to this ringbuffer index
 	unsigned int              lastSyncedRingBufPtr;
 
-	std::unordered_map<std::string, std::vector<char> > shaderSources;
+	// scratch memory for temporaries, one arena per frame in flight
+	// reset when the frame is retired so steady state doesn't touch the heap
+	std::vector<std::unique_ptr<LinearArena> >  frameArenas;
+
+	// indices of currently open scopes in current frame's timingScopes
+	std::vector<unsigned int>                openTimingScopes;
+	// scope names are interned so recording and resolving scopes doesn't allocate
+	// set nodes are stable so pointers to them stay valid
+	std::unordered_set<std::string>          timingScopeNames;
+	FrameTimings                             frameTimings;
+	// timestamp query results, kept so reading them back doesn't allocate
+	std::vector<uint64_t>                    timestampResults;
+	FrameStats                               frameStats;
 
 #ifndef NDEBUG
 	// debugging
@@ -165,17 +255,50 @@ struct RendererBase {
 	bool validPipeline;
 	bool pipelineDrawn;
 	bool scissorSet;
+	// begun but not yet ended
+	unsigned int numTextureUploads;
 #endif //  NDEBUG
 
 	std::string spirvCacheDir;
 
+	// only exists when recording
+	std::unique_ptr<TraceWriter>             traceWriter;
+
 
-	std::vector<char> loadSource(const std::string &name);
+	// mapped for the duration of one compile, see MappedFile
+	MappedFile loadSource(const std::string &name);
+
+	LinearArena &frameArena() {
+		if (frameArenas.size() <= currentFrameIdx) {
+			frameArenas.resize(currentFrameIdx + 1);
+		}
+		auto &arena = frameArenas[currentFrameIdx];
+		if (!arena) {
+			arena = std::make_unique<LinearArena>();
+		}
+		return *arena;
+	}
+
+	// call when the GPU is done with the frame
+	void retireFrameArena(unsigned int frameIdx) {
+		if (frameIdx < frameArenas.size() && frameArenas[frameIdx]) {
+			frameArenas[frameIdx]->reset();
+		}
+	}
 
 	bool loadCachedSPV(const std::string &name, const std::string &shaderName, std::vector<uint32_t> &spirv);
 
 	std::vector<uint32_t> compileSpirv(const std::string &name, const ShaderMacros &macros, ShaderKind kind);
 
+	// timestamps are in nanoseconds
+	void resolveTimingScopes(uint32_t frame, const std::vector<TimingScope> &scopes, const std::vector<uint64_t> &timestamps);
+
+	// sets everything except mip data pointers
+	static void initTextureUpload(TextureUpload &upload, const TextureDesc &desc);
+
+	// mip levels in CPU memory, Renderer::endTextureUpload then calls createTexture
+	TextureUpload beginScratchTextureUpload(const TextureDesc &desc);
+
 	explicit RendererBase(const RendererDesc &desc)
 	: swapchainDesc(desc.swapchain)
 	, wantedSwapchain(desc.swapchain)
@@ -198,18 +321,23 @@ struct RendererBase {
 	, validPipeline(false)
 	, pipelineDrawn(false)
 	, scissorSet(false)
+	, numTextureUploads(0)
 #endif //  NDEBUG
 	{
 		char *prefPath = SDL_GetPrefPath("", "SMAADemo");
 		spirvCacheDir = prefPath;
 		SDL_free(prefPath);
+
+		if (!desc.recordFile.empty()) {
+			traceWriter = std::make_unique<TraceWriter>(desc.recordFile, desc);
+		}
 	}
 
 
-	RendererBase(const RendererBase &)            = default;
+	RendererBase(const RendererBase &)            = delete;
 	RendererBase(RendererBase &&)                 = default;
 
-	RendererBase &operator=(const RendererBase &) = default;
+	RendererBase &operator=(const RendererBase &) = delete;
 	RendererBase &operator=(RendererBase &&)      = default;
 
 	~RendererBase() {}
@@ -231,6 +359,10 @@ struct RendererBase {
 
 #include "NullRenderer.h"
 
+#elif defined(RENDERER_SOFTWARE)
+
+#include "SoftwareRenderer.h"
+
 #else
 
 #error "No renderer specified"
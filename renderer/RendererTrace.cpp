@@ -0,0 +1,1027 @@
+/*
+Copyright (c) 2015-2018 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include <cstring>
+
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+
+#include "RendererInternal.h"
+#include "RendererTrace.h"
+#include "utils/Utils.h"
+
+
+namespace renderer {
+
+
+static const char     traceMagic[8] = { 'S', 'M', 'A', 'A', 'T', 'R', 'C', '\0' };
+static const uint32_t traceVersion  = 5;
+
+// flush to file when buffer grows past this
+static const size_t   traceFlushSize = 1024 * 1024;
+
+
+TraceWriter::TraceWriter(const std::string &filename, const RendererDesc &desc)
+: file(nullptr)
+{
+	file = fopen(filename.c_str(), "wb");
+	if (!file) {
+		LOG("Failed to open trace file \"%s\"\n", filename.c_str());
+		throw std::runtime_error("Failed to open trace file");
+	}
+	LOG("Recording renderer trace to \"%s\"\n", filename.c_str());
+
+	buffer.reserve(traceFlushSize + 4096);
+	buffer.insert(buffer.end(), traceMagic, traceMagic + sizeof(traceMagic));
+	writeU32(traceVersion);
+	writeU32(desc.ephemeralRingBufSize);
+	writeSwapchainDesc(desc.swapchain);
+}
+
+
+TraceWriter::~TraceWriter() {
+	command(TraceCommand::End);
+
+	if (!buffer.empty()) {
+		if (fwrite(&buffer[0], 1, buffer.size(), file) != buffer.size()) {
+			LOG("Failed to write trace\n");
+		}
+		buffer.clear();
+	}
+
+	fclose(file);
+	file = nullptr;
+}
+
+
+void TraceWriter::flush() {
+	if (buffer.empty()) {
+		return;
+	}
+
+	if (fwrite(&buffer[0], 1, buffer.size(), file) != buffer.size()) {
+		LOG("Failed to write trace\n");
+		throw std::runtime_error("Failed to write trace");
+	}
+	buffer.clear();
+}
+
+
+void TraceWriter::command(TraceCommand c) {
+	if (buffer.size() >= traceFlushSize) {
+		flush();
+	}
+	buffer.push_back(static_cast<uint8_t>(c));
+}
+
+
+void TraceWriter::writeU32(uint32_t value) {
+	while (value >= 0x80) {
+		buffer.push_back(static_cast<uint8_t>(value | 0x80));
+		value >>= 7;
+	}
+	buffer.push_back(static_cast<uint8_t>(value));
+}
+
+
+void TraceWriter::writeBool(bool value) {
+	buffer.push_back(value ? 1 : 0);
+}
+
+
+void TraceWriter::writeFloat(float value) {
+	// host byte order
+	uint8_t bytes[sizeof(float)];
+	memcpy(bytes, &value, sizeof(float));
+	buffer.insert(buffer.end(), bytes, bytes + sizeof(float));
+}
+
+
+void TraceWriter::writeString(const std::string &str) {
+	writeU32(static_cast<uint32_t>(str.size()));
+	buffer.insert(buffer.end(), str.begin(), str.end());
+}
+
+
+void TraceWriter::writeBlob(const void *data, uint32_t size) {
+	writeU32(size);
+	if (size > 0) {
+		const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+		buffer.insert(buffer.end(), bytes, bytes + size);
+	}
+}
+
+
+void TraceWriter::writeSwapchainDesc(const SwapchainDesc &desc) {
+	writeU32(desc.width);
+	writeU32(desc.height);
+	writeU32(desc.numFrames);
+	writeEnum(desc.vsync);
+	writeBool(desc.fullscreen);
+}
+
+
+void TraceWriter::createBuffer(BufferHandle handle, BufferType type, uint32_t size, const void *contents) {
+	command(TraceCommand::CreateBuffer);
+	writeHandle(handle);
+	writeEnum(type);
+	writeBlob(contents, size);
+}
+
+
+void TraceWriter::createEphemeralBuffer(BufferHandle handle, BufferType type, uint32_t size, const void *contents) {
+	command(TraceCommand::CreateEphemeralBuffer);
+	writeHandle(handle);
+	writeEnum(type);
+	writeBlob(contents, size);
+}
+
+
+void TraceWriter::createFramebuffer(FramebufferHandle handle, const FramebufferDesc &desc) {
+	command(TraceCommand::CreateFramebuffer);
+	writeHandle(handle);
+	writeHandle(desc.renderPass_);
+	writeHandle(desc.depthStencil_);
+	for (const auto &c : desc.colors_) {
+		writeHandle(c);
+	}
+	writeString(desc.name_);
+}
+
+
+void TraceWriter::createPipeline(PipelineHandle handle, const PipelineDesc &desc) {
+	command(TraceCommand::CreatePipeline);
+	writeHandle(handle);
+	writeString(desc.vertexShaderName);
+	writeString(desc.fragmentShaderName);
+	writeHandle(desc.renderPass_);
+
+	writeU32(static_cast<uint32_t>(desc.shaderMacros_.size()));
+	for (const auto &macro : desc.shaderMacros_) {
+		writeString(macro.first);
+		writeString(macro.second);
+	}
+
+	writeU32(desc.vertexAttribMask);
+	for (unsigned int i = 0; i < MAX_VERTEX_ATTRIBS; i++) {
+		if (desc.vertexAttribMask & (1 << i)) {
+			const auto &attr = desc.vertexAttribs[i];
+			writeU32(attr.bufBinding);
+			writeU32(attr.count);
+			writeEnum(attr.format);
+			writeU32(attr.offset);
+		}
+	}
+	for (const auto &buf : desc.vertexBuffers) {
+		writeU32(buf.stride);
+	}
+	for (const auto &layout : desc.descriptorSetLayouts) {
+		writeHandle(layout);
+	}
+
+	writeU32(desc.numSamples_);
+	writeBool(desc.depthWrite_);
+	writeBool(desc.depthTest_);
+	writeBool(desc.cullFaces_);
+	writeBool(desc.scissorTest_);
+	writeBool(desc.blending_);
+	writeEnum(desc.sourceBlend_);
+	writeEnum(desc.destinationBlend_);
+	writeString(desc.name_);
+}
+
+
+void TraceWriter::createRenderPass(RenderPassHandle handle, const RenderPassDesc &desc) {
+	command(TraceCommand::CreateRenderPass);
+	writeHandle(handle);
+	writeEnum(desc.depthStencilFormat_);
+	for (const auto &rt : desc.colorRTs_) {
+		writeEnum(rt.format);
+		if (rt.format != Format::Invalid) {
+			writeEnum(rt.passBegin);
+			writeEnum(rt.initialLayout);
+			writeEnum(rt.finalLayout);
+			for (unsigned int i = 0; i < 4; i++) {
+				writeFloat(rt.clearValue[i]);
+			}
+		}
+	}
+	writeU32(desc.numSamples_);
+	writeBool(desc.clearDepthAttachment);
+	writeFloat(desc.depthClearValue);
+	writeString(desc.name_);
+}
+
+
+void TraceWriter::createRenderTarget(RenderTargetHandle handle, const RenderTargetDesc &desc) {
+	command(TraceCommand::CreateRenderTarget);
+	writeHandle(handle);
+	writeU32(desc.width_);
+	writeU32(desc.height_);
+	writeU32(desc.numSamples_);
+	writeEnum(desc.format_);
+	writeEnum(desc.additionalViewFormat_);
+	writeBool(desc.swapchain_);
+	writeString(desc.name_);
+}
+
+
+void TraceWriter::createSampler(SamplerHandle handle, const SamplerDesc &desc) {
+	command(TraceCommand::CreateSampler);
+	writeHandle(handle);
+	writeEnum(desc.min);
+	writeEnum(desc.mag);
+	writeBool(desc.mipmaps_);
+	writeString(desc.name_);
+}
+
+
+void TraceWriter::createTexture(TextureHandle handle, const TextureDesc &desc) {
+	command(TraceCommand::CreateTexture);
+	writeHandle(handle);
+	writeU32(desc.width_);
+	writeU32(desc.height_);
+	writeEnum(desc.format_);
+	writeU32(desc.numMips_);
+	for (unsigned int i = 0; i < desc.numMips_; i++) {
+		writeBlob(desc.mipData_[i].data, desc.mipData_[i].size);
+	}
+	writeString(desc.name_);
+}
+
+
+void TraceWriter::createDescriptorSetLayout(DSLayoutHandle handle, const DescriptorLayout *layout) {
+	command(TraceCommand::CreateDescriptorSetLayout);
+	writeHandle(handle);
+
+	std::vector<DescriptorLayout> entries;
+	while (layout->type != DescriptorType::End) {
+		entries.push_back(*layout);
+		layout++;
+	}
+
+	writeU32(static_cast<uint32_t>(entries.size()));
+	for (const auto &entry : entries) {
+		writeEnum(entry.type);
+		writeU32(entry.offset);
+	}
+
+	dsLayouts[handle.handle] = std::move(entries);
+}
+
+
+void TraceWriter::getRenderTargetTexture(TextureHandle handle, RenderTargetHandle rt) {
+	command(TraceCommand::GetRenderTargetTexture);
+	writeHandle(handle);
+	writeHandle(rt);
+}
+
+
+void TraceWriter::getRenderTargetView(TextureHandle handle, RenderTargetHandle rt, Format f) {
+	command(TraceCommand::GetRenderTargetView);
+	writeHandle(handle);
+	writeHandle(rt);
+	writeEnum(f);
+}
+
+
+void TraceWriter::deleteBuffer(BufferHandle handle) {
+	command(TraceCommand::DeleteBuffer);
+	writeHandle(handle);
+}
+
+
+void TraceWriter::deleteFramebuffer(FramebufferHandle handle) {
+	command(TraceCommand::DeleteFramebuffer);
+	writeHandle(handle);
+}
+
+
+void TraceWriter::deleteRenderPass(RenderPassHandle handle) {
+	command(TraceCommand::DeleteRenderPass);
+	writeHandle(handle);
+}
+
+
+void TraceWriter::deleteRenderTarget(RenderTargetHandle handle) {
+	command(TraceCommand::DeleteRenderTarget);
+	writeHandle(handle);
+}
+
+
+void TraceWriter::deleteSampler(SamplerHandle handle) {
+	command(TraceCommand::DeleteSampler);
+	writeHandle(handle);
+}
+
+
+void TraceWriter::deleteTexture(TextureHandle handle) {
+	command(TraceCommand::DeleteTexture);
+	writeHandle(handle);
+}
+
+
+void TraceWriter::setSwapchainDesc(const SwapchainDesc &desc) {
+	command(TraceCommand::SetSwapchainDesc);
+	writeSwapchainDesc(desc);
+}
+
+
+void TraceWriter::beginFrame() {
+	command(TraceCommand::BeginFrame);
+}
+
+
+void TraceWriter::presentFrame(RenderTargetHandle image) {
+	command(TraceCommand::PresentFrame);
+	writeHandle(image);
+}
+
+
+void TraceWriter::beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle) {
+	command(TraceCommand::BeginRenderPass);
+	writeHandle(rpHandle);
+	writeHandle(fbHandle);
+}
+
+
+void TraceWriter::endRenderPass() {
+	command(TraceCommand::EndRenderPass);
+}
+
+
+void TraceWriter::beginTimingScope(const std::string &name) {
+	command(TraceCommand::BeginTimingScope);
+	writeString(name);
+}
+
+
+void TraceWriter::endTimingScope() {
+	command(TraceCommand::EndTimingScope);
+}
+
+
+void TraceWriter::layoutTransition(RenderTargetHandle image, Layout src, Layout dest) {
+	command(TraceCommand::LayoutTransition);
+	writeHandle(image);
+	writeEnum(src);
+	writeEnum(dest);
+}
+
+
+void TraceWriter::setScissorRect(unsigned int x, unsigned int y, unsigned int width, unsigned int height) {
+	command(TraceCommand::SetScissorRect);
+	writeU32(x);
+	writeU32(y);
+	writeU32(width);
+	writeU32(height);
+}
+
+
+void TraceWriter::setViewport(unsigned int x, unsigned int y, unsigned int width, unsigned int height) {
+	command(TraceCommand::SetViewport);
+	writeU32(x);
+	writeU32(y);
+	writeU32(width);
+	writeU32(height);
+}
+
+
+void TraceWriter::bindPipeline(PipelineHandle pipeline) {
+	command(TraceCommand::BindPipeline);
+	writeHandle(pipeline);
+}
+
+
+void TraceWriter::bindDescriptorSet(unsigned int index, DSLayoutHandle layout, const void *data) {
+	command(TraceCommand::BindDescriptorSet);
+	writeU32(index);
+	writeHandle(layout);
+
+	auto it = dsLayouts.find(layout.handle);
+	assert(it != dsLayouts.end());
+
+	const char *bytes = reinterpret_cast<const char *>(data);
+	for (const auto &entry : it->second) {
+		switch (entry.type) {
+		case DescriptorType::End:
+		case DescriptorType::Count:
+			UNREACHABLE();
+			break;
+
+		case DescriptorType::UniformBuffer:
+		case DescriptorType::StorageBuffer:
+			writeHandle(*reinterpret_cast<const BufferHandle *>(bytes + entry.offset));
+			break;
+
+		case DescriptorType::Sampler:
+			writeHandle(*reinterpret_cast<const SamplerHandle *>(bytes + entry.offset));
+			break;
+
+		case DescriptorType::Texture:
+			writeHandle(*reinterpret_cast<const TextureHandle *>(bytes + entry.offset));
+			break;
+
+		case DescriptorType::CombinedSampler: {
+			const CSampler &combined = *reinterpret_cast<const CSampler *>(bytes + entry.offset);
+			writeHandle(combined.tex);
+			writeHandle(combined.sampler);
+		} break;
+		}
+	}
+}
+
+
+void TraceWriter::bindIndexBuffer(BufferHandle buffer_, bool bit16) {
+	command(TraceCommand::BindIndexBuffer);
+	writeHandle(buffer_);
+	writeBool(bit16);
+}
+
+
+void TraceWriter::bindVertexBuffer(unsigned int binding, BufferHandle buffer_) {
+	command(TraceCommand::BindVertexBuffer);
+	writeU32(binding);
+	writeHandle(buffer_);
+}
+
+
+void TraceWriter::blit(FramebufferHandle source, FramebufferHandle target, unsigned int n) {
+	command(TraceCommand::Blit);
+	writeHandle(source);
+	writeHandle(target);
+	writeU32(n);
+}
+
+
+void TraceWriter::resolveMSAA(FramebufferHandle source, FramebufferHandle target, unsigned int n) {
+	command(TraceCommand::ResolveMSAA);
+	writeHandle(source);
+	writeHandle(target);
+	writeU32(n);
+}
+
+
+void TraceWriter::draw(unsigned int firstVertex, unsigned int vertexCount) {
+	command(TraceCommand::Draw);
+	writeU32(firstVertex);
+	writeU32(vertexCount);
+}
+
+
+void TraceWriter::drawIndexedInstanced(unsigned int vertexCount, unsigned int instanceCount) {
+	command(TraceCommand::DrawIndexedInstanced);
+	writeU32(vertexCount);
+	writeU32(instanceCount);
+}
+
+
+void TraceWriter::drawIndexedOffset(unsigned int vertexCount, unsigned int firstIndex) {
+	command(TraceCommand::DrawIndexedOffset);
+	writeU32(vertexCount);
+	writeU32(firstIndex);
+}
+
+
+void TraceWriter::drawIndexedBaseVertex(unsigned int vertexCount, unsigned int firstIndex, int baseVertex) {
+	command(TraceCommand::DrawIndexedBaseVertex);
+	writeU32(vertexCount);
+	writeU32(firstIndex);
+	writeU32(static_cast<uint32_t>(baseVertex));
+}
+
+
+TraceReplayer::TraceReplayer(const std::string &filename)
+: pos(0)
+, numCommands(0)
+{
+	contents = MappedFile(filename);
+
+	if (contents.size() < sizeof(traceMagic) || memcmp(contents.data(), traceMagic, sizeof(traceMagic)) != 0) {
+		LOG("\"%s\" is not a renderer trace\n", filename.c_str());
+		throw std::runtime_error("Not a renderer trace");
+	}
+	pos = sizeof(traceMagic);
+
+	uint32_t version = readU32();
+	if (version != traceVersion) {
+		LOG("Trace \"%s\" has version %u, expected %u\n", filename.c_str(), version, traceVersion);
+		throw std::runtime_error("Unsupported trace version");
+	}
+
+	desc.ephemeralRingBufSize = readU32();
+	desc.swapchain            = readSwapchainDesc();
+	// replay as fast as possible by default
+	desc.swapchain.vsync      = VSync::Off;
+}
+
+
+TraceReplayer::~TraceReplayer() {
+}
+
+
+void TraceReplayer::error(const char *message) {
+	LOG("Trace error at offset %u: %s\n", static_cast<unsigned int>(pos), message);
+	throw std::runtime_error(message);
+}
+
+
+uint8_t TraceReplayer::readU8() {
+	if (pos >= contents.size()) {
+		error("unexpected end of trace");
+	}
+	return static_cast<uint8_t>(contents.data()[pos++]);
+}
+
+
+uint32_t TraceReplayer::readU32() {
+	uint32_t value = 0;
+	unsigned int shift = 0;
+	uint8_t b;
+	do {
+		if (shift > 28) {
+			error("bad varint");
+		}
+		b = readU8();
+		value |= static_cast<uint32_t>(b & 0x7F) << shift;
+		shift += 7;
+	} while (b & 0x80);
+
+	return value;
+}
+
+
+bool TraceReplayer::readBool() {
+	return readU8() != 0;
+}
+
+
+float TraceReplayer::readFloat() {
+	if (pos + sizeof(float) > contents.size()) {
+		error("unexpected end of trace");
+	}
+
+	float value;
+	memcpy(&value, contents.data() + pos, sizeof(float));
+	pos += sizeof(float);
+	return value;
+}
+
+
+std::string TraceReplayer::readString() {
+	uint32_t size = 0;
+	const char *data = readBlob(size);
+	return std::string(data, size);
+}
+
+
+const char *TraceReplayer::readBlob(uint32_t &size) {
+	size = readU32();
+	if (pos + size > contents.size()) {
+		error("unexpected end of trace");
+	}
+
+	const char *data = contents.data() + pos;
+	pos += size;
+	return data;
+}
+
+
+SwapchainDesc TraceReplayer::readSwapchainDesc() {
+	SwapchainDesc swapchain;
+	swapchain.width      = readU32();
+	swapchain.height     = readU32();
+	swapchain.numFrames  = readU32();
+	swapchain.vsync      = readEnum(static_cast<VSync>(static_cast<uint32_t>(VSync::LateSwapTear) + 1));
+	swapchain.fullscreen = readBool();
+	return swapchain;
+}
+
+
+bool TraceReplayer::replayFrame(Renderer &renderer) {
+	while (pos < contents.size()) {
+		uint8_t c = readU8();
+		if (c >= static_cast<uint8_t>(TraceCommand::Count)) {
+			error("bad command");
+		}
+
+		TraceCommand command = static_cast<TraceCommand>(c);
+		if (command == TraceCommand::End) {
+			return false;
+		}
+
+		replayCommand(renderer, command);
+		numCommands++;
+
+		if (command == TraceCommand::PresentFrame) {
+			return true;
+		}
+	}
+
+	// trace was not closed properly, recording program probably crashed
+	return false;
+}
+
+
+void TraceReplayer::replayCommand(Renderer &renderer, TraceCommand command) {
+	switch (command) {
+	case TraceCommand::End:
+	case TraceCommand::Count:
+		UNREACHABLE();
+		break;
+
+	case TraceCommand::CreateBuffer:
+	case TraceCommand::CreateEphemeralBuffer: {
+		uint32_t id     = readU32();
+		BufferType type = readEnum(static_cast<BufferType>(static_cast<uint32_t>(BufferType::Everything) + 1));
+		uint32_t size   = 0;
+		const char *data = readBlob(size);
+		if (command == TraceCommand::CreateBuffer) {
+			buffers[id] = renderer.createBuffer(type, size, data);
+		} else {
+			buffers[id] = renderer.createEphemeralBuffer(type, size, data);
+			ephemeralBuffers.push_back(id);
+		}
+	} break;
+
+	case TraceCommand::CreateFramebuffer: {
+		uint32_t id = readU32();
+		FramebufferDesc fbDesc;
+		fbDesc.renderPass(lookup(renderPasses));
+		fbDesc.depthStencil(lookup(renderTargets));
+		for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
+			fbDesc.color(i, lookup(renderTargets));
+		}
+		fbDesc.name(readString());
+		framebuffers[id] = renderer.createFramebuffer(fbDesc);
+	} break;
+
+	case TraceCommand::CreatePipeline: {
+		uint32_t id = readU32();
+		PipelineDesc plDesc;
+		plDesc.vertexShader(readString());
+		plDesc.fragmentShader(readString());
+		plDesc.renderPass(lookup(renderPasses));
+
+		ShaderMacros macros;
+		uint32_t numMacros = readU32();
+		for (uint32_t i = 0; i < numMacros; i++) {
+			std::string key = readString();
+			macros[key]     = readString();
+		}
+		plDesc.shaderMacros(macros);
+
+		uint32_t attribMask = readU32();
+		for (unsigned int i = 0; i < MAX_VERTEX_ATTRIBS; i++) {
+			if (attribMask & (1 << i)) {
+				uint8_t   bufBinding = static_cast<uint8_t>(readU32());
+				uint8_t   count      = static_cast<uint8_t>(readU32());
+				VtxFormat format     = readEnum(static_cast<VtxFormat>(static_cast<uint32_t>(VtxFormat::UNorm8) + 1));
+				uint8_t   offset     = static_cast<uint8_t>(readU32());
+				plDesc.vertexAttrib(i, bufBinding, count, format, offset);
+			}
+		}
+		for (unsigned int i = 0; i < MAX_VERTEX_BUFFERS; i++) {
+			plDesc.vertexBufferStride(static_cast<uint8_t>(i), readU32());
+		}
+		for (unsigned int i = 0; i < MAX_DESCRIPTOR_SETS; i++) {
+			uint32_t layoutId = readU32();
+			if (layoutId != 0) {
+				auto it = dsLayouts.find(layoutId);
+				if (it == dsLayouts.end()) {
+					error("unknown descriptor set layout");
+				}
+				plDesc.descriptorSetLayout(i, it->second.handle);
+			}
+		}
+
+		plDesc.numSamples(readU32());
+		plDesc.depthWrite(readBool());
+		plDesc.depthTest(readBool());
+		plDesc.cullFaces(readBool());
+		plDesc.scissorTest(readBool());
+		bool blending = readBool();
+		plDesc.blending(blending);
+		BlendFunc source      = readEnum(static_cast<BlendFunc>(static_cast<uint32_t>(BlendFunc::OneMinusSrcAlpha) + 1));
+		BlendFunc destination = readEnum(static_cast<BlendFunc>(static_cast<uint32_t>(BlendFunc::OneMinusSrcAlpha) + 1));
+		if (blending) {
+			plDesc.sourceBlend(source);
+			plDesc.destinationBlend(destination);
+		}
+		plDesc.name(readString());
+
+		pipelines[id] = renderer.createPipeline(plDesc);
+	} break;
+
+	case TraceCommand::CreateRenderPass: {
+		uint32_t id = readU32();
+		RenderPassDesc rpDesc;
+		rpDesc.depthStencil(readEnum(static_cast<Format>(static_cast<uint32_t>(Format::sBC7) + 1)), PassBegin::DontCare);
+		for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
+			Format format = readEnum(static_cast<Format>(static_cast<uint32_t>(Format::sBC7) + 1));
+			if (format != Format::Invalid) {
+				PassBegin passBegin = readEnum(static_cast<PassBegin>(static_cast<uint32_t>(PassBegin::Clear) + 1));
+				Layout initial      = readEnum(static_cast<Layout>(static_cast<uint32_t>(Layout::ColorAttachment) + 1));
+				Layout final        = readEnum(static_cast<Layout>(static_cast<uint32_t>(Layout::ColorAttachment) + 1));
+				glm::vec4 clear;
+				for (unsigned int j = 0; j < 4; j++) {
+					clear[j] = readFloat();
+				}
+				rpDesc.color(i, format, passBegin, initial, final, clear);
+			}
+		}
+		rpDesc.numSamples(readU32());
+		bool clearDepth  = readBool();
+		float depthClear = readFloat();
+		if (clearDepth) {
+			rpDesc.clearDepth(depthClear);
+		}
+		rpDesc.name(readString());
+
+		renderPasses[id] = renderer.createRenderPass(rpDesc);
+	} break;
+
+	case TraceCommand::CreateRenderTarget: {
+		uint32_t id = readU32();
+		RenderTargetDesc rtDesc;
+		rtDesc.width(readU32());
+		rtDesc.height(readU32());
+		rtDesc.numSamples(readU32());
+		rtDesc.format(readEnum(static_cast<Format>(static_cast<uint32_t>(Format::sBC7) + 1)));
+		rtDesc.additionalViewFormat(readEnum(static_cast<Format>(static_cast<uint32_t>(Format::sBC7) + 1)));
+		rtDesc.swapchain(readBool());
+		rtDesc.name(readString());
+
+		renderTargets[id] = renderer.createRenderTarget(rtDesc);
+	} break;
+
+	case TraceCommand::CreateSampler: {
+		uint32_t id = readU32();
+		SamplerDesc samplerDesc;
+		samplerDesc.minFilter(readEnum(static_cast<FilterMode>(static_cast<uint32_t>(FilterMode::Linear) + 1)));
+		samplerDesc.magFilter(readEnum(static_cast<FilterMode>(static_cast<uint32_t>(FilterMode::Linear) + 1)));
+		samplerDesc.mipmaps(readBool());
+		samplerDesc.name(readString());
+
+		samplers[id] = renderer.createSampler(samplerDesc);
+	} break;
+
+	case TraceCommand::CreateTexture: {
+		uint32_t id = readU32();
+		TextureDesc texDesc;
+		texDesc.width(readU32());
+		texDesc.height(readU32());
+		texDesc.format(readEnum(static_cast<Format>(static_cast<uint32_t>(Format::sBC7) + 1)));
+		uint32_t numMips = readU32();
+		if (numMips == 0 || numMips > MAX_TEXTURE_MIPLEVELS) {
+			error("bad texture mip count");
+		}
+		texDesc.numMips(numMips);
+		for (uint32_t i = 0; i < numMips; i++) {
+			uint32_t size = 0;
+			const char *data = readBlob(size);
+			texDesc.mipLevelData(i, data, size);
+		}
+		texDesc.name(readString());
+
+		textures[id] = renderer.createTexture(texDesc);
+	} break;
+
+	case TraceCommand::CreateDescriptorSetLayout: {
+		uint32_t id = readU32();
+		DSLayout layout;
+		layout.size = 0;
+		uint32_t count = readU32();
+		layout.layout.reserve(count + 1);
+		for (uint32_t i = 0; i < count; i++) {
+			DescriptorLayout entry;
+			entry.type   = readEnum(DescriptorType::Count);
+			entry.offset = readU32();
+			if (entry.type == DescriptorType::End) {
+				error("bad descriptor type");
+			}
+			layout.size = std::max(layout.size, entry.offset + descriptorSize(entry.type));
+			layout.layout.push_back(entry);
+		}
+
+		DescriptorLayout end;
+		end.type   = DescriptorType::End;
+		end.offset = 0;
+		layout.layout.push_back(end);
+
+		layout.handle = renderer.createDescriptorSetLayout(&layout.layout[0]);
+		// don't keep end marker around
+		layout.layout.pop_back();
+		dsLayouts[id] = std::move(layout);
+	} break;
+
+	case TraceCommand::GetRenderTargetTexture: {
+		uint32_t id = readU32();
+		RenderTargetHandle rt = lookup(renderTargets);
+		textures[id] = renderer.getRenderTargetTexture(rt);
+	} break;
+
+	case TraceCommand::GetRenderTargetView: {
+		uint32_t id = readU32();
+		RenderTargetHandle rt = lookup(renderTargets);
+		Format f = readEnum(static_cast<Format>(static_cast<uint32_t>(Format::sBC7) + 1));
+		textures[id] = renderer.getRenderTargetView(rt, f);
+	} break;
+
+	case TraceCommand::DeleteBuffer:
+		renderer.deleteBuffer(remove(buffers));
+		break;
+
+	case TraceCommand::DeleteFramebuffer:
+		renderer.deleteFramebuffer(remove(framebuffers));
+		break;
+
+	case TraceCommand::DeleteRenderPass:
+		renderer.deleteRenderPass(remove(renderPasses));
+		break;
+
+	case TraceCommand::DeleteRenderTarget: {
+		RenderTargetHandle rt = remove(renderTargets);
+		renderer.deleteRenderTarget(rt);
+	} break;
+
+	case TraceCommand::DeleteSampler:
+		renderer.deleteSampler(remove(samplers));
+		break;
+
+	case TraceCommand::DeleteTexture:
+		renderer.deleteTexture(remove(textures));
+		break;
+
+	case TraceCommand::SetSwapchainDesc: {
+		SwapchainDesc swapchain = readSwapchainDesc();
+		swapchain.vsync = desc.swapchain.vsync;
+		renderer.setSwapchainDesc(swapchain);
+	} break;
+
+	case TraceCommand::BeginFrame:
+		renderer.beginFrame();
+		break;
+
+	case TraceCommand::PresentFrame:
+		renderer.presentFrame(lookup(renderTargets));
+
+		for (uint32_t id : ephemeralBuffers) {
+			buffers.erase(id);
+		}
+		ephemeralBuffers.clear();
+		break;
+
+	case TraceCommand::BeginRenderPass: {
+		RenderPassHandle rp  = lookup(renderPasses);
+		FramebufferHandle fb = lookup(framebuffers);
+		renderer.beginRenderPass(rp, fb);
+	} break;
+
+	case TraceCommand::EndRenderPass:
+		renderer.endRenderPass();
+		break;
+
+	case TraceCommand::BeginTimingScope:
+		renderer.beginTimingScope(readString());
+		break;
+
+	case TraceCommand::EndTimingScope:
+		renderer.endTimingScope();
+		break;
+
+	case TraceCommand::LayoutTransition: {
+		RenderTargetHandle rt = lookup(renderTargets);
+		Layout src  = readEnum(static_cast<Layout>(static_cast<uint32_t>(Layout::ColorAttachment) + 1));
+		Layout dest = readEnum(static_cast<Layout>(static_cast<uint32_t>(Layout::ColorAttachment) + 1));
+		renderer.layoutTransition(rt, src, dest);
+	} break;
+
+	case TraceCommand::SetScissorRect:
+	case TraceCommand::SetViewport: {
+		unsigned int x      = readU32();
+		unsigned int y      = readU32();
+		unsigned int width  = readU32();
+		unsigned int height = readU32();
+		if (command == TraceCommand::SetScissorRect) {
+			renderer.setScissorRect(x, y, width, height);
+		} else {
+			renderer.setViewport(x, y, width, height);
+		}
+	} break;
+
+	case TraceCommand::BindPipeline:
+		renderer.bindPipeline(lookup(pipelines));
+		break;
+
+	case TraceCommand::BindDescriptorSet: {
+		unsigned int index = readU32();
+		uint32_t layoutId  = readU32();
+		auto it = dsLayouts.find(layoutId);
+		if (it == dsLayouts.end()) {
+			error("unknown descriptor set layout");
+		}
+		const DSLayout &layout = it->second;
+
+		// handles are default constructed as 0 so zeroed memory is all null handles
+		dsData.assign((layout.size + sizeof(uint64_t) - 1) / sizeof(uint64_t), 0);
+		char *bytes = reinterpret_cast<char *>(dsData.data());
+		for (const auto &entry : layout.layout) {
+			switch (entry.type) {
+			case DescriptorType::End:
+			case DescriptorType::Count:
+				UNREACHABLE();
+				break;
+
+			case DescriptorType::UniformBuffer:
+			case DescriptorType::StorageBuffer:
+				new (bytes + entry.offset) BufferHandle(lookup(buffers));
+				break;
+
+			case DescriptorType::Sampler:
+				new (bytes + entry.offset) SamplerHandle(lookup(samplers));
+				break;
+
+			case DescriptorType::Texture:
+				new (bytes + entry.offset) TextureHandle(lookup(textures));
+				break;
+
+			case DescriptorType::CombinedSampler: {
+				CSampler *combined = new (bytes + entry.offset) CSampler;
+				combined->tex      = lookup(textures);
+				combined->sampler  = lookup(samplers);
+			} break;
+			}
+		}
+
+		renderer.bindDescriptorSet(index, layout.handle, bytes);
+	} break;
+
+	case TraceCommand::BindIndexBuffer: {
+		BufferHandle buffer = lookup(buffers);
+		renderer.bindIndexBuffer(buffer, readBool());
+	} break;
+
+	case TraceCommand::BindVertexBuffer: {
+		unsigned int binding = readU32();
+		renderer.bindVertexBuffer(binding, lookup(buffers));
+	} break;
+
+	case TraceCommand::Blit:
+	case TraceCommand::ResolveMSAA: {
+		FramebufferHandle source = lookup(framebuffers);
+		FramebufferHandle target = lookup(framebuffers);
+		unsigned int n           = readU32();
+		if (command == TraceCommand::Blit) {
+			renderer.blit(source, target, n);
+		} else {
+			renderer.resolveMSAA(source, target, n);
+		}
+	} break;
+
+	case TraceCommand::Draw: {
+		unsigned int firstVertex = readU32();
+		renderer.draw(firstVertex, readU32());
+	} break;
+
+	case TraceCommand::DrawIndexedInstanced: {
+		unsigned int vertexCount = readU32();
+		renderer.drawIndexedInstanced(vertexCount, readU32());
+	} break;
+
+	case TraceCommand::DrawIndexedOffset: {
+		unsigned int vertexCount = readU32();
+		renderer.drawIndexedOffset(vertexCount, readU32());
+	} break;
+
+	case TraceCommand::DrawIndexedBaseVertex: {
+		unsigned int vertexCount = readU32();
+		unsigned int firstIndex  = readU32();
+		renderer.drawIndexedBaseVertex(vertexCount, firstIndex, static_cast<int>(readU32()));
+	} break;
+	}
+}
+
+
+}  // namespace renderer
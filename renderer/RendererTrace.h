@@ -0,0 +1,281 @@
+/*
+Copyright (c) 2015-2018 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef RENDERERTRACE_H
+#define RENDERERTRACE_H
+
+
+#include <cstdio>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Renderer.h"
+
+
+namespace renderer {
+
+
+// trace file is a header followed by a stream of commands
+// each command is one TraceCommand byte followed by its arguments
+// integers and handles are LEB128 varints, handles are recorded as their raw value
+// strings and blobs are length followed by contents
+enum class TraceCommand : uint8_t {
+	  End
+	, CreateBuffer
+	, CreateEphemeralBuffer
+	, CreateFramebuffer
+	, CreatePipeline
+	, CreateRenderPass
+	, CreateRenderTarget
+	, CreateSampler
+	, CreateTexture
+	, CreateDescriptorSetLayout
+	, GetRenderTargetTexture
+	, GetRenderTargetView
+	, DeleteBuffer
+	, DeleteFramebuffer
+	, DeleteRenderPass
+	, DeleteRenderTarget
+	, DeleteSampler
+	, DeleteTexture
+	, SetSwapchainDesc
+	, BeginFrame
+	, PresentFrame
+	, BeginRenderPass
+	, EndRenderPass
+	, BeginTimingScope
+	, EndTimingScope
+	, LayoutTransition
+	, SetScissorRect
+	, SetViewport
+	, BindPipeline
+	, BindDescriptorSet
+	, BindIndexBuffer
+	, BindVertexBuffer
+	, Blit
+	, ResolveMSAA
+	, Draw
+	, DrawIndexedInstanced
+	, DrawIndexedOffset
+	, DrawIndexedBaseVertex
+	, Count
+};
+
+
+// records Renderer calls
+// Renderer facade calls this after forwarding to the backend so creation calls know their result
+class TraceWriter {
+	FILE                  *file;
+	std::vector<uint8_t>   buffer;
+	// descriptor set contents are recorded using their layouts
+	std::unordered_map<uint32_t, std::vector<DescriptorLayout> >  dsLayouts;
+
+
+	void flush();
+
+	void command(TraceCommand c);
+	void writeU32(uint32_t value);
+	void writeBool(bool value);
+	void writeFloat(float value);
+	void writeString(const std::string &str);
+	void writeBlob(const void *data, uint32_t size);
+
+	template <typename T> void writeHandle(const Handle<T> &handle) {
+		writeU32(handle.handle);
+	}
+
+	template <typename E> void writeEnum(E value) {
+		writeU32(static_cast<uint32_t>(value));
+	}
+
+	void writeSwapchainDesc(const SwapchainDesc &desc);
+
+
+public:
+
+	TraceWriter(const std::string &filename, const RendererDesc &desc);
+
+	TraceWriter(const TraceWriter &)            = delete;
+	TraceWriter &operator=(const TraceWriter &) = delete;
+	TraceWriter(TraceWriter &&)                 = delete;
+	TraceWriter &operator=(TraceWriter &&)      = delete;
+
+	~TraceWriter();
+
+	void createBuffer(BufferHandle handle, BufferType type, uint32_t size, const void *contents);
+	void createEphemeralBuffer(BufferHandle handle, BufferType type, uint32_t size, const void *contents);
+	void createFramebuffer(FramebufferHandle handle, const FramebufferDesc &desc);
+	void createPipeline(PipelineHandle handle, const PipelineDesc &desc);
+	void createRenderPass(RenderPassHandle handle, const RenderPassDesc &desc);
+	void createRenderTarget(RenderTargetHandle handle, const RenderTargetDesc &desc);
+	void createSampler(SamplerHandle handle, const SamplerDesc &desc);
+	void createTexture(TextureHandle handle, const TextureDesc &desc);
+	void createDescriptorSetLayout(DSLayoutHandle handle, const DescriptorLayout *layout);
+	void getRenderTargetTexture(TextureHandle handle, RenderTargetHandle rt);
+	void getRenderTargetView(TextureHandle handle, RenderTargetHandle rt, Format f);
+
+	void deleteBuffer(BufferHandle handle);
+	void deleteFramebuffer(FramebufferHandle handle);
+	void deleteRenderPass(RenderPassHandle handle);
+	void deleteRenderTarget(RenderTargetHandle handle);
+	void deleteSampler(SamplerHandle handle);
+	void deleteTexture(TextureHandle handle);
+
+	void setSwapchainDesc(const SwapchainDesc &desc);
+
+	void beginFrame();
+	void presentFrame(RenderTargetHandle image);
+	void beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle);
+	void endRenderPass();
+	void beginTimingScope(const std::string &name);
+	void endTimingScope();
+	void layoutTransition(RenderTargetHandle image, Layout src, Layout dest);
+	void setScissorRect(unsigned int x, unsigned int y, unsigned int width, unsigned int height);
+	void setViewport(unsigned int x, unsigned int y, unsigned int width, unsigned int height);
+	void bindPipeline(PipelineHandle pipeline);
+	void bindDescriptorSet(unsigned int index, DSLayoutHandle layout, const void *data);
+	void bindIndexBuffer(BufferHandle buffer_, bool bit16);
+	void bindVertexBuffer(unsigned int binding, BufferHandle buffer_);
+	void blit(FramebufferHandle source, FramebufferHandle target, unsigned int n);
+	void resolveMSAA(FramebufferHandle source, FramebufferHandle target, unsigned int n);
+	void draw(unsigned int firstVertex, unsigned int vertexCount);
+	void drawIndexedInstanced(unsigned int vertexCount, unsigned int instanceCount);
+	void drawIndexedOffset(unsigned int vertexCount, unsigned int firstIndex);
+	void drawIndexedBaseVertex(unsigned int vertexCount, unsigned int firstIndex, int baseVertex);
+};
+
+
+// plays back a trace recorded by TraceWriter against any Renderer
+// recorded handles are mapped to the ones the replaying renderer returns
+class TraceReplayer {
+	struct DSLayout {
+		DSLayoutHandle                 handle;
+		std::vector<DescriptorLayout>  layout;
+		// size of the struct the layout describes
+		unsigned int                   size;
+	};
+
+	MappedFile         contents;
+	size_t             pos;
+	RendererDesc       desc;
+	unsigned int       numCommands;
+
+	std::unordered_map<uint32_t, BufferHandle>        buffers;
+	std::unordered_map<uint32_t, DSLayout>            dsLayouts;
+	std::unordered_map<uint32_t, FramebufferHandle>   framebuffers;
+	std::unordered_map<uint32_t, PipelineHandle>      pipelines;
+	std::unordered_map<uint32_t, RenderPassHandle>    renderPasses;
+	std::unordered_map<uint32_t, RenderTargetHandle>  renderTargets;
+	std::unordered_map<uint32_t, SamplerHandle>       samplers;
+	std::unordered_map<uint32_t, TextureHandle>       textures;
+
+	// ephemeral buffers only live until the end of the frame
+	std::vector<uint32_t>  ephemeralBuffers;
+
+	// scratch space for descriptor set contents
+	std::vector<uint64_t>  dsData;
+
+
+	void error(const char *message);
+
+	uint8_t      readU8();
+	uint32_t     readU32();
+	bool         readBool();
+	float        readFloat();
+	std::string  readString();
+	const char  *readBlob(uint32_t &size);
+
+	template <typename E> E readEnum(E count) {
+		uint32_t value = readU32();
+		if (value >= static_cast<uint32_t>(count)) {
+			error("enum value out of range");
+		}
+		return static_cast<E>(value);
+	}
+
+	// looks up recorded handle, 0 is always the null handle
+	template <typename T> T lookup(std::unordered_map<uint32_t, T> &map) {
+		uint32_t id = readU32();
+		if (id == 0) {
+			return T();
+		}
+
+		auto it = map.find(id);
+		if (it == map.end()) {
+			error("unknown handle");
+		}
+		return it->second;
+	}
+
+	// removes recorded handle from map and returns it
+	template <typename T> T remove(std::unordered_map<uint32_t, T> &map) {
+		uint32_t id = readU32();
+		auto it = map.find(id);
+		if (it == map.end()) {
+			error("unknown handle");
+		}
+		T handle = it->second;
+		map.erase(it);
+		return handle;
+	}
+
+	SwapchainDesc readSwapchainDesc();
+
+	void replayCommand(Renderer &renderer, TraceCommand c);
+
+
+public:
+
+	explicit TraceReplayer(const std::string &filename);
+
+	TraceReplayer(const TraceReplayer &)            = delete;
+	TraceReplayer &operator=(const TraceReplayer &) = delete;
+	TraceReplayer(TraceReplayer &&)                 = delete;
+	TraceReplayer &operator=(TraceReplayer &&)      = delete;
+
+	~TraceReplayer();
+
+	// desc the trace was recorded with, vsync is turned off
+	// can be adjusted before creating the renderer
+	RendererDesc &getRendererDesc() {
+		return desc;
+	}
+
+
+	unsigned int getNumCommands() const {
+		return numCommands;
+	}
+
+	// replays commands up to and including the next presentFrame
+	// returns false when the trace has ended
+	bool replayFrame(Renderer &renderer);
+};
+
+
+}  // namespace renderer
+
+
+#endif  // RENDERERTRACE_H
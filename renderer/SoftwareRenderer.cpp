@@ -0,0 +1,1467 @@
+/*
+Copyright (c) 2015-2018 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifdef RENDERER_SOFTWARE
+
+#include <chrono>
+#include <stdexcept>
+
+#include <glm/gtc/packing.hpp>
+
+#include "RendererInternal.h"
+#include "utils/JobSystem.h"
+#include "utils/Profiler.h"
+#include "utils/Utils.h"
+
+
+namespace renderer {
+
+
+// rounds value to what the rendertarget format can store
+static inline glm::vec4 quantize(Format format, glm::vec4 v) {
+	switch (format) {
+	case Format::Invalid:
+		UNREACHABLE();
+		break;
+
+	case Format::R8:
+		v = glm::round(glm::clamp(v, 0.0f, 1.0f) * 255.0f) / 255.0f;
+		return glm::vec4(v.x, 0.0f, 0.0f, 1.0f);
+
+	case Format::RG8:
+		v = glm::round(glm::clamp(v, 0.0f, 1.0f) * 255.0f) / 255.0f;
+		return glm::vec4(v.x, v.y, 0.0f, 1.0f);
+
+	case Format::RGB8:
+		v = glm::round(glm::clamp(v, 0.0f, 1.0f) * 255.0f) / 255.0f;
+		return glm::vec4(v.x, v.y, v.z, 1.0f);
+
+	case Format::RGBA8:
+		return glm::round(glm::clamp(v, 0.0f, 1.0f) * 255.0f) / 255.0f;
+
+	case Format::sRGBA8: {
+		v = glm::clamp(v, 0.0f, 1.0f);
+		return glm::vec4(swQuantizeSRGB(v.x), swQuantizeSRGB(v.y), swQuantizeSRGB(v.z), std::round(v.w * 255.0f) / 255.0f);
+	}
+
+	case Format::RG16Float:
+		return glm::vec4(v.x, v.y, 0.0f, 1.0f);
+
+	case Format::RGBA16Float:
+	case Format::RGBA32Float:
+		return v;
+
+	case Format::Depth16:
+	case Format::Depth16S8:
+	case Format::Depth24S8:
+	case Format::Depth24X8:
+	case Format::Depth32Float:
+		return glm::vec4(glm::clamp(v.x, 0.0f, 1.0f), 0.0f, 0.0f, 1.0f);
+
+	case Format::BC1:
+	case Format::sBC1:
+	case Format::BC3:
+	case Format::sBC3:
+	case Format::BC7:
+	case Format::sBC7:
+		// not renderable
+		UNREACHABLE();
+		break;
+	}
+
+	UNREACHABLE();
+	return v;
+}
+
+
+static float blendFactor(BlendFunc f, float srcAlpha) {
+	switch (f) {
+	case BlendFunc::Zero:
+		return 0.0f;
+
+	case BlendFunc::One:
+		return 1.0f;
+
+	case BlendFunc::Constant:
+		// TODO: get from desc, same as other renderers
+		return 0.5f;
+
+	case BlendFunc::SrcAlpha:
+		return srcAlpha;
+
+	case BlendFunc::OneMinusSrcAlpha:
+		return 1.0f - srcAlpha;
+	}
+
+	UNREACHABLE();
+	return 0.0f;
+}
+
+
+// texel in the memory layout of format, texels are already quantized
+static void encodeTexel(Format format, const glm::vec4 &v, char *dst_) {
+	uint8_t *dst = reinterpret_cast<uint8_t *>(dst_);
+	switch (format) {
+	case Format::Invalid:
+	case Format::Depth16:
+	case Format::Depth16S8:
+	case Format::Depth24S8:
+	case Format::Depth24X8:
+	case Format::Depth32Float:
+	case Format::BC1:
+	case Format::sBC1:
+	case Format::BC3:
+	case Format::sBC3:
+	case Format::BC7:
+	case Format::sBC7:
+		UNREACHABLE();
+		break;
+
+	case Format::R8:
+	case Format::RG8:
+	case Format::RGB8:
+	case Format::RGBA8: {
+		unsigned int n = formatSize(format);
+		for (unsigned int i = 0; i < n; i++) {
+			dst[i] = static_cast<uint8_t>(std::round(v[i] * 255.0f));
+		}
+	} break;
+
+	case Format::sRGBA8:
+		dst[0] = swEncodeSRGB8(v.x);
+		dst[1] = swEncodeSRGB8(v.y);
+		dst[2] = swEncodeSRGB8(v.z);
+		dst[3] = static_cast<uint8_t>(std::round(v.w * 255.0f));
+		break;
+
+	case Format::RG16Float: {
+		uint32_t packed = glm::packHalf2x16(glm::vec2(v));
+		memcpy(dst, &packed, sizeof(packed));
+	} break;
+
+	case Format::RGBA16Float: {
+		uint32_t packed[2] = { glm::packHalf2x16(glm::vec2(v.x, v.y)), glm::packHalf2x16(glm::vec2(v.z, v.w)) };
+		memcpy(dst, packed, sizeof(packed));
+	} break;
+
+	case Format::RGBA32Float:
+		memcpy(dst, &v, sizeof(v));
+		break;
+	}
+}
+
+
+static float edgeFunction(const glm::vec4 &a, const glm::vec4 &b, float x, float y) {
+	return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+}
+
+
+static SWFloat edgeFunction(const glm::vec4 &a, const glm::vec4 &b, const SWFloat &x, const SWFloat &y) {
+	return SWFloat(b.x - a.x) * (y - SWFloat(a.y)) - SWFloat(b.y - a.y) * (x - SWFloat(a.x));
+}
+
+
+// top-left fill rule for positive area triangles in window coordinates
+static bool isTopLeft(const glm::vec4 &a, const glm::vec4 &b) {
+	return (a.y == b.y && b.x > a.x) || (b.y < a.y);
+}
+
+
+static SWVertex lerpVertex(const SWVertex &a, const SWVertex &b, float t) {
+	SWVertex result;
+	result.position = glm::mix(a.position, b.position, t);
+	for (unsigned int i = 0; i < SW_MAX_VARYINGS; i++) {
+		result.varyings[i] = glm::mix(a.varyings[i], b.varyings[i], t);
+	}
+	return result;
+}
+
+
+RendererImpl::RendererImpl(const RendererDesc &desc)
+: RendererBase(desc)
+, indexBuffer16(false)
+, viewport(0, 0, 0, 0)
+, scissor(0, 0, 0, 0)
+, swapchainWidth(0)
+, swapchainHeight(0)
+{
+	SDL_Init(SDL_INIT_EVENTS);
+
+	currentRefreshRate = 60;
+	maxRefreshRate     = 60;
+
+	// MSAA rendertargets are accepted but only have one sample
+	features.maxMSAASamples  = 16;
+	features.sRGBFramebuffer = true;
+	features.SSBOSupported   = true;
+	// timing scopes measure CPU time
+	features.timestamps      = true;
+
+	recreateRingBuffer(desc.ephemeralRingBufSize);
+	drawableSize   = glm::uvec2(desc.swapchain.width, desc.swapchain.height);
+
+	frames.resize(desc.swapchain.numFrames);
+
+	LOG("Software renderer using %u threads\n", jobSystemNumThreads());
+}
+
+
+void RendererImpl::recreateRingBuffer(unsigned int newSize) {
+	assert(newSize > 0);
+
+	ringBufPtr  = 0;
+	ringBufSize = newSize;
+	ringBuffer.resize(newSize, 0);
+}
+
+
+RendererImpl::~RendererImpl() {
+	for (unsigned int i = 0; i < frames.size(); i++) {
+		auto &f = frames.at(i);
+		if (f.outstanding) {
+			waitForFrame(i);
+		}
+		deleteFrameInternal(f);
+	}
+	frames.clear();
+
+	SDL_Quit();
+}
+
+
+bool RendererImpl::isRenderTargetFormatSupported(Format /* format */) const {
+	return true;
+}
+
+
+BufferHandle RendererImpl::createBuffer(BufferType /* type */, uint32_t size, const void *contents) {
+	assert(size != 0);
+	assert(contents != nullptr);
+
+	auto result    = buffers.add();
+	Buffer &buffer = result.first;
+	buffer.ringBufferAlloc = false;
+	buffer.beginOffs       = 0;
+	buffer.size            = size;
+	buffer.contents.resize(size);
+	memcpy(&buffer.contents[0], contents, size);
+
+	return result.second;
+}
+
+
+BufferHandle RendererImpl::createEphemeralBuffer(BufferType /* type */, uint32_t size, const void *contents) {
+	assert(size != 0);
+	assert(contents != nullptr);
+
+	unsigned int beginPtr = ringBufferAllocate(size, 256);
+
+	memcpy(&ringBuffer[beginPtr], contents, size);
+
+	auto result    = buffers.add();
+	Buffer &buffer = result.first;
+	buffer.ringBufferAlloc = true;
+	buffer.beginOffs       = beginPtr;
+	buffer.size            = size;
+
+	frames.at(currentFrameIdx).ephemeralBuffers.push_back(result.second);
+
+	return result.second;
+}
+
+
+FramebufferHandle RendererImpl::createFramebuffer(const FramebufferDesc &desc) {
+	auto result = framebuffers.add();
+	auto &fb = result.first;
+	fb.desc     = desc;
+
+	RenderTargetHandle first = desc.colors_[0] ? desc.colors_[0] : desc.depthStencil_;
+	assert(first);
+	const auto &rt = rendertargets.get(first);
+	fb.width  = rt.width;
+	fb.height = rt.height;
+
+	return result.second;
+}
+
+
+RenderPassHandle RendererImpl::createRenderPass(const RenderPassDesc &desc) {
+	auto result = renderpasses.add();
+	auto &rp    = result.first;
+	rp.desc     = desc;
+
+	return result.second;
+}
+
+
+PipelineHandle RendererImpl::createPipeline(const PipelineDesc &desc) {
+	PROFILE_FUNCTION();
+
+	// same flip as the Vulkan renderer
+	ShaderMacros macros = desc.shaderMacros_;
+	macros.emplace("VULKAN_FLIP", "1");
+
+	// look up shaders first so a failure doesn't leave an empty pipeline behind
+	const SWShaderInfo *vertexShader = findSWShader(desc.vertexShaderName + ".vert", macros);
+	if (!vertexShader || !vertexShader->vertexShader) {
+		LOG("No software vertex shader \"%s\" with these macros for pipeline \"%s\", add it to swShaderGen\n", desc.vertexShaderName.c_str(), desc.name_.c_str());
+		throw std::runtime_error("No software vertex shader");
+	}
+
+	const SWShaderInfo *fragmentShader = findSWShader(desc.fragmentShaderName + ".frag", macros);
+	if (!fragmentShader || !fragmentShader->fragmentShader) {
+		LOG("No software fragment shader \"%s\" with these macros for pipeline \"%s\", add it to swShaderGen\n", desc.fragmentShaderName.c_str(), desc.name_.c_str());
+		throw std::runtime_error("No software fragment shader");
+	}
+
+	auto result = pipelines.add();
+	auto &pipeline = result.first;
+	pipeline.desc           = desc;
+	pipeline.vertexShader   = vertexShader->vertexShader;
+	pipeline.fragmentShader = fragmentShader->fragmentShader;
+	pipeline.numVaryings    = fragmentShader->numVaryings;
+	pipeline.flatVaryings   = fragmentShader->flatVaryings;
+
+	return result.second;
+}
+
+
+RenderTargetHandle RendererImpl::createRenderTarget(const RenderTargetDesc &desc) {
+	assert(desc.width_  > 0);
+	assert(desc.height_ > 0);
+	assert(desc.format_ != Format::Invalid);
+
+	auto result = rendertargets.add();
+	auto &rt    = result.first;
+	rt.width    = desc.width_;
+	rt.height   = desc.height_;
+	rt.format   = desc.format_;
+	rt.texels.resize(rt.width * rt.height, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+
+	{
+		auto texResult    = textures.add();
+		Texture &tex      = texResult.first;
+		tex.width         = rt.width;
+		tex.height        = rt.height;
+		tex.format        = rt.format;
+		tex.renderTarget  = result.second;
+		rt.texture        = texResult.second;
+	}
+
+	if (desc.additionalViewFormat_ != Format::Invalid) {
+		auto texResult    = textures.add();
+		Texture &tex      = texResult.first;
+		tex.width         = rt.width;
+		tex.height        = rt.height;
+		tex.format        = desc.additionalViewFormat_;
+		tex.renderTarget  = result.second;
+		rt.additionalView = texResult.second;
+	}
+
+	return result.second;
+}
+
+
+SamplerHandle RendererImpl::createSampler(const SamplerDesc &desc) {
+	auto result = samplers.add();
+	Sampler &sampler = result.first;
+	sampler.desc = desc;
+
+	return result.second;
+}
+
+
+TextureHandle RendererImpl::createTexture(const TextureDesc &desc) {
+	assert(desc.width_   > 0);
+	assert(desc.height_  > 0);
+	assert(desc.numMips_ > 0);
+
+	// block compressed formats are not decoded, textureCompressionBC is false
+	if (isBlockFormat(desc.format_)) {
+		LOG("Texture format %s not supported by software renderer\n", formatName(desc.format_));
+		throw std::runtime_error("Unsupported texture format");
+	}
+
+	// only the top level is used, sampling doesn't do mipmapping
+	const auto &mip = desc.mipData_[0];
+	unsigned int numTexels = desc.width_ * desc.height_;
+
+	if (mip.size < numTexels * formatSize(desc.format_)) {
+		LOG("Texture \"%s\" data is %u bytes, expected %u\n", desc.name_.c_str(), mip.size, numTexels * formatSize(desc.format_));
+		throw std::runtime_error("Texture data too small");
+	}
+
+	auto result = textures.add();
+	Texture &texture = result.first;
+	texture.width  = desc.width_;
+	texture.height = desc.height_;
+	texture.format = desc.format_;
+	texture.texels.resize(numTexels);
+
+	const uint8_t *bytes = reinterpret_cast<const uint8_t *>(mip.data);
+	for (unsigned int i = 0; i < numTexels; i++) {
+		glm::vec4 &t = texture.texels[i];
+		switch (desc.format_) {
+		case Format::R8:
+			t = glm::vec4(bytes[i] / 255.0f, 0.0f, 0.0f, 1.0f);
+			break;
+
+		case Format::RG8:
+			t = glm::vec4(bytes[i * 2 + 0] / 255.0f, bytes[i * 2 + 1] / 255.0f, 0.0f, 1.0f);
+			break;
+
+		case Format::RGB8:
+			t = glm::vec4(bytes[i * 3 + 0] / 255.0f, bytes[i * 3 + 1] / 255.0f, bytes[i * 3 + 2] / 255.0f, 1.0f);
+			break;
+
+		case Format::RGBA8:
+			t = glm::vec4(bytes[i * 4 + 0] / 255.0f, bytes[i * 4 + 1] / 255.0f, bytes[i * 4 + 2] / 255.0f, bytes[i * 4 + 3] / 255.0f);
+			break;
+
+		case Format::sRGBA8:
+			t = glm::vec4(swSRGBToLinear(bytes[i * 4 + 0] / 255.0f)
+			            , swSRGBToLinear(bytes[i * 4 + 1] / 255.0f)
+			            , swSRGBToLinear(bytes[i * 4 + 2] / 255.0f)
+			            , bytes[i * 4 + 3] / 255.0f);
+			break;
+
+		case Format::RGBA32Float:
+			memcpy(&t, bytes + i * sizeof(glm::vec4), sizeof(glm::vec4));
+			break;
+
+		default:
+			LOG("Texture format %s not supported by software renderer\n", formatName(desc.format_));
+			throw std::runtime_error("Unsupported texture format");
+		}
+	}
+
+	return result.second;
+}
+
+
+// texels are converted from CPU memory by createTexture
+TextureUpload RendererImpl::beginTextureUpload(const TextureDesc &desc) {
+	return beginScratchTextureUpload(desc);
+}
+
+
+TextureHandle RendererImpl::endTextureUpload(TextureUpload & /* upload */) {
+	// scratch uploads are finished by Renderer::endTextureUpload
+	UNREACHABLE();
+}
+
+
+DSLayoutHandle RendererImpl::createDescriptorSetLayout(const DescriptorLayout *layout) {
+	auto result = dsLayouts.add();
+	DescriptorSetLayout &dsLayout = result.first;
+
+	while (layout->type != DescriptorType::End) {
+		dsLayout.layout.push_back(*layout);
+		layout++;
+	}
+	assert(layout->offset == 0);
+	assert(dsLayout.layout.size() <= SW_MAX_BINDINGS);
+
+	return result.second;
+}
+
+
+TextureHandle RendererImpl::getRenderTargetTexture(RenderTargetHandle handle) {
+	const auto &rt = rendertargets.get(handle);
+
+	return rt.texture;
+}
+
+
+TextureHandle RendererImpl::getRenderTargetView(RenderTargetHandle handle, Format f) {
+	const auto &rt = rendertargets.get(handle);
+
+	if (f == rt.format) {
+		return rt.texture;
+	}
+
+	assert(rt.additionalView);
+	assert(textures.get(rt.additionalView).format == f);
+	return rt.additionalView;
+}
+
+
+void RendererImpl::deleteBuffer(BufferHandle handle) {
+	buffers.removeWith(handle, [](Buffer &b) {
+		assert(!b.ringBufferAlloc);
+		assert(b.size != 0);
+		b.size = 0;
+		b.contents.clear();
+	} );
+}
+
+
+void RendererImpl::deleteFramebuffer(FramebufferHandle handle) {
+	framebuffers.remove(handle);
+}
+
+
+void RendererImpl::deleteRenderPass(RenderPassHandle handle) {
+	renderpasses.remove(handle);
+}
+
+
+void RendererImpl::deleteRenderTarget(RenderTargetHandle &handle) {
+	rendertargets.removeWith(handle, [this](RenderTarget &rt) {
+		assert(rt.texture);
+		this->textures.remove(rt.texture);
+		rt.texture = TextureHandle();
+
+		if (rt.additionalView) {
+			this->textures.remove(rt.additionalView);
+			rt.additionalView = TextureHandle();
+		}
+	} );
+}
+
+
+void RendererImpl::deleteSampler(SamplerHandle handle) {
+	samplers.remove(handle);
+}
+
+
+void RendererImpl::deleteTexture(TextureHandle handle) {
+	textures.removeWith(handle, [](Texture &tex) {
+		assert(!tex.renderTarget);
+		tex.texels.clear();
+	} );
+}
+
+
+void RendererImpl::setSwapchainDesc(const SwapchainDesc &desc) {
+	swapchainDesc  = desc;
+	drawableSize   = glm::uvec2(desc.width, desc.height);
+}
+
+
+MemoryStats RendererImpl::getMemStats() const {
+	MemoryStats stats;
+	return stats;
+}
+
+
+void RendererImpl::beginFrame() {
+	PROFILE_FUNCTION();
+
+	assert(!inFrame);
+	inFrame       = true;
+	inRenderPass  = false;
+	validPipeline = false;
+	pipelineDrawn = true;
+
+	currentFrameIdx        = frameNum % frames.size();
+	assert(currentFrameIdx < frames.size());
+	auto &frame            = frames.at(currentFrameIdx);
+
+	if (frame.outstanding) {
+		waitForFrame(currentFrameIdx);
+	}
+	assert(!frame.outstanding);
+
+	// descriptor sets stay bound across render passes like in Vulkan
+	// but not across frames since ephemeral buffers go away
+	for (unsigned int i = 0; i < MAX_DESCRIPTOR_SETS; i++) {
+		boundDSLayouts[i] = DSLayoutHandle();
+		boundDSData[i].clear();
+	}
+}
+
+
+void RendererImpl::presentFrame(RenderTargetHandle rtHandle) {
+	PROFILE_FUNCTION();
+
+	assert(inFrame);
+	inFrame = false;
+	assert(openTimingScopes.empty());
+
+	// copy to swapchain image so it can be read back
+	const auto &rt  = rendertargets.get(rtHandle);
+	swapchainWidth  = rt.width;
+	swapchainHeight = rt.height;
+	swapchainImage.resize(rt.width * rt.height);
+	bool sRGB = (rt.format == Format::sRGBA8);
+	for (unsigned int i = 0; i < swapchainImage.size(); i++) {
+		glm::vec4 c = glm::clamp(rt.texels[i], 0.0f, 1.0f);
+		glm::uvec4 u(glm::round(c * 255.0f));
+		if (sRGB) {
+			u.x = swEncodeSRGB8(c.x);
+			u.y = swEncodeSRGB8(c.y);
+			u.z = swEncodeSRGB8(c.z);
+		}
+		swapchainImage[i] = u.x | (u.y << 8) | (u.z << 16) | (u.w << 24);
+	}
+
+	auto &frame = frames.at(currentFrameIdx);
+
+	frame.usedRingBufPtr = ringBufPtr;
+	frame.outstanding    = true;
+	frame.lastFrameNum   = frameNum;
+
+	frameNum++;
+}
+
+
+void RendererImpl::waitForFrame(unsigned int frameIdx) {
+	PROFILE_FUNCTION();
+
+	assert(frameIdx < frames.size());
+
+	Frame &frame = frames.at(frameIdx);
+	assert(frame.outstanding);
+
+	for (auto handle : frame.ephemeralBuffers) {
+		Buffer &buffer = buffers.get(handle);
+		assert(buffer.ringBufferAlloc);
+		buffer.ringBufferAlloc = false;
+
+		assert(buffer.size   >  0);
+		buffer.size = 0;
+		buffer.beginOffs = 0;
+
+		buffers.remove(handle);
+	}
+	frame.ephemeralBuffers.clear();
+
+	if (!frame.timingScopes.empty()) {
+		resolveTimingScopes(frame.lastFrameNum, frame.timingScopes, frame.timestamps);
+		frame.timingScopes.clear();
+	}
+	frame.timestamps.clear();
+
+	frame.outstanding    = false;
+	lastSyncedFrame      = std::max(lastSyncedFrame, frame.lastFrameNum);
+	lastSyncedRingBufPtr = std::max(lastSyncedRingBufPtr, frame.usedRingBufPtr);
+	retireFrameArena(frameIdx);
+
+	for (auto &r : frame.readbacks) {
+		r.result.data = &r.data[0];
+		r.callback(r.result);
+	}
+	frame.readbacks.clear();
+}
+
+
+void RendererImpl::deleteFrameInternal(Frame &f) {
+	assert(!f.outstanding);
+}
+
+
+unsigned int RendererImpl::writeTimestamp(bool /* begin */) {
+	auto &frame = frames.at(currentFrameIdx);
+
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	unsigned int index = static_cast<unsigned int>(frame.timestamps.size());
+	frame.timestamps.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+
+	return index;
+}
+
+
+bool RendererImpl::isRenderPassCompatible(const RenderPass &pass, const Framebuffer &fb) {
+	if (fb.desc.depthStencil_) {
+		if (pass.desc.depthStencilFormat_ != rendertargets.get(fb.desc.depthStencil_).format) {
+			return false;
+		}
+	} else if (pass.desc.depthStencilFormat_ != Format::Invalid) {
+		return false;
+	}
+
+	for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
+		if (fb.desc.colors_[i]) {
+			if (pass.desc.colorRTs_[i].format != rendertargets.get(fb.desc.colors_[i]).format) {
+				return false;
+			}
+		} else if (pass.desc.colorRTs_[i].format != Format::Invalid) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+void RendererImpl::beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle) {
+	assert(inFrame);
+	assert(!inRenderPass);
+	inRenderPass  = true;
+	validPipeline = false;
+
+	assert(fbHandle);
+	const auto &fb = framebuffers.get(fbHandle);
+	const auto &rp = renderpasses.get(rpHandle);
+
+	// make sure renderpass and framebuffer match
+	assert(fb.desc.renderPass_ == rpHandle || isRenderPassCompatible(rp, fb));
+
+	beginTimingScope(rp.desc.name_);
+
+	currentFramebuffer = fbHandle;
+	targets            = SWTargets();
+	targets.width      = fb.width;
+	targets.height     = fb.height;
+
+	for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
+		if (!fb.desc.colors_[i]) {
+			continue;
+		}
+
+		auto &rt = rendertargets.get(fb.desc.colors_[i]);
+		assert(rt.width == fb.width && rt.height == fb.height);
+		targets.color[i]       = &rt.texels[0];
+		targets.colorFormat[i] = rt.format;
+
+		const auto &info = rp.desc.colorRTs_[i];
+		if (info.passBegin == PassBegin::Clear) {
+			std::fill(rt.texels.begin(), rt.texels.end(), quantize(rt.format, info.clearValue));
+		}
+	}
+
+	if (fb.desc.depthStencil_) {
+		auto &rt = rendertargets.get(fb.desc.depthStencil_);
+		assert(isDepthFormat(rt.format));
+		targets.depth = &rt.texels[0];
+
+		if (rp.desc.clearDepthAttachment) {
+			std::fill(rt.texels.begin(), rt.texels.end(), glm::vec4(rp.desc.depthClearValue, 0.0f, 0.0f, 1.0f));
+		}
+	}
+
+	viewport = glm::ivec4(0, 0, fb.width, fb.height);
+	scissor  = viewport;
+}
+
+
+void RendererImpl::endRenderPass() {
+	assert(inFrame);
+	assert(inRenderPass);
+	inRenderPass = false;
+
+	currentFramebuffer = FramebufferHandle();
+	targets            = SWTargets();
+
+	endTimingScope();
+}
+
+
+void RendererImpl::layoutTransition(RenderTargetHandle image, Layout src, Layout dest) {
+	assert(image);
+	assert(dest != Layout::Undefined);
+	assert(src != dest);
+}
+
+
+void RendererImpl::bindPipeline(PipelineHandle pipeline) {
+	assert(inFrame);
+	assert(pipeline);
+	assert(inRenderPass);
+	assert(pipelineDrawn);
+	pipelineDrawn = false;
+	validPipeline = true;
+	scissorSet = false;
+
+	currentPipeline = pipeline;
+	scissor         = glm::ivec4(0, 0, targets.width, targets.height);
+}
+
+
+void RendererImpl::bindIndexBuffer(BufferHandle buffer, bool bit16) {
+	assert(inFrame);
+	assert(validPipeline);
+
+	indexBuffer   = buffer;
+	indexBuffer16 = bit16;
+}
+
+
+void RendererImpl::bindVertexBuffer(unsigned int binding, BufferHandle buffer) {
+	assert(inFrame);
+	assert(validPipeline);
+	assert(binding < MAX_VERTEX_BUFFERS);
+
+	vertexBuffers[binding] = buffer;
+}
+
+
+void RendererImpl::bindDescriptorSet(unsigned int index, DSLayoutHandle layout, const void *data_) {
+	assert(validPipeline);
+	assert(index < MAX_DESCRIPTOR_SETS);
+
+	const auto &dsLayout = dsLayouts.get(layout);
+	unsigned int size = 0;
+	for (const auto &l : dsLayout.layout) {
+		size = std::max(size, l.offset + descriptorSize(l.type));
+	}
+
+	const char *data = reinterpret_cast<const char *>(data_);
+	boundDSLayouts[index] = layout;
+	boundDSData[index].assign(data, data + size);
+}
+
+
+void RendererImpl::setViewport(unsigned int x, unsigned int y, unsigned int width, unsigned int height) {
+	assert(inFrame);
+
+	viewport = glm::ivec4(x, y, width, height);
+}
+
+
+void RendererImpl::setScissorRect(unsigned int x, unsigned int y, unsigned int width, unsigned int height) {
+	assert(validPipeline);
+	assert(pipelines.get(currentPipeline).desc.scissorTest_);
+	scissorSet = true;
+
+	scissor = glm::ivec4(x, y, width, height);
+}
+
+
+void RendererImpl::copyRenderTarget(RenderTargetHandle source, RenderTargetHandle target) {
+	const auto &src = rendertargets.get(source);
+	auto &dst       = rendertargets.get(target);
+
+	// nearest neighbor scaling if sizes differ
+	for (unsigned int y = 0; y < dst.height; y++) {
+		unsigned int srcY = (y * src.height) / dst.height;
+		for (unsigned int x = 0; x < dst.width; x++) {
+			unsigned int srcX = (x * src.width) / dst.width;
+			dst.texels[y * dst.width + x] = quantize(dst.format, src.texels[srcY * src.width + srcX]);
+		}
+	}
+}
+
+
+void RendererImpl::blit(FramebufferHandle source, FramebufferHandle target, unsigned int n) {
+	assert(source);
+	assert(target);
+	assert(n == 0);
+
+	assert(!inRenderPass);
+
+	copyRenderTarget(framebuffers.get(source).desc.colors_[n], framebuffers.get(target).desc.colors_[n]);
+}
+
+
+void RendererImpl::resolveMSAA(FramebufferHandle source, FramebufferHandle target, unsigned int n) {
+	assert(source);
+	assert(target);
+	assert(n == 0);
+
+	assert(!inRenderPass);
+
+	// only one sample, resolve is a copy
+	copyRenderTarget(framebuffers.get(source).desc.colors_[n], framebuffers.get(target).desc.colors_[n]);
+}
+
+
+void RendererImpl::readbackRenderTarget(RenderTargetHandle handle, unsigned int x, unsigned int y, unsigned int width, unsigned int height, ReadbackCallback callback) {
+	assert(inFrame);
+	assert(!inRenderPass);
+	assert(callback);
+
+	const auto &rt = rendertargets.get(handle);
+	assert(!isDepthFormat(rt.format));
+
+	if (width == 0 && height == 0) {
+		width  = rt.width;
+		height = rt.height;
+	}
+	assert(x + width  <= rt.width);
+	assert(y + height <= rt.height);
+
+	unsigned int texelSize = formatSize(rt.format);
+
+	Readback readback;
+	readback.result.frameNum = frameNum;
+	readback.result.x        = x;
+	readback.result.y        = y;
+	readback.result.width    = width;
+	readback.result.height   = height;
+	readback.result.format   = rt.format;
+	readback.result.size     = width * height * texelSize;
+	readback.callback        = std::move(callback);
+
+	// rendering is already done so copy now, deliver when the frame completes like other renderers
+	readback.data.resize(readback.result.size);
+	char *dst = &readback.data[0];
+	for (unsigned int j = 0; j < height; j++) {
+		for (unsigned int i = 0; i < width; i++) {
+			encodeTexel(rt.format, rt.texels[(y + j) * rt.width + x + i], dst);
+			dst += texelSize;
+		}
+	}
+
+	frames.at(currentFrameIdx).readbacks.push_back(std::move(readback));
+}
+
+
+const char *RendererImpl::bufferData(BufferHandle handle) const {
+	const auto &buffer = buffers.get(handle);
+	if (buffer.ringBufferAlloc) {
+		return &ringBuffer[buffer.beginOffs];
+	}
+
+	return &buffer.contents[0];
+}
+
+
+SWImage RendererImpl::imageForTexture(TextureHandle handle) const {
+	SWImage image;
+	if (!handle) {
+		return image;
+	}
+
+	const auto &tex = textures.get(handle);
+	image.width  = tex.width;
+	image.height = tex.height;
+	if (tex.renderTarget) {
+		const auto &rt   = rendertargets.get(tex.renderTarget);
+		image.texels     = &rt.texels[0];
+		image.encodeSRGB = (rt.format == Format::sRGBA8 && tex.format != Format::sRGBA8);
+	} else {
+		image.texels     = &tex.texels[0];
+	}
+
+	return image;
+}
+
+
+void RendererImpl::resolveDescriptorSets() {
+	for (unsigned int set = 0; set < MAX_DESCRIPTOR_SETS; set++) {
+		auto &bindings = resources.sets[set];
+		std::fill(bindings.begin(), bindings.end(), SWBinding());
+
+		if (!boundDSLayouts[set]) {
+			continue;
+		}
+
+		const auto &dsLayout = dsLayouts.get(boundDSLayouts[set]);
+		const char *data     = &boundDSData[set][0];
+		for (unsigned int b = 0; b < dsLayout.layout.size(); b++) {
+			const auto &l = dsLayout.layout[b];
+			SWBinding &binding = bindings[b];
+
+			switch (l.type) {
+			case DescriptorType::End:
+			case DescriptorType::Count:
+				UNREACHABLE();
+				break;
+
+			case DescriptorType::UniformBuffer:
+			case DescriptorType::StorageBuffer: {
+				const BufferHandle &handle = *reinterpret_cast<const BufferHandle *>(data + l.offset);
+				binding.data = bufferData(handle);
+			} break;
+
+			case DescriptorType::Sampler: {
+				const SamplerHandle &handle = *reinterpret_cast<const SamplerHandle *>(data + l.offset);
+				binding.filter = samplers.get(handle).desc.mag;
+			} break;
+
+			case DescriptorType::Texture: {
+				const TextureHandle &handle = *reinterpret_cast<const TextureHandle *>(data + l.offset);
+				binding.image = imageForTexture(handle);
+			} break;
+
+			case DescriptorType::CombinedSampler: {
+				const CSampler &combined = *reinterpret_cast<const CSampler *>(data + l.offset);
+				binding.image  = imageForTexture(combined.tex);
+				// optional bindings like predication texture can be empty
+				if (combined.sampler) {
+					binding.filter = samplers.get(combined.sampler).desc.mag;
+				}
+			} break;
+			}
+		}
+	}
+}
+
+
+void RendererImpl::setupTriangle(const SWVertex &v0, const SWVertex &v1, const SWVertex &v2, bool cull, SWTriangleBatch &batch) {
+	// clip against near plane, z >= 0 in clip space
+	// can produce up to 4 vertices
+	const SWVertex *in[3] = { &v0, &v1, &v2 };
+	std::array<SWVertex, 4> clipped;
+	unsigned int numClipped = 0;
+	for (unsigned int i = 0; i < 3; i++) {
+		const SWVertex &a = *in[i];
+		const SWVertex &b = *in[(i + 1) % 3];
+		bool aInside = a.position.z >= 0.0f;
+		bool bInside = b.position.z >= 0.0f;
+
+		if (aInside) {
+			clipped[numClipped++] = a;
+		}
+		if (aInside != bInside) {
+			float t = a.position.z / (a.position.z - b.position.z);
+			clipped[numClipped++] = lerpVertex(a, b, t);
+		}
+	}
+
+	if (numClipped < 3) {
+		return;
+	}
+
+	// far plane is not clipped, only triangles entirely behind it are rejected
+	if (v0.position.z > v0.position.w && v1.position.z > v1.position.w && v2.position.z > v2.position.w) {
+		return;
+	}
+
+	// to window coordinates
+	std::array<glm::vec4, 4> windowPos;
+	for (unsigned int i = 0; i < numClipped; i++) {
+		const glm::vec4 &p = clipped[i].position;
+		if (p.w <= 0.0f) {
+			// degenerate after clipping
+			return;
+		}
+		float invW = 1.0f / p.w;
+		glm::vec3 ndc = glm::vec3(p) * invW;
+		windowPos[i].x = viewport.x + (ndc.x + 1.0f) * 0.5f * viewport.z;
+		// flipped like Vulkan renderer's negative viewport
+		windowPos[i].y = viewport.y + (1.0f - ndc.y) * 0.5f * viewport.w;
+		windowPos[i].z = ndc.z;
+		windowPos[i].w = invW;
+	}
+
+	const auto &p = pipelines.get(currentPipeline);
+	int clipMinX = std::max(0, viewport.x);
+	int clipMinY = std::max(0, viewport.y);
+	int clipMaxX = std::min(static_cast<int>(targets.width),  viewport.x + viewport.z) - 1;
+	int clipMaxY = std::min(static_cast<int>(targets.height), viewport.y + viewport.w) - 1;
+	if (p.desc.scissorTest_) {
+		clipMinX = std::max(clipMinX, scissor.x);
+		clipMinY = std::max(clipMinY, scissor.y);
+		clipMaxX = std::min(clipMaxX, scissor.x + scissor.z - 1);
+		clipMaxY = std::min(clipMaxY, scissor.y + scissor.w - 1);
+	}
+
+	// fan triangulation
+	for (unsigned int i = 1; i + 1 < numClipped; i++) {
+		unsigned int idx[3] = { 0, i, i + 1 };
+
+		float area = edgeFunction(windowPos[idx[0]], windowPos[idx[1]], windowPos[idx[2]].x, windowPos[idx[2]].y);
+		if (area == 0.0f) {
+			continue;
+		}
+
+		// Vulkan defines counterclockwise as front which is negative area here
+		if (cull && area > 0.0f) {
+			continue;
+		}
+
+		// rasterizer wants positive area
+		if (area < 0.0f) {
+			std::swap(idx[1], idx[2]);
+		}
+
+		SWTriangle tri;
+		float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+		for (unsigned int j = 0; j < 3; j++) {
+			const glm::vec4 &w = windowPos[idx[j]];
+			tri.pos[j] = w;
+			for (unsigned int k = 0; k < p.numVaryings; k++) {
+				tri.varyings[j][k] = clipped[idx[j]].varyings[k] * w.w;
+			}
+
+			minX = std::min(minX, w.x);
+			minY = std::min(minY, w.y);
+			maxX = std::max(maxX, w.x);
+			maxY = std::max(maxY, w.y);
+		}
+		for (unsigned int k = 0; k < p.numVaryings; k++) {
+			if (p.flatVaryings & (1U << k)) {
+				tri.varyings[0][k] = v0.varyings[k];
+			}
+		}
+
+		// pixel centers are at half coordinates
+		tri.minX = std::max(clipMinX, static_cast<int>(std::ceil(minX - 0.5f)));
+		tri.minY = std::max(clipMinY, static_cast<int>(std::ceil(minY - 0.5f)));
+		tri.maxX = std::min(clipMaxX, static_cast<int>(std::floor(maxX - 0.5f)));
+		tri.maxY = std::min(clipMaxY, static_cast<int>(std::floor(maxY - 0.5f)));
+
+		if (tri.minX > tri.maxX || tri.minY > tri.maxY) {
+			continue;
+		}
+
+		uint32_t index = static_cast<uint32_t>(batch.triangles.size());
+		batch.triangles.push_back(tri);
+
+		unsigned int tilesX = (targets.width + SW_TILE_SIZE - 1) / SW_TILE_SIZE;
+		for (int ty = tri.minY / SW_TILE_SIZE; ty <= tri.maxY / SW_TILE_SIZE; ty++) {
+			for (int tx = tri.minX / SW_TILE_SIZE; tx <= tri.maxX / SW_TILE_SIZE; tx++) {
+				batch.bins[ty * tilesX + tx].push_back(index);
+			}
+		}
+	}
+}
+
+
+void RendererImpl::rasterizeTile(unsigned int tile, unsigned int numBatches) {
+	unsigned int tilesX = (targets.width + SW_TILE_SIZE - 1) / SW_TILE_SIZE;
+	int tileMinX = (tile % tilesX) * SW_TILE_SIZE;
+	int tileMinY = (tile / tilesX) * SW_TILE_SIZE;
+	int tileMaxX = std::min(tileMinX + SW_TILE_SIZE, static_cast<int>(targets.width))  - 1;
+	int tileMaxY = std::min(tileMinY + SW_TILE_SIZE, static_cast<int>(targets.height)) - 1;
+
+	const auto &p    = pipelines.get(currentPipeline);
+	const auto &desc = p.desc;
+
+	// pixel centers of a quad relative to its top left corner
+	const SWFloat laneX(0.5f, 1.5f, 0.5f, 1.5f);
+	const SWFloat laneY(0.5f, 0.5f, 1.5f, 1.5f);
+	const SWFloat zero;
+	SWQuad quad;
+
+	// batches and bins are both in submission order
+	// so blending and depth ties resolve like on a GPU
+	for (unsigned int b = 0; b < numBatches; b++) {
+		const auto &batch = triangleBatches[b];
+		for (uint32_t triIndex : batch.bins[tile]) {
+			const auto &tri = batch.triangles[triIndex];
+			int minX = std::max(tileMinX, tri.minX);
+			int minY = std::max(tileMinY, tri.minY);
+			int maxX = std::min(tileMaxX, tri.maxX);
+			int maxY = std::min(tileMaxY, tri.maxY);
+			assert(minX <= maxX && minY <= maxY);
+
+			const glm::vec4 &v0 = tri.pos[0];
+			const glm::vec4 &v1 = tri.pos[1];
+			const glm::vec4 &v2 = tri.pos[2];
+			SWFloat invArea(1.0f / edgeFunction(v0, v1, v2.x, v2.y));
+			SWBool topLeft0(isTopLeft(v1, v2));
+			SWBool topLeft1(isTopLeft(v2, v0));
+			SWBool topLeft2(isTopLeft(v0, v1));
+
+			// pixel centers inside the clipped bounding box
+			SWFloat boundMinX(static_cast<float>(minX));
+			SWFloat boundMinY(static_cast<float>(minY));
+			SWFloat boundMaxX(static_cast<float>(maxX + 1));
+			SWFloat boundMaxY(static_cast<float>(maxY + 1));
+
+			// one 2x2 pixel quad per fragment shader call, a pixel in each lane
+			for (int qy = minY & ~1; qy <= maxY; qy += 2) {
+				SWFloat cy = SWFloat(static_cast<float>(qy)) + laneY;
+				for (int qx = minX & ~1; qx <= maxX; qx += 2) {
+					SWFloat cx = SWFloat(static_cast<float>(qx)) + laneX;
+					SWFloat w0 = edgeFunction(v1, v2, cx, cy);
+					SWFloat w1 = edgeFunction(v2, v0, cx, cy);
+					SWFloat w2 = edgeFunction(v0, v1, cx, cy);
+					SWBool covered =  (cx > boundMinX) & (cx < boundMaxX) & (cy > boundMinY) & (cy < boundMaxY)
+					               & ((w0 > zero) | ((w0 == zero) & topLeft0))
+					               & ((w1 > zero) | ((w1 == zero) & topLeft1))
+					               & ((w2 > zero) | ((w2 == zero) & topLeft2));
+					int coveredBits = covered.bits();
+					if (!coveredBits) {
+						continue;
+					}
+
+					SWFloat b0 = w0 * invArea;
+					SWFloat b1 = w1 * invArea;
+					SWFloat b2 = w2 * invArea;
+
+					// interpolation error can push z slightly out of range
+					SWFloat z = swClamp(b0 * SWFloat(v0.z) + b1 * SWFloat(v1.z) + b2 * SWFloat(v2.z), zero, SWFloat(1.0f));
+
+					// early depth test, write waits until the shader didn't discard
+					SWBool live = covered;
+					if (targets.depth && desc.depthTest_) {
+						float depth[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+						for (unsigned int l = 0; l < 4; l++) {
+							if (coveredBits & (1 << l)) {
+								depth[l] = targets.depth[(qy + (l >> 1)) * targets.width + qx + (l & 1)].x;
+							}
+						}
+						live = live & (z < SWFloat::load(depth));
+						if (!swAny(live)) {
+							continue;
+						}
+					}
+
+					SWFloat invW = b0 * SWFloat(v0.w) + b1 * SWFloat(v1.w) + b2 * SWFloat(v2.w);
+					SWFloat w    = SWFloat(1.0f) / invW;
+					quad.fragCoord[0] = cx;
+					quad.fragCoord[1] = cy;
+					quad.fragCoord[2] = z;
+					quad.fragCoord[3] = invW;
+					for (unsigned int k = 0; k < p.numVaryings; k++) {
+						bool flat = (p.flatVaryings & (1U << k)) != 0;
+						for (unsigned int c = 0; c < 4; c++) {
+							if (flat) {
+								quad.varyings[k][c] = SWFloat(tri.varyings[0][k][c]);
+							} else {
+								quad.varyings[k][c] = (b0 * SWFloat(tri.varyings[0][k][c]) + b1 * SWFloat(tri.varyings[1][k][c]) + b2 * SWFloat(tri.varyings[2][k][c])) * w;
+							}
+						}
+					}
+					for (auto &color : quad.colors) {
+						for (auto &c : color) {
+							c = zero;
+						}
+					}
+					quad.mask = SWBool(true);
+
+					p.fragmentShader(resources, quad);
+
+					int liveBits = (live & quad.mask).bits();
+					if (!liveBits) {
+						continue;
+					}
+
+					// blending and format conversion per pixel
+					float zs[4];
+					z.store(zs);
+					float colors[MAX_COLOR_RENDERTARGETS][4][4];
+					for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
+						if (targets.color[i]) {
+							for (unsigned int c = 0; c < 4; c++) {
+								quad.colors[i][c].store(colors[i][c]);
+							}
+						}
+					}
+
+					for (unsigned int l = 0; l < 4; l++) {
+						if (!(liveBits & (1 << l))) {
+							continue;
+						}
+
+						unsigned int index = (qy + (l >> 1)) * targets.width + qx + (l & 1);
+						if (targets.depth && desc.depthWrite_) {
+							targets.depth[index].x = zs[l];
+						}
+
+						for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
+							if (!targets.color[i]) {
+								continue;
+							}
+
+							glm::vec4 &dst = targets.color[i][index];
+							glm::vec4  src(colors[i][0][l], colors[i][1][l], colors[i][2][l], colors[i][3][l]);
+							if (desc.blending_) {
+								float srcFactor = blendFactor(desc.sourceBlend_,      src.w);
+								float dstFactor = blendFactor(desc.destinationBlend_, src.w);
+								// alpha uses the same factors as color, like glBlendFunc
+								src = src * srcFactor + dst * dstFactor;
+							}
+							dst = quantize(targets.colorFormat[i], src);
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+
+void RendererImpl::drawInternal(unsigned int first, unsigned int vertexCount, unsigned int instanceCount, bool indexed, int baseVertex) {
+	assert(inRenderPass);
+	assert(validPipeline);
+	assert(vertexCount > 0);
+	assert(instanceCount > 0);
+	// only triangle lists
+	assert(vertexCount % 3 == 0);
+
+	const auto &p    = pipelines.get(currentPipeline);
+	const auto &desc = p.desc;
+	assert(!desc.scissorTest_ || scissorSet);
+	pipelineDrawn = true;
+
+	resolveDescriptorSets();
+
+	const char *indices = nullptr;
+	if (indexed) {
+		assert(indexBuffer);
+		indices = bufferData(indexBuffer);
+	}
+
+	std::array<const char *, MAX_VERTEX_BUFFERS> vertexData;
+	for (unsigned int i = 0; i < MAX_VERTEX_BUFFERS; i++) {
+		vertexData[i] = vertexBuffers[i] ? bufferData(vertexBuffers[i]) : nullptr;
+	}
+
+	unsigned int tilesX   = (targets.width  + SW_TILE_SIZE - 1) / SW_TILE_SIZE;
+	unsigned int tilesY   = (targets.height + SW_TILE_SIZE - 1) / SW_TILE_SIZE;
+	unsigned int numTiles = tilesX * tilesY;
+
+	unsigned int trianglesPerInstance = vertexCount / 3;
+	unsigned int numTriangles         = trianglesPerInstance * instanceCount;
+	unsigned int numBatches           = (numTriangles + SW_VERTEX_BATCH - 1) / SW_VERTEX_BATCH;
+	if (triangleBatches.size() < numBatches) {
+		triangleBatches.resize(numBatches);
+	}
+
+	// vertex processing, setup and binning
+	// batches are independent, one job each
+	parallelFor(numBatches, 1, [&] (unsigned int beginBatch, unsigned int endBatch) {
+		// corners of up to 4 triangles, shaded 4 at a time
+		SWVertexLanes lanes;
+		SWVertex      vertices[12];
+		// attribute components of each lane, unused ones stay (0, 0, 0, 1)
+		float         attribs[MAX_VERTEX_ATTRIBS][4][4];
+		int32_t       vertexIndices[4], instances[4];
+		for (unsigned int a = 0; a < MAX_VERTEX_ATTRIBS; a++) {
+			for (unsigned int c = 0; c < 4; c++) {
+				for (unsigned int l = 0; l < 4; l++) {
+					attribs[a][c][l] = (c == 3) ? 1.0f : 0.0f;
+				}
+				lanes.attribs[a][c] = SWFloat::load(attribs[a][c]);
+			}
+		}
+
+		for (unsigned int b = beginBatch; b < endBatch; b++) {
+			auto &batch = triangleBatches[b];
+			batch.triangles.clear();
+			batch.bins.resize(std::max(static_cast<size_t>(numTiles), batch.bins.size()));
+			for (unsigned int tile = 0; tile < numTiles; tile++) {
+				batch.bins[tile].clear();
+			}
+
+			unsigned int endTriangle = std::min((b + 1) * SW_VERTEX_BATCH, numTriangles);
+			for (unsigned int firstTriangle = b * SW_VERTEX_BATCH; firstTriangle < endTriangle; firstTriangle += 4) {
+				unsigned int numCorners = std::min(4U, endTriangle - firstTriangle) * 3;
+				for (unsigned int firstCorner = 0; firstCorner < numCorners; firstCorner += 4) {
+					for (unsigned int l = 0; l < 4; l++) {
+						// lanes past the last corner repeat the first so they're valid
+						unsigned int corner   = firstCorner + ((firstCorner + l < numCorners) ? l : 0);
+						unsigned int t        = firstTriangle + corner / 3;
+						unsigned int instance = t / trianglesPerInstance;
+						unsigned int i        = (t % trianglesPerInstance) * 3 + corner % 3;
+
+						unsigned int vertexIndex = first + i;
+						if (indexed) {
+							if (indexBuffer16) {
+								vertexIndex = reinterpret_cast<const uint16_t *>(indices)[first + i];
+							} else {
+								vertexIndex = reinterpret_cast<const uint32_t *>(indices)[first + i];
+							}
+							vertexIndex += baseVertex;
+						}
+						vertexIndices[l] = vertexIndex;
+						instances[l]     = instance;
+
+						for (unsigned int a = 0; a < MAX_VERTEX_ATTRIBS; a++) {
+							if (!(desc.vertexAttribMask & (1 << a))) {
+								continue;
+							}
+
+							const auto &attr = desc.vertexAttribs[a];
+							assert(vertexData[attr.bufBinding]);
+							const char *src = vertexData[attr.bufBinding] + desc.vertexBuffers[attr.bufBinding].stride * vertexIndex + attr.offset;
+							for (unsigned int c = 0; c < attr.count; c++) {
+								switch (attr.format) {
+								case VtxFormat::Float:
+									memcpy(&attribs[a][c][l], src + c * sizeof(float), sizeof(float));
+									break;
+
+								case VtxFormat::UNorm8:
+									attribs[a][c][l] = static_cast<uint8_t>(src[c]) / 255.0f;
+									break;
+								}
+							}
+						}
+					}
+
+					lanes.vertexIndex   = SWInt::load(vertexIndices);
+					lanes.instanceIndex = SWInt::load(instances);
+					for (unsigned int a = 0; a < MAX_VERTEX_ATTRIBS; a++) {
+						if (desc.vertexAttribMask & (1 << a)) {
+							for (unsigned int c = 0; c < 4; c++) {
+								lanes.attribs[a][c] = SWFloat::load(attribs[a][c]);
+							}
+						}
+					}
+
+					p.vertexShader(resources, lanes);
+
+					unsigned int numLanes = std::min(4U, numCorners - firstCorner);
+					float out[4];
+					for (unsigned int c = 0; c < 4; c++) {
+						lanes.position[c].store(out);
+						for (unsigned int l = 0; l < numLanes; l++) {
+							vertices[firstCorner + l].position[c] = out[l];
+						}
+
+						for (unsigned int k = 0; k < p.numVaryings; k++) {
+							lanes.varyings[k][c].store(out);
+							for (unsigned int l = 0; l < numLanes; l++) {
+								vertices[firstCorner + l].varyings[k][c] = out[l];
+							}
+						}
+					}
+				}
+
+				for (unsigned int corner = 0; corner < numCorners; corner += 3) {
+					setupTriangle(vertices[corner], vertices[corner + 1], vertices[corner + 2], desc.cullFaces_, batch);
+				}
+			}
+		}
+	} );
+
+	// only tiles some triangle touches get a job
+	activeTiles.clear();
+	for (unsigned int tile = 0; tile < numTiles; tile++) {
+		for (unsigned int b = 0; b < numBatches; b++) {
+			if (!triangleBatches[b].bins[tile].empty()) {
+				activeTiles.push_back(tile);
+				break;
+			}
+		}
+	}
+
+	// tiles are independent, one job each
+	parallelFor(static_cast<unsigned int>(activeTiles.size()), 1, [this, numBatches] (unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			rasterizeTile(activeTiles[i], numBatches);
+		}
+	} );
+}
+
+
+void RendererImpl::draw(unsigned int firstVertex, unsigned int vertexCount) {
+	drawInternal(firstVertex, vertexCount, 1, false);
+}
+
+
+void RendererImpl::drawIndexedInstanced(unsigned int vertexCount, unsigned int instanceCount) {
+	drawInternal(0, vertexCount, instanceCount, true);
+}
+
+
+void RendererImpl::drawIndexedOffset(unsigned int vertexCount, unsigned int firstIndex) {
+	drawInternal(firstIndex, vertexCount, 1, true);
+}
+
+
+void RendererImpl::drawIndexedBaseVertex(unsigned int vertexCount, unsigned int firstIndex, int baseVertex) {
+	drawInternal(firstIndex, vertexCount, 1, true, baseVertex);
+}
+
+
+} // namespace renderer
+
+
+#endif //  RENDERER_SOFTWARE
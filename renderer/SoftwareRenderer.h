@@ -0,0 +1,772 @@
+/*
+Copyright (c) 2015-2018 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef SOFTWARERENDERER_H
+#define SOFTWARERENDERER_H
+
+
+#include "SoftwareSIMD.h"
+
+
+namespace renderer {
+
+
+#define SW_MAX_VARYINGS  8
+#define SW_MAX_BINDINGS  4
+#define SW_TILE_SIZE     64
+// triangles per vertex processing job
+#define SW_VERTEX_BATCH  256
+
+
+// output of vertex shader and input of fragment shader
+struct SWVertex {
+	glm::vec4  position;
+	glm::vec4  varyings[SW_MAX_VARYINGS];
+};
+
+
+// texture contents as seen by a shader
+struct SWImage {
+	unsigned int      width, height;
+	const glm::vec4  *texels;
+	// sRGB storage viewed through a linear format, shader sees encoded values
+	bool              encodeSRGB;
+
+
+	SWImage()
+	: width(0)
+	, height(0)
+	, texels(nullptr)
+	, encodeSRGB(false)
+	{
+	}
+};
+
+
+struct SWBinding {
+	// uniform or storage buffer contents
+	const char  *data;
+	SWImage      image;
+	FilterMode   filter;
+
+
+	SWBinding()
+	: data(nullptr)
+	, filter(FilterMode::Nearest)
+	{
+	}
+};
+
+
+// currently bound descriptor sets, binding is index in layout
+struct SWResources {
+	std::array<std::array<SWBinding, SW_MAX_BINDINGS>, MAX_DESCRIPTOR_SETS>  sets;
+
+
+	template <typename T> const T &buffer(unsigned int set, unsigned int binding) const {
+		assert(sets[set][binding].data);
+		return *reinterpret_cast<const T *>(sets[set][binding].data);
+	}
+
+
+	const SWImage &image(unsigned int set, unsigned int binding) const {
+		return sets[set][binding].image;
+	}
+
+
+	FilterMode filter(unsigned int set, unsigned int binding) const {
+		return sets[set][binding].filter;
+	}
+};
+
+
+// four vertices, one per lane, vectors are split into components
+struct SWVertexLanes {
+	// indexed by location, unused components are 0 and w is 1
+	SWFloat  attribs[MAX_VERTEX_ATTRIBS][4];
+	SWInt    vertexIndex;
+	SWInt    instanceIndex;
+
+	SWFloat  position[4];
+	SWFloat  varyings[SW_MAX_VARYINGS][4];
+};
+
+
+// 2x2 pixel quad, lanes are in the order of SoftwareSIMD.h
+// all four lanes run even when not covered so derivatives work
+struct SWQuad {
+	// window x and y of pixel center, depth in z, 1/w in w
+	SWFloat  fragCoord[4];
+	SWFloat  varyings[SW_MAX_VARYINGS][4];
+	SWFloat  colors[MAX_COLOR_RENDERTARGETS][4];
+	// true on entry, shader clears lanes it discards
+	SWBool   mask;
+};
+
+
+typedef void (*SWVertexShader)(const SWResources &res, SWVertexLanes &io);
+typedef void (*SWFragmentShader)(const SWResources &res, SWQuad &io);
+
+
+// shaders are generated from the GLSL ones by swShaderGen
+struct SWShaderInfo {
+	// shader file name and sorted macros like the SPIR-V cache
+	const char        *key;
+	// exactly one of these is set
+	SWVertexShader    vertexShader;
+	SWFragmentShader  fragmentShader;
+	// highest varying location used + 1
+	unsigned int      numVaryings;
+	// bit per varying location which is not interpolated
+	uint32_t          flatVaryings;
+};
+
+
+extern const SWShaderInfo  swShaders[];
+extern const unsigned int  swNumShaders;
+
+// returns nullptr if the permutation was not generated
+const SWShaderInfo *findSWShader(const std::string &filename, const ShaderMacros &macros);
+
+// sampling for generated shaders, results are rgba
+// clamp to edge, texel centers at half coordinates like Vulkan, no mipmaps
+void swTexture(const SWImage &image, FilterMode filter, const SWFloat &u, const SWFloat &v, int offsetX, int offsetY, SWFloat *result);
+// textureGather, comp is the channel to gather
+void swTextureGather(const SWImage &image, const SWFloat &u, const SWFloat &v, unsigned int comp, int offsetX, int offsetY, SWFloat *result);
+void swTexelFetch(const SWImage &image, const SWInt &x, const SWInt &y, SWFloat *result);
+
+float swSRGBToLinear(float v);
+float swLinearToSRGB(float v);
+// linear value to nearest sRGB8 value
+uint8_t swEncodeSRGB8(float v);
+// rounds linear value to nearest value representable in sRGB8
+float swQuantizeSRGB(float v);
+
+
+struct Buffer {
+	bool               ringBufferAlloc;
+	unsigned int       beginOffs;
+	unsigned int       size;
+	std::vector<char>  contents;
+
+
+	Buffer()
+	: ringBufferAlloc(false)
+	, beginOffs(0)
+	, size(0)
+	{
+	}
+
+	Buffer(const Buffer &)            = delete;
+	Buffer &operator=(const Buffer &) = delete;
+
+	Buffer(Buffer &&other)
+	: ringBufferAlloc(other.ringBufferAlloc)
+	, beginOffs(other.beginOffs)
+	, size(other.size)
+	, contents(std::move(other.contents))
+	{
+		other.ringBufferAlloc = false;
+		other.beginOffs       = 0;
+		other.size            = 0;
+	}
+
+	Buffer &operator=(Buffer &&other) {
+		if (this == &other) {
+			return *this;
+		}
+
+		assert(contents.empty());
+
+		ringBufferAlloc       = other.ringBufferAlloc;
+		beginOffs             = other.beginOffs;
+		size                  = other.size;
+		contents              = std::move(other.contents);
+
+		other.ringBufferAlloc = false;
+		other.beginOffs       = 0;
+		other.size            = 0;
+
+		return *this;
+	}
+
+	~Buffer() {
+	}
+};
+
+
+struct DescriptorSetLayout {
+	std::vector<DescriptorLayout> layout;
+
+
+	DescriptorSetLayout() {}
+
+	DescriptorSetLayout(const DescriptorSetLayout &)            = delete;
+	DescriptorSetLayout &operator=(const DescriptorSetLayout &) = delete;
+
+	DescriptorSetLayout(DescriptorSetLayout &&other)
+	: layout(std::move(other.layout))
+	{
+		assert(other.layout.empty());
+	}
+
+	DescriptorSetLayout &operator=(DescriptorSetLayout &&other) {
+		if (this == &other) {
+			return *this;
+		}
+
+		assert(layout.empty());
+		layout = std::move(other.layout);
+		assert(other.layout.empty());
+
+		return *this;
+	}
+
+	~DescriptorSetLayout() {}
+};
+
+
+struct Framebuffer {
+	FramebufferDesc  desc;
+	unsigned int     width, height;
+
+
+	Framebuffer(const Framebuffer &)            = delete;
+	Framebuffer &operator=(const Framebuffer &) = delete;
+
+	Framebuffer(Framebuffer &&other)
+	: desc(other.desc)
+	, width(other.width)
+	, height(other.height)
+	{
+		other.desc   = FramebufferDesc();
+		other.width  = 0;
+		other.height = 0;
+	}
+
+	Framebuffer &operator=(Framebuffer &&other) {
+		if (this == &other) {
+			return *this;
+		}
+
+		desc         = other.desc;
+		width        = other.width;
+		height       = other.height;
+
+		other.desc   = FramebufferDesc();
+		other.width  = 0;
+		other.height = 0;
+
+		return *this;
+	}
+
+	Framebuffer()
+	: width(0)
+	, height(0)
+	{
+	}
+
+	~Framebuffer() {}
+};
+
+
+struct Pipeline {
+	PipelineDesc      desc;
+	SWVertexShader    vertexShader;
+	SWFragmentShader  fragmentShader;
+	// from fragment shader, vertex shader outputs beyond these are not used
+	unsigned int      numVaryings;
+	uint32_t          flatVaryings;
+
+
+	Pipeline(const Pipeline &)            = delete;
+	Pipeline &operator=(const Pipeline &) = delete;
+
+	Pipeline(Pipeline &&other)
+	: desc(other.desc)
+	, vertexShader(other.vertexShader)
+	, fragmentShader(other.fragmentShader)
+	, numVaryings(other.numVaryings)
+	, flatVaryings(other.flatVaryings)
+	{
+		other.desc           = PipelineDesc();
+		other.vertexShader   = nullptr;
+		other.fragmentShader = nullptr;
+		other.numVaryings    = 0;
+		other.flatVaryings   = 0;
+	}
+
+	Pipeline &operator=(Pipeline &&other) {
+		if (this == &other) {
+			return *this;
+		}
+
+		desc                 = other.desc;
+		vertexShader         = other.vertexShader;
+		fragmentShader       = other.fragmentShader;
+		numVaryings          = other.numVaryings;
+		flatVaryings         = other.flatVaryings;
+
+		other.desc           = PipelineDesc();
+		other.vertexShader   = nullptr;
+		other.fragmentShader = nullptr;
+		other.numVaryings    = 0;
+		other.flatVaryings   = 0;
+
+		return *this;
+	}
+
+	Pipeline()
+	: vertexShader(nullptr)
+	, fragmentShader(nullptr)
+	, numVaryings(0)
+	, flatVaryings(0)
+	{
+	}
+
+	~Pipeline() {}
+};
+
+
+struct RenderPass {
+	RenderPassDesc  desc;
+
+
+	RenderPass(const RenderPass &)            = delete;
+	RenderPass &operator=(const RenderPass &) = delete;
+
+	RenderPass(RenderPass &&other)
+	: desc(other.desc)
+	{
+		other.desc = RenderPassDesc();
+	}
+
+	RenderPass &operator=(RenderPass &&other) {
+		if (this == &other) {
+			return *this;
+		}
+
+		desc       = other.desc;
+
+		other.desc = RenderPassDesc();
+
+		return *this;
+	}
+
+	RenderPass() {}
+
+	~RenderPass() {}
+};
+
+
+struct RenderTarget {
+	unsigned int            width, height;
+	Format                  format;
+	// one sample per pixel regardless of desc, depth is in x
+	std::vector<glm::vec4>  texels;
+	TextureHandle           texture;
+	TextureHandle           additionalView;
+
+
+	RenderTarget(const RenderTarget &)            = delete;
+	RenderTarget &operator=(const RenderTarget &) = delete;
+
+	RenderTarget(RenderTarget &&other)
+	: width(other.width)
+	, height(other.height)
+	, format(other.format)
+	, texels(std::move(other.texels))
+	, texture(other.texture)
+	, additionalView(other.additionalView)
+	{
+		other.width          = 0;
+		other.height         = 0;
+		other.format         = Format::Invalid;
+		other.texture        = TextureHandle();
+		other.additionalView = TextureHandle();
+	}
+
+	RenderTarget &operator=(RenderTarget &&other) {
+		if (this == &other) {
+			return *this;
+		}
+
+		assert(!texture);
+		assert(!additionalView);
+
+		width                = other.width;
+		height               = other.height;
+		format               = other.format;
+		texels               = std::move(other.texels);
+		texture              = other.texture;
+		additionalView       = other.additionalView;
+
+		other.width          = 0;
+		other.height         = 0;
+		other.format         = Format::Invalid;
+		other.texture        = TextureHandle();
+		other.additionalView = TextureHandle();
+
+		return *this;
+	}
+
+	RenderTarget()
+	: width(0)
+	, height(0)
+	, format(Format::Invalid)
+	{
+	}
+
+	~RenderTarget() {
+		assert(!texture);
+		assert(!additionalView);
+	}
+};
+
+
+struct Sampler {
+	SamplerDesc desc;
+
+
+	Sampler(const Sampler &)            = delete;
+	Sampler &operator=(const Sampler &) = delete;
+
+	Sampler(Sampler &&other)
+	: desc(other.desc)
+	{
+		other.desc = SamplerDesc();
+	}
+
+	Sampler &operator=(Sampler &&other) {
+		if (this == &other) {
+			return *this;
+		}
+
+		desc       = other.desc;
+
+		other.desc = SamplerDesc();
+
+		return *this;
+	}
+
+	Sampler() {}
+
+	~Sampler() {}
+};
+
+
+struct Texture {
+	unsigned int            width, height;
+	// format this texture is viewed as
+	Format                  format;
+	// linear values, sRGB is decoded on upload
+	std::vector<glm::vec4>  texels;
+	// if set texels are in the rendertarget instead
+	RenderTargetHandle      renderTarget;
+
+
+	Texture(const Texture &)            = delete;
+	Texture &operator=(const Texture &) = delete;
+
+	Texture(Texture &&other)
+	: width(other.width)
+	, height(other.height)
+	, format(other.format)
+	, texels(std::move(other.texels))
+	, renderTarget(other.renderTarget)
+	{
+		other.width        = 0;
+		other.height       = 0;
+		other.format       = Format::Invalid;
+		other.renderTarget = RenderTargetHandle();
+	}
+
+	Texture &operator=(Texture &&other) {
+		if (this == &other) {
+			return *this;
+		}
+
+		width              = other.width;
+		height             = other.height;
+		format             = other.format;
+		texels             = std::move(other.texels);
+		renderTarget       = other.renderTarget;
+
+		other.width        = 0;
+		other.height       = 0;
+		other.format       = Format::Invalid;
+		other.renderTarget = RenderTargetHandle();
+
+		return *this;
+	}
+
+	Texture()
+	: width(0)
+	, height(0)
+	, format(Format::Invalid)
+	{
+	}
+
+	~Texture() {}
+};
+
+
+// readback waiting for its frame to complete
+struct Readback {
+	ReadbackResult     result;
+	ReadbackCallback   callback;
+	std::vector<char>  data;
+};
+
+
+struct Frame {
+	bool                      outstanding;
+	uint32_t                  lastFrameNum;
+	unsigned int              usedRingBufPtr;
+	std::vector<BufferHandle> ephemeralBuffers;
+	std::vector<TimingScope>  timingScopes;
+	std::vector<uint64_t>     timestamps;
+	std::vector<Readback>     readbacks;
+
+
+	Frame()
+	: outstanding(false)
+	, lastFrameNum(0)
+	, usedRingBufPtr(0)
+	{}
+
+	~Frame() {
+		assert(ephemeralBuffers.empty());
+		assert(readbacks.empty());
+		assert(!outstanding);
+	}
+
+	Frame(const Frame &)            = delete;
+	Frame &operator=(const Frame &) = delete;
+
+	Frame(Frame &&other)
+	: outstanding(other.outstanding)
+	, lastFrameNum(other.lastFrameNum)
+	, usedRingBufPtr(other.usedRingBufPtr)
+	, ephemeralBuffers(std::move(other.ephemeralBuffers))
+	, timingScopes(std::move(other.timingScopes))
+	, timestamps(std::move(other.timestamps))
+	, readbacks(std::move(other.readbacks))
+	{
+		other.outstanding      = false;
+		other.lastFrameNum     = 0;
+		other.usedRingBufPtr   = 0;
+	}
+
+	Frame &operator=(Frame &&other) {
+		assert(ephemeralBuffers.empty());
+		ephemeralBuffers = std::move(other.ephemeralBuffers);
+		assert(other.ephemeralBuffers.empty());
+
+		outstanding = other.outstanding;
+		other.outstanding = false;
+
+		lastFrameNum = other.lastFrameNum;
+		other.lastFrameNum = 0;
+
+		usedRingBufPtr       = other.usedRingBufPtr;
+		other.usedRingBufPtr = 0;
+
+		timingScopes = std::move(other.timingScopes);
+		timestamps   = std::move(other.timestamps);
+
+		assert(readbacks.empty());
+		readbacks    = std::move(other.readbacks);
+
+		return *this;
+	}
+};
+
+
+// triangle after clipping and viewport transform
+struct SWTriangle {
+	// window coordinates in xy, depth in z, 1/w in w
+	glm::vec4  pos[3];
+	// varyings premultiplied by 1/w
+	// flat varyings are in the first vertex as is, from the provoking vertex
+	glm::vec4  varyings[3][SW_MAX_VARYINGS];
+	// bounding box in pixels, inclusive
+	int        minX, minY, maxX, maxY;
+};
+
+
+// triangles set up by one vertex processing job
+struct SWTriangleBatch {
+	std::vector<SWTriangle>               triangles;
+	// indices of triangles overlapping each tile, in submission order
+	std::vector<std::vector<uint32_t> >   bins;
+};
+
+
+// rendertargets of current render pass
+struct SWTargets {
+	unsigned int                                      width, height;
+	std::array<glm::vec4 *, MAX_COLOR_RENDERTARGETS>  color;
+	std::array<Format, MAX_COLOR_RENDERTARGETS>       colorFormat;
+	glm::vec4                                        *depth;
+
+
+	SWTargets()
+	: width(0)
+	, height(0)
+	, depth(nullptr)
+	{
+		color.fill(nullptr);
+		colorFormat.fill(Format::Invalid);
+	}
+};
+
+
+struct RendererImpl : public RendererBase {
+	std::vector<char> ringBuffer;
+
+	std::vector<Frame>                       frames;
+
+	ResourceContainer<Buffer>                buffers;
+	ResourceContainer<DescriptorSetLayout>   dsLayouts;
+	ResourceContainer<Framebuffer>           framebuffers;
+	ResourceContainer<Pipeline>              pipelines;
+	ResourceContainer<RenderPass>            renderpasses;
+	ResourceContainer<RenderTarget>          rendertargets;
+	ResourceContainer<Sampler>               samplers;
+	ResourceContainer<Texture>               textures;
+
+	PipelineHandle                                currentPipeline;
+	FramebufferHandle                             currentFramebuffer;
+	BufferHandle                                  indexBuffer;
+	bool                                          indexBuffer16;
+	std::array<BufferHandle, MAX_VERTEX_BUFFERS>  vertexBuffers;
+	SWTargets                                     targets;
+	// descriptor sets are resolved at draw time since ringbuffer can move
+	std::array<DSLayoutHandle, MAX_DESCRIPTOR_SETS>     boundDSLayouts;
+	std::array<std::vector<char>, MAX_DESCRIPTOR_SETS>  boundDSData;
+	SWResources                                   resources;
+	glm::ivec4                                    viewport;
+	glm::ivec4                                    scissor;
+
+	// last presented image as RGBA8, sRGB encoded
+	std::vector<uint32_t>                         swapchainImage;
+	unsigned int                                  swapchainWidth;
+	unsigned int                                  swapchainHeight;
+
+	// triangles of current draw call, batches are kept to reuse their memory
+	std::vector<SWTriangleBatch>                  triangleBatches;
+	// tiles which have triangles in current draw call
+	std::vector<unsigned int>                     activeTiles;
+
+
+	void recreateRingBuffer(unsigned int newSize);
+	unsigned int ringBufferAllocate(unsigned int size, unsigned int alignPower);
+
+	void waitForFrame(unsigned int frameIdx);
+	void deleteFrameInternal(Frame &f);
+
+	// begin is true for the start of a timing scope
+	unsigned int writeTimestamp(bool begin);
+
+	const char *bufferData(BufferHandle handle) const;
+	SWImage imageForTexture(TextureHandle handle) const;
+	void resolveDescriptorSets();
+	void copyRenderTarget(RenderTargetHandle source, RenderTargetHandle target);
+
+	void drawInternal(unsigned int first, unsigned int vertexCount, unsigned int instanceCount, bool indexed, int baseVertex = 0);
+	void setupTriangle(const SWVertex &v0, const SWVertex &v1, const SWVertex &v2, bool cull, SWTriangleBatch &batch);
+	void rasterizeTile(unsigned int tile, unsigned int numBatches);
+
+	explicit RendererImpl(const RendererDesc &desc);
+
+	~RendererImpl();
+
+
+	bool isRenderTargetFormatSupported(Format format) const;
+
+	bool isRenderPassCompatible(const RenderPass &pass, const Framebuffer &fb);
+
+	RenderTargetHandle   createRenderTarget(const RenderTargetDesc &desc);
+	FramebufferHandle    createFramebuffer(const FramebufferDesc &desc);
+	RenderPassHandle     createRenderPass(const RenderPassDesc &desc);
+	PipelineHandle       createPipeline(const PipelineDesc &desc);
+	BufferHandle         createBuffer(BufferType type, uint32_t size, const void *contents);
+	BufferHandle         createEphemeralBuffer(BufferType type, uint32_t size, const void *contents);
+	SamplerHandle        createSampler(const SamplerDesc &desc);
+	TextureHandle        createTexture(const TextureDesc &desc);
+	TextureUpload        beginTextureUpload(const TextureDesc &desc);
+	TextureHandle        endTextureUpload(TextureUpload &upload);
+
+	DSLayoutHandle       createDescriptorSetLayout(const DescriptorLayout *layout);
+
+	TextureHandle        getRenderTargetTexture(RenderTargetHandle handle);
+	TextureHandle        getRenderTargetView(RenderTargetHandle handle, Format f);
+
+	void deleteBuffer(BufferHandle handle);
+	void deleteFramebuffer(FramebufferHandle fbo);
+	void deleteRenderPass(RenderPassHandle fbo);
+	void deleteSampler(SamplerHandle handle);
+	void deleteTexture(TextureHandle handle);
+	void deleteRenderTarget(RenderTargetHandle &fbo);
+
+
+	void setSwapchainDesc(const SwapchainDesc &desc);
+	MemoryStats getMemStats() const;
+
+	void beginFrame();
+	void presentFrame(RenderTargetHandle image);
+
+	void beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle);
+	void endRenderPass();
+
+	void beginTimingScope(const std::string &name);
+	void endTimingScope();
+
+	void layoutTransition(RenderTargetHandle image, Layout src, Layout dest);
+
+	void setViewport(unsigned int x, unsigned int y, unsigned int width, unsigned int height);
+	void setScissorRect(unsigned int x, unsigned int y, unsigned int width, unsigned int height);
+
+	void bindPipeline(PipelineHandle pipeline);
+	void bindIndexBuffer(BufferHandle buffer, bool bit16);
+	void bindVertexBuffer(unsigned int binding, BufferHandle buffer);
+
+	void bindDescriptorSet(unsigned int index, DSLayoutHandle layout, const void *data);
+
+	void blit(FramebufferHandle source, FramebufferHandle target, unsigned int n);
+	void resolveMSAA(FramebufferHandle source, FramebufferHandle target, unsigned int n);
+
+	void readbackRenderTarget(RenderTargetHandle handle, unsigned int x, unsigned int y, unsigned int width, unsigned int height, ReadbackCallback callback);
+
+	void draw(unsigned int firstVertex, unsigned int vertexCount);
+	void drawIndexedInstanced(unsigned int vertexCount, unsigned int instanceCount);
+	void drawIndexedOffset(unsigned int vertexCount, unsigned int firstIndex);
+	void drawIndexedBaseVertex(unsigned int vertexCount, unsigned int firstIndex, int baseVertex);
+};
+
+
+} // namespace renderer
+
+
+#endif  // SOFTWARERENDERER_H
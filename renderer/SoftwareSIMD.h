@@ -0,0 +1,578 @@
+/*
+Copyright (c) 2015-2018 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef SOFTWARESIMD_H
+#define SOFTWARESIMD_H
+
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SW_USE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+
+namespace renderer {
+
+
+// values of four shader invocations, one per lane
+// fragment shaders run on 2x2 pixel quads: top left, top right, bottom left, bottom right
+// without SSE2 the lanes are plain arrays and every operation loops over them
+
+#ifndef SW_USE_SSE2
+
+#define SW_LANEWISE(Result, expr)         \
+	Result r;                             \
+	for (unsigned int l = 0; l < 4; l++) { \
+		r.v[l] = (expr);                  \
+	}                                     \
+	return r;
+
+#endif  // SW_USE_SSE2
+
+
+// true lanes have all bits set
+struct SWBool {
+#ifdef SW_USE_SSE2
+	__m128   v;
+
+	SWBool() : v(_mm_setzero_ps()) {}
+	explicit SWBool(bool b) : v(_mm_castsi128_ps(_mm_set1_epi32(b ? -1 : 0))) {}
+	explicit SWBool(__m128 v_) : v(v_) {}
+
+	// bit per lane like _mm_movemask_ps
+	int bits() const { return _mm_movemask_ps(v); }
+#else  // SW_USE_SSE2
+	int32_t  v[4];
+
+	SWBool() { v[0] = v[1] = v[2] = v[3] = 0; }
+	explicit SWBool(bool b) { v[0] = v[1] = v[2] = v[3] = b ? -1 : 0; }
+
+	int bits() const { return (v[0] & 1) | (v[1] & 2) | (v[2] & 4) | (v[3] & 8); }
+#endif  // SW_USE_SSE2
+};
+
+
+struct SWFloat {
+#ifdef SW_USE_SSE2
+	__m128   v;
+
+	SWFloat() : v(_mm_setzero_ps()) {}
+	explicit SWFloat(float f) : v(_mm_set1_ps(f)) {}
+	SWFloat(float l0, float l1, float l2, float l3) : v(_mm_setr_ps(l0, l1, l2, l3)) {}
+	explicit SWFloat(__m128 v_) : v(v_) {}
+
+	static SWFloat load(const float *p) { return SWFloat(_mm_loadu_ps(p)); }
+	void store(float *p) const { _mm_storeu_ps(p, v); }
+#else  // SW_USE_SSE2
+	float    v[4];
+
+	SWFloat() { v[0] = v[1] = v[2] = v[3] = 0.0f; }
+	explicit SWFloat(float f) { v[0] = v[1] = v[2] = v[3] = f; }
+	SWFloat(float l0, float l1, float l2, float l3) { v[0] = l0; v[1] = l1; v[2] = l2; v[3] = l3; }
+
+	static SWFloat load(const float *p) { SWFloat r; memcpy(r.v, p, sizeof(r.v)); return r; }
+	void store(float *p) const { memcpy(p, v, sizeof(v)); }
+#endif  // SW_USE_SSE2
+
+	float lane(unsigned int l) const { float t[4]; store(t); return t[l]; }
+};
+
+
+struct SWInt {
+#ifdef SW_USE_SSE2
+	__m128i  v;
+
+	SWInt() : v(_mm_setzero_si128()) {}
+	explicit SWInt(int32_t i) : v(_mm_set1_epi32(i)) {}
+	SWInt(int32_t l0, int32_t l1, int32_t l2, int32_t l3) : v(_mm_setr_epi32(l0, l1, l2, l3)) {}
+	explicit SWInt(__m128i v_) : v(v_) {}
+
+	// xored into both sides of a comparison, signed needs none
+	static __m128i bias() { return _mm_setzero_si128(); }
+
+	static SWInt load(const int32_t *p) { return SWInt(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))); }
+	void store(int32_t *p) const { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v); }
+#else  // SW_USE_SSE2
+	int32_t  v[4];
+
+	SWInt() { v[0] = v[1] = v[2] = v[3] = 0; }
+	explicit SWInt(int32_t i) { v[0] = v[1] = v[2] = v[3] = i; }
+	SWInt(int32_t l0, int32_t l1, int32_t l2, int32_t l3) { v[0] = l0; v[1] = l1; v[2] = l2; v[3] = l3; }
+
+	static SWInt load(const int32_t *p) { SWInt r; memcpy(r.v, p, sizeof(r.v)); return r; }
+	void store(int32_t *p) const { memcpy(p, v, sizeof(v)); }
+#endif  // SW_USE_SSE2
+
+	int32_t lane(unsigned int l) const { int32_t t[4]; store(t); return t[l]; }
+};
+
+
+struct SWUInt {
+#ifdef SW_USE_SSE2
+	__m128i  v;
+
+	SWUInt() : v(_mm_setzero_si128()) {}
+	explicit SWUInt(uint32_t u) : v(_mm_set1_epi32(static_cast<int32_t>(u))) {}
+	explicit SWUInt(__m128i v_) : v(v_) {}
+
+	// flips unsigned order into signed order for pcmpgtd
+	static __m128i bias() { return _mm_set1_epi32(INT32_MIN); }
+
+	static SWUInt load(const uint32_t *p) { return SWUInt(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))); }
+	void store(uint32_t *p) const { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v); }
+#else  // SW_USE_SSE2
+	uint32_t v[4];
+
+	SWUInt() { v[0] = v[1] = v[2] = v[3] = 0; }
+	explicit SWUInt(uint32_t u) { v[0] = v[1] = v[2] = v[3] = u; }
+
+	static SWUInt load(const uint32_t *p) { SWUInt r; memcpy(r.v, p, sizeof(r.v)); return r; }
+	void store(uint32_t *p) const { memcpy(p, v, sizeof(v)); }
+#endif  // SW_USE_SSE2
+
+	uint32_t lane(unsigned int l) const { uint32_t t[4]; store(t); return t[l]; }
+};
+
+
+// applies a scalar function to each lane, for things SSE2 has no instruction for
+template <typename F>
+inline SWFloat swLanewise(const SWFloat &a, F f) {
+	float t[4];
+	a.store(t);
+	for (unsigned int l = 0; l < 4; l++) {
+		t[l] = f(t[l]);
+	}
+	return SWFloat::load(t);
+}
+
+
+template <typename F>
+inline SWFloat swLanewise(const SWFloat &a, const SWFloat &b, F f) {
+	float t[4], u[4];
+	a.store(t);
+	b.store(u);
+	for (unsigned int l = 0; l < 4; l++) {
+		t[l] = f(t[l], u[l]);
+	}
+	return SWFloat::load(t);
+}
+
+
+template <typename T, typename F>
+inline T swLanewise(const T &a, const T &b, F f) {
+	typedef decltype(a.lane(0)) Lane;
+	Lane t[4], u[4];
+	a.store(t);
+	b.store(u);
+	for (unsigned int l = 0; l < 4; l++) {
+		t[l] = f(t[l], u[l]);
+	}
+	return T::load(t);
+}
+
+
+// bool
+
+
+#ifdef SW_USE_SSE2
+
+inline SWBool operator&(const SWBool &a, const SWBool &b) { return SWBool(_mm_and_ps(a.v, b.v)); }
+inline SWBool operator|(const SWBool &a, const SWBool &b) { return SWBool(_mm_or_ps(a.v, b.v)); }
+inline SWBool operator^(const SWBool &a, const SWBool &b) { return SWBool(_mm_xor_ps(a.v, b.v)); }
+inline SWBool operator!(const SWBool &a) { return SWBool(_mm_xor_ps(a.v, _mm_castsi128_ps(_mm_set1_epi32(-1)))); }
+// a && !b
+inline SWBool swAndNot(const SWBool &a, const SWBool &b) { return SWBool(_mm_andnot_ps(b.v, a.v)); }
+
+inline SWFloat swSelect(const SWBool &c, const SWFloat &a, const SWFloat &b) { return SWFloat(_mm_or_ps(_mm_and_ps(c.v, a.v), _mm_andnot_ps(c.v, b.v))); }
+inline SWInt   swSelect(const SWBool &c, const SWInt &a,   const SWInt &b)   { __m128i m = _mm_castps_si128(c.v); return SWInt(_mm_or_si128(_mm_and_si128(m, a.v), _mm_andnot_si128(m, b.v))); }
+inline SWUInt  swSelect(const SWBool &c, const SWUInt &a,  const SWUInt &b)  { __m128i m = _mm_castps_si128(c.v); return SWUInt(_mm_or_si128(_mm_and_si128(m, a.v), _mm_andnot_si128(m, b.v))); }
+inline SWBool  swSelect(const SWBool &c, const SWBool &a,  const SWBool &b)  { return SWBool(_mm_or_ps(_mm_and_ps(c.v, a.v), _mm_andnot_ps(c.v, b.v))); }
+
+#else  // SW_USE_SSE2
+
+inline SWBool operator&(const SWBool &a, const SWBool &b) { SW_LANEWISE(SWBool, a.v[l] & b.v[l]) }
+inline SWBool operator|(const SWBool &a, const SWBool &b) { SW_LANEWISE(SWBool, a.v[l] | b.v[l]) }
+inline SWBool operator^(const SWBool &a, const SWBool &b) { SW_LANEWISE(SWBool, a.v[l] ^ b.v[l]) }
+inline SWBool operator!(const SWBool &a) { SW_LANEWISE(SWBool, ~a.v[l]) }
+inline SWBool swAndNot(const SWBool &a, const SWBool &b) { SW_LANEWISE(SWBool, a.v[l] & ~b.v[l]) }
+
+inline SWFloat swSelect(const SWBool &c, const SWFloat &a, const SWFloat &b) { SW_LANEWISE(SWFloat, c.v[l] ? a.v[l] : b.v[l]) }
+inline SWInt   swSelect(const SWBool &c, const SWInt &a,   const SWInt &b)   { SW_LANEWISE(SWInt,   c.v[l] ? a.v[l] : b.v[l]) }
+inline SWUInt  swSelect(const SWBool &c, const SWUInt &a,  const SWUInt &b)  { SW_LANEWISE(SWUInt,  c.v[l] ? a.v[l] : b.v[l]) }
+inline SWBool  swSelect(const SWBool &c, const SWBool &a,  const SWBool &b)  { SW_LANEWISE(SWBool,  c.v[l] ? a.v[l] : b.v[l]) }
+
+#endif  // SW_USE_SSE2
+
+
+inline SWBool operator==(const SWBool &a, const SWBool &b) { return !(a ^ b); }
+inline SWBool operator!=(const SWBool &a, const SWBool &b) { return a ^ b; }
+
+inline bool swAny(const SWBool &a) { return a.bits() != 0; }
+inline bool swAll(const SWBool &a) { return a.bits() == 0xF; }
+
+
+// float
+
+
+#ifdef SW_USE_SSE2
+
+inline SWFloat operator+(const SWFloat &a, const SWFloat &b) { return SWFloat(_mm_add_ps(a.v, b.v)); }
+inline SWFloat operator-(const SWFloat &a, const SWFloat &b) { return SWFloat(_mm_sub_ps(a.v, b.v)); }
+inline SWFloat operator*(const SWFloat &a, const SWFloat &b) { return SWFloat(_mm_mul_ps(a.v, b.v)); }
+inline SWFloat operator/(const SWFloat &a, const SWFloat &b) { return SWFloat(_mm_div_ps(a.v, b.v)); }
+inline SWFloat operator-(const SWFloat &a) { return SWFloat(_mm_xor_ps(a.v, _mm_set1_ps(-0.0f))); }
+
+inline SWBool operator==(const SWFloat &a, const SWFloat &b) { return SWBool(_mm_cmpeq_ps(a.v, b.v)); }
+inline SWBool operator!=(const SWFloat &a, const SWFloat &b) { return SWBool(_mm_cmpneq_ps(a.v, b.v)); }
+inline SWBool operator< (const SWFloat &a, const SWFloat &b) { return SWBool(_mm_cmplt_ps(a.v, b.v)); }
+inline SWBool operator<=(const SWFloat &a, const SWFloat &b) { return SWBool(_mm_cmple_ps(a.v, b.v)); }
+inline SWBool operator> (const SWFloat &a, const SWFloat &b) { return SWBool(_mm_cmpgt_ps(a.v, b.v)); }
+inline SWBool operator>=(const SWFloat &a, const SWFloat &b) { return SWBool(_mm_cmpge_ps(a.v, b.v)); }
+
+inline SWFloat swMin(const SWFloat &a, const SWFloat &b) { return SWFloat(_mm_min_ps(a.v, b.v)); }
+inline SWFloat swMax(const SWFloat &a, const SWFloat &b) { return SWFloat(_mm_max_ps(a.v, b.v)); }
+inline SWFloat swAbs(const SWFloat &a) { return SWFloat(_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)); }
+inline SWFloat swSqrt(const SWFloat &a) { return SWFloat(_mm_sqrt_ps(a.v)); }
+
+
+// conversions round per MXCSR which is round to nearest even
+// magnitudes from 2^23 up are already integers and don't fit the conversion
+inline SWFloat swRoundEven(const SWFloat &a) {
+	__m128 big = _mm_cmpge_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v), _mm_set1_ps(8388608.0f));
+	__m128 r   = _mm_cvtepi32_ps(_mm_cvtps_epi32(a.v));
+	return SWFloat(_mm_or_ps(_mm_and_ps(big, a.v), _mm_andnot_ps(big, r)));
+}
+
+
+inline SWFloat swTrunc(const SWFloat &a) {
+	__m128 big = _mm_cmpge_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v), _mm_set1_ps(8388608.0f));
+	__m128 r   = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+	return SWFloat(_mm_or_ps(_mm_and_ps(big, a.v), _mm_andnot_ps(big, r)));
+}
+
+
+inline SWFloat swFloor(const SWFloat &a) {
+	SWFloat t = swTrunc(a);
+	return SWFloat(_mm_sub_ps(t.v, _mm_and_ps(_mm_cmpgt_ps(t.v, a.v), _mm_set1_ps(1.0f))));
+}
+
+
+inline SWFloat swCeil(const SWFloat &a) {
+	SWFloat t = swTrunc(a);
+	return SWFloat(_mm_add_ps(t.v, _mm_and_ps(_mm_cmplt_ps(t.v, a.v), _mm_set1_ps(1.0f))));
+}
+
+#else  // SW_USE_SSE2
+
+inline SWFloat operator+(const SWFloat &a, const SWFloat &b) { SW_LANEWISE(SWFloat, a.v[l] + b.v[l]) }
+inline SWFloat operator-(const SWFloat &a, const SWFloat &b) { SW_LANEWISE(SWFloat, a.v[l] - b.v[l]) }
+inline SWFloat operator*(const SWFloat &a, const SWFloat &b) { SW_LANEWISE(SWFloat, a.v[l] * b.v[l]) }
+inline SWFloat operator/(const SWFloat &a, const SWFloat &b) { SW_LANEWISE(SWFloat, a.v[l] / b.v[l]) }
+inline SWFloat operator-(const SWFloat &a) { SW_LANEWISE(SWFloat, -a.v[l]) }
+
+inline SWBool operator==(const SWFloat &a, const SWFloat &b) { SW_LANEWISE(SWBool, (a.v[l] == b.v[l]) ? -1 : 0) }
+inline SWBool operator!=(const SWFloat &a, const SWFloat &b) { SW_LANEWISE(SWBool, (a.v[l] != b.v[l]) ? -1 : 0) }
+inline SWBool operator< (const SWFloat &a, const SWFloat &b) { SW_LANEWISE(SWBool, (a.v[l] <  b.v[l]) ? -1 : 0) }
+inline SWBool operator<=(const SWFloat &a, const SWFloat &b) { SW_LANEWISE(SWBool, (a.v[l] <= b.v[l]) ? -1 : 0) }
+inline SWBool operator> (const SWFloat &a, const SWFloat &b) { SW_LANEWISE(SWBool, (a.v[l] >  b.v[l]) ? -1 : 0) }
+inline SWBool operator>=(const SWFloat &a, const SWFloat &b) { SW_LANEWISE(SWBool, (a.v[l] >= b.v[l]) ? -1 : 0) }
+
+// same operand order as minps and maxps
+inline SWFloat swMin(const SWFloat &a, const SWFloat &b) { SW_LANEWISE(SWFloat, (a.v[l] < b.v[l]) ? a.v[l] : b.v[l]) }
+inline SWFloat swMax(const SWFloat &a, const SWFloat &b) { SW_LANEWISE(SWFloat, (a.v[l] > b.v[l]) ? a.v[l] : b.v[l]) }
+inline SWFloat swAbs(const SWFloat &a) { SW_LANEWISE(SWFloat, std::fabs(a.v[l])) }
+inline SWFloat swSqrt(const SWFloat &a) { SW_LANEWISE(SWFloat, std::sqrt(a.v[l])) }
+inline SWFloat swRoundEven(const SWFloat &a) { SW_LANEWISE(SWFloat, std::nearbyint(a.v[l])) }
+inline SWFloat swTrunc(const SWFloat &a) { SW_LANEWISE(SWFloat, std::trunc(a.v[l])) }
+inline SWFloat swFloor(const SWFloat &a) { SW_LANEWISE(SWFloat, std::floor(a.v[l])) }
+inline SWFloat swCeil(const SWFloat &a) { SW_LANEWISE(SWFloat, std::ceil(a.v[l])) }
+
+#endif  // SW_USE_SSE2
+
+
+inline SWFloat swFract(const SWFloat &a) { return a - swFloor(a); }
+inline SWFloat swInverseSqrt(const SWFloat &a) { return SWFloat(1.0f) / swSqrt(a); }
+inline SWFloat swSign(const SWFloat &a) { return swSelect(a > SWFloat(0.0f), SWFloat(1.0f), swSelect(a < SWFloat(0.0f), SWFloat(-1.0f), SWFloat(0.0f))); }
+inline SWFloat swClamp(const SWFloat &a, const SWFloat &lo, const SWFloat &hi) { return swMin(swMax(a, lo), hi); }
+inline SWFloat swMix(const SWFloat &a, const SWFloat &b, const SWFloat &t) { return a + (b - a) * t; }
+inline SWFloat swStep(const SWFloat &edge, const SWFloat &a) { return swSelect(a < edge, SWFloat(0.0f), SWFloat(1.0f)); }
+// GLSL mod, result has the sign of b
+inline SWFloat swMod(const SWFloat &a, const SWFloat &b) { return a - b * swFloor(a / b); }
+
+
+inline SWFloat swSmoothStep(const SWFloat &edge0, const SWFloat &edge1, const SWFloat &a) {
+	SWFloat t = swClamp((a - edge0) / (edge1 - edge0), SWFloat(0.0f), SWFloat(1.0f));
+	return t * t * (SWFloat(3.0f) - SWFloat(2.0f) * t);
+}
+
+
+inline SWFloat swRound(const SWFloat &a) { return swRoundEven(a); }
+inline SWFloat swPow(const SWFloat &a, const SWFloat &b) { return swLanewise(a, b, [] (float x, float y) { return std::pow(x, y); } ); }
+inline SWFloat swExp(const SWFloat &a) { return swLanewise(a, [] (float x) { return std::exp(x); } ); }
+inline SWFloat swExp2(const SWFloat &a) { return swLanewise(a, [] (float x) { return std::exp2(x); } ); }
+inline SWFloat swLog(const SWFloat &a) { return swLanewise(a, [] (float x) { return std::log(x); } ); }
+inline SWFloat swLog2(const SWFloat &a) { return swLanewise(a, [] (float x) { return std::log2(x); } ); }
+inline SWFloat swSin(const SWFloat &a) { return swLanewise(a, [] (float x) { return std::sin(x); } ); }
+inline SWFloat swCos(const SWFloat &a) { return swLanewise(a, [] (float x) { return std::cos(x); } ); }
+inline SWFloat swTan(const SWFloat &a) { return swLanewise(a, [] (float x) { return std::tan(x); } ); }
+inline SWFloat swAsin(const SWFloat &a) { return swLanewise(a, [] (float x) { return std::asin(x); } ); }
+inline SWFloat swAcos(const SWFloat &a) { return swLanewise(a, [] (float x) { return std::acos(x); } ); }
+inline SWFloat swAtan(const SWFloat &a) { return swLanewise(a, [] (float x) { return std::atan(x); } ); }
+inline SWFloat swAtan2(const SWFloat &a, const SWFloat &b) { return swLanewise(a, b, [] (float y, float x) { return std::atan2(y, x); } ); }
+
+
+// derivatives within the quad, same value for both pixels of a row or column
+#ifdef SW_USE_SSE2
+
+inline SWFloat swDPdx(const SWFloat &a) {
+	return SWFloat(_mm_sub_ps(_mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(3, 3, 1, 1)), _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(2, 2, 0, 0))));
+}
+
+
+inline SWFloat swDPdy(const SWFloat &a) {
+	return SWFloat(_mm_sub_ps(_mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(3, 2, 3, 2)), _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(1, 0, 1, 0))));
+}
+
+#else  // SW_USE_SSE2
+
+inline SWFloat swDPdx(const SWFloat &a) { SW_LANEWISE(SWFloat, a.v[l | 1] - a.v[l & 2]) }
+inline SWFloat swDPdy(const SWFloat &a) { SW_LANEWISE(SWFloat, a.v[l | 2] - a.v[l & 1]) }
+
+#endif  // SW_USE_SSE2
+
+
+inline SWFloat swFwidth(const SWFloat &a) { return swAbs(swDPdx(a)) + swAbs(swDPdy(a)); }
+
+
+// int and uint
+
+
+#ifdef SW_USE_SSE2
+
+// SSE2 has no 32 bit multiply low, do even and odd lanes separately
+inline __m128i swMulLo(__m128i a, __m128i b) {
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd  = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+
+inline __m128i swSelectBits(__m128i c, __m128i a, __m128i b) {
+	return _mm_or_si128(_mm_and_si128(c, a), _mm_andnot_si128(c, b));
+}
+
+
+#define SW_INTEGER_OPS(T)                                                                                                          \
+	inline T operator+(const T &a, const T &b) { return T(_mm_add_epi32(a.v, b.v)); }                                             \
+	inline T operator-(const T &a, const T &b) { return T(_mm_sub_epi32(a.v, b.v)); }                                             \
+	inline T operator*(const T &a, const T &b) { return T(swMulLo(a.v, b.v)); }                                                   \
+	inline T operator-(const T &a) { return T(_mm_sub_epi32(_mm_setzero_si128(), a.v)); }                                         \
+	inline T operator&(const T &a, const T &b) { return T(_mm_and_si128(a.v, b.v)); }                                             \
+	inline T operator|(const T &a, const T &b) { return T(_mm_or_si128(a.v, b.v)); }                                              \
+	inline T operator^(const T &a, const T &b) { return T(_mm_xor_si128(a.v, b.v)); }                                             \
+	inline T operator~(const T &a) { return T(_mm_xor_si128(a.v, _mm_set1_epi32(-1))); }                                          \
+	inline T operator<<(const T &a, int n) { return T(_mm_sll_epi32(a.v, _mm_cvtsi32_si128(n))); }                                \
+	inline SWBool operator==(const T &a, const T &b) { return SWBool(_mm_castsi128_ps(_mm_cmpeq_epi32(a.v, b.v))); }              \
+	inline SWBool operator!=(const T &a, const T &b) { return !(a == b); }                                                         \
+	inline SWBool operator> (const T &a, const T &b) { return SWBool(_mm_castsi128_ps(_mm_cmpgt_epi32(_mm_xor_si128(a.v, T::bias()), _mm_xor_si128(b.v, T::bias())))); } \
+	inline SWBool operator< (const T &a, const T &b) { return b > a; }                                                             \
+	inline SWBool operator>=(const T &a, const T &b) { return !(b > a); }                                                          \
+	inline SWBool operator<=(const T &a, const T &b) { return !(a > b); }                                                          \
+	inline T swMin(const T &a, const T &b) { return T(swSelectBits(_mm_castps_si128((a < b).v), a.v, b.v)); }                     \
+	inline T swMax(const T &a, const T &b) { return T(swSelectBits(_mm_castps_si128((a > b).v), a.v, b.v)); }
+
+#else  // SW_USE_SSE2
+
+#define SW_INTEGER_OPS(T)                                                                                       \
+	inline T operator+(const T &a, const T &b) { SW_LANEWISE(T, a.v[l] + b.v[l]) }                              \
+	inline T operator-(const T &a, const T &b) { SW_LANEWISE(T, a.v[l] - b.v[l]) }                              \
+	inline T operator*(const T &a, const T &b) { SW_LANEWISE(T, a.v[l] * b.v[l]) }                              \
+	inline T operator-(const T &a) { SW_LANEWISE(T, 0 - a.v[l]) }                                                \
+	inline T operator&(const T &a, const T &b) { SW_LANEWISE(T, a.v[l] & b.v[l]) }                              \
+	inline T operator|(const T &a, const T &b) { SW_LANEWISE(T, a.v[l] | b.v[l]) }                              \
+	inline T operator^(const T &a, const T &b) { SW_LANEWISE(T, a.v[l] ^ b.v[l]) }                              \
+	inline T operator~(const T &a) { SW_LANEWISE(T, ~a.v[l]) }                                                  \
+	inline T operator<<(const T &a, int n) { SW_LANEWISE(T, a.v[l] << n) }                                      \
+	inline SWBool operator==(const T &a, const T &b) { SW_LANEWISE(SWBool, (a.v[l] == b.v[l]) ? -1 : 0) }       \
+	inline SWBool operator!=(const T &a, const T &b) { SW_LANEWISE(SWBool, (a.v[l] != b.v[l]) ? -1 : 0) }       \
+	inline SWBool operator> (const T &a, const T &b) { SW_LANEWISE(SWBool, (a.v[l] >  b.v[l]) ? -1 : 0) }       \
+	inline SWBool operator< (const T &a, const T &b) { SW_LANEWISE(SWBool, (a.v[l] <  b.v[l]) ? -1 : 0) }       \
+	inline SWBool operator>=(const T &a, const T &b) { SW_LANEWISE(SWBool, (a.v[l] >= b.v[l]) ? -1 : 0) }       \
+	inline SWBool operator<=(const T &a, const T &b) { SW_LANEWISE(SWBool, (a.v[l] <= b.v[l]) ? -1 : 0) }       \
+	inline T swMin(const T &a, const T &b) { SW_LANEWISE(T, (a.v[l] < b.v[l]) ? a.v[l] : b.v[l]) }              \
+	inline T swMax(const T &a, const T &b) { SW_LANEWISE(T, (a.v[l] > b.v[l]) ? a.v[l] : b.v[l]) }
+
+#endif  // SW_USE_SSE2
+
+
+SW_INTEGER_OPS(SWInt)
+SW_INTEGER_OPS(SWUInt)
+
+#undef SW_INTEGER_OPS
+
+
+#ifdef SW_USE_SSE2
+
+inline SWInt  operator>>(const SWInt &a, int n)  { return SWInt(_mm_sra_epi32(a.v, _mm_cvtsi32_si128(n))); }
+inline SWUInt operator>>(const SWUInt &a, int n) { return SWUInt(_mm_srl_epi32(a.v, _mm_cvtsi32_si128(n))); }
+
+
+inline SWInt swAbs(const SWInt &a) {
+	__m128i sign = _mm_srai_epi32(a.v, 31);
+	return SWInt(_mm_sub_epi32(_mm_xor_si128(a.v, sign), sign));
+}
+
+
+inline SWFloat swToFloat(const SWInt &a) { return SWFloat(_mm_cvtepi32_ps(a.v)); }
+
+
+// no unsigned conversion in SSE2, convert the halves separately
+inline SWFloat swToFloat(const SWUInt &a) {
+	__m128 hi = _mm_cvtepi32_ps(_mm_srli_epi32(a.v, 16));
+	__m128 lo = _mm_cvtepi32_ps(_mm_and_si128(a.v, _mm_set1_epi32(0xFFFF)));
+	return SWFloat(_mm_add_ps(_mm_mul_ps(hi, _mm_set1_ps(65536.0f)), lo));
+}
+
+
+// truncates like GLSL int()
+inline SWInt swToInt(const SWFloat &a) { return SWInt(_mm_cvttps_epi32(a.v)); }
+
+
+inline SWUInt swToUInt(const SWFloat &a) {
+	__m128  big = _mm_cmpge_ps(a.v, _mm_set1_ps(2147483648.0f));
+	__m128i lo  = _mm_cvttps_epi32(a.v);
+	__m128i hi  = _mm_xor_si128(_mm_cvttps_epi32(_mm_sub_ps(a.v, _mm_set1_ps(2147483648.0f))), _mm_set1_epi32(INT32_MIN));
+	return SWUInt(swSelectBits(_mm_castps_si128(big), hi, lo));
+}
+
+
+inline SWFloat swAsFloat(const SWInt &a)  { return SWFloat(_mm_castsi128_ps(a.v)); }
+inline SWFloat swAsFloat(const SWUInt &a) { return SWFloat(_mm_castsi128_ps(a.v)); }
+inline SWInt   swAsInt(const SWFloat &a)  { return SWInt(_mm_castps_si128(a.v)); }
+inline SWInt   swAsInt(const SWUInt &a)   { return SWInt(a.v); }
+inline SWUInt  swAsUInt(const SWFloat &a) { return SWUInt(_mm_castps_si128(a.v)); }
+inline SWUInt  swAsUInt(const SWInt &a)   { return SWUInt(a.v); }
+
+#else  // SW_USE_SSE2
+
+inline SWInt  operator>>(const SWInt &a, int n)  { SW_LANEWISE(SWInt,  a.v[l] >> n) }
+inline SWUInt operator>>(const SWUInt &a, int n) { SW_LANEWISE(SWUInt, a.v[l] >> n) }
+
+inline SWInt swAbs(const SWInt &a) { SW_LANEWISE(SWInt, (a.v[l] < 0) ? 0 - a.v[l] : a.v[l]) }
+
+inline SWFloat swToFloat(const SWInt &a)  { SW_LANEWISE(SWFloat, static_cast<float>(a.v[l])) }
+inline SWFloat swToFloat(const SWUInt &a) { SW_LANEWISE(SWFloat, static_cast<float>(a.v[l])) }
+// out of range values are undefined in GLSL but not allowed to be UB here
+inline SWInt   swToInt(const SWFloat &a)  { SW_LANEWISE(SWInt,  (std::fabs(a.v[l]) < 2147483648.0f) ? static_cast<int32_t>(a.v[l]) : INT32_MIN) }
+inline SWUInt  swToUInt(const SWFloat &a) { SW_LANEWISE(SWUInt, (a.v[l] >= 0.0f && a.v[l] < 4294967296.0f) ? static_cast<uint32_t>(a.v[l]) : 0U) }
+
+inline SWFloat swAsFloat(const SWInt &a)  { SWFloat r; memcpy(r.v, a.v, sizeof(r.v)); return r; }
+inline SWFloat swAsFloat(const SWUInt &a) { SWFloat r; memcpy(r.v, a.v, sizeof(r.v)); return r; }
+inline SWInt   swAsInt(const SWFloat &a)  { SWInt r;   memcpy(r.v, a.v, sizeof(r.v)); return r; }
+inline SWInt   swAsInt(const SWUInt &a)   { SWInt r;   memcpy(r.v, a.v, sizeof(r.v)); return r; }
+inline SWUInt  swAsUInt(const SWFloat &a) { SWUInt r;  memcpy(r.v, a.v, sizeof(r.v)); return r; }
+inline SWUInt  swAsUInt(const SWInt &a)   { SWUInt r;  memcpy(r.v, a.v, sizeof(r.v)); return r; }
+
+#endif  // SW_USE_SSE2
+
+
+inline SWInt  swToInt(const SWUInt &a)  { return swAsInt(a); }
+inline SWUInt swToUInt(const SWInt &a)  { return swAsUInt(a); }
+inline SWInt  swSign(const SWInt &a)    { return swSelect(a > SWInt(0), SWInt(1), swSelect(a < SWInt(0), SWInt(-1), SWInt(0))); }
+
+// bit tests so -ffast-math can't assume them false
+inline SWBool swIsNan(const SWFloat &a) { return (swAsInt(a) & SWInt(0x7FFFFFFF)) >  SWInt(0x7F800000); }
+inline SWBool swIsInf(const SWFloat &a) { return (swAsInt(a) & SWInt(0x7FFFFFFF)) == SWInt(0x7F800000); }
+
+template <typename T> inline T swClamp(const T &a, const T &lo, const T &hi) { return swMin(swMax(a, lo), hi); }
+
+
+// shifts and division by per lane amounts have no SSE2 instruction
+// amounts and divisors outside the defined range give 0 instead of UB
+inline SWInt  swShiftLeft(const SWInt &a, const SWUInt &n)   { return swAsInt(swLanewise(swAsUInt(a), n, [] (uint32_t x, uint32_t y) { return (y < 32) ? (x << y) : 0U; } )); }
+inline SWUInt swShiftLeft(const SWUInt &a, const SWUInt &n)  { return swLanewise(a, n, [] (uint32_t x, uint32_t y) { return (y < 32) ? (x << y) : 0U; } ); }
+inline SWInt  swShiftRight(const SWInt &a, const SWUInt &n)  { return swLanewise(a, swAsInt(n), [] (int32_t x, int32_t y) { return (y >= 0 && y < 32) ? (x >> y) : 0; } ); }
+inline SWUInt swShiftRight(const SWUInt &a, const SWUInt &n) { return swLanewise(a, n, [] (uint32_t x, uint32_t y) { return (y < 32) ? (x >> y) : 0U; } ); }
+
+inline SWInt  swDiv(const SWInt &a, const SWInt &b)   { return swLanewise(a, b, [] (int32_t x, int32_t y) { return (y == 0 || (y == -1 && x == INT32_MIN)) ? 0 : x / y; } ); }
+inline SWUInt swDiv(const SWUInt &a, const SWUInt &b) { return swLanewise(a, b, [] (uint32_t x, uint32_t y) { return (y == 0) ? 0U : x / y; } ); }
+// SRem, sign of a
+inline SWInt  swRem(const SWInt &a, const SWInt &b)   { return swLanewise(a, b, [] (int32_t x, int32_t y) { return (y == 0 || y == -1) ? 0 : x % y; } ); }
+inline SWUInt swRem(const SWUInt &a, const SWUInt &b) { return swLanewise(a, b, [] (uint32_t x, uint32_t y) { return (y == 0) ? 0U : x % y; } ); }
+// SMod, sign of b
+inline SWInt  swMod(const SWInt &a, const SWInt &b) {
+	return swLanewise(a, b, [] (int32_t x, int32_t y) {
+		if (y == 0 || y == -1) {
+			return 0;
+		}
+		int32_t r = x % y;
+		return (r != 0 && ((r < 0) != (y < 0))) ? r + y : r;
+	} );
+}
+
+
+inline SWFloat swUnpackSnorm16(const SWUInt &a, int shift) {
+	SWInt v = swAsInt(a << (16 - shift)) >> 16;
+	return swClamp(swToFloat(v) * SWFloat(1.0f / 32767.0f), SWFloat(-1.0f), SWFloat(1.0f));
+}
+
+
+inline SWFloat swUnpackUnorm(const SWUInt &a, int shift, uint32_t mask) {
+	return swToFloat((a >> shift) & SWUInt(mask)) * SWFloat(1.0f / mask);
+}
+
+
+// memory of uniform and storage buffers
+
+
+template <typename T>
+inline T swLoadScalar(const char *p) {
+	T t;
+	memcpy(&t, p, sizeof(T));
+	return t;
+}
+
+
+// different address in each lane, lanes not in mask are not read and get 0
+template <typename T>
+inline T swGather(const char *base, const SWInt &offsets, const SWBool &mask) {
+	typedef decltype(T().lane(0)) Lane;
+	int32_t o[4];
+	offsets.store(o);
+	int m = mask.bits();
+	Lane t[4];
+	for (unsigned int l = 0; l < 4; l++) {
+		t[l] = (m & (1 << l)) ? swLoadScalar<Lane>(base + o[l]) : Lane(0);
+	}
+	return T::load(t);
+}
+
+
+} // namespace renderer
+
+
+#endif  // SOFTWARESIMD_H
@@ -0,0 +1,237 @@
+/*
+Copyright (c) 2015-2018 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifdef RENDERER_SOFTWARE
+
+#include <algorithm>
+
+#include "RendererInternal.h"
+
+
+namespace renderer {
+
+
+float swSRGBToLinear(float v) {
+	if (v <= 0.04045f) {
+		return v / 12.92f;
+	} else {
+		return powf((v + 0.055f) / 1.055f, 2.4f);
+	}
+}
+
+
+float swLinearToSRGB(float v) {
+	if (v <= 0.0031308f) {
+		return v * 12.92f;
+	} else {
+		return 1.055f * powf(v, 1.0f / 2.4f) - 0.055f;
+	}
+}
+
+
+// sRGB8 decode table and the linear values halfway between its entries
+// so quantizing doesn't need pow per channel
+struct SRGBTables {
+	std::array<float, 256>  decode;
+	std::array<float, 255>  thresholds;
+
+
+	SRGBTables() {
+		for (unsigned int i = 0; i < 256; i++) {
+			decode[i] = swSRGBToLinear(i / 255.0f);
+		}
+		for (unsigned int i = 0; i < 255; i++) {
+			thresholds[i] = swSRGBToLinear((i + 0.5f) / 255.0f);
+		}
+	}
+};
+
+
+static const SRGBTables srgbTables;
+
+
+uint8_t swEncodeSRGB8(float v) {
+	return static_cast<uint8_t>(std::upper_bound(srgbTables.thresholds.begin(), srgbTables.thresholds.end(), v) - srgbTables.thresholds.begin());
+}
+
+
+float swQuantizeSRGB(float v) {
+	return srgbTables.decode[swEncodeSRGB8(v)];
+}
+
+
+static glm::vec4 fetchTexel(const SWImage &image, int x, int y) {
+	x = glm::clamp(x, 0, static_cast<int>(image.width)  - 1);
+	y = glm::clamp(y, 0, static_cast<int>(image.height) - 1);
+	return image.texels[y * image.width + x];
+}
+
+
+static glm::vec4 encodeSampled(const SWImage &image, glm::vec4 v) {
+	if (image.encodeSRGB) {
+		v.x = swLinearToSRGB(v.x);
+		v.y = swLinearToSRGB(v.y);
+		v.z = swLinearToSRGB(v.z);
+	}
+
+	return v;
+}
+
+
+// coord is in texels with texel centers at integers
+static glm::vec4 sampleTexels(const SWImage &image, FilterMode filter, glm::vec2 coord) {
+	if (!image.texels) {
+		return glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+
+	glm::vec4 result;
+	if (filter == FilterMode::Nearest) {
+		result = fetchTexel(image, static_cast<int>(std::floor(coord.x + 0.5f)), static_cast<int>(std::floor(coord.y + 0.5f)));
+	} else {
+		// 8 bits of subtexel precision like GPUs, otherwise sampling
+		// a texel center can pick up a tiny fraction of its neighbour
+		glm::ivec2 fixed(glm::round(coord * 256.0f));
+		glm::vec2 f = glm::vec2(fixed & 255) / 256.0f;
+		int x = fixed.x >> 8;
+		int y = fixed.y >> 8;
+
+		glm::vec4 top    = glm::mix(fetchTexel(image, x, y),     fetchTexel(image, x + 1, y),     f.x);
+		glm::vec4 bottom = glm::mix(fetchTexel(image, x, y + 1), fetchTexel(image, x + 1, y + 1), f.x);
+		result = glm::mix(top, bottom, f.y);
+	}
+
+	return encodeSampled(image, result);
+}
+
+
+// coordinates in texels are clamped so helper lanes outside the triangle
+// can't overflow the conversion to int
+static const float maxTexelCoord = 65536.0f;
+
+
+static void texelCoords(const SWImage &image, const SWFloat &u, const SWFloat &v, int offsetX, int offsetY, float *x, float *y) {
+	SWFloat limit(maxTexelCoord);
+	swClamp(u * SWFloat(static_cast<float>(image.width))  - SWFloat(0.5f - offsetX), -limit, limit).store(x);
+	swClamp(v * SWFloat(static_cast<float>(image.height)) - SWFloat(0.5f - offsetY), -limit, limit).store(y);
+}
+
+
+static void storeLanes(const glm::vec4 *lanes, SWFloat *result) {
+	for (unsigned int c = 0; c < 4; c++) {
+		result[c] = SWFloat(lanes[0][c], lanes[1][c], lanes[2][c], lanes[3][c]);
+	}
+}
+
+
+// texture, textureLod and textureLodOffset, there are no mipmaps
+void swTexture(const SWImage &image, FilterMode filter, const SWFloat &u, const SWFloat &v, int offsetX, int offsetY, SWFloat *result) {
+	float x[4], y[4];
+	texelCoords(image, u, v, offsetX, offsetY, x, y);
+
+	glm::vec4 lanes[4];
+	for (unsigned int l = 0; l < 4; l++) {
+		lanes[l] = sampleTexels(image, filter, glm::vec2(x[l], y[l]));
+	}
+	storeLanes(lanes, result);
+}
+
+
+// components in the same order as GLSL
+void swTextureGather(const SWImage &image, const SWFloat &u, const SWFloat &v, unsigned int comp, int offsetX, int offsetY, SWFloat *result) {
+	if (!image.texels) {
+		for (unsigned int c = 0; c < 4; c++) {
+			result[c] = SWFloat();
+		}
+		return;
+	}
+
+	float x[4], y[4];
+	texelCoords(image, u, v, offsetX, offsetY, x, y);
+
+	glm::vec4 lanes[4];
+	for (unsigned int l = 0; l < 4; l++) {
+		// same texel selection as linear filtering
+		int fx = static_cast<int>(std::round(x[l] * 256.0f)) >> 8;
+		int fy = static_cast<int>(std::round(y[l] * 256.0f)) >> 8;
+		glm::vec4 texels(fetchTexel(image, fx, fy + 1)[comp], fetchTexel(image, fx + 1, fy + 1)[comp], fetchTexel(image, fx + 1, fy)[comp], fetchTexel(image, fx, fy)[comp]);
+		if (image.encodeSRGB && comp < 3) {
+			for (unsigned int i = 0; i < 4; i++) {
+				texels[i] = swLinearToSRGB(texels[i]);
+			}
+		}
+		lanes[l] = texels;
+	}
+	storeLanes(lanes, result);
+}
+
+
+// texelFetch, there is only one sample so multisampled images work too
+void swTexelFetch(const SWImage &image, const SWInt &x, const SWInt &y, SWFloat *result) {
+	int32_t xs[4], ys[4];
+	x.store(xs);
+	y.store(ys);
+
+	glm::vec4 lanes[4];
+	for (unsigned int l = 0; l < 4; l++) {
+		if (image.texels) {
+			lanes[l] = encodeSampled(image, fetchTexel(image, xs[l], ys[l]));
+		} else {
+			lanes[l] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		}
+	}
+	storeLanes(lanes, result);
+}
+
+
+const SWShaderInfo *findSWShader(const std::string &filename, const ShaderMacros &macros) {
+	// same key as the SPIR-V cache
+	std::vector<std::string> sorted;
+	sorted.reserve(macros.size());
+	for (const auto &macro : macros) {
+		std::string s = macro.first;
+		if (!macro.second.empty()) {
+			s += "=" + macro.second;
+		}
+		sorted.push_back(std::move(s));
+	}
+	std::sort(sorted.begin(), sorted.end());
+
+	std::string key = filename;
+	for (const auto &s : sorted) {
+		key += "_" + s;
+	}
+
+	for (unsigned int i = 0; i < swNumShaders; i++) {
+		if (key == swShaders[i].key) {
+			return &swShaders[i];
+		}
+	}
+
+	return nullptr;
+}
+
+
+} // namespace renderer
+
+
+#endif //  RENDERER_SOFTWARE
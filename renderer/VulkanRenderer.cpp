@@ -27,6 +27,7 @@ THE SOFTWARE.
 #include <SDL_vulkan.h>
 
 #include "RendererInternal.h"
+#include "utils/Profiler.h"
 #include "utils/Utils.h"
 
 #include <boost/variant/apply_visitor.hpp>
@@ -202,6 +203,24 @@ static vk::Format vulkanFormat(Format format) {
 	case Format::Depth32Float:
 		return vk::Format::eD32Sfloat;
 
+	case Format::BC1:
+		return vk::Format::eBc1RgbaUnormBlock;
+
+	case Format::sBC1:
+		return vk::Format::eBc1RgbaSrgbBlock;
+
+	case Format::BC3:
+		return vk::Format::eBc3UnormBlock;
+
+	case Format::sBC3:
+		return vk::Format::eBc3SrgbBlock;
+
+	case Format::BC7:
+		return vk::Format::eBc7UnormBlock;
+
+	case Format::sBC7:
+		return vk::Format::eBc7SrgbBlock;
+
 	}
 
 	UNREACHABLE();
@@ -243,7 +262,7 @@ vk::BufferUsageFlags bufferTypeUsage(BufferType type) {
 }
 
 static VkBool32 VKAPI_PTR debugCallbackFunc(VkDebugReportFlagsEXT flags, VkDebugReportObjectTypeEXT objectType, uint64_t object, size_t location, int32_t /* messageCode */, const char * pLayerPrefix, const char * pMessage, void * /* pUserData*/) {
-	LOG("layer %s %s object %lu type %s location %lu: %s\n", pLayerPrefix, vk::to_string(vk::DebugReportFlagBitsEXT(flags)).c_str(), static_cast<unsigned long>(object), vk::to_string(vk::DebugReportObjectTypeEXT(objectType)).c_str(), static_cast<unsigned long>(location), pMessage);
+	LOG_ERROR("layer %s %s object %lu type %s location %lu: %s\n", pLayerPrefix, vk::to_string(vk::DebugReportFlagBitsEXT(flags)).c_str(), static_cast<unsigned long>(object), vk::to_string(vk::DebugReportObjectTypeEXT(objectType)).c_str(), static_cast<unsigned long>(location), pMessage);
 	logFlush();
 
 	// make errors fatal
@@ -256,58 +275,76 @@ static VkBool32 VKAPI_PTR debugCallbackFunc(VkDebugReportFlagsEXT flags, VkDebug
 
 RendererImpl::RendererImpl(const RendererDesc &desc)
 : RendererBase(desc)
+, window(nullptr)
+, headless(desc.headless)
 , graphicsQueueIndex(0)
 , transferQueueIndex(0)
-, numUploads(0)
+, swapchainFormat(vk::Format::eUndefined)
+, swapchainGeneration(0)
+, currentImageIdx(0)
+, stagingBufferMem(VK_NULL_HANDLE)
+, stagingMapping(nullptr)
+, stagingCoherent(false)
+, stagingBufSize(16 * 1048576)
+, stagingBufPtr(0)
+, lastSyncedStagingBufPtr(0)
+, nextTextureUploadId(1)
 , amdShaderInfo(false)
 , debugMarkers(false)
+, timestampPeriod(0.0)
+, timestampMask(0)
 , ringBufferMem(nullptr)
 , persistentMapping(nullptr)
 {
 	bool enableValidation = desc.debug;
 	bool enableMarkers    = desc.tracing;
 
-	// renderdoc crashes if SDL tries to init GL renderer so disable it
-	SDL_SetHint(SDL_HINT_RENDER_DRIVER, "software");
-	SDL_Init(SDL_INIT_EVENTS | SDL_INIT_VIDEO);
+	if (headless) {
+		SDL_Init(SDL_INIT_EVENTS);
+	} else {
+		// renderdoc crashes if SDL tries to init GL renderer so disable it
+		SDL_SetHint(SDL_HINT_RENDER_DRIVER, "software");
+		SDL_Init(SDL_INIT_EVENTS | SDL_INIT_VIDEO);
+
+		SDL_DisplayMode mode;
+		memset(&mode, 0, sizeof(mode));
+		int numDisplays = SDL_GetNumVideoDisplays();
+		LOG("Number of displays detected: %i\n", numDisplays);
+
+		for (int i = 0; i < numDisplays; i++) {
+			int retval = SDL_GetDesktopDisplayMode(i, &mode);
+			if (retval == 0) {
+				LOG("Desktop mode for display %d: %dx%d, refresh %d Hz\n", i, mode.w, mode.h, mode.refresh_rate);
+				currentRefreshRate = mode.refresh_rate;
+			} else {
+				LOG("Failed to get desktop display mode for display %d\n", i);
+			}
 
-	SDL_DisplayMode mode;
-	memset(&mode, 0, sizeof(mode));
-	int numDisplays = SDL_GetNumVideoDisplays();
-	LOG("Number of displays detected: %i\n", numDisplays);
+			int numModes = SDL_GetNumDisplayModes(i);
+			LOG("Number of display modes for display %i : %i\n", i, numModes);
 
-	for (int i = 0; i < numDisplays; i++) {
-		int retval = SDL_GetDesktopDisplayMode(i, &mode);
-		if (retval == 0) {
-			LOG("Desktop mode for display %d: %dx%d, refresh %d Hz\n", i, mode.w, mode.h, mode.refresh_rate);
-			currentRefreshRate = mode.refresh_rate;
-		} else {
-			LOG("Failed to get desktop display mode for display %d\n", i);
+			for (int j = 0; j < numModes; j++) {
+				SDL_GetDisplayMode(i, j, &mode);
+				LOG("Display mode %i : width %i, height %i, BPP %i, refresh %u Hz\n", j, mode.w, mode.h, SDL_BITSPERPIXEL(mode.format), mode.refresh_rate);
+				maxRefreshRate = std::max(static_cast<unsigned int>(mode.refresh_rate), maxRefreshRate);
+			}
 		}
 
-		int numModes = SDL_GetNumDisplayModes(i);
-		LOG("Number of display modes for display %i : %i\n", i, numModes);
-
-		for (int j = 0; j < numModes; j++) {
-			SDL_GetDisplayMode(i, j, &mode);
-			LOG("Display mode %i : width %i, height %i, BPP %i, refresh %u Hz\n", j, mode.w, mode.h, SDL_BITSPERPIXEL(mode.format), mode.refresh_rate);
-			maxRefreshRate = std::max(static_cast<unsigned int>(mode.refresh_rate), maxRefreshRate);
+		int flags = SDL_WINDOW_RESIZABLE;
+		flags |= SDL_WINDOW_VULKAN;
+		if (desc.swapchain.fullscreen) {
+			flags |= SDL_WINDOW_FULLSCREEN_DESKTOP;
 		}
-	}
 
-	int flags = SDL_WINDOW_RESIZABLE;
-	flags |= SDL_WINDOW_VULKAN;
-	if (desc.swapchain.fullscreen) {
-		flags |= SDL_WINDOW_FULLSCREEN_DESKTOP;
-	}
+		window = SDL_CreateWindow("SMAA Demo", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, desc.swapchain.width, desc.swapchain.height, flags);
 
-	window = SDL_CreateWindow("SMAA Demo", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, desc.swapchain.width, desc.swapchain.height, flags);
-
-	if (!window) {
-		LOG("SDL_CreateWindow failed: %s\n", SDL_GetError());
-		throw std::runtime_error("SDL_CreateWindow failed");
+		if (!window) {
+			LOG("SDL_CreateWindow failed: %s\n", SDL_GetError());
+			throw std::runtime_error("SDL_CreateWindow failed");
+		}
 	}
 
+	bool headlessSurfaceSupported = false;
 	{
 		auto extensions = vk::enumerateInstanceExtensionProperties();
 		std::sort(extensions.begin(), extensions.end()
@@ -330,20 +367,39 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 		padding.push_back('\0');
 		for (const auto &ext : extensions) {
 			LOG(" %s %s %u\n", ext.extensionName, &padding[strnlen(ext.extensionName, maxLen)], ext.specVersion);
+			if (strcmp(ext.extensionName, "VK_EXT_headless_surface") == 0) {
+				headlessSurfaceSupported = true;
+			}
 		}
 	}
 
-	unsigned int numExtensions = 0;
-	if (!SDL_Vulkan_GetInstanceExtensions(window, &numExtensions, NULL)) {
-		LOG("SDL_Vulkan_GetInstanceExtensions failed: %s\n", SDL_GetError());
-		throw std::runtime_error("SDL_Vulkan_GetInstanceExtensions failed");
-	}
+	std::vector<const char *> extensions;
+	if (headless) {
+		if (!headlessSurfaceSupported) {
+			LOG("VK_EXT_headless_surface not supported\n");
+			throw std::runtime_error("VK_EXT_headless_surface not supported");
+		}
+
+#ifdef VK_EXT_headless_surface
+		extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+		extensions.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+#else  // VK_EXT_headless_surface
+		LOG("Vulkan headers are too old for VK_EXT_headless_surface\n");
+		throw std::runtime_error("Vulkan headers are too old for VK_EXT_headless_surface");
+#endif  // VK_EXT_headless_surface
+	} else {
+		unsigned int numExtensions = 0;
+		if (!SDL_Vulkan_GetInstanceExtensions(window, &numExtensions, NULL)) {
+			LOG("SDL_Vulkan_GetInstanceExtensions failed: %s\n", SDL_GetError());
+			throw std::runtime_error("SDL_Vulkan_GetInstanceExtensions failed");
+		}
 
-	std::vector<const char *> extensions(numExtensions, nullptr);
+		extensions.resize(numExtensions, nullptr);
 
-	if(!SDL_Vulkan_GetInstanceExtensions(window, &numExtensions, &extensions[0])) {
-		LOG("SDL_Vulkan_GetInstanceExtensions failed: %s\n", SDL_GetError());
-		throw std::runtime_error("SDL_Vulkan_GetInstanceExtensions failed");
+		if(!SDL_Vulkan_GetInstanceExtensions(window, &numExtensions, &extensions[0])) {
+			LOG("SDL_Vulkan_GetInstanceExtensions failed: %s\n", SDL_GetError());
+			throw std::runtime_error("SDL_Vulkan_GetInstanceExtensions failed");
+		}
 	}
 
 	vk::ApplicationInfo appInfo;
@@ -412,7 +468,14 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 
 	deviceFeatures = physicalDevice.getFeatures();
 
-	if(!SDL_Vulkan_CreateSurface(window,
+	if (headless) {
+#ifdef VK_EXT_headless_surface
+		// swapchain works as usual but nothing is displayed
+		vk::HeadlessSurfaceCreateInfoEXT surfaceInfo;
+		surface = instance.createHeadlessSurfaceEXT(surfaceInfo, nullptr, dispatcher);
+		LOG("Created headless surface\n");
+#endif  // VK_EXT_headless_surface
+	} else if(!SDL_Vulkan_CreateSurface(window,
 								 (SDL_vulkanInstance) instance,
 								 (SDL_vulkanSurface *)&surface))
 	{
@@ -456,12 +519,22 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 	}
 
 	if (graphicsQueueIndex == queueProps.size()) {
-		LOG("Error: no graphics queue\n");
+		LOG_ERROR("no graphics queue\n");
 		throw std::runtime_error("Error: no graphics queue");
 	}
 
 	LOG("Using queue %u for graphics\n", graphicsQueueIndex);
 
+	{
+		uint32_t validBits = queueProps.at(graphicsQueueIndex).timestampValidBits;
+		if (validBits > 0 && deviceProperties.limits.timestampPeriod > 0.0f) {
+			features.timestamps = true;
+			timestampPeriod     = deviceProperties.limits.timestampPeriod;
+			timestampMask       = (validBits >= 64) ? ~0ULL : ((1ULL << validBits) - 1);
+		}
+		LOG("Timestamp queries %s\n", features.timestamps ? "supported" : "not supported");
+	}
+
 	std::array<float, 1> queuePriorities = { { 0.0f } };
 
 	std::array<vk::DeviceQueueCreateInfo, 2> queueCreateInfos;
@@ -617,22 +690,51 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 		}
 	}
 	features.SSBOSupported  = true;
+	// all supported device features are enabled
+	features.textureCompressionBC = deviceFeatures.textureCompressionBC;
+	LOG("BC texture compression %s\n", features.textureCompressionBC ? "supported" : "not supported");
 
 	recreateSwapchain();
 	recreateRingBuffer(desc.ephemeralRingBufSize);
 
-	acquireSem    = device.createSemaphore(vk::SemaphoreCreateInfo());
-	renderDoneSem = device.createSemaphore(vk::SemaphoreCreateInfo());
-
+	// upload command buffers are recycled individually
 	vk::CommandPoolCreateInfo cp;
+	cp.flags            = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
 	cp.queueFamilyIndex = transferQueueIndex;
 	transferCmdPool = device.createCommandPool(cp);
 
+	{
+		vk::BufferCreateInfo bufInfo;
+		bufInfo.size      = stagingBufSize;
+		bufInfo.usage     = vk::BufferUsageFlagBits::eTransferSrc;
+		stagingBuffer     = device.createBuffer(bufInfo);
+
+		VmaAllocationCreateInfo req = {};
+		req.flags          = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_USER_DATA_COPY_STRING_BIT;
+		req.usage          = VMA_MEMORY_USAGE_CPU_ONLY;
+		req.pUserData      = const_cast<char *>("Staging buffer");
+
+		VmaAllocationInfo  allocationInfo = {};
+		auto result = vmaAllocateMemoryForBuffer(allocator, stagingBuffer, &req, &stagingBufferMem, &allocationInfo);
+
+		if (result != VK_SUCCESS) {
+			LOG("vmaAllocateMemoryForBuffer failed: %s\n", vk::to_string(vk::Result(result)).c_str());
+			throw std::runtime_error("vmaAllocateMemoryForBuffer failed");
+		}
+		assert(allocationInfo.pMappedData != nullptr);
+
+		device.bindBufferMemory(stagingBuffer, allocationInfo.deviceMemory, allocationInfo.offset);
+
+		stagingMapping  = reinterpret_cast<char *>(allocationInfo.pMappedData);
+		assert(allocationInfo.memoryType < memoryProperties.memoryTypeCount);
+		stagingCoherent = !!(memoryProperties.memoryTypes[allocationInfo.memoryType].propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent);
+	}
+
 	vk::PipelineCacheCreateInfo cacheInfo;
-	std::vector<char> cacheData;
+	MappedFile cacheData;
 	std::string plCacheFile =  spirvCacheDir + "pipeline.cache";
 	if (!desc.skipShaderCache && fileExists(plCacheFile)) {
-		cacheData                 = readFile(plCacheFile);
+		cacheData                 = MappedFile(plCacheFile);
 		cacheInfo.initialDataSize = cacheData.size();
 		cacheInfo.pInitialData    = cacheData.data();
 	}
@@ -722,6 +824,7 @@ RendererImpl::~RendererImpl() {
 	assert(ringBuffer);
 	assert(persistentMapping);
 	assert(transferCmdPool);
+	assert(stagingBuffer);
 	assert(pipelineCache);
 
 	// save pipeline cache
@@ -742,16 +845,47 @@ RendererImpl::~RendererImpl() {
 	}
 	frames.clear();
 
+	for (auto &r : freeReadbacks) {
+		deleteReadbackInternal(r);
+	}
+	freeReadbacks.clear();
+
+	// copies recorded after the last frame are never submitted
+	if (currentUpload.cmdBuf) {
+		currentUpload.cmdBuf.end();
+		freeUploadCmdBufs.push_back(currentUpload.cmdBuf);
+		freeUploadSems.push_back(currentUpload.semaphore);
+		currentUpload.cmdBuf      = vk::CommandBuffer();
+		currentUpload.semaphore   = vk::Semaphore();
+		currentUpload.semWaitMask = vk::PipelineStageFlags();
+		currentUpload.imageAcquireBarriers.clear();
+		currentUpload.bufferAcquireBarriers.clear();
+	}
+
+	for (auto &sem : freeUploadSems) {
+		device.destroySemaphore(sem);
+	}
+	freeUploadSems.clear();
+	// command buffers are freed with the pool
+	freeUploadCmdBufs.clear();
+
+	vmaFreeMemory(allocator, stagingBufferMem);
+	stagingBufferMem = VK_NULL_HANDLE;
+	stagingMapping   = nullptr;
+	device.destroyBuffer(stagingBuffer);
+	stagingBuffer    = vk::Buffer();
+
 	for (auto &r : deleteResources) {
 		this->deleteResourceInternal(const_cast<Resource &>(r));
 	}
 	deleteResources.clear();
 
-	device.destroySemaphore(renderDoneSem);
-	renderDoneSem = vk::Semaphore();
-
-	device.destroySemaphore(acquireSem);
-	acquireSem = vk::Semaphore();
+	for (auto &sem : renderDoneSems) {
+		device.destroySemaphore(sem);
+		sem = vk::Semaphore();
+	}
+	renderDoneSems.clear();
+	swapchainImages.clear();
 
 	vmaFreeMemory(allocator, ringBufferMem);
 	ringBufferMem = nullptr;
@@ -805,6 +939,11 @@ RendererImpl::~RendererImpl() {
 		deleteTextureInternal(tex);
 	} );
 
+	for (auto &view : swapchainViews) {
+		device.destroyImageView(view);
+	}
+	swapchainViews.clear();
+
 	device.destroySwapchainKHR(swapchain);
 	swapchain = vk::SwapchainKHR();
 
@@ -828,7 +967,10 @@ RendererImpl::~RendererImpl() {
 	instance.destroy();
 	instance = vk::Instance();
 
-	SDL_DestroyWindow(window);
+	if (window) {
+		SDL_DestroyWindow(window);
+		window = nullptr;
+	}
 
 	SDL_Quit();
 }
@@ -878,7 +1020,7 @@ BufferHandle RendererImpl::createBuffer(BufferType type, uint32_t size, const vo
 	buffer.type   = type;
 
 	// copy contents to GPU memory
-	UploadOp op = allocateUploadOp(size);
+	UploadOp &op = beginUploadOp();
 	switch (type) {
 	case BufferType::Invalid:
 		UNREACHABLE();
@@ -887,26 +1029,27 @@ BufferHandle RendererImpl::createBuffer(BufferType type, uint32_t size, const vo
 	case BufferType::Index:
 	case BufferType::Vertex:
 	case BufferType::Everything:
-		op.semWaitMask = vk::PipelineStageFlagBits::eVertexInput;
+		op.semWaitMask |= vk::PipelineStageFlagBits::eVertexInput;
 		break;
 
 	case BufferType::Uniform:
 	case BufferType::Storage:
-		op.semWaitMask = vk::PipelineStageFlagBits::eVertexShader;
+		op.semWaitMask |= vk::PipelineStageFlagBits::eVertexShader;
 		break;
 
 	}
 
-	memcpy(static_cast<char *>(op.allocationInfo.pMappedData), contents, size);
-    vmaFlushAllocation(allocator, buffer.memory, 0, size);
+	StagingAlloc staging = allocateStaging(size, 4);
+	memcpy(staging.mapped, contents, size);
+	flushStaging(staging, size);
 
-	// TODO: reuse command buffer for multiple copies
 	vk::BufferCopy copyRegion;
-	copyRegion.srcOffset = 0;
+	copyRegion.srcOffset = staging.offset;
 	copyRegion.dstOffset = 0;
 	copyRegion.size      = size;
 
-	op.cmdBuf.copyBuffer(op.stagingBuffer, buffer.buffer, 1, &copyRegion);
+	op.cmdBuf.copyBuffer(staging.buffer, buffer.buffer, 1, &copyRegion);
+	releaseStaging(staging, size);
 
 	vk::BufferMemoryBarrier barrier;
 	barrier.srcAccessMask       = vk::AccessFlagBits::eTransferWrite;
@@ -928,8 +1071,6 @@ BufferHandle RendererImpl::createBuffer(BufferType type, uint32_t size, const vo
 		op.bufferAcquireBarriers.push_back(barrier);
 	}
 
-	submitUploadOp(std::move(op));
-
 	return result.second;
 }
 
@@ -990,6 +1131,7 @@ FramebufferHandle RendererImpl::createFramebuffer(const FramebufferDesc &desc) {
 
 	std::vector<vk::ImageView> attachmentViews;
 	unsigned int width = 0, height = 0;
+	bool swapchainFB = false;
 
 	for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
 		if (!desc.colors_[i]) {
@@ -997,6 +1139,9 @@ FramebufferHandle RendererImpl::createFramebuffer(const FramebufferDesc &desc) {
 		}
 
 		const auto &colorRT = renderTargets.get(desc.colors_[i]);
+		if (colorRT.swapchain) {
+			swapchainFB = true;
+		}
 
 		if (width == 0) {
 			assert(height == 0);
@@ -1022,6 +1167,18 @@ FramebufferHandle RendererImpl::createFramebuffer(const FramebufferDesc &desc) {
 		attachmentViews.push_back(depthRT.imageView);
 	}
 
+	if (swapchainFB) {
+		// need one for every swapchain image
+		auto result     = framebuffers.add();
+		Framebuffer &fb = result.first;
+		fb.desc         = desc;
+		fb.width        = width;
+		fb.height       = height;
+		createSwapchainFramebuffers(fb, renderPass.renderPass);
+
+		return result.second;
+	}
+
 	vk::FramebufferCreateInfo fbInfo;
 
 	fbInfo.renderPass       = renderPass.renderPass;
@@ -1045,6 +1202,60 @@ FramebufferHandle RendererImpl::createFramebuffer(const FramebufferDesc &desc) {
 }
 
 
+void RendererImpl::createSwapchainFramebuffers(Framebuffer &fb, vk::RenderPass renderPass) {
+	assert(fb.imageFramebuffers.empty());
+	assert(!swapchainViews.empty());
+
+	if (fb.width != swapchainDesc.width || fb.height != swapchainDesc.height) {
+		LOG("Framebuffer \"%s\" is %ux%u but swapchain is %ux%u\n", fb.desc.name_.c_str(), fb.width, fb.height, swapchainDesc.width, swapchainDesc.height);
+		throw std::runtime_error("Swapchain framebuffer size doesn't match swapchain");
+	}
+
+	fb.imageFramebuffers.reserve(swapchainViews.size());
+	for (unsigned int image = 0; image < swapchainViews.size(); image++) {
+		std::vector<vk::ImageView> attachmentViews;
+
+		for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
+			if (!fb.desc.colors_[i]) {
+				continue;
+			}
+
+			const auto &colorRT = renderTargets.get(fb.desc.colors_[i]);
+			if (colorRT.swapchain) {
+				attachmentViews.push_back(swapchainViews.at(image));
+			} else {
+				assert(colorRT.imageView);
+				attachmentViews.push_back(colorRT.imageView);
+			}
+		}
+
+		if (fb.desc.depthStencil_) {
+			const auto &depthRT = renderTargets.get(fb.desc.depthStencil_);
+			assert(depthRT.imageView);
+			attachmentViews.push_back(depthRT.imageView);
+		}
+
+		vk::FramebufferCreateInfo fbInfo;
+
+		fbInfo.renderPass       = renderPass;
+		assert(!attachmentViews.empty());
+		fbInfo.attachmentCount  = static_cast<uint32_t>(attachmentViews.size());
+		fbInfo.pAttachments     = &attachmentViews[0];
+		fbInfo.width            = fb.width;
+		fbInfo.height           = fb.height;
+		fbInfo.layers           = 1;
+
+		fb.imageFramebuffers.push_back(device.createFramebuffer(fbInfo));
+
+		debugNameObject<vk::Framebuffer>(fb.imageFramebuffers.back(), fb.desc.name_ + " " + std::to_string(image));
+	}
+
+	assert(currentImageIdx < fb.imageFramebuffers.size());
+	fb.framebuffer         = fb.imageFramebuffers.at(currentImageIdx);
+	fb.swapchainGeneration = swapchainGeneration;
+}
+
+
 static vk::SampleCountFlagBits sampleCountFlagsFromNum(unsigned int numSamples) {
 	switch (numSamples) {
 	case 1:
@@ -1307,6 +1518,8 @@ static vk::BlendFactor vulkanBlendFactor(BlendFunc b) {
 
 
 PipelineHandle RendererImpl::createPipeline(const PipelineDesc &desc) {
+	PROFILE_FUNCTION();
+
 	vk::GraphicsPipelineCreateInfo info;
 
 	ShaderMacros macros_(desc.shaderMacros_);
@@ -1423,8 +1636,9 @@ PipelineHandle RendererImpl::createPipeline(const PipelineDesc &desc) {
 			cb.srcColorBlendFactor  = vulkanBlendFactor(desc.sourceBlend_);
 			cb.dstColorBlendFactor  = vulkanBlendFactor(desc.destinationBlend_);
 			cb.colorBlendOp         = vk::BlendOp::eAdd;
-			cb.srcAlphaBlendFactor  = vk::BlendFactor::eOne;
-			cb.dstAlphaBlendFactor  = vk::BlendFactor::eOne;
+			// alpha uses the same factors as color, like glBlendFunc
+			cb.srcAlphaBlendFactor  = vulkanBlendFactor(desc.sourceBlend_);
+			cb.dstAlphaBlendFactor  = vulkanBlendFactor(desc.destinationBlend_);
 			cb.alphaBlendOp         = vk::BlendOp::eAdd;
 		}
 		cb.colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
@@ -1496,6 +1710,38 @@ RenderTargetHandle RendererImpl::createRenderTarget(const RenderTargetDesc &desc
 	assert(isPow2(desc.numSamples_));
 	assert(!desc.name_.empty());
 
+	if (desc.swapchain_) {
+		// swapchain images can only replace a plain rendertarget of the same size and format
+		// and must support everything rendertargets get used for
+		vk::ImageUsageFlags needed(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst);
+		if (!swapchainRT
+		    && vulkanFormat(desc.format_) == swapchainFormat
+		    && (swapchainUsage & needed) == needed
+		    && desc.numSamples_ == 1
+		    && desc.additionalViewFormat_ == Format::Invalid
+		    && desc.width_  == swapchainDesc.width
+		    && desc.height_ == swapchainDesc.height)
+		{
+			assert(currentImageIdx < swapchainViews.size());
+
+			auto result = renderTargets.add();
+			RenderTarget &rt = result.first;
+			rt.width     = desc.width_;
+			rt.height    = desc.height_;
+			rt.desc      = desc;
+			rt.format    = swapchainFormat;
+			rt.swapchain = true;
+			// beginFrame updates these to the acquired image
+			rt.image     = swapchainImages.at(currentImageIdx);
+			rt.imageView = swapchainViews.at(currentImageIdx);
+			swapchainRT  = result.second;
+
+			return result.second;
+		}
+
+		LOG("Rendertarget \"%s\" can't use swapchain images, presentFrame will copy it\n", desc.name_.c_str());
+	}
+
 	// TODO: use NV_dedicated_allocation when available
 
 	vk::Format format = vulkanFormat(desc.format_);
@@ -1522,6 +1768,7 @@ RenderTargetHandle RendererImpl::createRenderTarget(const RenderTargetDesc &desc
 	RenderTarget &rt = result.first;
 	rt.width  = desc.width_;
 	rt.height = desc.height_;
+	rt.desc   = desc;
 	rt.image = device.createImage(info);
 	LOG("rendertarget %s image is %p\n", desc.name_.c_str(), static_cast<VkImage>(rt.image));
 	rt.format = format;
@@ -1604,6 +1851,10 @@ SamplerHandle RendererImpl::createSampler(const SamplerDesc &desc) {
 
 	info.magFilter = vulkanFiltermode(desc.mag);
 	info.minFilter = vulkanFiltermode(desc.min);
+	if (desc.mipmaps_) {
+		info.mipmapMode = (desc.min == FilterMode::Nearest) ? vk::SamplerMipmapMode::eNearest : vk::SamplerMipmapMode::eLinear;
+		info.maxLod     = VK_LOD_CLAMP_NONE;
+	}
 
 	vk::SamplerAddressMode m = vk::SamplerAddressMode::eClampToEdge;
 	if (desc.wrapMode == WrapMode::Wrap) {
@@ -1664,9 +1915,70 @@ FragmentShaderHandle RendererImpl::createFragmentShader(const std::string &name,
 
 
 TextureHandle RendererImpl::createTexture(const TextureDesc &desc) {
-	assert(desc.width_   > 0);
-	assert(desc.height_  > 0);
-	assert(desc.numMips_ > 0);
+	// ended right away so the staging ring is fine
+	TextureUpload upload = beginTextureUploadInternal(desc, false);
+
+	for (unsigned int i = 0; i < desc.numMips_; i++) {
+		assert(desc.mipData_[i].data != nullptr);
+		assert(desc.mipData_[i].size != 0);
+		assert(desc.mipData_[i].size <= upload.mips[i].size);
+		// copy contents to GPU memory
+		memcpy(upload.mips[i].data, desc.mipData_[i].data, desc.mipData_[i].size);
+	}
+
+	return endTextureUpload(upload);
+}
+
+
+TextureUpload RendererImpl::beginTextureUpload(const TextureDesc &desc) {
+	// can be ended frames later, by then the ring has been reused
+	return beginTextureUploadInternal(desc, true);
+}
+
+
+TextureUpload RendererImpl::beginTextureUploadInternal(const TextureDesc &desc, bool dedicatedStaging) {
+	if (isBlockFormat(desc.format_) && !features.textureCompressionBC) {
+		LOG("Texture \"%s\" has format %s but BC texture compression is not supported\n", desc.name_.c_str(), formatName(desc.format_));
+		throw std::runtime_error("BC texture compression not supported");
+	}
+
+	TextureUpload upload;
+	initTextureUpload(upload, desc);
+
+	uint32_t align = std::max(formatSize(desc.format_), static_cast<uint32_t>(deviceProperties.limits.optimalBufferCopyOffsetAlignment));
+	std::array<uint32_t, MAX_TEXTURE_MIPLEVELS> offsets;
+	uint32_t bufferSize = 0;
+	for (unsigned int i = 0; i < upload.numMips; i++) {
+		offsets[i] = bufferSize;
+
+		// round size up for proper alignment
+		uint32_t size = upload.mips[i].size;
+		size = size + align - 1;
+		size = size / align;
+		size = size * align;
+		bufferSize += size;
+	}
+
+	StagingAlloc staging = dedicatedStaging ? allocateDedicatedStaging(bufferSize) : allocateStaging(bufferSize, align);
+	for (unsigned int i = 0; i < upload.numMips; i++) {
+		upload.mips[i].data = staging.mapped + offsets[i];
+	}
+
+	upload.id_ = nextTextureUploadId++;
+	textureUploads.emplace(upload.id_, staging);
+
+	return upload;
+}
+
+
+TextureHandle RendererImpl::endTextureUpload(TextureUpload &upload) {
+	auto it = textureUploads.find(upload.id_);
+	assert(it != textureUploads.end());
+	StagingAlloc staging = it->second;
+	textureUploads.erase(it);
+
+	const TextureDesc &desc = upload.desc_;
+	assert(desc.numMips_ == upload.numMips);
 
 	// TODO: check PhysicalDeviceFormatProperties
 
@@ -1714,40 +2026,35 @@ TextureHandle RendererImpl::createTexture(const TextureDesc &desc) {
 	debugNameObject<vk::Image>(tex.image, desc.name_);
 	debugNameObject<vk::ImageView>(tex.imageView, desc.name_);
 
-	// TODO: reuse command buffer for multiple copies
 	unsigned int w = desc.width_, h = desc.height_;
-	unsigned int bufferSize = 0;
-	uint32_t align = std::max(formatSize(desc.format_), static_cast<uint32_t>(deviceProperties.limits.optimalBufferCopyOffsetAlignment));
+	uint32_t bufferSize = 0;
 	std::vector<vk::BufferImageCopy> regions;
 	regions.reserve(desc.numMips_);
 	for (unsigned int i = 0; i < desc.numMips_; i++) {
-		assert(desc.mipData_[i].data != nullptr);
-		assert(desc.mipData_[i].size != 0);
-		unsigned int size = desc.mipData_[i].size;
+		// mip data points into staging memory
+		uint32_t offset = static_cast<uint32_t>(static_cast<char *>(upload.mips[i].data) - staging.mapped);
+		upload.mips[i].data = nullptr;
 
 		vk::ImageSubresourceLayers layers;
 		layers.aspectMask = vk::ImageAspectFlagBits::eColor;
+		layers.mipLevel   = i;
 		layers.layerCount = 1;
 
 		vk::BufferImageCopy region;
-		region.bufferOffset     = bufferSize;
+		region.bufferOffset     = staging.offset + offset;
 		// leave row length and image height 0 for tight packing
 		region.imageSubresource = layers;
 		region.imageExtent      = vk::Extent3D(w, h, 1);
 		regions.push_back(region);
 
-		// round size up for proper alignment
-		size = size + align - 1;
-		size = size / align;
-		size = size * align;
-		bufferSize += size;
+		bufferSize = offset + upload.mips[i].size;
 
 		w = std::max(w / 2, 1u);
 		h = std::max(h / 2, 1u);
 	}
 
-	UploadOp op = allocateUploadOp(bufferSize);
-	op.semWaitMask = vk::PipelineStageFlagBits::eFragmentShader;
+	UploadOp &op = beginUploadOp();
+	op.semWaitMask |= vk::PipelineStageFlagBits::eFragmentShader;
 
 	// transition to transfer destination
 	{
@@ -1772,15 +2079,10 @@ TextureHandle RendererImpl::createTexture(const TextureDesc &desc) {
 		// TODO: relax stage flag bits
 		op.cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eHost, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), {}, {}, { barrier });
 
-		char *mappedPtr = static_cast<char *>(op.allocationInfo.pMappedData);
-		for (unsigned int i = 0; i < desc.numMips_; i++) {
-			// copy contents to GPU memory
-			memcpy(mappedPtr + regions[i].bufferOffset, desc.mipData_[i].data, desc.mipData_[i].size);
-		}
-
-		vmaFlushAllocation(allocator, op.memory, 0, bufferSize);
+		flushStaging(staging, bufferSize);
 
-		op.cmdBuf.copyBufferToImage(op.stagingBuffer, tex.image, vk::ImageLayout::eTransferDstOptimal, regions);
+		op.cmdBuf.copyBufferToImage(staging.buffer, tex.image, vk::ImageLayout::eTransferDstOptimal, regions);
+		releaseStaging(staging, bufferSize);
 
 		// transition to shader use
 		barrier.srcAccessMask       = vk::AccessFlagBits::eTransferWrite;
@@ -1802,8 +2104,6 @@ TextureHandle RendererImpl::createTexture(const TextureDesc &desc) {
 		}
 	}
 
-	submitUploadOp(std::move(op));
-
 	return result.second;
 }
 
@@ -1846,6 +2146,7 @@ DSLayoutHandle RendererImpl::createDescriptorSetLayout(const DescriptorLayout *l
 
 TextureHandle RendererImpl::getRenderTargetTexture(RenderTargetHandle handle) {
 	const auto &rt = renderTargets.get(handle);
+	assert(!rt.swapchain);
 
 	return rt.texture;
 }
@@ -1890,6 +2191,12 @@ void RendererImpl::deleteRenderPass(RenderPassHandle handle) {
 
 void RendererImpl::deleteRenderTarget(RenderTargetHandle &handle) {
 	renderTargets.removeWith(handle, [this](struct RenderTarget &rt) {
+		if (rt.swapchain) {
+			// owns nothing, no need to wait for frames
+			this->deleteRenderTargetInternal(rt);
+			return;
+		}
+
 		// TODO: if lastUsedFrame has already been synced we could delete immediately
 		this->deleteResources.emplace(std::move(rt));
 	} );
@@ -1917,7 +2224,9 @@ void RendererImpl::setSwapchainDesc(const SwapchainDesc &desc) {
 
 	if (swapchainDesc.fullscreen != desc.fullscreen) {
 		changed = true;
-		if (desc.fullscreen) {
+		if (headless) {
+			// nothing to do
+		} else if (desc.fullscreen) {
 			// TODO: check return val?
 			SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN_DESKTOP);
 			LOG("Fullscreen\n");
@@ -1935,25 +2244,35 @@ void RendererImpl::setSwapchainDesc(const SwapchainDesc &desc) {
 		changed = true;
 	}
 
-	int w = -1, h = -1;
-	SDL_Vulkan_GetDrawableSize(window, &w, &h);
-	if (w <= 0 || h <= 0) {
-		throw std::runtime_error("drawable size is negative");
-	}
-
-	if (static_cast<unsigned int>(w) != drawableSize.x
-	 || static_cast<unsigned int>(h) != drawableSize.y) {
+	glm::uvec2 size = getDrawableSize(desc);
+	if (size != drawableSize) {
 		changed = true;
 	}
 
 	if (changed) {
 		wantedSwapchain = desc;
 		swapchainDirty  = true;
-		drawableSize    = glm::uvec2(w, h);
+		drawableSize    = size;
 	}
 }
 
 
+glm::uvec2 RendererImpl::getDrawableSize(const SwapchainDesc &desc) const {
+	if (headless) {
+		// no window, use whatever size was asked for
+		return glm::uvec2(desc.width, desc.height);
+	}
+
+	int w = -1, h = -1;
+	SDL_Vulkan_GetDrawableSize(window, &w, &h);
+	if (w <= 0 || h <= 0) {
+		throw std::runtime_error("drawable size is negative");
+	}
+
+	return glm::uvec2(w, h);
+}
+
+
 static const unsigned int numPresentModes = 4;
 static const std::array<vk::PresentModeKHR, numPresentModes> vsyncModes
 = {{ vk::PresentModeKHR::eFifo
@@ -2031,6 +2350,15 @@ unsigned int RendererImpl::bufferAlignment(BufferType type) {
 void RendererImpl::recreateSwapchain() {
 	assert(swapchainDirty);
 
+	// swapchain views and framebuffers using them are about to go away
+	if (!swapchainViews.empty()) {
+		for (unsigned int i = 0; i < frames.size(); i++) {
+			if (frames.at(i).outstanding) {
+				waitForFrame(i);
+			}
+		}
+	}
+
 	surfaceCapabilities = physicalDevice.getSurfaceCapabilitiesKHR(surface);
 	LOG("image count min-max %u - %u\n", surfaceCapabilities.minImageCount, surfaceCapabilities.maxImageCount);
 	LOG("image extent min-max %ux%u - %ux%u\n", surfaceCapabilities.minImageExtent.width, surfaceCapabilities.minImageExtent.height, surfaceCapabilities.maxImageExtent.width, surfaceCapabilities.maxImageExtent.height);
@@ -2039,38 +2367,38 @@ void RendererImpl::recreateSwapchain() {
 	LOG("supported surface alpha composite flags: %s\n", vk::to_string(surfaceCapabilities.supportedCompositeAlpha).c_str());
 	LOG("supported surface usage flags: %s\n", vk::to_string(surfaceCapabilities.supportedUsageFlags).c_str());
 
-	int tempW = -1, tempH = -1;
-	SDL_Vulkan_GetDrawableSize(window, &tempW, &tempH);
-	if (tempW <= 0 || tempH <= 0) {
-		throw std::runtime_error("drawable size is negative");
-	}
+	glm::uvec2 tempSize = getDrawableSize(wantedSwapchain);
 
 	// this is nasty but apparently surface might not have resized yet
 	// FIXME: find a better way
-	unsigned int w = std::max(surfaceCapabilities.minImageExtent.width,  std::min(static_cast<unsigned int>(tempW), surfaceCapabilities.maxImageExtent.width));
-	unsigned int h = std::max(surfaceCapabilities.minImageExtent.height, std::min(static_cast<unsigned int>(tempH), surfaceCapabilities.maxImageExtent.height));
+	unsigned int w = std::max(surfaceCapabilities.minImageExtent.width,  std::min(tempSize.x, surfaceCapabilities.maxImageExtent.width));
+	unsigned int h = std::max(surfaceCapabilities.minImageExtent.height, std::min(tempSize.y, surfaceCapabilities.maxImageExtent.height));
 
 	drawableSize = glm::uvec2(w, h);
 
 	swapchainDesc.width  = w;
 	swapchainDesc.height = h;
 
-	unsigned int numImages = wantedSwapchain.numFrames;
-	numImages = std::max(numImages, surfaceCapabilities.minImageCount);
+	// frames in flight are independent of swapchain images
+	// numFrames controls latency, image count only how presentation queues them
+	unsigned int numFrames = std::max(wantedSwapchain.numFrames, 1U);
+
+	// one more than minimum so acquire doesn't block on presentation engine
+	unsigned int numImages = surfaceCapabilities.minImageCount + 1;
 	if (surfaceCapabilities.maxImageCount != 0) {
 		numImages = std::min(numImages, surfaceCapabilities.maxImageCount);
 	}
 
-	LOG("Want %u images, using %u images\n", wantedSwapchain.numFrames, numImages);
+	LOG("Want %u frames, using %u frames and %u images\n", wantedSwapchain.numFrames, numFrames, numImages);
 
 	swapchainDesc.fullscreen = wantedSwapchain.fullscreen;
-	swapchainDesc.numFrames  = numImages;
+	swapchainDesc.numFrames  = numFrames;
 	swapchainDesc.vsync      = wantedSwapchain.vsync;
 
-	if (frames.size() != numImages) {
-		if (numImages < frames.size()) {
+	if (frames.size() != numFrames) {
+		if (numFrames < frames.size()) {
 			// decreasing, delete old and resize
-			for (unsigned int i = numImages; i < frames.size(); i++) {
+			for (unsigned int i = numFrames; i < frames.size(); i++) {
 				auto &f = frames.at(i);
 				if (f.outstanding) {
 					// wait until complete
@@ -2080,11 +2408,11 @@ void RendererImpl::recreateSwapchain() {
 				// delete contents of Frame
 				deleteFrameInternal(f);
 			}
-			frames.resize(numImages);
+			frames.resize(numFrames);
 		} else {
 			// increasing, resize and initialize new
 			unsigned int oldSize = static_cast<unsigned int>(frames.size());
-			frames.resize(numImages);
+			frames.resize(numFrames);
 
 			// descriptor pool
 			// TODO: these limits are arbitrary, find better ones
@@ -2109,8 +2437,8 @@ void RendererImpl::recreateSwapchain() {
 				assert(!f.fence);
 				f.fence = device.createFence(vk::FenceCreateInfo());
 
-				// we fill this in after we've created the swapchain
-				assert(!f.image);
+				assert(!f.acquireSem);
+				f.acquireSem = device.createSemaphore(vk::SemaphoreCreateInfo());
 
 				assert(!f.dsPool);
 				f.dsPool = device.createDescriptorPool(dsInfo);
@@ -2128,6 +2456,14 @@ void RendererImpl::recreateSwapchain() {
 				f.commandBuffer = bufs.at(0);
 				f.presentCmdBuf = bufs.at(1);
 				f.barrierCmdBuf = bufs.at(2);
+
+				assert(!f.timestampPool);
+				if (features.timestamps) {
+					vk::QueryPoolCreateInfo qp;
+					qp.queryType  = vk::QueryType::eTimestamp;
+					qp.queryCount = MAX_TIMESTAMPS;
+					f.timestampPool = device.createQueryPool(qp);
+				}
 			}
 		}
 	}
@@ -2138,15 +2474,15 @@ void RendererImpl::recreateSwapchain() {
 	imageExtent.height = swapchainDesc.height;
 
 	if (!(surfaceCapabilities.supportedTransforms & vk::SurfaceTransformFlagBitsKHR::eIdentity)) {
-		LOG("warning: identity transform not supported\n");
+		LOG_WARNING("identity transform not supported\n");
 	}
 
 	if (surfaceCapabilities.currentTransform != vk::SurfaceTransformFlagBitsKHR::eIdentity) {
-		LOG("warning: current transform is not identity\n");
+		LOG_WARNING("current transform is not identity\n");
 	}
 
 	if (!(surfaceCapabilities.supportedCompositeAlpha & vk::CompositeAlphaFlagBitsKHR::eOpaque)) {
-		LOG("warning: opaque alpha not supported\n");
+		LOG_WARNING("opaque alpha not supported\n");
 	}
 
 	// FIFO is guaranteed to be supported
@@ -2164,12 +2500,22 @@ void RendererImpl::recreateSwapchain() {
 
 	LOG("Using present mode %s\n", vk::to_string(swapchainPresentMode).c_str());
 
+	// prefer the format our rendertargets use so they can be swapchain images
 	// TODO: should fallback to Unorm and communicate back to demo
-	vk::Format surfaceFormat = vk::Format::eB8G8R8A8Srgb;
+	vk::Format surfaceFormat = vulkanFormat(Format::sRGBA8);
+	if (surfaceFormats.find(surfaceFormat) == surfaceFormats.end()) {
+		surfaceFormat = vk::Format::eB8G8R8A8Srgb;
+	}
 	if (surfaceFormats.find(surfaceFormat) == surfaceFormats.end()) {
 		throw std::runtime_error("No sRGB format backbuffer support");
 	}
 	features.sRGBFramebuffer = true;
+	swapchainFormat          = surfaceFormat;
+	LOG("Using swapchain format %s\n", vk::to_string(swapchainFormat).c_str());
+
+	// rendering directly to swapchain images needs more than the final blit
+	vk::ImageUsageFlags renderUsage(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc);
+	swapchainUsage = vk::ImageUsageFlags(vk::ImageUsageFlagBits::eTransferDst) | (surfaceCapabilities.supportedUsageFlags & renderUsage);
 
 	vk::SwapchainCreateInfoKHR swapchainCreateInfo;
 	swapchainCreateInfo.flags                 = vk::SwapchainCreateFlagBitsKHR();
@@ -2179,7 +2525,7 @@ void RendererImpl::recreateSwapchain() {
 	swapchainCreateInfo.imageColorSpace       = vk::ColorSpaceKHR::eSrgbNonlinear;
 	swapchainCreateInfo.imageExtent           = imageExtent;
 	swapchainCreateInfo.imageArrayLayers      = 1;
-	swapchainCreateInfo.imageUsage            = vk::ImageUsageFlagBits::eTransferDst;
+	swapchainCreateInfo.imageUsage            = swapchainUsage;
 
 	// no concurrent access
 	swapchainCreateInfo.imageSharingMode      = vk::SharingMode::eExclusive;
@@ -2194,18 +2540,39 @@ void RendererImpl::recreateSwapchain() {
 
 	vk::SwapchainKHR newSwapchain = device.createSwapchainKHR(swapchainCreateInfo);
 
+	for (auto &view : swapchainViews) {
+		device.destroyImageView(view);
+	}
+	swapchainViews.clear();
+
 	if (swapchain) {
 		device.destroySwapchainKHR(swapchain);
 	}
 	swapchain = newSwapchain;
 
-	std::vector<vk::Image> swapchainImages = device.getSwapchainImagesKHR(swapchain);
-	// TODO: implementation doesn't have to obey size, should resize here
-	assert(swapchainImages.size() == frames.size());
-	assert(swapchainImages.size() == numImages);
+	// implementation may create more images than we asked for
+	swapchainImages = device.getSwapchainImagesKHR(swapchain);
+	LOG("Got %u swapchain images\n", static_cast<unsigned int>(swapchainImages.size()));
+
+	if (swapchainUsage & vk::ImageUsageFlagBits::eColorAttachment) {
+		swapchainViews.reserve(swapchainImages.size());
+		for (const auto &image : swapchainImages) {
+			vk::ImageViewCreateInfo viewInfo;
+			viewInfo.image                       = image;
+			viewInfo.viewType                    = vk::ImageViewType::e2D;
+			viewInfo.format                      = swapchainFormat;
+			viewInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+			viewInfo.subresourceRange.levelCount = 1;
+			viewInfo.subresourceRange.layerCount = 1;
+			swapchainViews.push_back(device.createImageView(viewInfo));
+		}
+	}
+	// framebuffers notice this and recreate themselves
+	swapchainGeneration++;
 
-	for (unsigned int i = 0; i < numImages; i++) {
-		frames.at(i).image = swapchainImages.at(i);
+	// only grow, old ones might still be waited on by pending presents
+	while (renderDoneSems.size() < swapchainImages.size()) {
+		renderDoneSems.push_back(device.createSemaphore(vk::SemaphoreCreateInfo()));
 	}
 
 	swapchainDirty = false;
@@ -2226,6 +2593,8 @@ MemoryStats RendererImpl::getMemStats() const {
 
 
 void RendererImpl::beginFrame() {
+	PROFILE_FUNCTION();
+
 #ifndef NDEBUG
 	assert(!inFrame);
 	inFrame       = true;
@@ -2239,20 +2608,34 @@ void RendererImpl::beginFrame() {
 		assert(!swapchainDirty);
 	}
 
+	currentFrameIdx        = frameNum % frames.size();
+	assert(currentFrameIdx < frames.size());
+	auto &frame            = frames.at(currentFrameIdx);
+
+	// frames are a ringbuffer
+	// if the frame we want to reuse is still pending on the GPU, wait for it
+	// this also means its acquire semaphore is no longer in use
+	if (frame.outstanding) {
+		waitForFrame(currentFrameIdx);
+	}
+	assert(!frame.outstanding);
+
 	// acquire next image
 	uint32_t imageIdx = 0xFFFFFFFFU;
-	vk::Result result = device.acquireNextImageKHR(swapchain, UINT64_MAX, acquireSem, vk::Fence(), &imageIdx);
+	vk::Result result = device.acquireNextImageKHR(swapchain, UINT64_MAX, frame.acquireSem, vk::Fence(), &imageIdx);
 	if (result == vk::Result::eSuccess) {
 		// nothing to do
 	} else if (result == vk::Result::eErrorOutOfDateKHR) {
 		// swapchain went out of date during acquire, recreate and try again
 		LOG("swapchain out of date during acquireNextImageKHR, recreating...\n");
+		// wanted number of frames is unchanged so frame reference stays valid
 		swapchainDirty = true;
 		recreateSwapchain();
 		assert(!swapchainDirty);
+		assert(currentFrameIdx < frames.size());
 
 		imageIdx = 0xFFFFFFFFU;
-		result = device.acquireNextImageKHR(swapchain, UINT64_MAX, acquireSem, vk::Fence(), &imageIdx);
+		result = device.acquireNextImageKHR(swapchain, UINT64_MAX, frame.acquireSem, vk::Fence(), &imageIdx);
 		if (result != vk::Result::eSuccess) {
 			// nope, still wrong
 			LOG("acquireNextImageKHR failed: %s\n", vk::to_string(result).c_str());
@@ -2264,16 +2647,16 @@ void RendererImpl::beginFrame() {
 		throw std::runtime_error("acquireNextImageKHR failed");
 	}
 
-	assert(imageIdx < frames.size());
-	currentFrameIdx        = imageIdx;
-	auto &frame            = frames.at(currentFrameIdx);
+	assert(imageIdx < swapchainImages.size());
+	currentImageIdx        = imageIdx;
 
-	// frames are a ringbuffer
-	// if the frame we want to reuse is still pending on the GPU, wait for it
-	if (frame.outstanding) {
-		waitForFrame(currentFrameIdx);
+	if (swapchainRT) {
+		// contents of the acquired image are undefined
+		auto &rt         = renderTargets.get(swapchainRT);
+		rt.image         = swapchainImages.at(currentImageIdx);
+		rt.imageView     = swapchainViews.at(currentImageIdx);
+		rt.currentLayout = Layout::Undefined;
 	}
-	assert(!frame.outstanding);
 
 	device.resetFences( { frame.fence } );
 
@@ -2281,6 +2664,12 @@ void RendererImpl::beginFrame() {
 	currentCommandBuffer = frame.commandBuffer;
 	currentCommandBuffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
 
+	assert(frame.numTimestamps == 0);
+	assert(frame.timingScopes.empty());
+	if (frame.timestampPool) {
+		currentCommandBuffer.resetQueryPool(frame.timestampPool, 0, MAX_TIMESTAMPS);
+	}
+
 	currentPipelineLayout = vk::PipelineLayout();
 
 	// mark buffers deleted during gap between frames to be deleted when this frame has synced
@@ -2294,102 +2683,118 @@ void RendererImpl::beginFrame() {
 
 
 void RendererImpl::presentFrame(RenderTargetHandle rtHandle) {
+	PROFILE_FUNCTION();
+
 #ifndef NDEBUG
 	assert(inFrame);
 	inFrame = false;
 #endif  // NDEBUG
+	assert(openTimingScopes.empty());
 
 	const auto &rt = renderTargets.get(rtHandle);
+	assert(rt.currentLayout == Layout::TransferSrc);
 
 	auto &frame = frames.at(currentFrameIdx);
 	device.resetFences( { frame.fence } );
 
-	currentCommandBuffer.end();
-	// TODO: this could be a baked buffer
-	frame.presentCmdBuf.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
-
-	vk::Image image        = frame.image;
-	vk::ImageLayout layout = vk::ImageLayout::eTransferDstOptimal;
-
-	// transition image to transfer dst optimal
-	vk::ImageMemoryBarrier barrier;
-	barrier.srcAccessMask       = vk::AccessFlagBits();
-	barrier.dstAccessMask       = vk::AccessFlagBits::eTransferWrite;
-	barrier.oldLayout           = vk::ImageLayout::eUndefined;
-	barrier.newLayout           = layout;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.image               = image;
-
-	vk::ImageSubresourceRange range;
-	range.aspectMask            = vk::ImageAspectFlagBits::eColor;
-	range.baseMipLevel          = 0;
-	range.levelCount            = VK_REMAINING_MIP_LEVELS;
-	range.baseArrayLayer        = 0;
-	range.layerCount            = VK_REMAINING_ARRAY_LAYERS;
-	barrier.subresourceRange    = range;
+	assert(currentImageIdx < swapchainImages.size());
+	vk::Image image        = swapchainImages.at(currentImageIdx);
 
 	// TODO: add eComputeShader when implementing cs
 	// TODO: reduce wait mask
 	vk::PipelineStageFlags acquireWaitStage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-	frame.presentCmdBuf.pipelineBarrier(acquireWaitStage, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlagBits::eByRegion, {}, {}, { barrier });
 
-	vk::ImageBlit blit;
-	blit.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-	blit.srcSubresource.layerCount = 1;
-	blit.srcOffsets[1]             = vk::Offset3D(rt.width, rt.height, 1);
-	blit.dstSubresource            = blit.srcSubresource;
-	blit.dstOffsets[1]             = blit.srcOffsets[1];
+	if (rt.swapchain) {
+		// rendered straight into the swapchain image, only transition it for presentation
+		assert(rt.image == image);
+
+		vk::ImageMemoryBarrier barrier;
+		barrier.srcAccessMask       = vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eTransferWrite;
+		barrier.dstAccessMask       = vk::AccessFlags();
+		barrier.oldLayout           = vulkanLayout(rt.currentLayout);
+		barrier.newLayout           = vk::ImageLayout::ePresentSrcKHR;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image               = image;
+		barrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.layerCount = 1;
+		currentCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, vk::DependencyFlagBits::eByRegion, {}, {}, { barrier });
 
-	// blit draw image to presentation image
-	frame.presentCmdBuf.blitImage(rt.image, vk::ImageLayout::eTransferSrcOptimal, image, layout, { blit }, vk::Filter::eNearest);
+		// first write to the image might be a resolve or blit
+		acquireWaitStage |= vk::PipelineStageFlagBits::eTransfer;
+	}
 
-	// transition to present
-	barrier.srcAccessMask       = vk::AccessFlagBits::eTransferWrite;
-	barrier.dstAccessMask       = vk::AccessFlags();
-	barrier.oldLayout           = layout;
-	barrier.newLayout           = vk::ImageLayout::ePresentSrcKHR;
-	barrier.image               = image;
-	frame.presentCmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, vk::DependencyFlagBits::eByRegion, {}, {}, { barrier });
-	frame.presentCmdBuf.end();
+	currentCommandBuffer.end();
+
+	if (!rt.swapchain) {
+		// TODO: this could be a baked buffer
+		frame.presentCmdBuf.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+		vk::ImageLayout layout = vk::ImageLayout::eTransferDstOptimal;
+
+		// transition image to transfer dst optimal
+		vk::ImageMemoryBarrier barrier;
+		barrier.srcAccessMask       = vk::AccessFlagBits();
+		barrier.dstAccessMask       = vk::AccessFlagBits::eTransferWrite;
+		barrier.oldLayout           = vk::ImageLayout::eUndefined;
+		barrier.newLayout           = layout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image               = image;
+
+		vk::ImageSubresourceRange range;
+		range.aspectMask            = vk::ImageAspectFlagBits::eColor;
+		range.baseMipLevel          = 0;
+		range.levelCount            = VK_REMAINING_MIP_LEVELS;
+		range.baseArrayLayer        = 0;
+		range.layerCount            = VK_REMAINING_ARRAY_LAYERS;
+		barrier.subresourceRange    = range;
+
+		frame.presentCmdBuf.pipelineBarrier(acquireWaitStage, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlagBits::eByRegion, {}, {}, { barrier });
+
+		vk::ImageBlit blit;
+		blit.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+		blit.srcSubresource.layerCount = 1;
+		blit.srcOffsets[1]             = vk::Offset3D(rt.width, rt.height, 1);
+		blit.dstSubresource            = blit.srcSubresource;
+		blit.dstOffsets[1]             = blit.srcOffsets[1];
+
+		// blit draw image to presentation image
+		frame.presentCmdBuf.blitImage(rt.image, vk::ImageLayout::eTransferSrcOptimal, image, layout, { blit }, vk::Filter::eNearest);
+
+		// transition to present
+		barrier.srcAccessMask       = vk::AccessFlagBits::eTransferWrite;
+		barrier.dstAccessMask       = vk::AccessFlags();
+		barrier.oldLayout           = layout;
+		barrier.newLayout           = vk::ImageLayout::ePresentSrcKHR;
+		barrier.image               = image;
+		frame.presentCmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, vk::DependencyFlagBits::eByRegion, {}, {}, { barrier });
+		frame.presentCmdBuf.end();
+	}
 
 	// submit command buffers
 	vk::SubmitInfo submit;
 
 	std::array<vk::CommandBuffer, 2> submitBuffers;
 
-	std::vector<vk::Semaphore>          uploadSemaphores;
+	std::vector<vk::Semaphore>          waitSemaphores;
 	std::vector<vk::PipelineStageFlags> semWaitMasks;
-	std::vector<vk::ImageMemoryBarrier> imageAcquireBarriers;
-	std::vector<vk::BufferMemoryBarrier> bufferAcquireBarriers;
-	if (!uploads.empty()) {
-		LOG("%u uploads pending\n", static_cast<unsigned int>(uploads.size()));
-
-		// use semaphores to make sure draw doesn't proceed until uploads are ready
-		uploadSemaphores.reserve(uploads.size());
-		semWaitMasks.reserve(uploads.size());
-		for (auto &op : uploads) {
-			uploadSemaphores.push_back(op.semaphore);
-			semWaitMasks.push_back(op.semWaitMask);
-
-			imageAcquireBarriers.insert(imageAcquireBarriers.end()
-			                          , op.imageAcquireBarriers.begin()
-			                          , op.imageAcquireBarriers.end());
-			bufferAcquireBarriers.insert(bufferAcquireBarriers.end()
-			                           , op.bufferAcquireBarriers.begin()
-			                           , op.bufferAcquireBarriers.end());
-		}
-		LOG("Gathered %u image and %u buffer acquire barriers from %u upload ops\n"
-		   , static_cast<unsigned int >(imageAcquireBarriers.size())
-		   , static_cast<unsigned int >(bufferAcquireBarriers.size())
-		   , static_cast<unsigned int >(uploads.size()));
-
-		submit.waitSemaphoreCount   = uploadSemaphores.size();
-		submit.pWaitSemaphores      = uploadSemaphores.data();
-		submit.pWaitDstStageMask    = semWaitMasks.data();
-
+	if (currentUpload.cmdBuf) {
+		// all copies of this frame go to the transfer queue as one submit
+		submitUploadOp();
+		assert(!currentUpload.cmdBuf);
+		assert(frame.upload.cmdBuf);
+
+		// use semaphore to make sure draw doesn't proceed until uploads are ready
+		waitSemaphores.reserve(2);
+		semWaitMasks.reserve(2);
+		waitSemaphores.push_back(frame.upload.semaphore);
+		semWaitMasks.push_back(frame.upload.semWaitMask);
+
+		auto &imageAcquireBarriers  = frame.upload.imageAcquireBarriers;
+		auto &bufferAcquireBarriers = frame.upload.bufferAcquireBarriers;
 		if (!imageAcquireBarriers.empty() || !bufferAcquireBarriers.empty()) {
-			LOG("submitting acquire barriers\n");
 			auto barrierCmdBuf = frame.barrierCmdBuf;
 			barrierCmdBuf.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
 			barrierCmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTopOfPipe, vk::DependencyFlags(), {}, bufferAcquireBarriers, imageAcquireBarriers);
@@ -2410,24 +2815,43 @@ void RendererImpl::presentFrame(RenderTargetHandle rtHandle) {
 		submit.commandBufferCount   = 1;
 	}
 
-	vk::SubmitInfo submit2;
-	submit2.waitSemaphoreCount   = 1;
-	submit2.pWaitSemaphores      = &acquireSem;
-	submit2.pWaitDstStageMask    = &acquireWaitStage;
-	submit2.commandBufferCount   = 1;
-	submit2.pCommandBuffers      = &frame.presentCmdBuf;
-	submit2.signalSemaphoreCount = 1;
-	submit2.pSignalSemaphores    = &renderDoneSem;
+	if (rt.swapchain) {
+		// main command buffer writes the swapchain image so it waits for acquire
+		waitSemaphores.push_back(frame.acquireSem);
+		semWaitMasks.push_back(acquireWaitStage);
+	}
 
-	queue.submit({ submit, submit2 }, frame.fence);
+	if (!waitSemaphores.empty()) {
+		submit.waitSemaphoreCount   = waitSemaphores.size();
+		submit.pWaitSemaphores      = waitSemaphores.data();
+		submit.pWaitDstStageMask    = semWaitMasks.data();
+	}
+
+	if (rt.swapchain) {
+		submit.signalSemaphoreCount  = 1;
+		submit.pSignalSemaphores     = &renderDoneSems.at(currentImageIdx);
+
+		queue.submit({ submit }, frame.fence);
+	} else {
+		vk::SubmitInfo submit2;
+		submit2.waitSemaphoreCount   = 1;
+		submit2.pWaitSemaphores      = &frame.acquireSem;
+		submit2.pWaitDstStageMask    = &acquireWaitStage;
+		submit2.commandBufferCount   = 1;
+		submit2.pCommandBuffers      = &frame.presentCmdBuf;
+		submit2.signalSemaphoreCount = 1;
+		submit2.pSignalSemaphores    = &renderDoneSems.at(currentImageIdx);
+
+		queue.submit({ submit, submit2 }, frame.fence);
+	}
 
 	// present
 	vk::PresentInfoKHR presentInfo;
 	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores    = &renderDoneSem;
+	presentInfo.pWaitSemaphores    = &renderDoneSems.at(currentImageIdx);
 	presentInfo.swapchainCount     = 1;
 	presentInfo.pSwapchains        = &swapchain;
-	presentInfo.pImageIndices      = &currentFrameIdx;
+	presentInfo.pImageIndices      = &currentImageIdx;
 
 	auto presentResult = queue.presentKHR(&presentInfo);
 	if (presentResult == vk::Result::eSuccess) {
@@ -2440,7 +2864,8 @@ void RendererImpl::presentFrame(RenderTargetHandle rtHandle) {
 		LOG("presentKHR failed: %s\n", vk::to_string(presentResult).c_str());
 		throw std::runtime_error("presentKHR failed");
 	}
-	frame.usedRingBufPtr = ringBufPtr;
+	frame.usedRingBufPtr    = ringBufPtr;
+	frame.usedStagingBufPtr = stagingBufPtr;
 	frame.outstanding = true;
 	frame.lastFrameNum = frameNum;
 
@@ -2450,16 +2875,13 @@ void RendererImpl::presentFrame(RenderTargetHandle rtHandle) {
 		frame.deleteResources = std::move(deleteResources);
 		assert(deleteResources.empty());
 	}
-
-	if (!uploads.empty()) {
-		assert(frame.uploads.empty());
-		frame.uploads = std::move(uploads);
-	}
 	frameNum++;
 }
 
 
 void RendererImpl::waitForFrame(unsigned int frameIdx) {
+	PROFILE_FUNCTION();
+
 	assert(frameIdx < frames.size());
 
 	Frame &frame = frames.at(frameIdx);
@@ -2472,43 +2894,56 @@ void RendererImpl::waitForFrame(unsigned int frameIdx) {
 		throw std::runtime_error("wait result is not success");
 	}
 
-	if (!frame.uploads.empty()) {
-		for (auto &op : frame.uploads) {
-			device.freeCommandBuffers(transferCmdPool, { op.cmdBuf } );
-			device.destroySemaphore(op.semaphore);
-
-			op.cmdBuf    = vk::CommandBuffer();
-			op.semaphore = vk::Semaphore();
-			op.semWaitMask = vk::PipelineStageFlags();
-
-			if (op.stagingBuffer) {
-				assert(op.memory);
-
-				device.destroyBuffer(op.stagingBuffer);
-				vmaFreeMemory(allocator, op.memory);
-
-				op.stagingBuffer = vk::Buffer();
-				op.memory        = VK_NULL_HANDLE;
-				op.coherent      = false;
-			} else {
-				assert(!op.memory);
+	if (frame.numTimestamps > 0) {
+		// fence has signaled so results are available, no need to wait
+		auto &timestamps = timestampResults;
+		timestamps.resize(frame.numTimestamps);
+		auto queryResult = device.getQueryPoolResults(frame.timestampPool, 0, frame.numTimestamps, timestamps.size() * sizeof(uint64_t), &timestamps[0], sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+		if (queryResult == vk::Result::eSuccess) {
+			for (auto &t : timestamps) {
+				t = static_cast<uint64_t>((t & timestampMask) * timestampPeriod);
 			}
+			resolveTimingScopes(frame.lastFrameNum, frame.timingScopes, timestamps);
+		} else {
+			LOG("getQueryPoolResults failed: %s\n", vk::to_string(queryResult).c_str());
 		}
+		frame.numTimestamps = 0;
+	}
+	frame.timingScopes.clear();
 
-		assert(numUploads >= frame.uploads.size());
-		numUploads -= frame.uploads.size();
-		frame.uploads.clear();
+	// the graphics submit waited on the upload semaphore
+	// so the batch has also completed, recycle its command buffer and semaphore
+	if (frame.upload.cmdBuf) {
+		auto &op = frame.upload;
+		freeUploadCmdBufs.push_back(op.cmdBuf);
+		freeUploadSems.push_back(op.semaphore);
 
-		// if all pending uploads are complete, reset the command pool
-		// TODO: should use multiple command pools
-		if (numUploads == 0) {
-			device.resetCommandPool(transferCmdPool, vk::CommandPoolResetFlags());
+		op.cmdBuf      = vk::CommandBuffer();
+		op.semaphore   = vk::Semaphore();
+		op.semWaitMask = vk::PipelineStageFlags();
+		op.imageAcquireBarriers.clear();
+		op.bufferAcquireBarriers.clear();
+	}
+
+	// fence has signaled and the barrier made the copies visible to host
+	for (auto &r : frame.readbacks) {
+		if (!r.coherent) {
+			vmaInvalidateAllocation(allocator, r.memory, 0, VK_WHOLE_SIZE);
 		}
+		r.result.data = r.allocationInfo.pMappedData;
+		r.callback(r.result);
+
+		r.callback = nullptr;
+		r.result   = ReadbackResult();
+		freeReadbacks.push_back(std::move(r));
 	}
+	frame.readbacks.clear();
 
 	frame.outstanding    = false;
 	lastSyncedFrame      = std::max(lastSyncedFrame, frame.lastFrameNum);
 	lastSyncedRingBufPtr = std::max(lastSyncedRingBufPtr, frame.usedRingBufPtr);
+	lastSyncedStagingBufPtr = std::max(lastSyncedStagingBufPtr, frame.usedStagingBufPtr);
+	retireFrameArena(frameIdx);
 
 	// reset per-frame pools
 	device.resetCommandPool(frame.commandPool, vk::CommandPoolResetFlags());
@@ -2536,52 +2971,198 @@ void RendererImpl::waitForFrame(unsigned int frameIdx) {
 }
 
 
-UploadOp RendererImpl::allocateUploadOp(uint32_t size) {
-	UploadOp op;
+UploadOp &RendererImpl::beginUploadOp() {
+	if (currentUpload.cmdBuf) {
+		return currentUpload;
+	}
+
+	assert(!currentUpload.semaphore);
+	if (freeUploadSems.empty()) {
+		currentUpload.semaphore = device.createSemaphore(vk::SemaphoreCreateInfo());
+	} else {
+		currentUpload.semaphore = freeUploadSems.back();
+		freeUploadSems.pop_back();
+	}
+
+	if (freeUploadCmdBufs.empty()) {
+		vk::CommandBufferAllocateInfo cmdInfo(transferCmdPool, vk::CommandBufferLevel::ePrimary, 1);
+		currentUpload.cmdBuf = device.allocateCommandBuffers(cmdInfo)[0];
+	} else {
+		// begin implicitly resets it
+		currentUpload.cmdBuf = freeUploadCmdBufs.back();
+		freeUploadCmdBufs.pop_back();
+	}
+	currentUpload.cmdBuf.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+	return currentUpload;
+}
+
+
+StagingAlloc RendererImpl::allocateStaging(uint32_t size, uint32_t alignment) {
+	assert(alignment != 0);
+	assert(size > 0);
+
+	StagingAlloc staging;
+
+	if (size <= stagingBufSize) {
+		// alignment is not necessarily pow2 (3-byte formats)
+		unsigned int ptr     = stagingBufPtr;
+		unsigned int begin   = ptr % stagingBufSize;
+		unsigned int aligned = (begin + alignment - 1) / alignment * alignment;
+		if (aligned + size > stagingBufSize) {
+			// not enough space at the end, go back to beginning
+			ptr     += stagingBufSize - begin;
+			aligned  = 0;
+		} else {
+			ptr     += aligned - begin;
+		}
+		ptr += size;
+
+		// would it overwrite data the GPU has not yet copied?
+		if (ptr - lastSyncedStagingBufPtr <= stagingBufSize) {
+			stagingBufPtr    = ptr;
+			staging.buffer   = stagingBuffer;
+			staging.offset   = aligned;
+			staging.mapped   = stagingMapping + aligned;
+			staging.coherent = stagingCoherent;
+			return staging;
+		}
+	}
+
+	LOG_RATELIMITED(LogLevel::Warning, "out of staging buffer space, allocating dedicated staging buffer of %u bytes\n", size);
+
+	return allocateDedicatedStaging(size);
+}
+
 
-	// TODO: have a free list of semaphores instead of creating new ones all the time
-	op.semaphore = device.createSemaphore(vk::SemaphoreCreateInfo());
+StagingAlloc RendererImpl::allocateDedicatedStaging(uint32_t size) {
+	assert(size > 0);
 
-	vk::CommandBufferAllocateInfo cmdInfo(transferCmdPool, vk::CommandBufferLevel::ePrimary, 1);
-	op.cmdBuf = device.allocateCommandBuffers(cmdInfo)[0];
-	op.cmdBuf.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+	StagingAlloc staging;
 
-	// TODO: move staging buffer, memory and command buffer allocation to allocateUploadOp
 	vk::BufferCreateInfo bufInfo;
 	bufInfo.size      = size;
 	bufInfo.usage     = vk::BufferUsageFlagBits::eTransferSrc;
-	op.stagingBuffer  = device.createBuffer(bufInfo);
+	staging.buffer    = device.createBuffer(bufInfo);
 
 	VmaAllocationCreateInfo req = {};
 	req.usage         = VMA_MEMORY_USAGE_CPU_ONLY;
 	req.flags         = VMA_ALLOCATION_CREATE_MAPPED_BIT;
 	req.pUserData     = nullptr;
-	vmaAllocateMemoryForBuffer(allocator, op.stagingBuffer, &req, &op.memory, &op.allocationInfo);
-	assert(op.allocationInfo.pMappedData);
-	device.bindBufferMemory(op.stagingBuffer, op.allocationInfo.deviceMemory, op.allocationInfo.offset);
+	VmaAllocationInfo  allocationInfo = {};
+	auto result = vmaAllocateMemoryForBuffer(allocator, staging.buffer, &req, &staging.memory, &allocationInfo);
+	if (result != VK_SUCCESS) {
+		LOG("vmaAllocateMemoryForBuffer failed: %s\n", vk::to_string(vk::Result(result)).c_str());
+		throw std::runtime_error("vmaAllocateMemoryForBuffer failed");
+	}
+	assert(allocationInfo.pMappedData);
+	device.bindBufferMemory(staging.buffer, allocationInfo.deviceMemory, allocationInfo.offset);
 
-	numUploads++;
+	staging.mapped   = static_cast<char *>(allocationInfo.pMappedData);
+	assert(allocationInfo.memoryType < memoryProperties.memoryTypeCount);
+	staging.coherent = !!(memoryProperties.memoryTypes[allocationInfo.memoryType].propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent);
+
+	return staging;
+}
 
-	assert(op.allocationInfo.memoryType < memoryProperties.memoryTypeCount);
-	op.coherent = !!(memoryProperties.memoryTypes[op.allocationInfo.memoryType].propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent);
 
-	return op;
+void RendererImpl::flushStaging(const StagingAlloc &staging, uint32_t size) {
+	if (staging.coherent) {
+		return;
+	}
+
+	if (staging.memory) {
+		vmaFlushAllocation(allocator, staging.memory, 0, size);
+	} else {
+		vmaFlushAllocation(allocator, stagingBufferMem, staging.offset, size);
+	}
+}
+
+
+void RendererImpl::releaseStaging(const StagingAlloc &staging, uint32_t size) {
+	if (!staging.memory) {
+		// ring space is reclaimed when the frame syncs
+		return;
+	}
+
+	// the frame which submits this copy deletes it after it has synced
+	Buffer buffer;
+	buffer.buffer        = staging.buffer;
+	buffer.memory        = staging.memory;
+	buffer.size          = size;
+	buffer.type          = BufferType::Everything;
+	buffer.lastUsedFrame = frameNum;
+	deleteResources.emplace(std::move(buffer));
 }
 
 
-void RendererImpl::submitUploadOp(UploadOp &&op) {
-	op.cmdBuf.end();
+void RendererImpl::submitUploadOp() {
+	assert(currentUpload.cmdBuf);
+	assert(currentUpload.semaphore);
+
+	auto &frame = frames.at(currentFrameIdx);
+	assert(!frame.upload.cmdBuf);
+
+	currentUpload.cmdBuf.end();
 
 	vk::SubmitInfo submit;
 	submit.waitSemaphoreCount   = 0;
 	submit.commandBufferCount   = 1;
-	submit.pCommandBuffers      = &op.cmdBuf;
+	submit.pCommandBuffers      = &currentUpload.cmdBuf;
 	submit.signalSemaphoreCount = 1;
-	submit.pSignalSemaphores    = &op.semaphore;
+	submit.pSignalSemaphores    = &currentUpload.semaphore;
 
 	transferQueue.submit({ submit }, vk::Fence());
 
-	uploads.emplace_back(std::move(op));
+	frame.upload = std::move(currentUpload);
+}
+
+
+Readback RendererImpl::allocateReadback(unsigned int size) {
+	// reuse a previous buffer if one is big enough
+	for (auto it = freeReadbacks.begin(); it != freeReadbacks.end(); it++) {
+		if (it->bufferSize >= size) {
+			Readback r = std::move(*it);
+			freeReadbacks.erase(it);
+			return r;
+		}
+	}
+
+	Readback r;
+	vk::BufferCreateInfo bufInfo;
+	bufInfo.size     = size;
+	bufInfo.usage    = vk::BufferUsageFlagBits::eTransferDst;
+	r.buffer         = device.createBuffer(bufInfo);
+	r.bufferSize     = size;
+
+	VmaAllocationCreateInfo req = {};
+	req.usage        = VMA_MEMORY_USAGE_GPU_TO_CPU;
+	req.flags        = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+	req.pUserData    = nullptr;
+	vmaAllocateMemoryForBuffer(allocator, r.buffer, &req, &r.memory, &r.allocationInfo);
+	assert(r.allocationInfo.pMappedData);
+	device.bindBufferMemory(r.buffer, r.allocationInfo.deviceMemory, r.allocationInfo.offset);
+
+	assert(r.allocationInfo.memoryType < memoryProperties.memoryTypeCount);
+	r.coherent = !!(memoryProperties.memoryTypes[r.allocationInfo.memoryType].propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent);
+
+	return r;
+}
+
+
+void RendererImpl::deleteReadbackInternal(Readback &r) {
+	assert(r.buffer);
+	assert(r.memory);
+	assert(!r.callback);
+
+	device.destroyBuffer(r.buffer);
+	vmaFreeMemory(allocator, r.memory);
+
+	r.buffer         = vk::Buffer();
+	r.memory         = VK_NULL_HANDLE;
+	r.allocationInfo = {};
+	r.bufferSize     = 0;
+	r.coherent       = false;
 }
 
 
@@ -2604,7 +3185,15 @@ void RendererImpl::deleteBufferInternal(Buffer &b) {
 
 
 void RendererImpl::deleteFramebufferInternal(Framebuffer &fb) {
-	device.destroyFramebuffer(fb.framebuffer);
+	if (fb.imageFramebuffers.empty()) {
+		device.destroyFramebuffer(fb.framebuffer);
+	} else {
+		// framebuffer is one of these
+		for (auto &f : fb.imageFramebuffers) {
+			device.destroyFramebuffer(f);
+		}
+		fb.imageFramebuffers.clear();
+	}
 	fb.framebuffer = vk::Framebuffer();
 	fb.width       = 0;
 	fb.height      = 0;
@@ -2612,6 +3201,16 @@ void RendererImpl::deleteFramebufferInternal(Framebuffer &fb) {
 
 
 void RendererImpl::deleteRenderTargetInternal(RenderTarget &rt) {
+	if (rt.swapchain) {
+		// image and view belong to the swapchain
+		assert(!rt.texture);
+		swapchainRT  = RenderTargetHandle();
+		rt.image     = vk::Image();
+		rt.imageView = vk::ImageView();
+		rt.swapchain = false;
+		return;
+	}
+
 	assert(rt.texture);
 	auto &tex = this->textures.get(rt.texture);
 	assert(tex.image == rt.image);
@@ -2680,6 +3279,24 @@ void RendererImpl::deleteTextureInternal(Texture &tex) {
 }
 
 
+unsigned int RendererImpl::writeTimestamp(bool begin) {
+	auto &frame = frames.at(currentFrameIdx);
+	if (!frame.timestampPool) {
+		return 0;
+	}
+
+	assert(frame.numTimestamps < MAX_TIMESTAMPS);
+	unsigned int index = frame.numTimestamps;
+	// begin as soon as the command is reached, end once everything before it has finished
+	// so a scope measures only its own work
+	vk::PipelineStageFlagBits stage = begin ? vk::PipelineStageFlagBits::eTopOfPipe : vk::PipelineStageFlagBits::eBottomOfPipe;
+	currentCommandBuffer.writeTimestamp(stage, frame.timestampPool, index);
+	frame.numTimestamps++;
+
+	return index;
+}
+
+
 void RendererImpl::deleteResourceInternal(Resource &r) {
 	boost::apply_visitor(ResourceDeleter(this), r);
 }
@@ -2691,8 +3308,9 @@ void RendererImpl::deleteFrameInternal(Frame &f) {
 	device.destroyFence(f.fence);
 	f.fence = vk::Fence();
 
-	// owned by swapchain, don't delete
-	f.image = vk::Image();
+	assert(f.acquireSem);
+	device.destroySemaphore(f.acquireSem);
+	f.acquireSem = vk::Semaphore();
 
 	assert(f.dsPool);
 	device.destroyDescriptorPool(f.dsPool);
@@ -2710,6 +3328,11 @@ void RendererImpl::deleteFrameInternal(Frame &f) {
 	device.destroyCommandPool(f.commandPool);
 	f.commandPool = vk::CommandPool();
 
+	if (f.timestampPool) {
+		device.destroyQueryPool(f.timestampPool);
+		f.timestampPool = vk::QueryPool();
+	}
+
 	assert(f.deleteResources.empty());
 }
 
@@ -2724,10 +3347,26 @@ void RendererImpl::beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle
 
 	const auto &pass = renderPasses.get(rpHandle);
 	assert(pass.renderPass);
-	const auto &fb   = framebuffers.get(fbHandle);
+	auto &fb         = framebuffers.get(fbHandle);
+	if (!fb.imageFramebuffers.empty()) {
+		if (fb.swapchainGeneration != swapchainGeneration) {
+			// swapchain was recreated and the old views are gone
+			// recreateSwapchain waited for all frames so nothing uses these anymore
+			for (auto &f : fb.imageFramebuffers) {
+				device.destroyFramebuffer(f);
+			}
+			fb.imageFramebuffers.clear();
+			fb.framebuffer = vk::Framebuffer();
+			createSwapchainFramebuffers(fb, pass.renderPass);
+		}
+		fb.framebuffer = fb.imageFramebuffers.at(currentImageIdx);
+	}
 	assert(fb.framebuffer);
 	assert(fb.width  > 0);
 	assert(fb.height > 0);
+
+	beginTimingScope(pass.desc.name_);
+
 	// clear image
 
 	vk::RenderPassBeginInfo info;
@@ -2764,6 +3403,8 @@ void RendererImpl::endRenderPass() {
 
 	currentRenderPass = RenderPassHandle();
 	currentFramebuffer = FramebufferHandle();
+
+	endTimingScope();
 }
 
 
@@ -2872,11 +3513,18 @@ void RendererImpl::bindDescriptorSet(unsigned int dsIndex, DSLayoutHandle layout
 	dsInfo.descriptorSetCount  = 1;
 	dsInfo.pSetLayouts         = &layout.layout;
 
-	vk::DescriptorSet ds = device.allocateDescriptorSets(dsInfo)[0];
+	// pointer versions so neither of these allocates a std::vector
+	vk::DescriptorSet ds;
+	auto result = device.allocateDescriptorSets(&dsInfo, &ds);
+	if (result != vk::Result::eSuccess) {
+		LOG("allocateDescriptorSets failed: %s\n", vk::to_string(result).c_str());
+		throw std::runtime_error("allocateDescriptorSets failed");
+	}
 
-	std::vector<vk::WriteDescriptorSet>   writes;
-	std::vector<vk::DescriptorBufferInfo> bufferWrites;
-	std::vector<vk::DescriptorImageInfo>  imageWrites;
+	LinearArena &arena = frameArena();
+	ArenaVector<vk::WriteDescriptorSet>   writes{ArenaAllocator<vk::WriteDescriptorSet>(arena)};
+	ArenaVector<vk::DescriptorBufferInfo> bufferWrites{ArenaAllocator<vk::DescriptorBufferInfo>(arena)};
+	ArenaVector<vk::DescriptorImageInfo>  imageWrites{ArenaAllocator<vk::DescriptorImageInfo>(arena)};
 
 	unsigned int numWrites = static_cast<unsigned int>(layout.descriptors.size());
 	writes.reserve(numWrites);
@@ -2986,7 +3634,7 @@ void RendererImpl::bindDescriptorSet(unsigned int dsIndex, DSLayoutHandle layout
 		index++;
 	}
 
-	device.updateDescriptorSets(writes, {});
+	device.updateDescriptorSets(static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
 	currentCommandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, currentPipelineLayout, dsIndex, { ds }, {});
 }
 
@@ -3106,6 +3754,58 @@ void RendererImpl::resolveMSAA(FramebufferHandle source, FramebufferHandle targe
 }
 
 
+void RendererImpl::readbackRenderTarget(RenderTargetHandle handle, unsigned int x, unsigned int y, unsigned int width, unsigned int height, ReadbackCallback callback) {
+	assert(!inRenderPass);
+	assert(callback);
+
+	const auto &rt = renderTargets.get(handle);
+	assert(rt.currentLayout == Layout::TransferSrc);
+	assert(rt.desc.numSamples_ == 1);
+	assert(!isDepthFormat(rt.desc.format_));
+
+	if (width == 0 && height == 0) {
+		width  = rt.width;
+		height = rt.height;
+	}
+	assert(x + width  <= rt.width);
+	assert(y + height <= rt.height);
+
+	unsigned int size = width * height * formatSize(rt.desc.format_);
+	Readback readback = allocateReadback(size);
+	readback.result.frameNum = frameNum;
+	readback.result.x        = x;
+	readback.result.y        = y;
+	readback.result.width    = width;
+	readback.result.height   = height;
+	readback.result.format   = rt.desc.format_;
+	readback.result.size     = size;
+	readback.callback        = std::move(callback);
+
+	// viewport is flipped so image row 0 is already the top
+	vk::BufferImageCopy region;
+	region.bufferOffset                = 0;
+	region.bufferRowLength             = 0;
+	region.bufferImageHeight           = 0;
+	region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+	region.imageSubresource.layerCount = 1;
+	region.imageOffset                 = vk::Offset3D(x, y, 0);
+	region.imageExtent                 = vk::Extent3D(width, height, 1);
+	currentCommandBuffer.copyImageToBuffer(rt.image, vk::ImageLayout::eTransferSrcOptimal, readback.buffer, { region });
+
+	vk::BufferMemoryBarrier barrier;
+	barrier.srcAccessMask       = vk::AccessFlagBits::eTransferWrite;
+	barrier.dstAccessMask       = vk::AccessFlagBits::eHostRead;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer              = readback.buffer;
+	barrier.offset              = 0;
+	barrier.size                = VK_WHOLE_SIZE;
+	currentCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, vk::DependencyFlags(), {}, { barrier }, {});
+
+	frames.at(currentFrameIdx).readbacks.push_back(std::move(readback));
+}
+
+
 void RendererImpl::draw(unsigned int firstVertex, unsigned int vertexCount) {
 #ifndef NDEBUG
 	assert(inRenderPass);
@@ -3143,6 +3843,18 @@ void RendererImpl::drawIndexedOffset(unsigned int vertexCount, unsigned int firs
 }
 
 
+void RendererImpl::drawIndexedBaseVertex(unsigned int vertexCount, unsigned int firstIndex, int baseVertex) {
+#ifndef NDEBUG
+	assert(inRenderPass);
+	assert(validPipeline);
+	assert(vertexCount > 0);
+	pipelineDrawn = true;
+#endif //  NDEBUG
+
+	currentCommandBuffer.drawIndexed(vertexCount, 1, firstIndex, baseVertex, 0);
+}
+
+
 } // namespace renderer
 
 
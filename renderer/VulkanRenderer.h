@@ -238,10 +238,17 @@ struct Framebuffer {
 	FramebufferDesc  desc;
 	// TODO: store info about attachments to allow tracking layout
 
+	// one per swapchain image when rendering to the swapchain
+	// framebuffer is then the one of the current image
+	std::vector<vk::Framebuffer>  imageFramebuffers;
+	// swapchain they were created for
+	unsigned int     swapchainGeneration;
+
 
 	Framebuffer() noexcept
 	: width(0)
 	, height(0)
+	, swapchainGeneration(0)
 	{}
 
 	Framebuffer(const Framebuffer &)            = delete;
@@ -252,10 +259,14 @@ struct Framebuffer {
 	, height(other.height)
 	, framebuffer(other.framebuffer)
 	, desc(other.desc)
+	, imageFramebuffers(std::move(other.imageFramebuffers))
+	, swapchainGeneration(other.swapchainGeneration)
 	{
 		other.width       = 0;
 		other.height      = 0;
 		other.framebuffer = vk::Framebuffer();
+		other.imageFramebuffers.clear();
+		other.swapchainGeneration = 0;
 	}
 
 	Framebuffer &operator=(Framebuffer &&other) noexcept {
@@ -264,21 +275,27 @@ struct Framebuffer {
 		}
 
 		assert(!framebuffer);
+		assert(imageFramebuffers.empty());
 
 		width             = other.width;
 		height            = other.height;
 		framebuffer       = other.framebuffer;
 		desc              = other.desc;
+		imageFramebuffers = std::move(other.imageFramebuffers);
+		swapchainGeneration = other.swapchainGeneration;
 
 		other.width       = 0;
 		other.height      = 0;
 		other.framebuffer = vk::Framebuffer();
+		other.imageFramebuffers.clear();
+		other.swapchainGeneration = 0;
 
 		return *this;
 	}
 
 	~Framebuffer() {
 		assert(!framebuffer);
+		assert(imageFramebuffers.empty());
 	}
 
 
@@ -427,6 +444,9 @@ struct RenderTarget{
 	vk::Image     image;
 	vk::Format    format;
 	vk::ImageView imageView;
+	RenderTargetDesc     desc;
+	// image and imageView belong to the current swapchain image
+	bool          swapchain;
 
 
 	RenderTarget() noexcept
@@ -434,6 +454,7 @@ struct RenderTarget{
 	, height(0)
 	, currentLayout(Layout::Undefined)
 	, format(vk::Format::eUndefined)
+	, swapchain(false)
 	{}
 
 	RenderTarget(const RenderTarget &)            = delete;
@@ -448,7 +469,10 @@ struct RenderTarget{
 	, image(other.image)
 	, format(other.format)
 	, imageView(other.imageView)
+	, desc(other.desc)
+	, swapchain(other.swapchain)
 	{
+		other.desc          = RenderTargetDesc();
 		other.width         = 0;
 		other.height        = 0;
 		other.currentLayout = Layout::Undefined;
@@ -457,6 +481,7 @@ struct RenderTarget{
 		other.image         = vk::Image();
 		other.format        = vk::Format::eUndefined;
 		other.imageView     = vk::ImageView();
+		other.swapchain     = false;
 	}
 
 	RenderTarget &operator=(RenderTarget &&other) noexcept {
@@ -475,7 +500,10 @@ struct RenderTarget{
 		image               = other.image;
 		format              = other.format;
 		imageView           = other.imageView;
+		desc                = other.desc;
+		swapchain           = other.swapchain;
 
+		other.desc          = RenderTargetDesc();
 		other.width         = 0;
 		other.height        = 0;
 		other.currentLayout = Layout::Undefined;
@@ -484,6 +512,7 @@ struct RenderTarget{
 		other.image         = vk::Image();
 		other.format        = vk::Format::eUndefined;
 		other.imageView     = vk::ImageView();
+		other.swapchain     = false;
 
 		return *this;
 	}
@@ -674,32 +703,26 @@ namespace std {
 namespace renderer {
 
 
+// all copies recorded during one frame, submitted to the transfer queue
+// as a single batch in presentFrame
 struct UploadOp {
 	vk::CommandBuffer       cmdBuf;
 	vk::Semaphore           semaphore;
 	vk::PipelineStageFlags  semWaitMask;
-	vk::Buffer              stagingBuffer;
-	VmaAllocation           memory;
-	VmaAllocationInfo       allocationInfo;
 	std::vector<vk::ImageMemoryBarrier> imageAcquireBarriers;
 	std::vector<vk::BufferMemoryBarrier> bufferAcquireBarriers;
-	bool                    coherent;
 
 
 	UploadOp() noexcept
-	: memory(VK_NULL_HANDLE)
-	, coherent(false)
 	{
-		allocationInfo = {};
 	}
 
 	~UploadOp() noexcept {
 		assert(!cmdBuf);
 		assert(!semaphore);
 		assert(!semWaitMask);
-		assert(!stagingBuffer);
-		assert(!memory);
-		assert(!coherent);
+		assert(imageAcquireBarriers.empty());
+		assert(bufferAcquireBarriers.empty());
 	}
 
 
@@ -711,21 +734,14 @@ struct UploadOp {
 	: cmdBuf(other.cmdBuf)
 	, semaphore(other.semaphore)
 	, semWaitMask(other.semWaitMask)
-	, stagingBuffer(other.stagingBuffer)
-	, memory(other.memory)
-	, allocationInfo(other.allocationInfo)
 	, imageAcquireBarriers(std::move(other.imageAcquireBarriers))
 	, bufferAcquireBarriers(std::move(other.bufferAcquireBarriers))
-	, coherent(other.coherent)
 	{
 		other.cmdBuf        = vk::CommandBuffer();
 		other.semaphore     = vk::Semaphore();
 		other.semWaitMask   = vk::PipelineStageFlags();
-		other.stagingBuffer = vk::Buffer();
-		other.memory        = VK_NULL_HANDLE;
-		assert(other.imageAcquireBarriers.empty());
-		assert(other.bufferAcquireBarriers.empty());
-		other.coherent      = false;
+		other.imageAcquireBarriers.clear();
+		other.bufferAcquireBarriers.clear();
 	}
 
 
@@ -737,11 +753,8 @@ struct UploadOp {
 		assert(!cmdBuf);
 		assert(!semaphore);
 		assert(!semWaitMask);
-		assert(!stagingBuffer);
-		assert(!memory);
 		assert(imageAcquireBarriers.empty());
 		assert(bufferAcquireBarriers.empty());
-		assert(!coherent);
 
 		cmdBuf              = other.cmdBuf;
 		other.cmdBuf        = vk::CommandBuffer();
@@ -752,22 +765,116 @@ struct UploadOp {
 		semWaitMask         = other.semWaitMask;
 		other.semWaitMask   = vk::PipelineStageFlags();
 
-		stagingBuffer       = other.stagingBuffer;
-		other.stagingBuffer = vk::Buffer();
-
-		memory              = other.memory;
-		other.memory        = VK_NULL_HANDLE;
-
 		imageAcquireBarriers     = std::move(other.imageAcquireBarriers);
-		assert(other.imageAcquireBarriers.empty());
+		other.imageAcquireBarriers.clear();
 
 		bufferAcquireBarriers     = std::move(other.bufferAcquireBarriers);
-		assert(other.bufferAcquireBarriers.empty());
+		other.bufferAcquireBarriers.clear();
+
+		return *this;
+	}
+};
+
+
+// staging memory for one copy, from the staging ring or a dedicated buffer
+struct StagingAlloc {
+	vk::Buffer         buffer;
+	VmaAllocation      memory;
+	uint32_t           offset;
+	// points to offset, not beginning of buffer
+	char               *mapped;
+	bool               coherent;
 
-		coherent            = other.coherent;
-		other.coherent      = false;
 
-		allocationInfo      = other.allocationInfo;
+	StagingAlloc()
+	: memory(VK_NULL_HANDLE)
+	, offset(0)
+	, mapped(nullptr)
+	, coherent(false)
+	{
+	}
+};
+
+
+// host visible buffer a rendertarget is copied into
+// kept around and reused for later readbacks when done
+struct Readback {
+	vk::Buffer         buffer;
+	VmaAllocation      memory;
+	VmaAllocationInfo  allocationInfo;
+	unsigned int       bufferSize;
+	bool               coherent;
+	ReadbackResult     result;
+	ReadbackCallback   callback;
+
+
+	Readback() noexcept
+	: memory(VK_NULL_HANDLE)
+	, bufferSize(0)
+	, coherent(false)
+	{
+		allocationInfo = {};
+	}
+
+	~Readback() noexcept {
+		assert(!buffer);
+		assert(!memory);
+		assert(!callback);
+	}
+
+
+	Readback(const Readback &)            = delete;
+	Readback &operator=(const Readback &) = delete;
+
+
+	Readback(Readback &&other) noexcept
+	: buffer(other.buffer)
+	, memory(other.memory)
+	, allocationInfo(other.allocationInfo)
+	, bufferSize(other.bufferSize)
+	, coherent(other.coherent)
+	, result(other.result)
+	, callback(std::move(other.callback))
+	{
+		other.buffer         = vk::Buffer();
+		other.memory         = VK_NULL_HANDLE;
+		other.allocationInfo = {};
+		other.bufferSize     = 0;
+		other.coherent       = false;
+		other.result         = ReadbackResult();
+		other.callback       = nullptr;
+	}
+
+
+	Readback &operator=(Readback &&other) noexcept {
+		if (this == &other) {
+			return *this;
+		}
+
+		assert(!buffer);
+		assert(!memory);
+		assert(!callback);
+
+		buffer               = other.buffer;
+		other.buffer         = vk::Buffer();
+
+		memory               = other.memory;
+		other.memory         = VK_NULL_HANDLE;
+
+		allocationInfo       = other.allocationInfo;
+		other.allocationInfo = {};
+
+		bufferSize           = other.bufferSize;
+		other.bufferSize     = 0;
+
+		coherent             = other.coherent;
+		other.coherent       = false;
+
+		result               = other.result;
+		other.result         = ReadbackResult();
+
+		callback             = std::move(other.callback);
+		other.callback       = nullptr;
 
 		return *this;
 	}
@@ -778,38 +885,48 @@ struct Frame {
 	bool                          outstanding;
 	uint32_t                      lastFrameNum;
 	unsigned int                  usedRingBufPtr;
+	unsigned int                  usedStagingBufPtr;
 	std::vector<BufferHandle>     ephemeralBuffers;
 	vk::Fence                     fence;
-	vk::Image                     image;
+	// signaled when the swapchain image acquired for this frame is ready
+	vk::Semaphore                 acquireSem;
 	vk::DescriptorPool            dsPool;
 	vk::CommandPool               commandPool;
 	vk::CommandBuffer             commandBuffer;
 	vk::CommandBuffer             presentCmdBuf;
 	vk::CommandBuffer             barrierCmdBuf;
+	vk::QueryPool                 timestampPool;
+	unsigned int                  numTimestamps;
+	std::vector<TimingScope>      timingScopes;
 
 	// std::vector has some kind of issue with variant with non-copyable types, so use unordered_set
 	std::unordered_set<Resource>  deleteResources;
-	std::vector<UploadOp>         uploads;
+	UploadOp                      upload;
+	std::vector<Readback>         readbacks;
 
 
 	Frame()
 	: outstanding(false)
 	, lastFrameNum(0)
 	, usedRingBufPtr(0)
+	, usedStagingBufPtr(0)
+	, numTimestamps(0)
 	{}
 
 	~Frame() {
 		assert(ephemeralBuffers.empty());
 		assert(!fence);
-		assert(!image);
+		assert(!acquireSem);
 		assert(!dsPool);
 		assert(!commandPool);
 		assert(!commandBuffer);
 		assert(!presentCmdBuf);
 		assert(!barrierCmdBuf);
+		assert(!timestampPool);
 		assert(!outstanding);
 		assert(deleteResources.empty());
-		assert(uploads.empty());
+		assert(!upload.cmdBuf);
+		assert(readbacks.empty());
 	}
 
 	Frame(const Frame &)            = delete;
@@ -819,35 +936,44 @@ struct Frame {
 	: outstanding(other.outstanding)
 	, lastFrameNum(other.lastFrameNum)
 	, usedRingBufPtr(other.usedRingBufPtr)
+	, usedStagingBufPtr(other.usedStagingBufPtr)
 	, ephemeralBuffers(std::move(other.ephemeralBuffers))
 	, fence(other.fence)
-	, image(other.image)
+	, acquireSem(other.acquireSem)
 	, dsPool(other.dsPool)
 	, commandPool(other.commandPool)
 	, commandBuffer(other.commandBuffer)
 	, presentCmdBuf(other.presentCmdBuf)
 	, barrierCmdBuf(other.barrierCmdBuf)
+	, timestampPool(other.timestampPool)
+	, numTimestamps(other.numTimestamps)
+	, timingScopes(std::move(other.timingScopes))
 	, deleteResources(std::move(other.deleteResources))
-	, uploads(std::move(other.uploads))
+	, upload(std::move(other.upload))
+	, readbacks(std::move(other.readbacks))
 	{
-		other.image            = vk::Image();
+		other.acquireSem       = vk::Semaphore();
 		other.fence            = vk::Fence();
 		other.dsPool           = vk::DescriptorPool();
 		other.commandPool      = vk::CommandPool();
 		other.commandBuffer    = vk::CommandBuffer();
 		other.presentCmdBuf    = vk::CommandBuffer();
 		other.barrierCmdBuf    = vk::CommandBuffer();
+		other.timestampPool    = vk::QueryPool();
+		other.numTimestamps    = 0;
 		other.outstanding      = false;
 		other.lastFrameNum     = 0;
 		other.usedRingBufPtr   = 0;
+		other.usedStagingBufPtr = 0;
 		assert(other.deleteResources.empty());
-		assert(other.uploads.empty());
+		assert(!other.upload.cmdBuf);
+		assert(other.readbacks.empty());
 	}
 
 	Frame &operator=(Frame &&other) {
-		assert(!image);
-		image                = other.image;
-		other.image          = vk::Image();
+		assert(!acquireSem);
+		acquireSem           = other.acquireSem;
+		other.acquireSem     = vk::Semaphore();
 
 		assert(!fence);
 		fence                = other.fence;
@@ -873,6 +999,15 @@ struct Frame {
 		barrierCmdBuf        = other.barrierCmdBuf;
 		other.barrierCmdBuf  = vk::CommandBuffer();
 
+		assert(!timestampPool);
+		timestampPool        = other.timestampPool;
+		other.timestampPool  = vk::QueryPool();
+
+		numTimestamps        = other.numTimestamps;
+		other.numTimestamps  = 0;
+
+		timingScopes         = std::move(other.timingScopes);
+
 		assert(ephemeralBuffers.empty());
 		ephemeralBuffers = std::move(other.ephemeralBuffers);
 		assert(other.ephemeralBuffers.empty());
@@ -886,12 +1021,18 @@ struct Frame {
 		usedRingBufPtr       = other.usedRingBufPtr;
 		other.usedRingBufPtr = 0;
 
+		usedStagingBufPtr       = other.usedStagingBufPtr;
+		other.usedStagingBufPtr = 0;
+
 		deleteResources = std::move(other.deleteResources);
 		assert(other.deleteResources.empty());
 
-		assert(uploads.empty());
-		uploads = std::move(other.uploads);
-		assert(other.uploads.empty());
+		upload = std::move(other.upload);
+		assert(!other.upload.cmdBuf);
+
+		assert(readbacks.empty());
+		readbacks = std::move(other.readbacks);
+		assert(other.readbacks.empty());
 
 		return *this;
 	}
@@ -900,6 +1041,8 @@ struct Frame {
 
 struct RendererImpl : public RendererBase {
 	SDL_Window                              *window;
+	// no window, present to a VK_EXT_headless_surface swapchain
+	bool                                    headless;
 
 	std::vector<Frame>                      frames;
 
@@ -934,8 +1077,19 @@ struct RendererImpl : public RendererBase {
 	vk::Queue                               queue;
 	vk::Queue                               transferQueue;
 
-	vk::Semaphore                           acquireSem;
-	vk::Semaphore                           renderDoneSem;
+	vk::Format                              swapchainFormat;
+	vk::ImageUsageFlags                     swapchainUsage;
+	// incremented when swapchain images change
+	unsigned int                            swapchainGeneration;
+	// rendertarget aliasing the swapchain images, at most one
+	RenderTargetHandle                      swapchainRT;
+
+	// indexed by swapchain image, not frame
+	std::vector<vk::Image>                  swapchainImages;
+	// empty unless swapchain supports rendering to it
+	std::vector<vk::ImageView>              swapchainViews;
+	std::vector<vk::Semaphore>              renderDoneSems;
+	uint32_t                                currentImageIdx;
 
 	vk::CommandBuffer                       currentCommandBuffer;
 	vk::PipelineLayout                      currentPipelineLayout;
@@ -946,12 +1100,35 @@ struct RendererImpl : public RendererBase {
 	VmaAllocator                            allocator;
 
 	vk::CommandPool                         transferCmdPool;
-	std::vector<UploadOp>                   uploads;
-	unsigned int                            numUploads;
+	// copies since last presentFrame, cmdBuf is null if there are none
+	UploadOp                                currentUpload;
+	std::vector<vk::CommandBuffer>          freeUploadCmdBufs;
+	std::vector<vk::Semaphore>              freeUploadSems;
+
+	// persistent staging ringbuffer for uploads
+	// space is reclaimed when the frame which submitted the copies has synced
+	vk::Buffer                              stagingBuffer;
+	VmaAllocation                           stagingBufferMem;
+	char                                    *stagingMapping;
+	bool                                    stagingCoherent;
+	unsigned int                            stagingBufSize;
+	unsigned int                            stagingBufPtr;
+	unsigned int                            lastSyncedStagingBufPtr;
+
+	// begun with beginTextureUpload, not yet ended
+	std::unordered_map<uint32_t, StagingAlloc>  textureUploads;
+	uint32_t                                nextTextureUploadId;
+
+	// completed readbacks whose buffers can be reused
+	std::vector<Readback>                   freeReadbacks;
 
 	bool                                    amdShaderInfo;
 	bool                                    debugMarkers;
 
+	// nanoseconds per timestamp tick
+	double                                  timestampPeriod;
+	uint64_t                                timestampMask;
+
 	vk::Buffer                              ringBuffer;
 	VmaAllocation                           ringBufferMem;
 	char                                    *persistentMapping;
@@ -963,13 +1140,28 @@ struct RendererImpl : public RendererBase {
 	unsigned int bufferAlignment(BufferType type);
 
 	void recreateSwapchain();
+	void createSwapchainFramebuffers(Framebuffer &fb, vk::RenderPass renderPass);
+	glm::uvec2 getDrawableSize(const SwapchainDesc &desc) const;
 	void recreateRingBuffer(unsigned int newSize);
 	unsigned int ringBufferAllocate(unsigned int size, unsigned int alignPower);
 
 	void waitForFrame(unsigned int frameIdx);
 
-	UploadOp allocateUploadOp(uint32_t size);
-	void submitUploadOp(UploadOp &&op);
+	// begin is true for the start of a timing scope
+	unsigned int writeTimestamp(bool begin);
+
+	UploadOp &beginUploadOp();
+	StagingAlloc allocateStaging(uint32_t size, uint32_t alignment);
+	// not from the staging ring so it can stay mapped over several frames
+	StagingAlloc allocateDedicatedStaging(uint32_t size);
+	void flushStaging(const StagingAlloc &staging, uint32_t size);
+	// after the copy has been recorded, deletes dedicated staging once the frame has synced
+	void releaseStaging(const StagingAlloc &staging, uint32_t size);
+	TextureUpload beginTextureUploadInternal(const TextureDesc &desc, bool dedicatedStaging);
+	void submitUploadOp();
+
+	Readback allocateReadback(unsigned int size);
+	void deleteReadbackInternal(Readback &r);
 
 	void deleteBufferInternal(Buffer &b);
 	void deleteFramebufferInternal(Framebuffer &fb);
@@ -1042,6 +1234,8 @@ struct RendererImpl : public RendererBase {
 	BufferHandle         createEphemeralBuffer(BufferType type, uint32_t size, const void *contents);
 	SamplerHandle        createSampler(const SamplerDesc &desc);
 	TextureHandle        createTexture(const TextureDesc &desc);
+	TextureUpload        beginTextureUpload(const TextureDesc &desc);
+	TextureHandle        endTextureUpload(TextureUpload &upload);
 
 	DSLayoutHandle       createDescriptorSetLayout(const DescriptorLayout *layout);
 
@@ -1065,6 +1259,9 @@ struct RendererImpl : public RendererBase {
 	void beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle);
 	void endRenderPass();
 
+	void beginTimingScope(const std::string &name);
+	void endTimingScope();
+
 	void layoutTransition(RenderTargetHandle image, Layout src, Layout dest);
 
 	void setViewport(unsigned int x, unsigned int y, unsigned int width, unsigned int height);
@@ -1079,9 +1276,12 @@ struct RendererImpl : public RendererBase {
 	void blit(FramebufferHandle source, FramebufferHandle target, unsigned int n);
 	void resolveMSAA(FramebufferHandle source, FramebufferHandle target, unsigned int n);
 
+	void readbackRenderTarget(RenderTargetHandle handle, unsigned int x, unsigned int y, unsigned int width, unsigned int height, ReadbackCallback callback);
+
 	void draw(unsigned int firstVertex, unsigned int vertexCount);
 	void drawIndexedInstanced(unsigned int vertexCount, unsigned int instanceCount);
 	void drawIndexedOffset(unsigned int vertexCount, unsigned int firstIndex);
+	void drawIndexedBaseVertex(unsigned int vertexCount, unsigned int firstIndex, int baseVertex);
 };
 
 
@@ -7,6 +7,9 @@ FILES:= \
 	NullRenderer.cpp \
 	OpenGLRenderer.cpp \
 	RendererCommon.cpp \
+	RendererTrace.cpp \
+	SoftwareRenderer.cpp \
+	SoftwareShaders.cpp \
 	VulkanMemoryAllocator.cpp \
 	VulkanRenderer.cpp \
 	# empty line
@@ -21,10 +24,37 @@ ifeq ($(RENDERER),opengl)
 DEPENDS_renderer+=glew
 CFLAGS+=-DRENDERER_OPENGL -DGLEW_STATIC -DGLEW_NO_GLU
 
+ifeq ($(OPENGL_EGL),y)
+
+# EGL for headless contexts
+# GLEW then loads everything through EGL so windows use EGL too
+DEPENDS_renderer+=egl
+CFLAGS+=-DGLEW_EGL
+
+endif  # OPENGL_EGL
+
 else ifeq ($(RENDERER),null)
 
 CFLAGS+=-DRENDERER_NULL
 
+else ifeq ($(RENDERER),software)
+
+CFLAGS+=-DRENDERER_SOFTWARE
+
+# shaders are translated from SPIR-V to C++ at build time
+# generated file goes into the build directory
+FILES+=SoftwareShadersGenerated.cpp
+
+swShaderGen_MODULES:=shaderc
+swShaderGen_SRC:=$(dir)/swShaderGen.cpp
+
+PROGRAMS+= \
+	swShaderGen \
+	# empty line
+
+$(dir)/SoftwareShadersGenerated.cpp: $(EXEPREFIX)swShaderGen$(EXESUFFIX) $(wildcard $(TOPDIR)/*.vert $(TOPDIR)/*.frag $(TOPDIR)/*.h) | bindirs
+	./$(EXEPREFIX)swShaderGen$(EXESUFFIX) $(TOPDIR) $@
+
 else ifeq ($(RENDERER),vulkan)
 
 DEPENDS_renderer+=vulkan
@@ -0,0 +1,2891 @@
+/*
+Copyright (c) 2015-2018 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// generates the software renderer's shaders from the GLSL ones
+// each shader permutation is compiled to SPIR-V and translated to C++
+// which runs four invocations at once, one per SIMD lane (see SoftwareSIMD.h)
+//
+// usage: swShaderGen <shader source dir> <output file>
+
+
+#include <cassert>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <shaderc/shaderc.hpp>
+#include <spirv-tools/optimizer.hpp>
+#include <spirv/unified1/spirv.hpp>
+#include <spirv/unified1/GLSL.std.450.h>
+
+
+typedef std::map<std::string, std::string> Macros;
+
+
+enum class Stage : uint8_t {
+	  Vertex
+	, Fragment
+};
+
+
+struct Permutation {
+	std::string  name;
+	Stage        stage;
+	Macros       macros;
+};
+
+
+static std::string readFile(const std::string &filename) {
+	std::ifstream f(filename, std::ios::binary);
+	if (!f) {
+		throw std::runtime_error("Can't open \"" + filename + "\"");
+	}
+
+	std::stringstream ss;
+	ss << f.rdbuf();
+	return ss.str();
+}
+
+
+static void addPermutation(std::vector<Permutation> &perms, const std::string &name, Stage stage, Macros macros) {
+	// the software renderer flips like Vulkan
+	macros.emplace("VULKAN_FLIP", "1");
+
+	Permutation p;
+	p.name   = name;
+	p.stage  = stage;
+	p.macros = std::move(macros);
+	perms.push_back(std::move(p));
+}
+
+
+static void addPermutation(std::vector<Permutation> &perms, const std::string &name, Macros macros) {
+	addPermutation(perms, name, Stage::Vertex,   macros);
+	addPermutation(perms, name, Stage::Fragment, macros);
+}
+
+
+// every shader and macro combination the demo creates pipelines with
+// createPipeline fails with "No software shader" for anything else
+static std::vector<Permutation> permutations() {
+	std::vector<Permutation> perms;
+
+	addPermutation(perms, "blit",  Macros());
+	addPermutation(perms, "gui",   Macros());
+	addPermutation(perms, "image", Macros());
+
+	addPermutation(perms, "cube",  Macros());
+	addPermutation(perms, "cube",  Macros{ { "PACKED_CUBES", "1" } });
+
+	// subsample separate pass uses temporal.vert without macros
+	addPermutation(perms, "temporal", Stage::Vertex, Macros());
+	addPermutation(perms, "separate", Stage::Fragment, Macros());
+	for (const char *reprojection : { "0", "1" }) {
+		addPermutation(perms, "temporal", Macros{ { "SMAA_REPROJECTION", reprojection } });
+	}
+
+	for (const char *preset : { "10", "15", "20", "29", "39" }) {
+		addPermutation(perms, "fxaa", Macros{ { "FXAA_QUALITY_PRESET", preset } });
+	}
+
+	// all three SMAA passes get the same macros
+	for (const char *quality : { "CUSTOM", "LOW", "MEDIUM", "HIGH", "ULTRA" }) {
+		for (const char *edgeMethod : { "", "1", "2" }) {
+			for (bool predication : { false, true }) {
+				// no predication with depth edge detection
+				if (predication && strcmp(edgeMethod, "2") == 0) {
+					continue;
+				}
+
+				Macros macros;
+				macros.emplace(std::string("SMAA_PRESET_") + quality, "1");
+				if (*edgeMethod) {
+					macros.emplace("EDGEMETHOD", edgeMethod);
+				}
+				if (predication) {
+					macros.emplace("SMAA_PREDICATION", "1");
+				}
+
+				for (const char *name : { "smaaEdge", "smaaBlendWeight", "smaaNeighbor" }) {
+					addPermutation(perms, name, macros);
+				}
+			}
+		}
+	}
+
+	return perms;
+}
+
+
+static std::string filename(const Permutation &p) {
+	return p.name + ((p.stage == Stage::Vertex) ? ".vert" : ".frag");
+}
+
+
+// same as the shader cache key in RendererBase::compileSpirv
+static std::string shaderKey(const Permutation &p) {
+	std::vector<std::string> sorted;
+	for (const auto &macro : p.macros) {
+		std::string s = macro.first;
+		if (!macro.second.empty()) {
+			s += "=" + macro.second;
+		}
+		sorted.push_back(s);
+	}
+	std::sort(sorted.begin(), sorted.end());
+
+	std::string key = filename(p);
+	for (const auto &s : sorted) {
+		key += "_" + s;
+	}
+
+	return key;
+}
+
+
+class Includer final : public shaderc::CompileOptions::IncluderInterface {
+	struct Include {
+		shaderc_include_result  result;
+		std::string             name;
+		std::string             contents;
+	};
+
+	const std::string &sourceDir;
+
+
+public:
+
+	explicit Includer(const std::string &sourceDir_)
+	: sourceDir(sourceDir_)
+	{
+	}
+
+	Includer(const Includer &)            = delete;
+	Includer(Includer &&)                 = delete;
+
+	Includer &operator=(const Includer &) = delete;
+	Includer &operator=(Includer &&)      = delete;
+
+	~Includer() {}
+
+
+	shaderc_include_result *GetInclude(const char *requested_source, shaderc_include_type /* type */, const char * /* requesting_source */, size_t /* include_depth */) override {
+		std::unique_ptr<Include> inc(new Include);
+		inc->name     = requested_source;
+		inc->contents = readFile(sourceDir + "/" + inc->name);
+
+		memset(&inc->result, 0, sizeof(inc->result));
+		inc->result.source_name        = inc->name.c_str();
+		inc->result.source_name_length = inc->name.size();
+		inc->result.content            = inc->contents.c_str();
+		inc->result.content_length     = inc->contents.size();
+		inc->result.user_data          = inc.get();
+
+		return &inc.release()->result;
+	}
+
+
+	void ReleaseInclude(shaderc_include_result *data) override {
+		delete static_cast<Include *>(data->user_data);
+	}
+};
+
+
+// same compile options and optimizer passes as the renderers use at runtime
+static std::vector<uint32_t> compile(const std::string &sourceDir, const Permutation &p) {
+	std::string name = filename(p);
+	std::string src  = readFile(sourceDir + "/" + name);
+
+	shaderc::CompileOptions options;
+	options.SetIncluder(std::unique_ptr<Includer>(new Includer(sourceDir)));
+	for (const auto &macro : p.macros) {
+		options.AddMacroDefinition(macro.first, macro.second);
+	}
+
+	shaderc::Compiler compiler;
+	auto kind   = (p.stage == Stage::Vertex) ? shaderc_glsl_vertex_shader : shaderc_glsl_fragment_shader;
+	auto result = compiler.CompileGlslToSpv(src.data(), src.size(), kind, name.c_str(), options);
+	if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
+		throw std::runtime_error("Shader " + name + " compile failed: " + result.GetErrorMessage());
+	}
+
+	std::vector<uint32_t> spirv(result.cbegin(), result.cend());
+
+	spvtools::Optimizer opt(SPV_ENV_UNIVERSAL_1_2);
+	opt.SetMessageConsumer([] (spv_message_level_t /* level */, const char * /* source */, const spv_position_t & /* position */, const char *message) {
+		fprintf(stderr, "%s\n", message);
+	});
+	opt.RegisterPerformancePasses();
+
+	std::vector<uint32_t> optimized;
+	if (!opt.Run(&spirv[0], spirv.size(), &optimized)) {
+		throw std::runtime_error("Shader " + name + " optimization failed");
+	}
+
+	return optimized;
+}
+
+
+// SPIR-V module as far as the translator needs it
+
+
+enum class Scalar : uint8_t {
+	  Float
+	, Int
+	, UInt
+	, Bool
+};
+
+
+static const char *laneType(Scalar s) {
+	switch (s) {
+	case Scalar::Float:
+		return "SWFloat";
+
+	case Scalar::Int:
+		return "SWInt";
+
+	case Scalar::UInt:
+		return "SWUInt";
+
+	case Scalar::Bool:
+		return "SWBool";
+	}
+
+	return nullptr;
+}
+
+
+struct Instruction {
+	spv::Op                op;
+	// operands, not including the opcode word
+	std::vector<uint32_t>  words;
+
+
+	Instruction()
+	: op(spv::OpNop)
+	{
+	}
+
+
+	uint32_t resultType() const {
+		return words.at(0);
+	}
+
+
+	uint32_t result() const {
+		return words.at(1);
+	}
+
+
+	// operand after result type and id
+	uint32_t operand(unsigned int i) const {
+		return words.at(2 + i);
+	}
+
+
+	unsigned int numOperands() const {
+		return static_cast<unsigned int>(words.size()) - 2;
+	}
+};
+
+
+struct Type {
+	spv::Op                op;
+	// vector, matrix, array and pointer element type
+	uint32_t               element;
+	// vector and matrix size, array length
+	uint32_t               count;
+	bool                   isSigned;
+	std::vector<uint32_t>  members;
+	spv::StorageClass      storage;
+
+
+	Type()
+	: op(spv::OpNop)
+	, element(0)
+	, count(0)
+	, isSigned(false)
+	, storage(spv::StorageClassMax)
+	{
+	}
+};
+
+
+struct MemberDecorations {
+	uint32_t  offset;
+	uint32_t  matrixStride;
+	bool      rowMajor;
+	int       builtIn;
+
+
+	MemberDecorations()
+	: offset(0)
+	, matrixStride(0)
+	, rowMajor(false)
+	, builtIn(-1)
+	{
+	}
+};
+
+
+struct Decorations {
+	int                             location;
+	unsigned int                    component;
+	int                             set;
+	int                             binding;
+	int                             builtIn;
+	uint32_t                        arrayStride;
+	bool                            flat;
+	std::vector<MemberDecorations>  members;
+
+
+	Decorations()
+	: location(-1)
+	, component(0)
+	, set(-1)
+	, binding(-1)
+	, builtIn(-1)
+	, arrayStride(0)
+	, flat(false)
+	{
+	}
+
+
+	MemberDecorations &member(uint32_t index) {
+		if (members.size() <= index) {
+			members.resize(index + 1);
+		}
+		return members[index];
+	}
+};
+
+
+struct Block {
+	uint32_t                  label;
+	std::vector<Instruction>  instructions;
+	// from OpLoopMerge, 0 if this is not a loop header
+	uint32_t                  loopMerge;
+
+
+	Block()
+	: label(0)
+	, loopMerge(0)
+	{
+	}
+};
+
+
+struct Module {
+	std::unordered_map<uint32_t, Type>          types;
+	std::unordered_map<uint32_t, Decorations>   decorations;
+	// scalar constants as their bits, composites as constituent ids
+	std::unordered_map<uint32_t, Instruction>   constants;
+	std::unordered_map<uint32_t, Instruction>   variables;
+	std::vector<uint32_t>                       interfaceVariables;
+	uint32_t                                    glslExtension;
+	std::vector<Block>                          blocks;
+
+
+	Module()
+	: glslExtension(0)
+	{
+	}
+
+
+	explicit Module(const std::vector<uint32_t> &spirv);
+
+	const Type &type(uint32_t id) const {
+		auto it = types.find(id);
+		if (it == types.end()) {
+			throw std::runtime_error("Unknown type " + std::to_string(id));
+		}
+		return it->second;
+	}
+
+	Decorations decoration(uint32_t id) const {
+		auto it = decorations.find(id);
+		if (it == decorations.end()) {
+			return Decorations();
+		}
+		return it->second;
+	}
+
+	// value of a scalar integer constant
+	uint32_t constant(uint32_t id) const {
+		auto it = constants.find(id);
+		if (it == constants.end() || it->second.op != spv::OpConstant) {
+			throw std::runtime_error("Expected a constant as " + std::to_string(id));
+		}
+		return it->second.operand(0);
+	}
+
+	bool isConstant(uint32_t id) const {
+		return constants.find(id) != constants.end();
+	}
+};
+
+
+Module::Module(const std::vector<uint32_t> &spirv)
+: glslExtension(0)
+{
+	if (spirv.size() < 5 || spirv[0] != spv::MagicNumber) {
+		throw std::runtime_error("Not SPIR-V");
+	}
+
+	unsigned int numFunctions = 0;
+	for (size_t pos = 5; pos < spirv.size(); ) {
+		Instruction inst;
+		inst.op                = static_cast<spv::Op>(spirv[pos] & spv::OpCodeMask);
+		unsigned int numWords  = spirv[pos] >> spv::WordCountShift;
+		if (numWords == 0 || pos + numWords > spirv.size()) {
+			throw std::runtime_error("Truncated SPIR-V");
+		}
+		inst.words.assign(spirv.begin() + pos + 1, spirv.begin() + pos + numWords);
+		pos += numWords;
+
+		const auto &w = inst.words;
+		switch (inst.op) {
+		case spv::OpEntryPoint: {
+			// skip the name string to get the interface
+			unsigned int i = 2;
+			while (i < w.size() && (w[i] >> 24) != 0) {
+				i++;
+			}
+			interfaceVariables.assign(w.begin() + i + 1, w.end());
+		} break;
+
+		case spv::OpExtInstImport: {
+			const char *name = reinterpret_cast<const char *>(&w[1]);
+			if (strcmp(name, "GLSL.std.450") != 0) {
+				throw std::runtime_error(std::string("Unsupported extended instruction set ") + name);
+			}
+			glslExtension = w[0];
+		} break;
+
+		case spv::OpDecorate: {
+			auto &d = decorations[w[0]];
+			switch (static_cast<spv::Decoration>(w[1])) {
+			case spv::DecorationLocation:
+				d.location = w[2];
+				break;
+
+			case spv::DecorationComponent:
+				d.component = w[2];
+				break;
+
+			case spv::DecorationDescriptorSet:
+				d.set = w[2];
+				break;
+
+			case spv::DecorationBinding:
+				d.binding = w[2];
+				break;
+
+			case spv::DecorationBuiltIn:
+				d.builtIn = w[2];
+				break;
+
+			case spv::DecorationArrayStride:
+				d.arrayStride = w[2];
+				break;
+
+			case spv::DecorationFlat:
+				d.flat = true;
+				break;
+
+			default:
+				break;
+			}
+		} break;
+
+		case spv::OpMemberDecorate: {
+			auto &m = decorations[w[0]].member(w[1]);
+			switch (static_cast<spv::Decoration>(w[2])) {
+			case spv::DecorationOffset:
+				m.offset = w[3];
+				break;
+
+			case spv::DecorationMatrixStride:
+				m.matrixStride = w[3];
+				break;
+
+			case spv::DecorationRowMajor:
+				m.rowMajor = true;
+				break;
+
+			case spv::DecorationBuiltIn:
+				m.builtIn = w[3];
+				break;
+
+			default:
+				break;
+			}
+		} break;
+
+		case spv::OpTypeVoid:
+		case spv::OpTypeBool:
+		case spv::OpTypeSampler:
+		case spv::OpTypeFunction:
+			types[w[0]].op = inst.op;
+			break;
+
+		case spv::OpTypeInt:
+		case spv::OpTypeFloat: {
+			if (w[1] != 32) {
+				throw std::runtime_error("Only 32 bit scalars are supported");
+			}
+			auto &t    = types[w[0]];
+			t.op       = inst.op;
+			t.isSigned = (inst.op == spv::OpTypeInt) && w[2];
+		} break;
+
+		case spv::OpTypeVector:
+		case spv::OpTypeMatrix: {
+			auto &t   = types[w[0]];
+			t.op      = inst.op;
+			t.element = w[1];
+			t.count   = w[2];
+		} break;
+
+		case spv::OpTypeImage:
+		case spv::OpTypeSampledImage: {
+			auto &t   = types[w[0]];
+			t.op      = inst.op;
+			t.element = w[1];
+		} break;
+
+		case spv::OpTypeArray:
+		case spv::OpTypeRuntimeArray: {
+			auto &t   = types[w[0]];
+			t.op      = inst.op;
+			t.element = w[1];
+			// array length is a constant defined before the array type
+			t.count   = (inst.op == spv::OpTypeArray) ? constant(w[2]) : 0;
+		} break;
+
+		case spv::OpTypeStruct: {
+			auto &t   = types[w[0]];
+			t.op      = inst.op;
+			t.members.assign(w.begin() + 1, w.end());
+		} break;
+
+		case spv::OpTypePointer: {
+			auto &t   = types[w[0]];
+			t.op      = inst.op;
+			t.storage = static_cast<spv::StorageClass>(w[1]);
+			t.element = w[2];
+		} break;
+
+		case spv::OpConstant:
+		case spv::OpConstantTrue:
+		case spv::OpConstantFalse:
+		case spv::OpConstantComposite:
+		case spv::OpConstantNull:
+		case spv::OpUndef:
+		case spv::OpSpecConstant:
+		case spv::OpSpecConstantTrue:
+		case spv::OpSpecConstantFalse:
+		case spv::OpSpecConstantComposite: {
+			if (!blocks.empty()) {
+				// OpUndef inside a function
+				blocks.back().instructions.push_back(inst);
+				break;
+			}
+
+			// spec constants keep their default values
+			switch (inst.op) {
+			case spv::OpSpecConstant:
+				inst.op = spv::OpConstant;
+				break;
+
+			case spv::OpSpecConstantTrue:
+				inst.op = spv::OpConstantTrue;
+				break;
+
+			case spv::OpSpecConstantFalse:
+				inst.op = spv::OpConstantFalse;
+				break;
+
+			case spv::OpSpecConstantComposite:
+				inst.op = spv::OpConstantComposite;
+				break;
+
+			default:
+				break;
+			}
+			uint32_t id = inst.result();
+			constants.emplace(id, std::move(inst));
+		} break;
+
+		case spv::OpVariable:
+			if (blocks.empty()) {
+				uint32_t id = inst.result();
+				variables.emplace(id, std::move(inst));
+			} else {
+				blocks.back().instructions.push_back(inst);
+			}
+			break;
+
+		case spv::OpFunction:
+			numFunctions++;
+			if (numFunctions > 1) {
+				throw std::runtime_error("Function calls are not supported, SPIR-V should be fully inlined");
+			}
+			break;
+
+		case spv::OpFunctionParameter:
+			throw std::runtime_error("Entry point can't have parameters");
+
+		case spv::OpLabel:
+			blocks.push_back(Block());
+			blocks.back().label = w[0];
+			break;
+
+		case spv::OpLoopMerge:
+			blocks.back().loopMerge = w[0];
+			break;
+
+		case spv::OpFunctionEnd:
+		case spv::OpSelectionMerge:
+		case spv::OpLine:
+		case spv::OpNoLine:
+		case spv::OpNop:
+			break;
+
+		default:
+			if (blocks.empty()) {
+				// debug info, capabilities, execution modes etc.
+				break;
+			}
+			blocks.back().instructions.push_back(inst);
+			break;
+		}
+	}
+
+	if (blocks.empty()) {
+		throw std::runtime_error("No entry point");
+	}
+}
+
+
+// translation to C++
+
+
+static std::string floatLiteral(float f) {
+	if (std::isinf(f)) {
+		return (f < 0.0f) ? "-std::numeric_limits<float>::infinity()" : "std::numeric_limits<float>::infinity()";
+	} else if (std::isnan(f)) {
+		return "std::numeric_limits<float>::quiet_NaN()";
+	}
+
+	// 9 significant digits round trip any float
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%.9g", f);
+	std::string s(buffer);
+	if (s.find_first_of(".e") == std::string::npos) {
+		s += ".0";
+	}
+
+	return s + "f";
+}
+
+
+static std::string literal(Scalar kind, uint32_t bits) {
+	switch (kind) {
+	case Scalar::Float: {
+		float f;
+		memcpy(&f, &bits, sizeof(f));
+		return "SWFloat(" + floatLiteral(f) + ")";
+	}
+
+	case Scalar::Int:
+		if (bits == 0x80000000U) {
+			return "SWInt(INT32_MIN)";
+		}
+		return "SWInt(" + std::to_string(static_cast<int32_t>(bits)) + ")";
+
+	case Scalar::UInt:
+		return "SWUInt(" + std::to_string(bits) + "u)";
+
+	case Scalar::Bool:
+		return bits ? "SWBool(true)" : "SWBool(false)";
+	}
+
+	return std::string();
+}
+
+
+static std::string zero(Scalar kind) {
+	return std::string(laneType(kind)) + "()";
+}
+
+
+// reinterprets bits, int and uint share a register
+static std::string view(const std::string &expr, Scalar from, Scalar to) {
+	if (from == to) {
+		return expr;
+	}
+
+	if (from == Scalar::Bool || to == Scalar::Bool) {
+		throw std::runtime_error("Can't reinterpret booleans");
+	}
+
+	switch (to) {
+	case Scalar::Float:
+		return "swAsFloat(" + expr + ")";
+
+	case Scalar::Int:
+		return "swAsInt(" + expr + ")";
+
+	case Scalar::UInt:
+		return "swAsUInt(" + expr + ")";
+
+	case Scalar::Bool:
+		break;
+	}
+
+	return std::string();
+}
+
+
+// where a pointer points, resolved while translating
+struct Pointer {
+	enum class Kind : uint8_t {
+		  Buffer
+		, Interface
+		, Local
+	};
+
+	Kind          kind;
+	uint32_t      variable;
+	// pointee type
+	uint32_t      type;
+
+	// Buffer: byte offset from start of the binding
+	// dynamicOffset is a SWInt variable with per lane offset or empty
+	unsigned int  set, binding;
+	uint32_t      offset;
+	std::string   dynamicOffset;
+	uint32_t      matrixStride;
+	bool          rowMajor;
+
+	// Interface and Local: index of first scalar of the pointee in the variable
+	unsigned int  first;
+
+
+	Pointer()
+	: kind(Kind::Buffer)
+	, variable(0)
+	, type(0)
+	, set(0)
+	, binding(0)
+	, offset(0)
+	, matrixStride(0)
+	, rowMajor(false)
+	, first(0)
+	{
+	}
+};
+
+
+// descriptor bindings of an image, sampler or both
+struct Handle {
+	int  imageSet, imageBinding;
+	int  samplerSet, samplerBinding;
+
+
+	Handle()
+	: imageSet(-1)
+	, imageBinding(-1)
+	, samplerSet(-1)
+	, samplerBinding(-1)
+	{
+	}
+
+
+	std::string image() const {
+		if (imageSet < 0) {
+			throw std::runtime_error("Missing image");
+		}
+		return "res.image(" + std::to_string(imageSet) + ", " + std::to_string(imageBinding) + ")";
+	}
+
+
+	std::string filter() const {
+		if (samplerSet < 0) {
+			throw std::runtime_error("Missing sampler");
+		}
+		return "res.filter(" + std::to_string(samplerSet) + ", " + std::to_string(samplerBinding) + ")";
+	}
+};
+
+
+struct Value {
+	enum class Kind : uint8_t {
+		  Numeric
+		, Pointer
+		, Handle
+	};
+
+	Kind                      kind;
+	uint32_t                  type;
+	// expression for each scalar of the flattened type
+	std::vector<std::string>  comps;
+	Pointer                   pointer;
+	Handle                    handle;
+
+
+	Value()
+	: kind(Kind::Numeric)
+	, type(0)
+	{
+	}
+};
+
+
+// interface variable scalar as a member of the io struct
+struct Slot {
+	// empty if the scalar is ignored, like gl_PointSize
+	std::string  expr;
+	// type of the member, not of the variable
+	Scalar       kind;
+
+
+	Slot()
+	: kind(Scalar::Float)
+	{
+	}
+};
+
+
+// C++ version of one shader
+struct Translation {
+	std::string   code;
+	// highest used varying location + 1
+	unsigned int  numVaryings;
+	// fragment inputs which are not interpolated
+	uint32_t      flatVaryings;
+
+
+	Translation()
+	: numVaryings(0)
+	, flatVaryings(0)
+	{
+	}
+};
+
+
+class Translator {
+	const Module                                       &m;
+	Stage                                              stage;
+
+	std::unordered_map<uint32_t, Value>                values;
+	std::unordered_map<uint32_t, std::vector<Scalar> > leafCache;
+	std::unordered_map<uint32_t, std::vector<Slot> >   interfaceSlots;
+
+	std::unordered_map<uint32_t, unsigned int>         blockIndex;
+	// innermost loop containing each block as index of its header, -1 if none
+	std::vector<int>                                   loopOf;
+	// enclosing loop of each loop header
+	std::vector<int>                                   parentLoop;
+	// merge block of each loop header
+	std::vector<unsigned int>                          loopEnd;
+	std::unordered_map<uint32_t, unsigned int>         defBlock;
+	// values defined in a loop and used after leaving it
+	// lanes which already left must keep their value so assignments are masked
+	std::unordered_map<uint32_t, bool>                 masked;
+	// phis of each block
+	std::vector<std::vector<const Instruction *> >     phis;
+
+	std::vector<std::pair<Scalar, std::string> >       declarations;
+	std::vector<std::string>                           prologue;
+	std::string                                        body;
+	unsigned int                                       indent;
+	unsigned int                                       currentBlock;
+	bool                                               usesResources;
+
+	unsigned int                                       maxAttrib;
+	unsigned int                                       maxColor;
+	Translation                                        result;
+
+
+	void line(const std::string &s) {
+		body.append(indent, '\t');
+		body += s;
+		body += "\n";
+	}
+
+
+	const std::vector<Scalar> &leaves(uint32_t typeId);
+	std::pair<unsigned int, uint32_t> subrange(uint32_t typeId, const uint32_t *indices, unsigned int count);
+	unsigned int locationCount(uint32_t typeId);
+
+	const Value &value(uint32_t id);
+	const std::string &comp(uint32_t id, unsigned int i) {
+		const auto &v = value(id);
+		if (v.kind != Value::Kind::Numeric) {
+			throw std::runtime_error("Expected a numeric value as " + std::to_string(id));
+		}
+		return v.comps.at(i);
+	}
+
+	Scalar kindOf(uint32_t id) {
+		return leaves(value(id).type).at(0);
+	}
+
+	unsigned int sizeOf(uint32_t id) {
+		return static_cast<unsigned int>(leaves(value(id).type).size());
+	}
+
+	// component i of id converted to kind
+	std::string comp(uint32_t id, unsigned int i, Scalar kind) {
+		return view(comp(id, i), kindOf(id), kind);
+	}
+
+	// declares variables for the scalars of id and assigns them
+	std::vector<std::string> assign(uint32_t id, const std::vector<Scalar> &kinds, const std::vector<std::string> &exprs);
+	void define(const Instruction &inst, const std::vector<std::string> &exprs);
+	void defineHandle(uint32_t id, const Handle &h);
+	void definePointer(uint32_t id, const Pointer &p);
+
+	void locationSlots(uint32_t typeId, unsigned int location, unsigned int component, const std::string &array, std::vector<Slot> &slots);
+	void builtInSlots(int builtIn, uint32_t typeId, std::vector<Slot> &slots);
+	void setupInterface(uint32_t id, const Instruction &var);
+	void bufferLeaves(uint32_t typeId, uint32_t offset, uint32_t matrixStride, bool rowMajor, std::vector<std::pair<Scalar, uint32_t> > &out);
+
+	bool unconditional() const {
+		return currentBlock == 0 && loopOf[0] < 0;
+	}
+	void maskedAssign(const std::string &dst, const std::string &src);
+
+	void analyze();
+	void edge(uint32_t target, const std::string &mask);
+	void translateBlocks(unsigned int begin, unsigned int end);
+	void translateBlock(unsigned int index);
+	void translateInstruction(const Instruction &inst);
+	void translateExtension(const Instruction &inst);
+	void translateAccessChain(const Instruction &inst);
+	void translateLoad(const Instruction &inst);
+	void translateStore(const Instruction &inst);
+	void translateImage(const Instruction &inst);
+
+	// applies fn or operator op to each component of the operands viewed as argKind
+	// fn returns fnKind which is viewed as the result type
+	void componentwise(const Instruction &inst, Scalar argKind, const std::string &fn, Scalar fnKind, unsigned int firstArg = 0);
+	void componentwiseOp(const Instruction &inst, Scalar argKind, const char *op, Scalar fnKind);
+
+
+public:
+
+	Translator(const Module &m_, Stage stage_);
+
+	Translator(const Translator &)            = delete;
+	Translator(Translator &&)                 = delete;
+
+	Translator &operator=(const Translator &) = delete;
+	Translator &operator=(Translator &&)      = delete;
+
+	~Translator() {}
+
+	Translation translate(const std::string &functionName);
+};
+
+
+Translator::Translator(const Module &m_, Stage stage_)
+: m(m_)
+, stage(stage_)
+, indent(1)
+, currentBlock(0)
+, usesResources(false)
+, maxAttrib(0)
+, maxColor(0)
+{
+}
+
+
+const std::vector<Scalar> &Translator::leaves(uint32_t typeId) {
+	auto it = leafCache.find(typeId);
+	if (it != leafCache.end()) {
+		return it->second;
+	}
+
+	std::vector<Scalar> scalars;
+	const Type &t = m.type(typeId);
+	switch (t.op) {
+	case spv::OpTypeFloat:
+		scalars.push_back(Scalar::Float);
+		break;
+
+	case spv::OpTypeInt:
+		scalars.push_back(t.isSigned ? Scalar::Int : Scalar::UInt);
+		break;
+
+	case spv::OpTypeBool:
+		scalars.push_back(Scalar::Bool);
+		break;
+
+	case spv::OpTypeVector:
+	case spv::OpTypeMatrix:
+	case spv::OpTypeArray: {
+		std::vector<Scalar> element = leaves(t.element);
+		for (unsigned int i = 0; i < t.count; i++) {
+			scalars.insert(scalars.end(), element.begin(), element.end());
+		}
+	} break;
+
+	case spv::OpTypeStruct:
+		for (uint32_t member : t.members) {
+			const auto &l = leaves(member);
+			scalars.insert(scalars.end(), l.begin(), l.end());
+		}
+		break;
+
+	default:
+		throw std::runtime_error("Type " + std::to_string(typeId) + " is not numeric");
+	}
+
+	return leafCache.emplace(typeId, std::move(scalars)).first->second;
+}
+
+
+// first scalar and type of a member of a composite
+std::pair<unsigned int, uint32_t> Translator::subrange(uint32_t typeId, const uint32_t *indices, unsigned int count) {
+	unsigned int first = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		const Type &t = m.type(typeId);
+		uint32_t index = indices[i];
+		if (t.op == spv::OpTypeStruct) {
+			for (uint32_t j = 0; j < index; j++) {
+				first += static_cast<unsigned int>(leaves(t.members.at(j)).size());
+			}
+			typeId = t.members.at(index);
+		} else if (t.op == spv::OpTypeVector || t.op == spv::OpTypeMatrix || t.op == spv::OpTypeArray) {
+			if (index >= t.count) {
+				throw std::runtime_error("Composite index out of range");
+			}
+			first  += index * static_cast<unsigned int>(leaves(t.element).size());
+			typeId  = t.element;
+		} else {
+			throw std::runtime_error("Can't index type " + std::to_string(typeId));
+		}
+	}
+
+	return std::make_pair(first, typeId);
+}
+
+
+unsigned int Translator::locationCount(uint32_t typeId) {
+	const Type &t = m.type(typeId);
+	switch (t.op) {
+	case spv::OpTypeMatrix:
+		return t.count;
+
+	case spv::OpTypeArray:
+		return t.count * locationCount(t.element);
+
+	case spv::OpTypeStruct: {
+		unsigned int count = 0;
+		for (uint32_t member : t.members) {
+			count += locationCount(member);
+		}
+		return count;
+	}
+
+	default:
+		return 1;
+	}
+}
+
+
+const Value &Translator::value(uint32_t id) {
+	auto it = values.find(id);
+	if (it != values.end()) {
+		return it->second;
+	}
+
+	// constants become literals on first use
+	auto c = m.constants.find(id);
+	if (c == m.constants.end()) {
+		throw std::runtime_error("Use of undefined value " + std::to_string(id));
+	}
+
+	const Instruction &inst = c->second;
+	Value v;
+	v.type = inst.resultType();
+	const auto &kinds = leaves(v.type);
+	switch (inst.op) {
+	case spv::OpConstant:
+		v.comps.push_back(literal(kinds.at(0), inst.operand(0)));
+		break;
+
+	case spv::OpConstantTrue:
+		v.comps.push_back(literal(Scalar::Bool, 1));
+		break;
+
+	case spv::OpConstantFalse:
+		v.comps.push_back(literal(Scalar::Bool, 0));
+		break;
+
+	case spv::OpConstantComposite:
+		for (unsigned int i = 0; i < inst.numOperands(); i++) {
+			const auto &constituent = value(inst.operand(i)).comps;
+			v.comps.insert(v.comps.end(), constituent.begin(), constituent.end());
+		}
+		break;
+
+	case spv::OpConstantNull:
+		for (Scalar k : kinds) {
+			v.comps.push_back(literal(k, 0));
+		}
+		break;
+
+	case spv::OpUndef:
+		for (Scalar k : kinds) {
+			v.comps.push_back(zero(k));
+		}
+		break;
+
+	default:
+		throw std::runtime_error("Unsupported constant");
+	}
+	assert(v.comps.size() == kinds.size());
+
+	return values.emplace(id, std::move(v)).first->second;
+}
+
+
+std::vector<std::string> Translator::assign(uint32_t id, const std::vector<Scalar> &kinds, const std::vector<std::string> &exprs) {
+	if (exprs.size() != kinds.size()) {
+		throw std::runtime_error("Wrong number of components for " + std::to_string(id));
+	}
+
+	bool isMasked = masked[id];
+	std::vector<std::string> names;
+	for (unsigned int i = 0; i < kinds.size(); i++) {
+		std::string name = "r" + std::to_string(id);
+		if (kinds.size() > 1) {
+			name += "_" + std::to_string(i);
+		}
+		declarations.emplace_back(kinds[i], name);
+
+		if (isMasked) {
+			line(name + " = swSelect(cur, " + exprs[i] + ", " + name + ");");
+		} else {
+			line(name + " = " + exprs[i] + ";");
+		}
+		names.push_back(name);
+	}
+
+	return names;
+}
+
+
+void Translator::define(const Instruction &inst, const std::vector<std::string> &exprs) {
+	Value v;
+	v.type  = inst.resultType();
+	v.comps = assign(inst.result(), leaves(v.type), exprs);
+	values[inst.result()] = std::move(v);
+}
+
+
+void Translator::defineHandle(uint32_t id, const Handle &h) {
+	Value v;
+	v.kind   = Value::Kind::Handle;
+	v.handle = h;
+	values[id] = v;
+}
+
+
+void Translator::definePointer(uint32_t id, const Pointer &p) {
+	Value v;
+	v.kind    = Value::Kind::Pointer;
+	v.type    = p.type;
+	v.pointer = p;
+	values[id] = v;
+}
+
+
+void Translator::maskedAssign(const std::string &dst, const std::string &src) {
+	if (unconditional()) {
+		line(dst + " = " + src + ";");
+	} else {
+		line(dst + " = swSelect(cur, " + src + ", " + dst + ");");
+	}
+}
+
+
+static bool hasResult(spv::Op op) {
+	switch (op) {
+	case spv::OpStore:
+	case spv::OpCopyMemory:
+	case spv::OpBranch:
+	case spv::OpBranchConditional:
+	case spv::OpSwitch:
+	case spv::OpReturn:
+	case spv::OpReturnValue:
+	case spv::OpKill:
+	case spv::OpUnreachable:
+	case spv::OpImageWrite:
+	case spv::OpControlBarrier:
+	case spv::OpMemoryBarrier:
+		return false;
+
+	default:
+		return true;
+	}
+}
+
+
+// operands of an instruction which can be ids
+static unsigned int firstIdOperand(const Instruction &inst) {
+	return hasResult(inst.op) ? 2 : 0;
+}
+
+
+void Translator::analyze() {
+	unsigned int numBlocks = static_cast<unsigned int>(m.blocks.size());
+	for (unsigned int i = 0; i < numBlocks; i++) {
+		blockIndex[m.blocks[i].label] = i;
+	}
+
+	// structured control flow lays out a loop as the blocks from its header up to its merge block
+	loopOf.assign(numBlocks, -1);
+	parentLoop.assign(numBlocks, -1);
+	loopEnd.assign(numBlocks, 0);
+	for (unsigned int h = 0; h < numBlocks; h++) {
+		if (!m.blocks[h].loopMerge) {
+			continue;
+		}
+
+		unsigned int end = blockIndex.at(m.blocks[h].loopMerge);
+		if (end <= h) {
+			throw std::runtime_error("Loop merge block before its header");
+		}
+		int parent = loopOf[h];
+		if (parent >= 0 && end > loopEnd[parent]) {
+			throw std::runtime_error("Loops are not nested");
+		}
+		parentLoop[h] = parent;
+		loopEnd[h]    = end;
+		for (unsigned int i = h; i < end; i++) {
+			loopOf[i] = h;
+		}
+	}
+
+	auto inLoop = [&] (unsigned int block, int loop) {
+		for (int l = loopOf[block]; l >= 0; l = parentLoop[l]) {
+			if (l == loop) {
+				return true;
+			}
+		}
+		return false;
+	};
+
+	// only back edges may go backwards and loops are only entered through their header
+	phis.resize(numBlocks);
+	for (unsigned int i = 0; i < numBlocks; i++) {
+		for (const auto &inst : m.blocks[i].instructions) {
+			if (hasResult(inst.op)) {
+				defBlock[inst.result()] = i;
+			}
+			if (inst.op == spv::OpPhi) {
+				phis[i].push_back(&inst);
+			}
+
+			std::vector<uint32_t> targets;
+			if (inst.op == spv::OpBranch) {
+				targets.push_back(inst.words[0]);
+			} else if (inst.op == spv::OpBranchConditional) {
+				targets.push_back(inst.words[1]);
+				targets.push_back(inst.words[2]);
+			} else if (inst.op == spv::OpSwitch) {
+				targets.push_back(inst.words[1]);
+				for (unsigned int j = 3; j < inst.words.size(); j += 2) {
+					targets.push_back(inst.words[j]);
+				}
+			}
+
+			for (uint32_t target : targets) {
+				unsigned int t = blockIndex.at(target);
+				if (t <= i && !(m.blocks[t].loopMerge && inLoop(i, t))) {
+					throw std::runtime_error("Unstructured backwards branch");
+				}
+				int l = loopOf[t];
+				if (l >= 0 && static_cast<unsigned int>(l) != t && !inLoop(i, l)) {
+					throw std::runtime_error("Branch into the middle of a loop");
+				}
+			}
+		}
+	}
+
+	// a value which outlives the loop it is defined in must not be overwritten
+	// by the iterations of lanes which are still looping
+	auto use = [&] (uint32_t id, unsigned int block) {
+		auto it = defBlock.find(id);
+		if (it == defBlock.end()) {
+			return;
+		}
+		int l = loopOf[it->second];
+		if (l >= 0 && !inLoop(block, l)) {
+			masked[id] = true;
+		}
+	};
+
+	for (unsigned int i = 0; i < numBlocks; i++) {
+		for (const auto &inst : m.blocks[i].instructions) {
+			if (inst.op == spv::OpPhi) {
+				// a phi operand is used at the end of the predecessor
+				for (unsigned int j = 2; j + 1 < inst.words.size(); j += 2) {
+					use(inst.words[j], blockIndex.at(inst.words[j + 1]));
+				}
+				continue;
+			}
+
+			for (unsigned int j = firstIdOperand(inst); j < inst.words.size(); j++) {
+				use(inst.words[j], i);
+			}
+		}
+	}
+
+	// phis are variables written by the incoming edges
+	for (unsigned int i = 0; i < numBlocks; i++) {
+		for (const Instruction *phi : phis[i]) {
+			Value v;
+			v.type = phi->resultType();
+			const auto &kinds = leaves(v.type);
+			for (unsigned int j = 0; j < kinds.size(); j++) {
+				std::string name = "r" + std::to_string(phi->result());
+				if (kinds.size() > 1) {
+					name += "_" + std::to_string(j);
+				}
+				declarations.emplace_back(kinds[j], name);
+				v.comps.push_back(name);
+			}
+			values[phi->result()] = std::move(v);
+		}
+	}
+}
+
+
+void Translator::locationSlots(uint32_t typeId, unsigned int location, unsigned int component, const std::string &array, std::vector<Slot> &slots) {
+	const Type &t = m.type(typeId);
+	switch (t.op) {
+	case spv::OpTypeFloat:
+	case spv::OpTypeInt:
+	case spv::OpTypeVector: {
+		const auto &kinds = leaves(typeId);
+		if (component + kinds.size() > 4) {
+			throw std::runtime_error("Location has more than 4 components");
+		}
+		for (unsigned int i = 0; i < kinds.size(); i++) {
+			Slot s;
+			s.expr = "io." + array + "[" + std::to_string(location) + "][" + std::to_string(component + i) + "]";
+			// integers are kept bitcast in the float slots
+			s.kind = Scalar::Float;
+			slots.push_back(s);
+		}
+
+		if (array == "varyings") {
+			result.numVaryings = std::max(result.numVaryings, location + 1);
+		} else if (array == "attribs") {
+			maxAttrib = std::max(maxAttrib, location + 1);
+		} else {
+			maxColor = std::max(maxColor, location + 1);
+		}
+	} break;
+
+	case spv::OpTypeMatrix:
+	case spv::OpTypeArray:
+		for (unsigned int i = 0; i < t.count; i++) {
+			locationSlots(t.element, location + i * locationCount(t.element), 0, array, slots);
+		}
+		break;
+
+	case spv::OpTypeStruct:
+		for (uint32_t member : t.members) {
+			locationSlots(member, location, 0, array, slots);
+			location += locationCount(member);
+		}
+		break;
+
+	default:
+		throw std::runtime_error("Unsupported interface variable type");
+	}
+}
+
+
+void Translator::builtInSlots(int builtIn, uint32_t typeId, std::vector<Slot> &slots) {
+	const auto &kinds = leaves(typeId);
+	switch (builtIn) {
+	case spv::BuiltInPosition:
+	case spv::BuiltInFragCoord: {
+		const char *name = (builtIn == spv::BuiltInPosition) ? "position" : "fragCoord";
+		for (unsigned int i = 0; i < kinds.size(); i++) {
+			Slot s;
+			s.expr = std::string("io.") + name + "[" + std::to_string(i) + "]";
+			slots.push_back(s);
+		}
+	} break;
+
+	case spv::BuiltInVertexIndex:
+	case spv::BuiltInInstanceIndex: {
+		Slot s;
+		s.expr = (builtIn == spv::BuiltInVertexIndex) ? "io.vertexIndex" : "io.instanceIndex";
+		s.kind = Scalar::Int;
+		slots.push_back(s);
+	} break;
+
+	case spv::BuiltInPointSize:
+	case spv::BuiltInClipDistance:
+	case spv::BuiltInCullDistance:
+		// not supported by the software renderer, writes are dropped
+		slots.resize(slots.size() + kinds.size());
+		break;
+
+	default:
+		throw std::runtime_error("Unsupported builtin " + std::to_string(builtIn));
+	}
+}
+
+
+void Translator::setupInterface(uint32_t id, const Instruction &var) {
+	const Type &pointer = m.type(var.resultType());
+	uint32_t typeId     = pointer.element;
+	Decorations d       = m.decoration(id);
+	bool output         = (pointer.storage == spv::StorageClassOutput);
+
+	std::vector<Slot> slots;
+	if (d.builtIn >= 0) {
+		builtInSlots(d.builtIn, typeId, slots);
+	} else if (m.type(typeId).op == spv::OpTypeStruct && !m.decoration(typeId).members.empty() && m.decoration(typeId).members[0].builtIn >= 0) {
+		// gl_PerVertex
+		const Type &t         = m.type(typeId);
+		Decorations memberDec = m.decoration(typeId);
+		for (unsigned int i = 0; i < t.members.size(); i++) {
+			builtInSlots((i < memberDec.members.size()) ? memberDec.members[i].builtIn : -1, t.members[i], slots);
+		}
+	} else {
+		if (d.location < 0) {
+			throw std::runtime_error("Interface variable " + std::to_string(id) + " has no location");
+		}
+
+		const char *array = nullptr;
+		if (stage == Stage::Vertex) {
+			array = output ? "varyings" : "attribs";
+		} else {
+			array = output ? "colors" : "varyings";
+		}
+		locationSlots(typeId, d.location, d.component, array, slots);
+
+		if (d.flat && stage == Stage::Fragment && !output) {
+			for (unsigned int i = 0; i < locationCount(typeId); i++) {
+				result.flatVaryings |= 1U << (d.location + i);
+			}
+		}
+	}
+
+	// outputs start as 0 so every invocation writes them fully
+	if (output) {
+		for (const auto &s : slots) {
+			if (!s.expr.empty()) {
+				line(s.expr + " = " + zero(s.kind) + ";");
+			}
+		}
+	}
+
+	interfaceSlots.emplace(id, std::move(slots));
+}
+
+
+// scalars of a buffer member with their byte offsets
+void Translator::bufferLeaves(uint32_t typeId, uint32_t offset, uint32_t matrixStride, bool rowMajor, std::vector<std::pair<Scalar, uint32_t> > &out) {
+	const Type &t = m.type(typeId);
+	switch (t.op) {
+	case spv::OpTypeFloat:
+	case spv::OpTypeInt:
+	case spv::OpTypeBool:
+		out.emplace_back(leaves(typeId).at(0), offset);
+		break;
+
+	case spv::OpTypeVector:
+		for (unsigned int i = 0; i < t.count; i++) {
+			bufferLeaves(t.element, offset + 4 * i, 0, false, out);
+		}
+		break;
+
+	case spv::OpTypeMatrix: {
+		const Type &column = m.type(t.element);
+		for (unsigned int c = 0; c < t.count; c++) {
+			for (unsigned int r = 0; r < column.count; r++) {
+				uint32_t o = rowMajor ? (r * matrixStride + c * 4) : (c * matrixStride + r * 4);
+				bufferLeaves(column.element, offset + o, 0, false, out);
+			}
+		}
+	} break;
+
+	case spv::OpTypeArray: {
+		uint32_t stride = m.decoration(typeId).arrayStride;
+		for (unsigned int i = 0; i < t.count; i++) {
+			bufferLeaves(t.element, offset + i * stride, matrixStride, rowMajor, out);
+		}
+	} break;
+
+	case spv::OpTypeStruct: {
+		Decorations d = m.decoration(typeId);
+		for (unsigned int i = 0; i < t.members.size(); i++) {
+			MemberDecorations md = (i < d.members.size()) ? d.members[i] : MemberDecorations();
+			bufferLeaves(t.members[i], offset + md.offset, md.matrixStride, md.rowMajor, out);
+		}
+	} break;
+
+	default:
+		throw std::runtime_error("Unsupported buffer member type");
+	}
+}
+
+
+void Translator::translateAccessChain(const Instruction &inst) {
+	const Value &base = value(inst.operand(0));
+	if (base.kind != Value::Kind::Pointer) {
+		throw std::runtime_error("Access chain base is not a pointer");
+	}
+
+	Pointer p        = base.pointer;
+	std::string dyn  = p.dynamicOffset;
+	for (unsigned int i = 1; i < inst.numOperands(); i++) {
+		uint32_t index = inst.operand(i);
+		const Type &t  = m.type(p.type);
+
+		if (p.kind != Pointer::Kind::Buffer) {
+			if (!m.isConstant(index)) {
+				throw std::runtime_error("Dynamic indexing is only supported in buffers");
+			}
+			uint32_t c = m.constant(index);
+			auto sub   = subrange(p.type, &c, 1);
+			p.first   += sub.first;
+			p.type     = sub.second;
+			continue;
+		}
+
+		uint32_t stride = 0;
+		switch (t.op) {
+		case spv::OpTypeStruct: {
+			uint32_t member       = m.constant(index);
+			MemberDecorations md  = m.decoration(p.type).members.at(member);
+			p.offset             += md.offset;
+			p.matrixStride        = md.matrixStride;
+			p.rowMajor            = md.rowMajor;
+			p.type                = t.members.at(member);
+		} continue;
+
+		case spv::OpTypeArray:
+		case spv::OpTypeRuntimeArray:
+			stride = m.decoration(p.type).arrayStride;
+			break;
+
+		case spv::OpTypeMatrix:
+			if (p.rowMajor) {
+				throw std::runtime_error("Indexing row major matrices is not supported");
+			}
+			stride = p.matrixStride;
+			break;
+
+		case spv::OpTypeVector:
+			stride = 4;
+			break;
+
+		default:
+			throw std::runtime_error("Can't index type " + std::to_string(p.type));
+		}
+		p.type = t.element;
+
+		if (m.isConstant(index)) {
+			p.offset += m.constant(index) * stride;
+		} else {
+			std::string term = comp(index, 0, Scalar::Int) + " * SWInt(" + std::to_string(stride) + ")";
+			dyn = dyn.empty() ? term : "(" + dyn + " + " + term + ")";
+		}
+	}
+
+	if (dyn != p.dynamicOffset) {
+		// per lane offsets are computed once like any other value
+		std::vector<std::string> names = assign(inst.result(), { Scalar::Int }, { dyn });
+		p.dynamicOffset = names[0];
+	}
+
+	definePointer(inst.result(), p);
+}
+
+
+void Translator::translateLoad(const Instruction &inst) {
+	const Value &source = value(inst.operand(0));
+	if (source.kind == Value::Kind::Handle) {
+		defineHandle(inst.result(), source.handle);
+		return;
+	}
+	if (source.kind != Value::Kind::Pointer) {
+		throw std::runtime_error("Load from a non-pointer");
+	}
+
+	const Pointer &p  = source.pointer;
+	const auto &kinds = leaves(inst.resultType());
+	std::vector<std::string> exprs;
+	switch (p.kind) {
+	case Pointer::Kind::Buffer: {
+		std::vector<std::pair<Scalar, uint32_t> > scalars;
+		bufferLeaves(p.type, p.offset, p.matrixStride, p.rowMajor, scalars);
+
+		std::string base = "buf" + std::to_string(p.set) + "_" + std::to_string(p.binding);
+		for (const auto &s : scalars) {
+			std::string address = base + " + " + std::to_string(s.second);
+			const char *lane    = (s.first == Scalar::Float) ? "float" : (s.first == Scalar::Int) ? "int32_t" : "uint32_t";
+			std::string e;
+			if (p.dynamicOffset.empty()) {
+				// same address in all lanes
+				e = std::string(laneType(s.first == Scalar::Bool ? Scalar::UInt : s.first)) + "(swLoadScalar<" + lane + ">(" + address + "))";
+			} else {
+				e = std::string("swGather<") + laneType(s.first == Scalar::Bool ? Scalar::UInt : s.first) + ">(" + address + ", " + p.dynamicOffset + ", cur)";
+			}
+			if (s.first == Scalar::Bool) {
+				e = "(" + e + " != SWUInt(0u))";
+			}
+			exprs.push_back(e);
+		}
+	} break;
+
+	case Pointer::Kind::Interface: {
+		const auto &slots = interfaceSlots.at(p.variable);
+		for (unsigned int i = 0; i < kinds.size(); i++) {
+			const Slot &s = slots.at(p.first + i);
+			exprs.push_back(s.expr.empty() ? zero(kinds[i]) : view(s.expr, s.kind, kinds[i]));
+		}
+	} break;
+
+	case Pointer::Kind::Local: {
+		const auto &vars = values.at(p.variable).comps;
+		for (unsigned int i = 0; i < kinds.size(); i++) {
+			exprs.push_back(vars.at(p.first + i));
+		}
+	} break;
+	}
+
+	define(inst, exprs);
+}
+
+
+void Translator::translateStore(const Instruction &inst) {
+	const Value &target = value(inst.words[0]);
+	if (target.kind != Value::Kind::Pointer) {
+		throw std::runtime_error("Store to a non-pointer");
+	}
+
+	const Pointer &p = target.pointer;
+	uint32_t object  = inst.words[1];
+	unsigned int n   = sizeOf(object);
+	const auto &kinds = leaves(value(object).type);
+	switch (p.kind) {
+	case Pointer::Kind::Buffer:
+		throw std::runtime_error("Buffer stores are not supported");
+
+	case Pointer::Kind::Interface: {
+		const auto &slots = interfaceSlots.at(p.variable);
+		for (unsigned int i = 0; i < n; i++) {
+			const Slot &s = slots.at(p.first + i);
+			if (!s.expr.empty()) {
+				maskedAssign(s.expr, view(comp(object, i), kinds[i], s.kind));
+			}
+		}
+	} break;
+
+	case Pointer::Kind::Local: {
+		const auto &vars = values.at(p.variable).comps;
+		for (unsigned int i = 0; i < n; i++) {
+			maskedAssign(vars.at(p.first + i), comp(object, i));
+		}
+	} break;
+	}
+}
+
+
+void Translator::componentwise(const Instruction &inst, Scalar argKind, const std::string &fn, Scalar fnKind, unsigned int firstArg) {
+	const auto &kinds = leaves(inst.resultType());
+	std::vector<std::string> exprs;
+	for (unsigned int i = 0; i < kinds.size(); i++) {
+		std::string e = fn + "(";
+		for (unsigned int a = firstArg; a < inst.numOperands(); a++) {
+			uint32_t arg = inst.operand(a);
+			if (a != firstArg) {
+				e += ", ";
+			}
+			// scalars are used with every component
+			e += comp(arg, (sizeOf(arg) == 1) ? 0 : i, argKind);
+		}
+		e += ")";
+		exprs.push_back((kinds[i] == Scalar::Bool) ? e : view(e, fnKind, kinds[i]));
+	}
+
+	define(inst, exprs);
+}
+
+
+void Translator::componentwiseOp(const Instruction &inst, Scalar argKind, const char *op, Scalar fnKind) {
+	const auto &kinds = leaves(inst.resultType());
+	std::vector<std::string> exprs;
+	for (unsigned int i = 0; i < kinds.size(); i++) {
+		std::string e;
+		if (inst.numOperands() == 1) {
+			e = std::string("(") + op + comp(inst.operand(0), i, argKind) + ")";
+		} else {
+			uint32_t a = inst.operand(0), b = inst.operand(1);
+			e = "(" + comp(a, (sizeOf(a) == 1) ? 0 : i, argKind) + " " + op + " " + comp(b, (sizeOf(b) == 1) ? 0 : i, argKind) + ")";
+		}
+		exprs.push_back((kinds[i] == Scalar::Bool) ? e : view(e, fnKind, kinds[i]));
+	}
+
+	define(inst, exprs);
+}
+
+
+static std::string sum(const std::vector<std::string> &terms) {
+	std::string e = "(" + terms.at(0);
+	for (unsigned int i = 1; i < terms.size(); i++) {
+		e += " + " + terms[i];
+	}
+	return e + ")";
+}
+
+
+void Translator::translateInstruction(const Instruction &inst) {
+	const auto &w = inst.words;
+	switch (inst.op) {
+	case spv::OpPhi:
+		// assigned by the incoming edges
+		break;
+
+	case spv::OpUndef: {
+		std::vector<std::string> exprs;
+		for (Scalar k : leaves(inst.resultType())) {
+			exprs.push_back(zero(k));
+		}
+		define(inst, exprs);
+	} break;
+
+	case spv::OpVariable: {
+		// function local, hopefully optimized away
+		Value v;
+		v.kind             = Value::Kind::Pointer;
+		v.type             = m.type(inst.resultType()).element;
+		v.pointer.kind     = Pointer::Kind::Local;
+		v.pointer.variable = inst.result();
+		v.pointer.type     = v.type;
+		const auto &kinds  = leaves(v.type);
+		for (unsigned int i = 0; i < kinds.size(); i++) {
+			std::string name = "r" + std::to_string(inst.result()) + "_" + std::to_string(i);
+			declarations.emplace_back(kinds[i], name);
+			line(name + " = " + ((inst.numOperands() > 1) ? comp(inst.operand(1), i) : zero(kinds[i])) + ";");
+			v.comps.push_back(name);
+		}
+		values[inst.result()] = std::move(v);
+	} break;
+
+	case spv::OpLoad:
+		translateLoad(inst);
+		break;
+
+	case spv::OpStore:
+		translateStore(inst);
+		break;
+
+	case spv::OpAccessChain:
+	case spv::OpInBoundsAccessChain:
+		translateAccessChain(inst);
+		break;
+
+	case spv::OpCopyObject:
+		define(inst, value(inst.operand(0)).comps);
+		break;
+
+	case spv::OpCompositeConstruct: {
+		std::vector<std::string> exprs;
+		for (unsigned int i = 0; i < inst.numOperands(); i++) {
+			const auto &c = value(inst.operand(i)).comps;
+			exprs.insert(exprs.end(), c.begin(), c.end());
+		}
+		define(inst, exprs);
+	} break;
+
+	case spv::OpCompositeExtract: {
+		const Value &composite = value(inst.operand(0));
+		auto sub               = subrange(composite.type, &w[3], inst.numOperands() - 1);
+		size_t n               = leaves(sub.second).size();
+		define(inst, std::vector<std::string>(composite.comps.begin() + sub.first, composite.comps.begin() + sub.first + n));
+	} break;
+
+	case spv::OpCompositeInsert: {
+		const Value &composite = value(inst.operand(1));
+		auto sub               = subrange(composite.type, &w[4], inst.numOperands() - 2);
+		std::vector<std::string> exprs = composite.comps;
+		const auto &object     = value(inst.operand(0)).comps;
+		std::copy(object.begin(), object.end(), exprs.begin() + sub.first);
+		define(inst, exprs);
+	} break;
+
+	case spv::OpVectorShuffle: {
+		std::vector<std::string> both = value(inst.operand(0)).comps;
+		const auto &second            = value(inst.operand(1)).comps;
+		both.insert(both.end(), second.begin(), second.end());
+		const auto &kinds = leaves(inst.resultType());
+		std::vector<std::string> exprs;
+		for (unsigned int i = 2; i < inst.numOperands(); i++) {
+			uint32_t c = inst.operand(i);
+			exprs.push_back((c == 0xFFFFFFFFU) ? zero(kinds[0]) : both.at(c));
+		}
+		define(inst, exprs);
+	} break;
+
+	case spv::OpVectorExtractDynamic: {
+		uint32_t vec   = inst.operand(0);
+		uint32_t index = inst.operand(1);
+		if (m.isConstant(index)) {
+			define(inst, { comp(vec, m.constant(index)) });
+			break;
+		}
+		std::string idx = comp(index, 0, Scalar::Int);
+		std::string e   = comp(vec, 0);
+		for (unsigned int i = 1; i < sizeOf(vec); i++) {
+			e = "swSelect(" + idx + " == SWInt(" + std::to_string(i) + "), " + comp(vec, i) + ", " + e + ")";
+		}
+		define(inst, { e });
+	} break;
+
+	case spv::OpVectorInsertDynamic: {
+		uint32_t vec   = inst.operand(0);
+		uint32_t index = inst.operand(2);
+		std::string idx = comp(index, 0, Scalar::Int);
+		std::vector<std::string> exprs;
+		for (unsigned int i = 0; i < sizeOf(vec); i++) {
+			exprs.push_back("swSelect(" + idx + " == SWInt(" + std::to_string(i) + "), " + comp(inst.operand(1), 0) + ", " + comp(vec, i) + ")");
+		}
+		define(inst, exprs);
+	} break;
+
+	case spv::OpFAdd:
+		componentwiseOp(inst, Scalar::Float, "+", Scalar::Float);
+		break;
+
+	case spv::OpFSub:
+		componentwiseOp(inst, Scalar::Float, "-", Scalar::Float);
+		break;
+
+	case spv::OpFMul:
+	case spv::OpVectorTimesScalar:
+	case spv::OpMatrixTimesScalar:
+		componentwiseOp(inst, Scalar::Float, "*", Scalar::Float);
+		break;
+
+	case spv::OpFDiv:
+		componentwiseOp(inst, Scalar::Float, "/", Scalar::Float);
+		break;
+
+	case spv::OpFNegate:
+		componentwiseOp(inst, Scalar::Float, "-", Scalar::Float);
+		break;
+
+	case spv::OpFMod:
+		componentwise(inst, Scalar::Float, "swMod", Scalar::Float);
+		break;
+
+	case spv::OpIAdd:
+		componentwiseOp(inst, Scalar::Int, "+", Scalar::Int);
+		break;
+
+	case spv::OpISub:
+		componentwiseOp(inst, Scalar::Int, "-", Scalar::Int);
+		break;
+
+	case spv::OpIMul:
+		componentwiseOp(inst, Scalar::Int, "*", Scalar::Int);
+		break;
+
+	case spv::OpSNegate:
+		componentwiseOp(inst, Scalar::Int, "-", Scalar::Int);
+		break;
+
+	case spv::OpSDiv:
+		componentwise(inst, Scalar::Int, "swDiv", Scalar::Int);
+		break;
+
+	case spv::OpUDiv:
+		componentwise(inst, Scalar::UInt, "swDiv", Scalar::UInt);
+		break;
+
+	case spv::OpSRem:
+		componentwise(inst, Scalar::Int, "swRem", Scalar::Int);
+		break;
+
+	case spv::OpSMod:
+		componentwise(inst, Scalar::Int, "swMod", Scalar::Int);
+		break;
+
+	case spv::OpUMod:
+		componentwise(inst, Scalar::UInt, "swRem", Scalar::UInt);
+		break;
+
+	case spv::OpBitwiseAnd:
+		componentwiseOp(inst, Scalar::UInt, "&", Scalar::UInt);
+		break;
+
+	case spv::OpBitwiseOr:
+		componentwiseOp(inst, Scalar::UInt, "|", Scalar::UInt);
+		break;
+
+	case spv::OpBitwiseXor:
+		componentwiseOp(inst, Scalar::UInt, "^", Scalar::UInt);
+		break;
+
+	case spv::OpNot:
+		componentwiseOp(inst, Scalar::UInt, "~", Scalar::UInt);
+		break;
+
+	case spv::OpShiftLeftLogical:
+	case spv::OpShiftRightLogical:
+	case spv::OpShiftRightArithmetic: {
+		Scalar kind       = (inst.op == spv::OpShiftRightArithmetic) ? Scalar::Int : Scalar::UInt;
+		uint32_t base     = inst.operand(0);
+		uint32_t shift    = inst.operand(1);
+		const auto &kinds = leaves(inst.resultType());
+		std::vector<std::string> exprs;
+		for (unsigned int i = 0; i < kinds.size(); i++) {
+			std::string e;
+			unsigned int si = (sizeOf(shift) == 1) ? 0 : i;
+			if (m.isConstant(shift) && m.constants.at(shift).op == spv::OpConstant && m.constant(shift) < 32) {
+				e = "(" + comp(base, i, kind) + ((inst.op == spv::OpShiftLeftLogical) ? " << " : " >> ") + std::to_string(m.constant(shift)) + ")";
+			} else {
+				e = std::string((inst.op == spv::OpShiftLeftLogical) ? "swShiftLeft(" : "swShiftRight(") + comp(base, i, kind) + ", " + comp(shift, si, Scalar::UInt) + ")";
+			}
+			exprs.push_back(view(e, kind, kinds[i]));
+		}
+		define(inst, exprs);
+	} break;
+
+	case spv::OpConvertFToS:
+		componentwise(inst, Scalar::Float, "swToInt", Scalar::Int);
+		break;
+
+	case spv::OpConvertFToU:
+		componentwise(inst, Scalar::Float, "swToUInt", Scalar::UInt);
+		break;
+
+	case spv::OpConvertSToF:
+		componentwise(inst, Scalar::Int, "swToFloat", Scalar::Float);
+		break;
+
+	case spv::OpConvertUToF:
+		componentwise(inst, Scalar::UInt, "swToFloat", Scalar::Float);
+		break;
+
+	case spv::OpBitcast:
+	case spv::OpSConvert:
+	case spv::OpUConvert:
+	case spv::OpFConvert: {
+		// only 32 bit types so these just change the type
+		const auto &kinds = leaves(inst.resultType());
+		std::vector<std::string> exprs;
+		for (unsigned int i = 0; i < kinds.size(); i++) {
+			exprs.push_back(comp(inst.operand(0), i, kinds[i]));
+		}
+		define(inst, exprs);
+	} break;
+
+	case spv::OpFOrdEqual:
+	case spv::OpFUnordEqual:
+		componentwiseOp(inst, Scalar::Float, "==", Scalar::Bool);
+		break;
+
+	case spv::OpFOrdNotEqual:
+	case spv::OpFUnordNotEqual:
+		componentwiseOp(inst, Scalar::Float, "!=", Scalar::Bool);
+		break;
+
+	case spv::OpFOrdLessThan:
+	case spv::OpFUnordLessThan:
+		componentwiseOp(inst, Scalar::Float, "<", Scalar::Bool);
+		break;
+
+	case spv::OpFOrdGreaterThan:
+	case spv::OpFUnordGreaterThan:
+		componentwiseOp(inst, Scalar::Float, ">", Scalar::Bool);
+		break;
+
+	case spv::OpFOrdLessThanEqual:
+	case spv::OpFUnordLessThanEqual:
+		componentwiseOp(inst, Scalar::Float, "<=", Scalar::Bool);
+		break;
+
+	case spv::OpFOrdGreaterThanEqual:
+	case spv::OpFUnordGreaterThanEqual:
+		componentwiseOp(inst, Scalar::Float, ">=", Scalar::Bool);
+		break;
+
+	case spv::OpIEqual:
+		componentwiseOp(inst, Scalar::Int, "==", Scalar::Bool);
+		break;
+
+	case spv::OpINotEqual:
+		componentwiseOp(inst, Scalar::Int, "!=", Scalar::Bool);
+		break;
+
+	case spv::OpSLessThan:
+		componentwiseOp(inst, Scalar::Int, "<", Scalar::Bool);
+		break;
+
+	case spv::OpSGreaterThan:
+		componentwiseOp(inst, Scalar::Int, ">", Scalar::Bool);
+		break;
+
+	case spv::OpSLessThanEqual:
+		componentwiseOp(inst, Scalar::Int, "<=", Scalar::Bool);
+		break;
+
+	case spv::OpSGreaterThanEqual:
+		componentwiseOp(inst, Scalar::Int, ">=", Scalar::Bool);
+		break;
+
+	case spv::OpULessThan:
+		componentwiseOp(inst, Scalar::UInt, "<", Scalar::Bool);
+		break;
+
+	case spv::OpUGreaterThan:
+		componentwiseOp(inst, Scalar::UInt, ">", Scalar::Bool);
+		break;
+
+	case spv::OpULessThanEqual:
+		componentwiseOp(inst, Scalar::UInt, "<=", Scalar::Bool);
+		break;
+
+	case spv::OpUGreaterThanEqual:
+		componentwiseOp(inst, Scalar::UInt, ">=", Scalar::Bool);
+		break;
+
+	case spv::OpLogicalAnd:
+		componentwiseOp(inst, Scalar::Bool, "&", Scalar::Bool);
+		break;
+
+	case spv::OpLogicalOr:
+		componentwiseOp(inst, Scalar::Bool, "|", Scalar::Bool);
+		break;
+
+	case spv::OpLogicalNotEqual:
+		componentwiseOp(inst, Scalar::Bool, "^", Scalar::Bool);
+		break;
+
+	case spv::OpLogicalEqual:
+		componentwiseOp(inst, Scalar::Bool, "==", Scalar::Bool);
+		break;
+
+	case spv::OpLogicalNot:
+		componentwiseOp(inst, Scalar::Bool, "!", Scalar::Bool);
+		break;
+
+	case spv::OpAny:
+	case spv::OpAll: {
+		uint32_t vec = inst.operand(0);
+		std::string e = comp(vec, 0);
+		for (unsigned int i = 1; i < sizeOf(vec); i++) {
+			e = "(" + e + ((inst.op == spv::OpAny) ? " | " : " & ") + comp(vec, i) + ")";
+		}
+		define(inst, { e });
+	} break;
+
+	case spv::OpIsNan:
+		componentwise(inst, Scalar::Float, "swIsNan", Scalar::Bool);
+		break;
+
+	case spv::OpIsInf:
+		componentwise(inst, Scalar::Float, "swIsInf", Scalar::Bool);
+		break;
+
+	case spv::OpSelect: {
+		uint32_t cond     = inst.operand(0);
+		const auto &kinds = leaves(inst.resultType());
+		std::vector<std::string> exprs;
+		for (unsigned int i = 0; i < kinds.size(); i++) {
+			exprs.push_back("swSelect(" + comp(cond, (sizeOf(cond) == 1) ? 0 : i) + ", " + comp(inst.operand(1), i) + ", " + comp(inst.operand(2), i) + ")");
+		}
+		define(inst, exprs);
+	} break;
+
+	case spv::OpDot: {
+		std::vector<std::string> terms;
+		for (unsigned int i = 0; i < sizeOf(inst.operand(0)); i++) {
+			terms.push_back(comp(inst.operand(0), i) + " * " + comp(inst.operand(1), i));
+		}
+		define(inst, { sum(terms) });
+	} break;
+
+	case spv::OpMatrixTimesVector:
+	case spv::OpVectorTimesMatrix:
+	case spv::OpMatrixTimesMatrix: {
+		// column major, component (c, r) is at c * rows + r
+		uint32_t a = inst.operand(0), b = inst.operand(1);
+		std::vector<std::string> exprs;
+		if (inst.op == spv::OpMatrixTimesVector) {
+			unsigned int cols = sizeOf(b), rows = sizeOf(a) / cols;
+			for (unsigned int r = 0; r < rows; r++) {
+				std::vector<std::string> terms;
+				for (unsigned int k = 0; k < cols; k++) {
+					terms.push_back(comp(a, k * rows + r) + " * " + comp(b, k));
+				}
+				exprs.push_back(sum(terms));
+			}
+		} else if (inst.op == spv::OpVectorTimesMatrix) {
+			unsigned int rows = sizeOf(a), cols = sizeOf(b) / rows;
+			for (unsigned int c = 0; c < cols; c++) {
+				std::vector<std::string> terms;
+				for (unsigned int k = 0; k < rows; k++) {
+					terms.push_back(comp(a, k) + " * " + comp(b, c * rows + k));
+				}
+				exprs.push_back(sum(terms));
+			}
+		} else {
+			unsigned int inner = m.type(value(a).type).count;
+			unsigned int rows  = sizeOf(a) / inner;
+			unsigned int cols  = sizeOf(b) / inner;
+			for (unsigned int c = 0; c < cols; c++) {
+				for (unsigned int r = 0; r < rows; r++) {
+					std::vector<std::string> terms;
+					for (unsigned int k = 0; k < inner; k++) {
+						terms.push_back(comp(a, k * rows + r) + " * " + comp(b, c * inner + k));
+					}
+					exprs.push_back(sum(terms));
+				}
+			}
+		}
+		define(inst, exprs);
+	} break;
+
+	case spv::OpTranspose: {
+		uint32_t a        = inst.operand(0);
+		unsigned int cols = m.type(value(a).type).count;
+		unsigned int rows = sizeOf(a) / cols;
+		std::vector<std::string> exprs;
+		for (unsigned int r = 0; r < rows; r++) {
+			for (unsigned int c = 0; c < cols; c++) {
+				exprs.push_back(comp(a, c * rows + r));
+			}
+		}
+		define(inst, exprs);
+	} break;
+
+	case spv::OpDPdx:
+	case spv::OpDPdxFine:
+	case spv::OpDPdxCoarse:
+		componentwise(inst, Scalar::Float, "swDPdx", Scalar::Float);
+		break;
+
+	case spv::OpDPdy:
+	case spv::OpDPdyFine:
+	case spv::OpDPdyCoarse:
+		componentwise(inst, Scalar::Float, "swDPdy", Scalar::Float);
+		break;
+
+	case spv::OpFwidth:
+	case spv::OpFwidthFine:
+	case spv::OpFwidthCoarse:
+		componentwise(inst, Scalar::Float, "swFwidth", Scalar::Float);
+		break;
+
+	case spv::OpExtInst:
+		translateExtension(inst);
+		break;
+
+	case spv::OpSampledImage:
+	case spv::OpImage:
+	case spv::OpImageSampleImplicitLod:
+	case spv::OpImageSampleExplicitLod:
+	case spv::OpImageFetch:
+	case spv::OpImageGather:
+	case spv::OpImageQuerySize:
+	case spv::OpImageQuerySizeLod:
+	case spv::OpImageQueryLevels:
+	case spv::OpImageQuerySamples:
+		translateImage(inst);
+		break;
+
+	default:
+		throw std::runtime_error("Unsupported instruction " + std::to_string(inst.op));
+	}
+}
+
+
+void Translator::translateExtension(const Instruction &inst) {
+	if (inst.operand(0) != m.glslExtension) {
+		throw std::runtime_error("Unknown extended instruction set");
+	}
+
+	// arguments start at operand 2
+	auto arg = [&] (unsigned int a) { return inst.operand(2 + a); };
+
+	const char *fn  = nullptr;
+	Scalar kind     = Scalar::Float;
+	switch (static_cast<GLSLstd450>(inst.operand(1))) {
+	case GLSLstd450Round:          fn = "swRound";          break;
+	case GLSLstd450RoundEven:      fn = "swRoundEven";      break;
+	case GLSLstd450Trunc:          fn = "swTrunc";          break;
+	case GLSLstd450FAbs:           fn = "swAbs";            break;
+	case GLSLstd450FSign:          fn = "swSign";           break;
+	case GLSLstd450Floor:          fn = "swFloor";          break;
+	case GLSLstd450Ceil:           fn = "swCeil";           break;
+	case GLSLstd450Fract:          fn = "swFract";          break;
+	case GLSLstd450Sin:            fn = "swSin";            break;
+	case GLSLstd450Cos:            fn = "swCos";            break;
+	case GLSLstd450Tan:            fn = "swTan";            break;
+	case GLSLstd450Asin:           fn = "swAsin";           break;
+	case GLSLstd450Acos:           fn = "swAcos";           break;
+	case GLSLstd450Atan:           fn = "swAtan";           break;
+	case GLSLstd450Atan2:          fn = "swAtan2";          break;
+	case GLSLstd450Pow:            fn = "swPow";            break;
+	case GLSLstd450Exp:            fn = "swExp";            break;
+	case GLSLstd450Log:            fn = "swLog";            break;
+	case GLSLstd450Exp2:           fn = "swExp2";           break;
+	case GLSLstd450Log2:           fn = "swLog2";           break;
+	case GLSLstd450Sqrt:           fn = "swSqrt";           break;
+	case GLSLstd450InverseSqrt:    fn = "swInverseSqrt";    break;
+	case GLSLstd450FMin:
+	case GLSLstd450NMin:           fn = "swMin";            break;
+	case GLSLstd450FMax:
+	case GLSLstd450NMax:           fn = "swMax";            break;
+	case GLSLstd450FClamp:
+	case GLSLstd450NClamp:         fn = "swClamp";          break;
+	case GLSLstd450FMix:           fn = "swMix";            break;
+	case GLSLstd450Step:           fn = "swStep";           break;
+	case GLSLstd450SmoothStep:     fn = "swSmoothStep";     break;
+	case GLSLstd450SAbs:           fn = "swAbs";     kind = Scalar::Int;   break;
+	case GLSLstd450SSign:          fn = "swSign";    kind = Scalar::Int;   break;
+	case GLSLstd450SMin:           fn = "swMin";     kind = Scalar::Int;   break;
+	case GLSLstd450SMax:           fn = "swMax";     kind = Scalar::Int;   break;
+	case GLSLstd450SClamp:         fn = "swClamp";   kind = Scalar::Int;   break;
+	case GLSLstd450UMin:           fn = "swMin";     kind = Scalar::UInt;  break;
+	case GLSLstd450UMax:           fn = "swMax";     kind = Scalar::UInt;  break;
+	case GLSLstd450UClamp:         fn = "swClamp";   kind = Scalar::UInt;  break;
+
+	case GLSLstd450Fma: {
+		std::vector<std::string> exprs;
+		const auto &kinds = leaves(inst.resultType());
+		for (unsigned int i = 0; i < kinds.size(); i++) {
+			exprs.push_back("(" + comp(arg(0), i) + " * " + comp(arg(1), i) + " + " + comp(arg(2), i) + ")");
+		}
+		define(inst, exprs);
+	} return;
+
+	case GLSLstd450Length:
+	case GLSLstd450Distance:
+	case GLSLstd450Normalize: {
+		std::vector<std::string> v;
+		for (unsigned int i = 0; i < sizeOf(arg(0)); i++) {
+			if (static_cast<GLSLstd450>(inst.operand(1)) == GLSLstd450Distance) {
+				v.push_back("(" + comp(arg(0), i) + " - " + comp(arg(1), i) + ")");
+			} else {
+				v.push_back(comp(arg(0), i));
+			}
+		}
+		std::vector<std::string> terms;
+		for (const auto &c : v) {
+			terms.push_back(c + " * " + c);
+		}
+
+		if (static_cast<GLSLstd450>(inst.operand(1)) != GLSLstd450Normalize) {
+			define(inst, { "swSqrt(" + sum(terms) + ")" });
+		} else {
+			std::vector<std::string> exprs;
+			for (const auto &c : v) {
+				exprs.push_back(c + " * swInverseSqrt(" + sum(terms) + ")");
+			}
+			define(inst, exprs);
+		}
+	} return;
+
+	case GLSLstd450Cross: {
+		auto c = [&] (unsigned int a, unsigned int i) { return comp(arg(a), i); };
+		define(inst, { "(" + c(0, 1) + " * " + c(1, 2) + " - " + c(1, 1) + " * " + c(0, 2) + ")"
+		             , "(" + c(0, 2) + " * " + c(1, 0) + " - " + c(1, 2) + " * " + c(0, 0) + ")"
+		             , "(" + c(0, 0) + " * " + c(1, 1) + " - " + c(1, 0) + " * " + c(0, 1) + ")" });
+	} return;
+
+	case GLSLstd450UnpackSnorm2x16: {
+		std::string a = comp(arg(0), 0, Scalar::UInt);
+		define(inst, { "swUnpackSnorm16(" + a + ", 0)", "swUnpackSnorm16(" + a + ", 16)" });
+	} return;
+
+	case GLSLstd450UnpackUnorm2x16: {
+		std::string a = comp(arg(0), 0, Scalar::UInt);
+		define(inst, { "swUnpackUnorm(" + a + ", 0, 0xFFFFu)", "swUnpackUnorm(" + a + ", 16, 0xFFFFu)" });
+	} return;
+
+	case GLSLstd450UnpackUnorm4x8: {
+		std::string a = comp(arg(0), 0, Scalar::UInt);
+		define(inst, { "swUnpackUnorm(" + a + ", 0, 0xFFu)", "swUnpackUnorm(" + a + ", 8, 0xFFu)"
+		             , "swUnpackUnorm(" + a + ", 16, 0xFFu)", "swUnpackUnorm(" + a + ", 24, 0xFFu)" });
+	} return;
+
+	default:
+		throw std::runtime_error("Unsupported GLSL.std.450 instruction " + std::to_string(inst.operand(1)));
+	}
+
+	componentwise(inst, kind, fn, kind, 2);
+}
+
+
+void Translator::translateImage(const Instruction &inst) {
+	auto handle = [&] (uint32_t id) {
+		const Value &v = value(id);
+		if (v.kind != Value::Kind::Handle) {
+			throw std::runtime_error("Expected an image or sampler as " + std::to_string(id));
+		}
+		usesResources = true;
+		return v.handle;
+	};
+
+	// constant offset from the optional image operands starting at operand first
+	auto offset = [&] (unsigned int first) {
+		std::string o = "0, 0";
+		if (inst.numOperands() <= first) {
+			return o;
+		}
+		uint32_t mask = inst.operand(first);
+		unsigned int next = first + 1;
+		for (uint32_t bit = 1; bit <= mask; bit <<= 1) {
+			if (!(mask & bit)) {
+				continue;
+			}
+			switch (bit) {
+			case spv::ImageOperandsBiasMask:
+			case spv::ImageOperandsLodMask:
+			case spv::ImageOperandsSampleMask:
+			case spv::ImageOperandsMinLodMask:
+				// only level 0 and one sample exist
+				next++;
+				break;
+
+			case spv::ImageOperandsGradMask:
+				next += 2;
+				break;
+
+			case spv::ImageOperandsConstOffsetMask: {
+				const Instruction &c = m.constants.at(inst.operand(next));
+				o = std::to_string(static_cast<int32_t>(m.constant(c.operand(0)))) + ", " + std::to_string(static_cast<int32_t>(m.constant(c.operand(1))));
+				next++;
+			} break;
+
+			default:
+				throw std::runtime_error("Unsupported image operand " + std::to_string(bit));
+			}
+		}
+		return o;
+	};
+
+	switch (inst.op) {
+	case spv::OpSampledImage: {
+		Handle h          = handle(inst.operand(0));
+		Handle sampler    = handle(inst.operand(1));
+		h.samplerSet      = sampler.samplerSet;
+		h.samplerBinding  = sampler.samplerBinding;
+		defineHandle(inst.result(), h);
+	} return;
+
+	case spv::OpImage:
+		defineHandle(inst.result(), handle(inst.operand(0)));
+		return;
+
+	case spv::OpImageQuerySize:
+	case spv::OpImageQuerySizeLod: {
+		Handle h = handle(inst.operand(0));
+		if (sizeOf(inst.result()) != 2) {
+			throw std::runtime_error("Only 2D image sizes are supported");
+		}
+		define(inst, { "SWInt(static_cast<int32_t>(" + h.image() + ".width))", "SWInt(static_cast<int32_t>(" + h.image() + ".height))" });
+	} return;
+
+	case spv::OpImageQueryLevels:
+	case spv::OpImageQuerySamples:
+		handle(inst.operand(0));
+		define(inst, { literal(Scalar::Int, 1) });
+		return;
+
+	default:
+		break;
+	}
+
+	Handle h        = handle(inst.operand(0));
+	uint32_t coord  = inst.operand(1);
+	std::string call;
+	switch (inst.op) {
+	case spv::OpImageSampleImplicitLod:
+	case spv::OpImageSampleExplicitLod:
+		call = "swTexture(" + h.image() + ", " + h.filter() + ", " + comp(coord, 0, Scalar::Float) + ", " + comp(coord, 1, Scalar::Float) + ", " + offset(2) + ", t);";
+		break;
+
+	case spv::OpImageFetch:
+		call = "swTexelFetch(" + h.image() + ", " + comp(coord, 0, Scalar::Int) + ", " + comp(coord, 1, Scalar::Int) + ", t);";
+		break;
+
+	case spv::OpImageGather:
+		call = "swTextureGather(" + h.image() + ", " + comp(coord, 0, Scalar::Float) + ", " + comp(coord, 1, Scalar::Float) + ", " + std::to_string(m.constant(inst.operand(2))) + ", " + offset(3) + ", t);";
+		break;
+
+	default:
+		throw std::runtime_error("Unsupported image instruction");
+	}
+
+	line("{");
+	indent++;
+	line("SWFloat t[4];");
+	line(call);
+	const auto &kinds = leaves(inst.resultType());
+	std::vector<std::string> exprs;
+	for (unsigned int i = 0; i < kinds.size(); i++) {
+		exprs.push_back(view("t[" + std::to_string(i) + "]", Scalar::Float, kinds[i]));
+	}
+	define(inst, exprs);
+	indent--;
+	line("}");
+}
+
+
+// lanes in mask go from the current block to target
+void Translator::edge(uint32_t target, const std::string &mask) {
+	unsigned int t = blockIndex.at(target);
+	std::string targetMask = "m" + std::to_string(t);
+	line(targetMask + " = " + targetMask + " | " + mask + ";");
+	if (phis[t].empty()) {
+		return;
+	}
+
+	line("{");
+	indent++;
+	std::string e = mask;
+	if (mask != "cur") {
+		line("const SWBool e = " + mask + ";");
+		e = "e";
+	}
+
+	// incoming values can be other phis of the same block which must be read before any is written
+	uint32_t label = m.blocks[currentBlock].label;
+	std::vector<std::pair<const Instruction *, uint32_t> > incoming;
+	bool swap = false;
+	for (const Instruction *phi : phis[t]) {
+		uint32_t v = 0;
+		for (unsigned int j = 2; j + 1 < phi->words.size(); j += 2) {
+			if (phi->words[j + 1] == label) {
+				v = phi->words[j];
+			}
+		}
+		if (!v) {
+			throw std::runtime_error("Phi has no value for predecessor");
+		}
+		incoming.emplace_back(phi, v);
+
+		auto d = defBlock.find(v);
+		if (d != defBlock.end() && d->second == t && values.count(v) && v != phi->result()) {
+			for (const Instruction *other : phis[t]) {
+				swap = swap || (other->result() == v);
+			}
+		}
+	}
+
+	unsigned int temp = 0;
+	std::vector<std::vector<std::string> > sources;
+	for (const auto &in : incoming) {
+		std::vector<std::string> comps = value(in.second).comps;
+		if (swap) {
+			const auto &kinds = leaves(in.first->resultType());
+			for (unsigned int i = 0; i < comps.size(); i++) {
+				std::string name = "t" + std::to_string(temp++);
+				line("const " + std::string(laneType(kinds[i])) + " " + name + " = " + comps[i] + ";");
+				comps[i] = name;
+			}
+		}
+		sources.push_back(std::move(comps));
+	}
+
+	for (unsigned int p = 0; p < incoming.size(); p++) {
+		const auto &dst = values.at(incoming[p].first->result()).comps;
+		for (unsigned int i = 0; i < dst.size(); i++) {
+			if (dst[i] != sources[p][i]) {
+				line(dst[i] + " = swSelect(" + e + ", " + sources[p][i] + ", " + dst[i] + ");");
+			}
+		}
+	}
+
+	indent--;
+	line("}");
+}
+
+
+void Translator::translateBlocks(unsigned int begin, unsigned int end) {
+	for (unsigned int i = begin; i < end; ) {
+		if (!m.blocks[i].loopMerge) {
+			translateBlock(i);
+			i++;
+			continue;
+		}
+
+		// loop until no lane takes a back edge
+		line("do {");
+		indent++;
+		translateBlock(i);
+		translateBlocks(i + 1, loopEnd[i]);
+		indent--;
+		line("} while (swAny(m" + std::to_string(i) + "));");
+		i = loopEnd[i];
+	}
+}
+
+
+void Translator::translateBlock(unsigned int index) {
+	currentBlock = index;
+	std::string outer;
+	std::swap(outer, body);
+	indent++;
+
+	const Block &block = m.blocks.at(index);
+	std::string mask   = "m" + std::to_string(index);
+	if (index != 0) {
+		line(mask + " = SWBool();");
+	}
+
+	for (const auto &inst : block.instructions) {
+		const auto &w = inst.words;
+		switch (inst.op) {
+		case spv::OpBranch:
+			edge(w[0], "cur");
+			break;
+
+		case spv::OpBranchConditional: {
+			const std::string &c = comp(w[0], 0);
+			if (w[1] == w[2]) {
+				edge(w[1], "cur");
+			} else {
+				edge(w[1], "(cur & " + c + ")");
+				edge(w[2], "swAndNot(cur, " + c + ")");
+			}
+		} break;
+
+		case spv::OpSwitch: {
+			Scalar kind = kindOf(w[0]);
+			std::string any;
+			for (unsigned int j = 2; j + 1 < w.size(); j += 2) {
+				std::string match = "(" + comp(w[0], 0) + " == " + literal(kind, w[j]) + ")";
+				edge(w[j + 1], "(cur & " + match + ")");
+				any = any.empty() ? match : "(" + any + " | " + match + ")";
+			}
+			edge(w[1], any.empty() ? "cur" : "swAndNot(cur, " + any + ")");
+		} break;
+
+		case spv::OpReturn:
+		case spv::OpUnreachable:
+			// lanes just don't continue anywhere
+			break;
+
+		case spv::OpKill:
+			if (stage != Stage::Fragment) {
+				throw std::runtime_error("Kill outside a fragment shader");
+			}
+			line("io.mask = swAndNot(io.mask, cur);");
+			break;
+
+		case spv::OpReturnValue:
+			throw std::runtime_error("Entry point can't return a value");
+
+		default:
+			translateInstruction(inst);
+			break;
+		}
+	}
+
+	indent--;
+	std::swap(outer, body);
+
+	// the entry block runs once with all lanes, others when any lane got there
+	if (index == 0) {
+		line("{");
+	} else {
+		line("if (swAny(" + mask + ")) {");
+	}
+	if (outer.find("cur") != std::string::npos) {
+		indent++;
+		line(std::string("const SWBool cur") + ((index == 0) ? "(true);" : " = " + mask + ";"));
+		indent--;
+	}
+	body += outer;
+	line("}");
+}
+
+
+Translation Translator::translate(const std::string &functionName) {
+	analyze();
+
+	// globals, sorted to keep the output stable
+	std::vector<uint32_t> ids;
+	for (const auto &v : m.variables) {
+		ids.push_back(v.first);
+	}
+	std::sort(ids.begin(), ids.end());
+
+	for (uint32_t id : ids) {
+		const Instruction &var = m.variables.at(id);
+		const Type &pointer    = m.type(var.resultType());
+		Decorations d          = m.decoration(id);
+		switch (pointer.storage) {
+		case spv::StorageClassInput:
+		case spv::StorageClassOutput: {
+			setupInterface(id, var);
+			Pointer p;
+			p.kind     = Pointer::Kind::Interface;
+			p.variable = id;
+			p.type     = pointer.element;
+			definePointer(id, p);
+		} break;
+
+		case spv::StorageClassUniform:
+		case spv::StorageClassStorageBuffer: {
+			if (d.set < 0 || d.binding < 0) {
+				throw std::runtime_error("Buffer without set or binding");
+			}
+			Pointer p;
+			p.kind     = Pointer::Kind::Buffer;
+			p.variable = id;
+			p.type     = pointer.element;
+			p.set      = d.set;
+			p.binding  = d.binding;
+			definePointer(id, p);
+			prologue.push_back("const char *buf" + std::to_string(d.set) + "_" + std::to_string(d.binding) + " = res.sets[" + std::to_string(d.set) + "][" + std::to_string(d.binding) + "].data;");
+			usesResources = true;
+		} break;
+
+		case spv::StorageClassUniformConstant: {
+			Handle h;
+			spv::Op op = m.type(pointer.element).op;
+			if (op == spv::OpTypeImage || op == spv::OpTypeSampledImage) {
+				h.imageSet       = d.set;
+				h.imageBinding   = d.binding;
+			}
+			if (op == spv::OpTypeSampler || op == spv::OpTypeSampledImage) {
+				h.samplerSet     = d.set;
+				h.samplerBinding = d.binding;
+			}
+			if (d.set < 0 || d.binding < 0 || (h.imageSet < 0 && h.samplerSet < 0)) {
+				throw std::runtime_error("Unsupported uniform constant");
+			}
+			defineHandle(id, h);
+		} break;
+
+		case spv::StorageClassPrivate: {
+			Instruction local = var;
+			local.op          = spv::OpVariable;
+			translateInstruction(local);
+		} break;
+
+		default:
+			throw std::runtime_error("Unsupported storage class " + std::to_string(pointer.storage));
+		}
+	}
+
+	translateBlocks(0, static_cast<unsigned int>(m.blocks.size()));
+
+	// sanity checks against the io structs
+	std::string code;
+	const char *io = (stage == Stage::Vertex) ? "SWVertexLanes" : "SWQuad";
+	if (result.numVaryings) {
+		code += "static_assert(" + std::to_string(result.numVaryings) + " <= SW_MAX_VARYINGS, \"" + functionName + " has too many varyings\");\n";
+	}
+	if (maxAttrib) {
+		code += "static_assert(" + std::to_string(maxAttrib) + " <= MAX_VERTEX_ATTRIBS, \"" + functionName + " has too many attributes\");\n";
+	}
+	if (maxColor) {
+		code += "static_assert(" + std::to_string(maxColor) + " <= MAX_COLOR_RENDERTARGETS, \"" + functionName + " has too many outputs\");\n";
+	}
+	if (!code.empty()) {
+		code += "\n\n";
+	}
+
+	code += std::string("static void ") + functionName + "(const SWResources &" + (usesResources ? "res" : "/* res */") + ", " + io + " &io) {\n";
+
+	// declarations of each type on as few lines as is readable
+	std::vector<std::pair<Scalar, std::string> > decls = declarations;
+	for (unsigned int i = 1; i < m.blocks.size(); i++) {
+		decls.emplace_back(Scalar::Bool, "m" + std::to_string(i));
+	}
+	for (Scalar kind : { Scalar::Float, Scalar::Int, Scalar::UInt, Scalar::Bool }) {
+		std::string l;
+		for (const auto &decl : decls) {
+			if (decl.first != kind) {
+				continue;
+			}
+			if (l.size() + decl.second.size() > 110) {
+				code += l + ";\n";
+				l.clear();
+			}
+			l += l.empty() ? "\t" + std::string(laneType(kind)) + " " + decl.second : ", " + decl.second;
+		}
+		if (!l.empty()) {
+			code += l + ";\n";
+		}
+	}
+	if (!decls.empty()) {
+		code += "\n";
+	}
+
+	for (const auto &p : prologue) {
+		code += "\t" + p + "\n";
+	}
+	if (!prologue.empty()) {
+		code += "\n";
+	}
+
+	code += body;
+	code += "}\n";
+
+	result.code = std::move(code);
+	return result;
+}
+
+
+struct Generated {
+	std::string  key;
+	Stage        stage;
+	std::string  function;
+	Translation  translation;
+};
+
+
+static std::string generate(const std::string &sourceDir) {
+	std::vector<Generated> shaders;
+	// many permutations only differ in macros the shader doesn't use
+	std::map<std::vector<uint32_t>, unsigned int> unique;
+	std::map<std::string, unsigned int> counts;
+	std::string functions;
+
+	for (const auto &p : permutations()) {
+		std::vector<uint32_t> spirv = compile(sourceDir, p);
+
+		Generated g;
+		g.key   = shaderKey(p);
+		g.stage = p.stage;
+
+		auto it = unique.find(spirv);
+		if (it != unique.end()) {
+			g.function    = shaders[it->second].function;
+			g.translation = shaders[it->second].translation;
+		} else {
+			std::string prefix = p.name + ((p.stage == Stage::Vertex) ? "Vertex" : "Fragment");
+			g.function         = prefix + std::to_string(counts[prefix]++);
+
+			try {
+				Module module(spirv);
+				Translator translator(module, p.stage);
+				g.translation = translator.translate(g.function);
+			} catch (std::exception &e) {
+				throw std::runtime_error("Shader " + g.key + ": " + e.what());
+			}
+			unique.emplace(std::move(spirv), static_cast<unsigned int>(shaders.size()));
+
+			functions += "// " + g.key + "\n";
+			functions += g.translation.code;
+			functions += "\n\n";
+		}
+
+		shaders.push_back(std::move(g));
+	}
+
+	std::string out;
+	out += "// generated by swShaderGen from the GLSL shaders, don't edit\n";
+	out += "\n\n";
+	out += "#include \"renderer/RendererInternal.h\"\n";
+	out += "\n\n";
+	out += "#ifdef RENDERER_SOFTWARE\n";
+	out += "\n\n";
+	out += "#include <limits>\n";
+	out += "\n\n";
+	out += "namespace renderer {\n";
+	out += "\n\n";
+	out += functions;
+	out += "const SWShaderInfo swShaders[] = {\n";
+	for (unsigned int i = 0; i < shaders.size(); i++) {
+		const auto &g = shaders[i];
+		char flat[16];
+		snprintf(flat, sizeof(flat), "0x%02x", g.translation.flatVaryings);
+		out += (i == 0) ? "\t  { \"" : "\t, { \"";
+		out += g.key + "\", ";
+		out += (g.stage == Stage::Vertex) ? g.function + ", nullptr, " : "nullptr, " + g.function + ", ";
+		out += std::to_string(g.translation.numVaryings) + ", " + flat + " }\n";
+	}
+	out += "};\n";
+	out += "\n\n";
+	out += "const unsigned int swNumShaders = sizeof(swShaders) / sizeof(swShaders[0]);\n";
+	out += "\n\n";
+	out += "} // namespace renderer\n";
+	out += "\n\n";
+	out += "#endif  // RENDERER_SOFTWARE\n";
+
+	return out;
+}
+
+
+int main(int argc, char *argv[]) {
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s <shader source dir> <output file>\n", argv[0]);
+		return 1;
+	}
+
+	try {
+		std::string out = generate(argv[1]);
+
+		// only written on success so a failed run gets retried by make
+		std::ofstream f(argv[2], std::ios::binary | std::ios::trunc);
+		f << out;
+		f.close();
+		if (!f) {
+			throw std::runtime_error(std::string("Failed to write \"") + argv[2] + "\"");
+		}
+	} catch (std::exception &e) {
+		fprintf(stderr, "%s\n", e.what());
+		remove(argv[2]);
+		return 1;
+	}
+
+	return 0;
+}
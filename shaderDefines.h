@@ -42,6 +42,9 @@ layout(set = 0, binding = 0, std140) uniform Globals
 	float predicationScale;
 	float predicationStrength;
 	float reprojWeigthScale;
+
+	// x is distance between cube centers, y is position of grid index 0
+	vec4 cubeGrid;
 };
 
 
@@ -63,3 +66,14 @@ struct Cube {
 	vec3   color;
 	float  pad1;
 };
+
+
+// compact alternative to Cube used when PACKED_CUBES is defined
+// x: rotation x and y as snorm16
+// y: rotation z as snorm16, grid index x in high half
+//    rotation w is reconstructed and always non-negative
+// z: grid index y and z
+// w: linear RGB as 10 bits per channel
+struct PackedCube {
+	uvec4  data;
+};
@@ -0,0 +1,95 @@
+/*
+Copyright (c) 2015-2018 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// replacement operator new lives in its own file and uses nothing
+// which could allocate, so it can't recurse into itself
+
+
+#include <cstdlib>
+
+#include <atomic>
+#include <new>
+
+#include "Allocations.h"
+
+
+namespace {
+
+
+std::atomic<uint64_t>  allocations(0);
+
+// zero initialized, no constructor so it's safe to touch from operator new
+thread_local uint64_t  threadAllocations = 0;
+
+
+void countAllocation() {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	threadAllocations++;
+}
+
+
+}  // namespace
+
+
+uint64_t allocationCount() {
+	return allocations.load(std::memory_order_relaxed);
+}
+
+
+uint64_t threadAllocationCount() {
+	return threadAllocations;
+}
+
+
+void *countedMalloc(size_t size) {
+	countAllocation();
+	return malloc(size);
+}
+
+
+void countedFree(void *ptr) {
+	free(ptr);
+}
+
+
+// replace global new and delete to count allocations
+// the array and nothrow versions call these by default
+
+void *operator new(size_t size) {
+	countAllocation();
+	void *ptr = malloc(size ? size : 1);
+	if (!ptr) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+
+void operator delete(void *ptr) noexcept {
+	free(ptr);
+}
+
+
+void operator delete(void *ptr, size_t /* size */) noexcept {
+	free(ptr);
+}
@@ -0,0 +1,49 @@
+/*
+Copyright (c) 2015-2018 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef ALLOCATIONS_H
+#define ALLOCATIONS_H
+
+
+#include <cstddef>
+#include <cstdint>
+
+
+// global operator new is replaced to count heap allocations
+// plain malloc calls are not counted unless they go through countedMalloc
+
+// number of allocations by any thread
+uint64_t allocationCount();
+
+// number of allocations by the calling thread
+// compare before and after a frame on the rendering thread to check it
+// didn't allocate, background jobs don't show up here
+uint64_t threadAllocationCount();
+
+// malloc and free which are included in the counts
+// for libraries with their own allocator hooks
+void *countedMalloc(size_t size);
+void countedFree(void *ptr);
+
+
+#endif  // ALLOCATIONS_H
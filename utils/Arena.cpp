@@ -0,0 +1,64 @@
+/*
+Copyright (c) 2015-2018 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include <algorithm>
+
+#include "Arena.h"
+
+
+void *LinearArena::allocate(size_t size, size_t alignment) {
+	assert(alignment != 0);
+	assert((alignment & (alignment - 1)) == 0);
+
+	while (current < blocks.size()) {
+		Block &block = blocks[current];
+		uintptr_t base    = reinterpret_cast<uintptr_t>(block.data.get());
+		uintptr_t aligned = (base + used + alignment - 1) & ~uintptr_t(alignment - 1);
+		size_t    offset  = aligned - base;
+		if (offset + size <= block.size) {
+			used = offset + size;
+			return block.data.get() + offset;
+		}
+
+		// doesn't fit, rest of this block is wasted until reset
+		current++;
+		used = 0;
+	}
+
+	// out of blocks, add one big enough for this
+	// blocks are kept so this stops happening once the arena has grown enough
+	blocks.emplace_back(std::max(blockSize, size + alignment));
+	current = blocks.size() - 1;
+	used    = 0;
+	return allocate(size, alignment);
+}
+
+
+size_t LinearArena::capacity() const {
+	size_t total = 0;
+	for (const auto &b : blocks) {
+		total += b.size;
+	}
+	return total;
+}
+
@@ -0,0 +1,142 @@
+/*
+Copyright (c) 2015-2018 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef ARENA_H
+#define ARENA_H
+
+
+#include <cassert>
+#include <cinttypes>
+#include <cstddef>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+
+// bump allocator for short lived temporaries
+// individual allocations are never freed, reset releases everything at once
+// blocks are kept across reset so once it has grown big enough it stops allocating
+class LinearArena {
+	struct Block {
+		std::unique_ptr<char[]>  data;
+		size_t                   size;
+
+
+		explicit Block(size_t size_)
+		: data(new char[size_])
+		, size(size_)
+		{
+		}
+	};
+
+	size_t              blockSize;
+	std::vector<Block>  blocks;
+	// index of block we're allocating from
+	size_t              current;
+	// offset of first free byte in current block
+	size_t              used;
+
+
+public:
+
+	explicit LinearArena(size_t blockSize_ = 64 * 1024)
+	: blockSize(blockSize_)
+	, current(0)
+	, used(0)
+	{
+	}
+
+
+	// alignment must be a power of two
+	void *allocate(size_t size, size_t alignment);
+
+
+	void reset() {
+		current = 0;
+		used    = 0;
+	}
+
+
+	// bytes in all blocks
+	size_t capacity() const;
+
+
+	LinearArena(const LinearArena &)            = delete;
+	LinearArena &operator=(const LinearArena &) = delete;
+	LinearArena(LinearArena &&)                 = delete;
+	LinearArena &operator=(LinearArena &&)      = delete;
+};
+
+
+// STL allocator which takes memory from a LinearArena
+// containers using it must not outlive the arena's next reset
+template <typename T> class ArenaAllocator {
+	template <typename U> friend class ArenaAllocator;
+
+	LinearArena  *arena;
+
+
+public:
+
+	typedef T value_type;
+
+
+	explicit ArenaAllocator(LinearArena &arena_)
+	: arena(&arena_)
+	{
+	}
+
+
+	template <typename U> ArenaAllocator(const ArenaAllocator<U> &other)
+	: arena(other.arena)
+	{
+	}
+
+
+	T *allocate(size_t n) {
+		return reinterpret_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+	}
+
+
+	void deallocate(T * /* p */, size_t /* n */) {
+		// freed when the arena is reset
+	}
+
+
+	template <typename U> bool operator==(const ArenaAllocator<U> &other) const {
+		return arena == other.arena;
+	}
+
+
+	template <typename U> bool operator!=(const ArenaAllocator<U> &other) const {
+		return arena != other.arena;
+	}
+};
+
+
+template <typename T> using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char> > ArenaString;
+
+
+#endif  // ARENA_H
@@ -0,0 +1,570 @@
+/*
+Copyright (c) 2015-2018 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include <cassert>
+
+#include <array>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+
+#else  // _WIN32
+
+#include <pthread.h>
+
+#endif  // _WIN32
+
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "Utils.h"
+
+
+// mingw fuckery...
+#if defined(__GNUC__) && defined(_WIN32)
+
+#include <mingw.thread.h>
+#include <mingw.mutex.h>
+#include <mingw.condition_variable.h>
+
+#endif  // defined(__GNUC__) && defined(_WIN32)
+
+
+namespace {
+
+
+// must be pow2
+static const unsigned int jobsPerThread  = 4096;
+static const unsigned int dequeSize      = 4096;
+static const unsigned int backgroundSize = 256;
+
+
+// Chase-Lev deque
+// owner pushes and pops at bottom, other threads steal from top
+// fixed size, push fails when full and the caller runs the job itself
+class JobDeque {
+	std::atomic<int64_t>                   top;
+	std::atomic<int64_t>                   bottom;
+	std::array<std::atomic<Job *>, dequeSize>  jobs;
+
+
+public:
+
+	JobDeque()
+	: top(0)
+	, bottom(0)
+	{
+		for (auto &j : jobs) {
+			j.store(nullptr, std::memory_order_relaxed);
+		}
+	}
+
+
+	bool push(Job *job) {
+		int64_t b = bottom.load(std::memory_order_relaxed);
+		int64_t t = top.load(std::memory_order_acquire);
+		if (b - t >= int64_t(dequeSize)) {
+			return false;
+		}
+
+		jobs[b & (dequeSize - 1)].store(job, std::memory_order_relaxed);
+		bottom.store(b + 1, std::memory_order_release);
+		return true;
+	}
+
+
+	Job *pop() {
+		int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = top.load(std::memory_order_relaxed);
+
+		if (t > b) {
+			// empty
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		Job *job = jobs[b & (dequeSize - 1)].load(std::memory_order_relaxed);
+		if (t == b) {
+			// last one, race against thieves
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+				job = nullptr;
+			}
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return job;
+	}
+
+
+	Job *steal() {
+		int64_t t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t b = bottom.load(std::memory_order_acquire);
+		if (t >= b) {
+			return nullptr;
+		}
+
+		Job *job = jobs[t & (dequeSize - 1)].load(std::memory_order_relaxed);
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+			return nullptr;
+		}
+		return job;
+	}
+
+
+	bool empty() const {
+		return top.load(std::memory_order_acquire) >= bottom.load(std::memory_order_acquire);
+	}
+
+
+	JobDeque(const JobDeque &)            = delete;
+	JobDeque &operator=(const JobDeque &) = delete;
+	JobDeque(JobDeque &&)                 = delete;
+	JobDeque &operator=(JobDeque &&)      = delete;
+};
+
+
+struct JobThread {
+	unsigned int                          index;
+	JobDeque                              deque;
+	std::array<Job, jobsPerThread>        pool;
+	unsigned int                          nextJob;
+	// for picking steal victims
+	uint32_t                              randomState;
+
+
+	explicit JobThread(unsigned int index_)
+	: index(index_)
+	, nextJob(0)
+	, randomState(index_ * 2654435761U + 1)
+	{
+	}
+
+
+	JobThread(const JobThread &)            = delete;
+	JobThread &operator=(const JobThread &) = delete;
+	JobThread(JobThread &&)                 = delete;
+	JobThread &operator=(JobThread &&)      = delete;
+};
+
+
+// threads[0] is the one which called jobSystemInit
+std::vector<std::unique_ptr<JobThread>>  threads;
+std::vector<std::thread>                 workers;
+std::atomic<bool>                        running(false);
+
+thread_local JobThread                  *currentThread = nullptr;
+
+// background jobs, only taken by workers
+std::mutex                               backgroundMutex;
+std::array<Job *, backgroundSize>        backgroundJobs;
+unsigned int                             backgroundBegin = 0;
+unsigned int                             backgroundCount = 0;
+
+// idle workers sleep here
+std::mutex                               sleepMutex;
+std::condition_variable                  sleepCV;
+std::atomic<unsigned int>                sleepingThreads(0);
+uint64_t                                 wakeGeneration = 0;
+bool                                     quitWorkers    = false;
+
+
+void wakeWorkers(bool all) {
+	// pairs with the fence in workerThread
+	// either we see it sleeping or it sees our job
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (sleepingThreads.load(std::memory_order_relaxed) == 0) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		wakeGeneration++;
+	}
+	if (all) {
+		sleepCV.notify_all();
+	} else {
+		sleepCV.notify_one();
+	}
+}
+
+
+// xorshift, only needs to spread steal attempts around
+unsigned int randomVictim(JobThread &self) {
+	uint32_t x = self.randomState;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	self.randomState = x;
+	return x % threads.size();
+}
+
+
+Job *stealJob(JobThread &self) {
+	unsigned int numThreads = static_cast<unsigned int>(threads.size());
+	unsigned int first = randomVictim(self);
+	for (unsigned int i = 0; i < numThreads; i++) {
+		unsigned int victim = (first + i) % numThreads;
+		if (victim == self.index) {
+			continue;
+		}
+
+		Job *job = threads[victim]->deque.steal();
+		if (job) {
+			return job;
+		}
+	}
+
+	return nullptr;
+}
+
+
+Job *takeBackgroundJob() {
+	std::lock_guard<std::mutex> lock(backgroundMutex);
+	if (backgroundCount == 0) {
+		return nullptr;
+	}
+
+	Job *job = backgroundJobs[backgroundBegin];
+	backgroundBegin = (backgroundBegin + 1) % backgroundSize;
+	backgroundCount--;
+	return job;
+}
+
+
+Job *findJob(JobThread &self, bool background) {
+	Job *job = self.deque.pop();
+	if (!job) {
+		job = stealJob(self);
+	}
+	if (!job && background) {
+		job = takeBackgroundJob();
+	}
+	return job;
+}
+
+
+bool haveWork() {
+	for (const auto &t : threads) {
+		if (!t->deque.empty()) {
+			return true;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(backgroundMutex);
+	return backgroundCount > 0;
+}
+
+
+void pushJob(Job *job) {
+	JobThread *self = currentThread;
+	assert(self);
+	if (!self->deque.push(job)) {
+		// full, don't wait for space
+		job->function(job->storage);
+		jobFinished(job);
+		return;
+	}
+	wakeWorkers(false);
+}
+
+
+void pinThread(unsigned int index) {
+	unsigned int numCores = std::max(1U, std::thread::hardware_concurrency());
+	unsigned int core     = index % numCores;
+
+#if defined(_WIN32)
+
+	if (core < 64) {
+		SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core);
+	}
+
+#elif defined(__linux__)
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core, &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+		LOG("Failed to pin job thread %u to core %u\n", index, core);
+	}
+
+#else
+
+	STUBBED("thread affinity");
+	(void) core;
+
+#endif
+}
+
+
+void workerThread(unsigned int index, bool pin) {
+	std::string name = "worker " + std::to_string(index);
+	profilerSetThreadName(name.c_str());
+	if (pin) {
+		pinThread(index);
+	}
+
+	JobThread &self = *threads[index];
+	currentThread   = &self;
+
+	while (true) {
+		Job *job = findJob(self, true);
+		if (job) {
+			job->function(job->storage);
+			jobFinished(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		if (quitWorkers) {
+			break;
+		}
+
+		// check again after announcing we're going to sleep
+		// so a job pushed in between can't be missed
+		uint64_t generation = wakeGeneration;
+		sleepingThreads.fetch_add(1, std::memory_order_relaxed);
+		lock.unlock();
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		bool work = haveWork();
+		lock.lock();
+		if (!work) {
+			sleepCV.wait(lock, [&] () { return quitWorkers || wakeGeneration != generation; });
+		}
+		sleepingThreads.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	currentThread = nullptr;
+}
+
+
+}  // namespace
+
+
+void jobFinished(Job *job) {
+	JobCounter *counter = job->counter;
+	job->counter        = nullptr;
+	job->finished.store(true, std::memory_order_release);
+
+	// last one releases everything waiting on the counter
+	// nothing may touch counter after unlock, a waiting thread can destroy it
+	counter->lock();
+	Job *waiting = nullptr;
+	if (counter->count.fetch_sub(1, std::memory_order_seq_cst) == 1) {
+		waiting          = counter->waiting;
+		counter->waiting = nullptr;
+	}
+	counter->unlock();
+
+	while (waiting) {
+		Job *next = waiting->nextWaiting;
+		waiting->nextWaiting = nullptr;
+		pushJob(waiting);
+		waiting = next;
+	}
+}
+
+
+void jobSystemInit(unsigned int numThreads, bool pinThreads) {
+	assert(!running);
+	assert(threads.empty());
+
+	if (numThreads == 0) {
+		numThreads = std::max(1U, std::thread::hardware_concurrency());
+	}
+
+	threads.reserve(numThreads);
+	for (unsigned int i = 0; i < numThreads; i++) {
+		threads.emplace_back(new JobThread(i));
+	}
+
+	currentThread = threads[0].get();
+	if (pinThreads) {
+		pinThread(0);
+	}
+
+	quitWorkers = false;
+	workers.reserve(numThreads - 1);
+	for (unsigned int i = 1; i < numThreads; i++) {
+		workers.emplace_back(workerThread, i, pinThreads);
+	}
+
+	running.store(true, std::memory_order_release);
+	LOG("Job system using %u threads\n", numThreads);
+}
+
+
+void jobSystemShutdown() {
+	if (!running) {
+		return;
+	}
+
+	running.store(false, std::memory_order_release);
+
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		quitWorkers = true;
+		wakeGeneration++;
+	}
+	sleepCV.notify_all();
+
+	for (auto &t : workers) {
+		t.join();
+	}
+	workers.clear();
+
+	currentThread = nullptr;
+	threads.clear();
+	backgroundBegin = 0;
+	backgroundCount = 0;
+}
+
+
+unsigned int jobSystemNumThreads() {
+	if (!running.load(std::memory_order_acquire)) {
+		return 1;
+	}
+
+	return static_cast<unsigned int>(threads.size());
+}
+
+
+void jobWait(JobCounter &counter) {
+	JobThread *self = currentThread;
+	while (!counter.done()) {
+		Job *job = self ? findJob(*self, false) : nullptr;
+		if (job) {
+			job->function(job->storage);
+			jobFinished(job);
+		} else {
+			// the rest are running on other threads
+			std::this_thread::yield();
+		}
+	}
+}
+
+
+bool jobHelp() {
+	JobThread *self = currentThread;
+	if (!self) {
+		return false;
+	}
+
+	Job *job = findJob(*self, false);
+	if (!job) {
+		return false;
+	}
+
+	job->function(job->storage);
+	jobFinished(job);
+	return true;
+}
+
+
+Job *jobAllocate() {
+	JobThread *self = currentThread;
+	if (!self) {
+		return nullptr;
+	}
+
+	// skip slots still in use, a long background job can hold one for a while
+	while (true) {
+		for (unsigned int i = 0; i < jobsPerThread; i++) {
+			Job *job = &self->pool[self->nextJob];
+			self->nextJob = (self->nextJob + 1) % jobsPerThread;
+			if (job->finished.load(std::memory_order_acquire)) {
+				job->finished.store(false, std::memory_order_relaxed);
+				return job;
+			}
+		}
+
+		// only happens with more than jobsPerThread jobs in flight
+		if (!jobHelp()) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+
+bool jobSubmit(Job *job, JobCounter &counter, JobCounter *dependency, bool background) {
+	assert(job);
+	assert(!job->counter);
+	assert(!job->nextWaiting);
+
+	job->counter = &counter;
+
+	if (background) {
+		assert(!dependency);
+
+		if (workers.empty()) {
+			counter.count.fetch_add(1, std::memory_order_relaxed);
+			job->function(job->storage);
+			jobFinished(job);
+			return true;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(backgroundMutex);
+			if (backgroundCount == backgroundSize) {
+				// running it here would stall the caller, let it retry instead
+				// counter was never touched so nothing waiting on it is affected
+				job->counter = nullptr;
+				job->finished.store(true, std::memory_order_release);
+				return false;
+			}
+
+			// before a worker can take it
+			counter.count.fetch_add(1, std::memory_order_relaxed);
+			backgroundJobs[(backgroundBegin + backgroundCount) % backgroundSize] = job;
+			backgroundCount++;
+		}
+
+		wakeWorkers(false);
+		return true;
+	}
+
+	counter.count.fetch_add(1, std::memory_order_relaxed);
+
+	if (dependency) {
+		dependency->lock();
+		if (dependency->count.load(std::memory_order_seq_cst) != 0) {
+			job->nextWaiting    = dependency->waiting;
+			dependency->waiting = job;
+			dependency->unlock();
+			return true;
+		}
+		dependency->unlock();
+	}
+
+	pushJob(job);
+	return true;
+}
@@ -0,0 +1,226 @@
+/*
+Copyright (c) 2015-2018 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+
+#include <cassert>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <type_traits>
+
+
+// work stealing job scheduler
+//
+// the thread calling jobSystemInit and the workers it starts each own a deque
+// jobs are pushed to the submitting thread's deque, idle threads steal from others
+// jobs come from fixed per-thread pools so running one doesn't allocate
+//
+// jobs submitted from threads which are not part of the job system,
+// or when the system isn't running, run immediately on the submitting thread
+// jobs must not throw
+
+
+class JobCounter;
+
+
+struct Job {
+	// calls the callable stored in storage
+	void                  (*function)(const void *storage);
+	JobCounter             *counter;
+	// next job waiting on the same dependency
+	Job                    *nextWaiting;
+	// slot can be reused when set
+	std::atomic<bool>       finished;
+	alignas(16) char        storage[64];
+
+
+	Job()
+	: function(nullptr)
+	, counter(nullptr)
+	, nextWaiting(nullptr)
+	, finished(true)
+	{
+	}
+
+
+	Job(const Job &)            = delete;
+	Job &operator=(const Job &) = delete;
+	Job(Job &&)                 = delete;
+	Job &operator=(Job &&)      = delete;
+};
+
+
+// number of unfinished jobs submitted with it
+// jobs submitted with jobRunAfter wait until it reaches zero
+class JobCounter {
+	friend bool jobSubmit(Job *job, JobCounter &counter, JobCounter *dependency, bool background);
+	friend void jobFinished(Job *job);
+
+	std::atomic<unsigned int>  count;
+	// held while the last job releases waiting jobs
+	// so the counter isn't done (and destroyed) before that's finished
+	std::atomic<bool>          locked;
+	Job                       *waiting;
+
+
+	void lock() {
+		while (locked.exchange(true, std::memory_order_seq_cst)) {
+		}
+	}
+
+
+	void unlock() {
+		locked.store(false, std::memory_order_seq_cst);
+	}
+
+
+public:
+
+	JobCounter()
+	: count(0)
+	, locked(false)
+	, waiting(nullptr)
+	{
+	}
+
+
+	~JobCounter() {
+		assert(done());
+		assert(!waiting);
+	}
+
+
+	bool done() const {
+		return count.load(std::memory_order_seq_cst) == 0 && !locked.load(std::memory_order_seq_cst);
+	}
+
+
+	JobCounter(const JobCounter &)            = delete;
+	JobCounter &operator=(const JobCounter &) = delete;
+	JobCounter(JobCounter &&)                 = delete;
+	JobCounter &operator=(JobCounter &&)      = delete;
+};
+
+
+// numThreads includes the calling thread, 0 means one per hardware thread
+// pinThreads sets the affinity of each thread to a single core
+void jobSystemInit(unsigned int numThreads, bool pinThreads);
+
+// waits for the workers to finish their current jobs
+// unfinished jobs are dropped
+void jobSystemShutdown();
+
+// including the thread which called jobSystemInit, 1 when not running
+unsigned int jobSystemNumThreads();
+
+// runs jobs until counter reaches zero
+// only sleeps when there's nothing to help with
+void jobWait(JobCounter &counter);
+
+// runs one pending job on the calling thread, false if there was none
+// doesn't take background jobs
+bool jobHelp();
+
+// internal, used by the templates below
+Job *jobAllocate();
+// false if the background queue is full, job is released without running
+bool jobSubmit(Job *job, JobCounter &counter, JobCounter *dependency, bool background);
+void jobFinished(Job *job);
+
+
+template <typename F> void jobTrampoline(const void *storage) {
+	(*reinterpret_cast<const F *>(storage))();
+}
+
+
+template <typename F> bool jobRunInternal(JobCounter *dependency, JobCounter &counter, bool background, const F &f) {
+	static_assert(sizeof(F)  <= sizeof(Job::storage), "Job is too big, capture less or capture a pointer");
+	static_assert(alignof(F) <= 16,                   "Job alignment is too big");
+	static_assert(std::is_trivially_destructible<F>::value, "Job must be trivially destructible");
+
+	Job *job = jobAllocate();
+	if (!job) {
+		if (dependency) {
+			jobWait(*dependency);
+		}
+		f();
+		return true;
+	}
+
+	new (job->storage) F(f);
+	job->function = &jobTrampoline<F>;
+	return jobSubmit(job, counter, dependency, background);
+}
+
+
+// f is copied into the job, it must be small and trivially destructible
+// so capture pointers and references instead of containers
+template <typename F> void jobRun(JobCounter &counter, const F &f) {
+	jobRunInternal(nullptr, counter, false, f);
+}
+
+
+// doesn't start until dependency reaches zero
+template <typename F> void jobRunAfter(JobCounter &dependency, JobCounter &counter, const F &f) {
+	jobRunInternal(&dependency, counter, false, f);
+}
+
+
+// for long jobs like file loading which shouldn't delay frame work
+// only workers run these, never a thread helping in jobWait
+// runs immediately when there are no workers
+// returns false without running f when the background queue is full,
+// the caller should keep the work queued and try again later
+template <typename F> bool jobRunBackground(JobCounter &counter, const F &f) {
+	return jobRunInternal(nullptr, counter, true, f);
+}
+
+
+// calls fn(begin, end) for chunks of [0, count) of at most grainSize items
+// first chunk runs on the calling thread, returns when all are done
+template <typename F> void parallelFor(unsigned int count, unsigned int grainSize, const F &fn) {
+	assert(grainSize > 0);
+
+	if (count <= grainSize || jobSystemNumThreads() == 1) {
+		fn(0, count);
+		return;
+	}
+
+	JobCounter counter;
+	const F *fnPtr = &fn;
+	for (unsigned int begin = grainSize; begin < count; begin += grainSize) {
+		unsigned int end = std::min(begin + grainSize, count);
+		jobRun(counter, [fnPtr, begin, end] () {
+			(*fnPtr)(begin, end);
+		});
+	}
+	fn(0, grainSize);
+	jobWait(counter);
+}
+
+
+#endif  // JOBSYSTEM_H
@@ -0,0 +1,255 @@
+/*
+Copyright (c) 2015-2018 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifdef PROFILING
+
+
+#include <cassert>
+#include <cstdio>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "Profiler.h"
+#include "Utils.h"
+
+
+namespace {
+
+
+struct FILEDeleter {
+	void operator()(FILE *f) { fclose(f); }
+};
+
+
+struct ProfileEvent {
+	const char  *name;
+	uint64_t     begin;
+	uint64_t     end;
+};
+
+
+// events are appended only by the owning thread
+// count is published with release so profilerWrite can read
+// finished events from another thread without locking
+struct EventBlock {
+	std::array<ProfileEvent, 4096>  events;
+	std::atomic<unsigned int>       count;
+	std::atomic<EventBlock *>       next;
+
+
+	EventBlock()
+	: count(0)
+	, next(nullptr)
+	{
+	}
+
+
+	EventBlock(const EventBlock &)            = delete;
+	EventBlock &operator=(const EventBlock &) = delete;
+	EventBlock(EventBlock &&)                 = delete;
+	EventBlock &operator=(EventBlock &&)      = delete;
+};
+
+
+struct ThreadBuffer {
+	unsigned int  tid;
+	std::string   name;
+	EventBlock   *first;
+	EventBlock   *current;
+
+
+	explicit ThreadBuffer(unsigned int tid_)
+	: tid(tid_)
+	, first(new EventBlock)
+	, current(first)
+	{
+	}
+
+
+	~ThreadBuffer() {
+		EventBlock *b = first;
+		while (b) {
+			EventBlock *n = b->next.load(std::memory_order_relaxed);
+			delete b;
+			b = n;
+		}
+		first   = nullptr;
+		current = nullptr;
+	}
+
+
+	ThreadBuffer(const ThreadBuffer &)            = delete;
+	ThreadBuffer &operator=(const ThreadBuffer &) = delete;
+	ThreadBuffer(ThreadBuffer &&)                 = delete;
+	ThreadBuffer &operator=(ThreadBuffer &&)      = delete;
+};
+
+
+// buffers outlive their threads so events from finished threads still get written
+std::mutex                                  buffersMutex;
+std::vector<std::unique_ptr<ThreadBuffer>>  buffers;
+
+thread_local ThreadBuffer *threadBuffer = nullptr;
+
+// timestamp and wall clock when first thread registered
+// used to find out timestamp frequency
+uint64_t                                    calibrationTimestamp = 0;
+std::chrono::steady_clock::time_point       calibrationTime;
+
+
+ThreadBuffer *registerThread() {
+	std::lock_guard<std::mutex> lock(buffersMutex);
+	if (buffers.empty()) {
+		calibrationTimestamp = profilerTimestamp();
+		calibrationTime      = std::chrono::steady_clock::now();
+	}
+	buffers.emplace_back(new ThreadBuffer(static_cast<unsigned int>(buffers.size())));
+	return buffers.back().get();
+}
+
+
+void writeEscaped(FILE *f, const char *str) {
+	for (const char *c = str; *c; c++) {
+		if (*c == '"' || *c == '\\') {
+			fputc('\\', f);
+		}
+		fputc(*c, f);
+	}
+}
+
+
+}  // namespace
+
+
+void profilerRecord(const char *name, uint64_t begin, uint64_t end) {
+	ThreadBuffer *buf = threadBuffer;
+	if (!buf) {
+		buf = registerThread();
+		threadBuffer = buf;
+	}
+
+	EventBlock *block = buf->current;
+	unsigned int idx = block->count.load(std::memory_order_relaxed);
+	if (idx == block->events.size()) {
+		EventBlock *n = new EventBlock;
+		block->next.store(n, std::memory_order_release);
+		buf->current = n;
+		block = n;
+		idx = 0;
+	}
+
+	ProfileEvent &e = block->events[idx];
+	e.name  = name;
+	e.begin = begin;
+	e.end   = end;
+	block->count.store(idx + 1, std::memory_order_release);
+}
+
+
+void profilerSetThreadName(const char *name) {
+	if (!threadBuffer) {
+		threadBuffer = registerThread();
+	}
+
+	std::lock_guard<std::mutex> lock(buffersMutex);
+	threadBuffer->name = name;
+}
+
+
+void profilerWrite(const std::string &filename) {
+	std::unique_ptr<FILE, FILEDeleter> f(fopen(filename.c_str(), "wb"));
+	if (!f) {
+		LOG("Failed to open profile file \"%s\"\n", filename.c_str());
+		throw std::runtime_error("Failed to open profile file");
+	}
+
+	std::lock_guard<std::mutex> lock(buffersMutex);
+
+	// chrome wants microseconds, make them relative to earliest event
+	// events are recorded when scopes end so that is not necessarily the first one
+	uint64_t base = UINT64_MAX;
+	for (const auto &buf : buffers) {
+		for (const EventBlock *b = buf->first; b; b = b->next.load(std::memory_order_acquire)) {
+			unsigned int count = b->count.load(std::memory_order_acquire);
+			for (unsigned int i = 0; i < count; i++) {
+				base = std::min(base, b->events[i].begin);
+			}
+		}
+	}
+	if (base == UINT64_MAX) {
+		base = 0;
+	}
+
+#ifdef PROFILER_TSC
+	double nsPerTick = 1.0;
+	{
+		uint64_t ticks = profilerTimestamp() - calibrationTimestamp;
+		auto elapsed   = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - calibrationTime);
+		if (ticks > 0) {
+			nsPerTick = double(elapsed.count()) / double(ticks);
+		}
+	}
+#else  // PROFILER_TSC
+	const double nsPerTick = 1.0;
+#endif  // PROFILER_TSC
+	const double usPerTick = nsPerTick / 1000.0;
+
+	unsigned int numEvents = 0;
+	fprintf(f.get(), "{\"traceEvents\":[\n");
+	bool first = true;
+	for (const auto &buf : buffers) {
+		if (!buf->name.empty()) {
+			fprintf(f.get(), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"", first ? "" : ",\n", buf->tid);
+			writeEscaped(f.get(), buf->name.c_str());
+			fprintf(f.get(), "\"}}");
+			first = false;
+		}
+
+		for (const EventBlock *b = buf->first; b; b = b->next.load(std::memory_order_acquire)) {
+			unsigned int count = b->count.load(std::memory_order_acquire);
+			for (unsigned int i = 0; i < count; i++) {
+				const ProfileEvent &e = b->events[i];
+				// scopes which ended after the first pass might have begun before base
+				uint64_t begin = std::max(e.begin, base);
+				fprintf(f.get(), "%s{\"name\":\"", first ? "" : ",\n");
+				writeEscaped(f.get(), e.name);
+				fprintf(f.get(), "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", buf->tid, double(begin - base) * usPerTick, double(e.end - begin) * usPerTick);
+				first = false;
+			}
+			numEvents += count;
+		}
+	}
+	fprintf(f.get(), "\n],\"displayTimeUnit\":\"ns\"}\n");
+
+	LOG("Wrote %u profile events from %u threads to \"%s\"\n", numEvents, static_cast<unsigned int>(buffers.size()), filename.c_str());
+}
+
+
+#endif  // PROFILING
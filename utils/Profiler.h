@@ -0,0 +1,125 @@
+/*
+Copyright (c) 2015-2018 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+
+#include <string>
+
+
+#ifdef PROFILING
+
+
+#include <cinttypes>
+
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+
+// reading the clock through the OS is most of the cost of a scope
+// so use the TSC directly and convert to nanoseconds when writing
+#define PROFILER_TSC 1
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else  // _MSC_VER
+#include <x86intrin.h>
+#endif  // _MSC_VER
+
+static inline uint64_t profilerTimestamp() {
+	return __rdtsc();
+}
+
+#else  // x86
+
+#include <chrono>
+
+static inline uint64_t profilerTimestamp() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+#endif  // x86
+
+
+// name must be a string with static lifetime, only the pointer is stored
+void profilerRecord(const char *name, uint64_t begin, uint64_t end);
+
+void profilerSetThreadName(const char *name);
+
+// writes everything recorded so far as Chrome trace_event JSON
+// can be called while other threads are still recording
+void profilerWrite(const std::string &filename);
+
+
+class ProfileScope {
+	const char  *name;
+	uint64_t     begin;
+
+
+public:
+
+	explicit ProfileScope(const char *name_)
+	: name(name_)
+	, begin(profilerTimestamp())
+	{
+	}
+
+
+	~ProfileScope() {
+		profilerRecord(name, begin, profilerTimestamp());
+	}
+
+
+	ProfileScope(const ProfileScope &)            = delete;
+	ProfileScope &operator=(const ProfileScope &) = delete;
+	ProfileScope(ProfileScope &&)                 = delete;
+	ProfileScope &operator=(ProfileScope &&)      = delete;
+};
+
+
+#define PROFILE_CONCAT2(a, b) a ## b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope_, __LINE__)(name)
+#define PROFILE_FUNCTION()  PROFILE_SCOPE(__func__)
+
+
+#else  // PROFILING
+
+
+#define PROFILE_SCOPE(name)
+#define PROFILE_FUNCTION()
+
+
+static inline void profilerSetThreadName(const char * /* name */) {
+}
+
+
+static inline void profilerWrite(const std::string & /* filename */) {
+}
+
+
+#endif  // PROFILING
+
+
+#endif  // PROFILER_H
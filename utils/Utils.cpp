@@ -23,63 +23,695 @@ THE SOFTWARE.
 
 #include <cstring>
 #include <cassert>
+#include <csignal>
+#include <cstdarg>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 #include <sys/stat.h>
 
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+
+#else  // _WIN32
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#endif  // _WIN32
+
 #include "Utils.h"
 
 #include <SDL.h>
 
 
+// mingw fuckery...
+#if defined(__GNUC__) && defined(_WIN32)
+
+#include <mingw.thread.h>
+#include <mingw.mutex.h>
+#include <mingw.condition_variable.h>
+
+#endif  // defined(__GNUC__) && defined(_WIN32)
+
+
 struct FILEDeleter {
 	void operator()(FILE *f) { fclose(f); }
 };
 
 
-static FILE *logFile;
+namespace {
+
+
+// fixed size so the writer never needs to allocate
+static const unsigned int logRingSize   = 64 * 1024;
+// entries are aligned to header size so a header always fits before the end
+static const unsigned int logEntryAlign = 16;
+// length of an entry which only skips to beginning of the ring
+static const uint32_t     logWrapMarker = UINT32_MAX;
+
+
+struct LogEntryHeader {
+	// global order of messages, the writer merges threads by this
+	uint64_t  sequence;
+	uint32_t  length;
+	LogLevel  level;
+};
+
+static_assert(sizeof(LogEntryHeader) == logEntryAlign, "LogEntryHeader size is wrong");
+
+
+// single producer (owning thread) single consumer (writer) ring
+// head and tail only grow, position in data is them modulo size
+struct LogRing {
+	std::atomic<uint64_t>       head;
+	std::atomic<uint64_t>       tail;
+	std::atomic<unsigned int>   dropped;
+	// owning thread has exited, writer frees the ring once it's empty
+	std::atomic<bool>           abandoned;
+	alignas(logEntryAlign) char  data[logRingSize];
+
+
+	LogRing()
+	: head(0)
+	, tail(0)
+	, dropped(0)
+	, abandoned(false)
+	{
+	}
+
+
+	LogRing(const LogRing &)            = delete;
+	LogRing &operator=(const LogRing &) = delete;
+	LogRing(LogRing &&)                 = delete;
+	LogRing &operator=(LogRing &&)      = delete;
+};
+
+
+// marks the ring abandoned when its thread exits
+struct ThreadLogRing {
+	LogRing *ring;
+
+
+	ThreadLogRing()
+	: ring(nullptr)
+	{
+	}
+
+
+	~ThreadLogRing() {
+		if (ring) {
+			ring->abandoned.store(true, std::memory_order_release);
+			ring = nullptr;
+		}
+	}
+
+
+	ThreadLogRing(const ThreadLogRing &)            = delete;
+	ThreadLogRing &operator=(const ThreadLogRing &) = delete;
+	ThreadLogRing(ThreadLogRing &&)                 = delete;
+	ThreadLogRing &operator=(ThreadLogRing &&)      = delete;
+};
+
+
+FILE                                   *logFile = nullptr;
+std::atomic<bool>                       logRunning(false);
+std::atomic<LogLevel>                   logLevel(LogLevel::Info);
+std::atomic<uint64_t>                   logSequence(0);
+
+// only taken when a thread logs for the first time and briefly by the writer
+std::mutex                              ringsMutex;
+std::vector<std::unique_ptr<LogRing>>   rings;
+
+thread_local ThreadLogRing              threadRing;
+
+// serializes draining between writer thread, logFlush and crash handler
+std::mutex                              drainMutex;
+
+std::thread                             writerThread;
+std::mutex                              writerMutex;
+std::condition_variable                 writerCV;
+bool                                    writerQuit = false;
+
+
+const int crashSignals[] = {
+	  SIGSEGV
+	, SIGABRT
+	, SIGFPE
+	, SIGILL
+#ifdef SIGBUS
+	, SIGBUS
+#endif  // SIGBUS
+};
+
+
+LogRing *registerLogRing() {
+	std::lock_guard<std::mutex> lock(ringsMutex);
+	rings.emplace_back(new LogRing);
+	return rings.back().get();
+}
+
+
+// returns header of the oldest entry or nullptr if ring is empty
+// skips wrap markers
+const LogEntryHeader *peekEntry(LogRing &ring) {
+	uint64_t head = ring.head.load(std::memory_order_acquire);
+	uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+	while (tail != head) {
+		const LogEntryHeader *header = reinterpret_cast<const LogEntryHeader *>(&ring.data[tail % logRingSize]);
+		if (header->length != logWrapMarker) {
+			return header;
+		}
+		tail += logRingSize - tail % logRingSize;
+		ring.tail.store(tail, std::memory_order_release);
+	}
+	return nullptr;
+}
+
+
+// give up on a lock after a while when crashing
+// the crashed thread might be the one holding it
+void crashLock(std::unique_lock<std::mutex> &lock) {
+	for (unsigned int i = 0; i < 100 && !lock.try_lock(); i++) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+
+// written in front of the message, info and debug have none
+const char *levelPrefix(LogLevel level) {
+	switch (level) {
+	case LogLevel::Debug:
+	case LogLevel::Info:
+		return "";
+
+	case LogLevel::Warning:
+		return "WARNING: ";
+
+	case LogLevel::Error:
+		return "ERROR: ";
+	}
+
+	return "";
+}
+
+
+// passes the entries of all rings to out in sequence order
+// doesn't allocate so the crash handler can use it
+// returns true if there were errors
+template <typename Rings, typename Out>
+bool drainEntries(const Rings &ringList, Out &&out) {
+	bool error = false;
+	while (true) {
+		LogRing              *oldest  = nullptr;
+		const LogEntryHeader *entry   = nullptr;
+		for (const auto &ringPtr : ringList) {
+			LogRing &ring = *ringPtr;
+			const LogEntryHeader *h = peekEntry(ring);
+			if (h && (!entry || h->sequence < entry->sequence)) {
+				oldest = &ring;
+				entry  = h;
+			}
+		}
+
+		if (!entry) {
+			break;
+		}
+
+		out(entry->level, reinterpret_cast<const char *>(entry) + sizeof(LogEntryHeader), entry->length);
+		if (entry->level == LogLevel::Error) {
+			error = true;
+		}
+
+		uint64_t tail = oldest->tail.load(std::memory_order_relaxed);
+		tail += (sizeof(LogEntryHeader) + entry->length + logEntryAlign - 1) & ~uint64_t(logEntryAlign - 1);
+		oldest->tail.store(tail, std::memory_order_release);
+	}
+
+	for (const auto &ringPtr : ringList) {
+		unsigned int dropped = ringPtr->dropped.exchange(0, std::memory_order_relaxed);
+		if (dropped > 0) {
+			char buf[64];
+			int length = snprintf(buf, sizeof(buf), "log ring full, dropped %u messages\n", dropped);
+			out(LogLevel::Warning, buf, static_cast<unsigned int>(std::max(length, 0)));
+		}
+	}
+
+	return error;
+}
+
+
+// writes everything in the rings in sequence order
+// caller must hold drainMutex
+void drainRings(FILE *f) {
+	// copy the ring list so threads logging for the first time
+	// don't wait for file writes
+	// rings are only removed here and draining is serialized by drainMutex
+	std::vector<LogRing *> drainList;
+	{
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		drainList.reserve(rings.size());
+		for (const auto &ring : rings) {
+			drainList.push_back(ring.get());
+		}
+	}
+
+	bool error = drainEntries(drainList, [f] (LogLevel level, const char *text, unsigned int length) {
+		fputs(levelPrefix(level), f);
+		fwrite(text, 1, length, f);
+	});
+
+	if (error) {
+		fflush(f);
+	}
+
+	bool haveAbandoned = false;
+	for (LogRing *ring : drainList) {
+		if (ring->abandoned.load(std::memory_order_acquire)) {
+			haveAbandoned = true;
+		}
+	}
+
+	if (haveAbandoned) {
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		rings.erase(std::remove_if(rings.begin(), rings.end(), [] (const std::unique_ptr<LogRing> &ring) {
+			return ring->abandoned.load(std::memory_order_acquire)
+			    && ring->tail.load(std::memory_order_relaxed) == ring->head.load(std::memory_order_acquire);
+		}), rings.end());
+	}
+}
+
+
+// crash handler output goes through this instead of stdio
+char         crashBuf[4096];
+unsigned int crashBufUsed = 0;
+
+
+void crashBufFlush(int fd) {
+	const char *p = crashBuf;
+	while (crashBufUsed > 0) {
+#ifdef _WIN32
+		int written = _write(fd, p, crashBufUsed);
+#else  // _WIN32
+		ssize_t written = write(fd, p, crashBufUsed);
+#endif  // _WIN32
+		if (written <= 0) {
+			break;
+		}
+		p            += written;
+		crashBufUsed -= static_cast<unsigned int>(written);
+	}
+	crashBufUsed = 0;
+}
+
+
+void crashBufAppend(int fd, const char *text, unsigned int length) {
+	while (length > 0) {
+		if (crashBufUsed == sizeof(crashBuf)) {
+			crashBufFlush(fd);
+		}
+		unsigned int n = std::min(length, static_cast<unsigned int>(sizeof(crashBuf)) - crashBufUsed);
+		memcpy(crashBuf + crashBufUsed, text, n);
+		crashBufUsed += n;
+		text         += n;
+		length       -= n;
+	}
+}
+
+
+void writerThreadFunc() {
+	FILE *f = logFile ? logFile : stdout;
+
+	std::unique_lock<std::mutex> lock(writerMutex);
+	while (!writerQuit) {
+		writerCV.wait_for(lock, std::chrono::milliseconds(10));
+		lock.unlock();
+
+		{
+			std::lock_guard<std::mutex> drainLock(drainMutex);
+			drainRings(f);
+		}
+
+		lock.lock();
+	}
+}
+
+
+void crashHandler(int sig) {
+	// best effort, not strictly async signal safe
+	std::unique_lock<std::mutex> lock(drainMutex, std::defer_lock);
+	crashLock(lock);
+
+	FILE *f = logFile ? logFile : stdout;
+	// stdio is only used under drainMutex
+	// if we got it the buffered output is safe to flush and comes first
+	if (lock.owns_lock()) {
+		fflush(f);
+	}
+
+#ifdef _WIN32
+	int fd = _fileno(f);
+#else  // _WIN32
+	int fd = fileno(f);
+#endif  // _WIN32
+
+	// don't take ringsMutex or copy the ring list, the process is going down anyway
+	drainEntries(rings, [fd] (LogLevel level, const char *text, unsigned int length) {
+		const char *prefix = levelPrefix(level);
+		crashBufAppend(fd, prefix, static_cast<unsigned int>(strlen(prefix)));
+		crashBufAppend(fd, text, length);
+	});
+	crashBufFlush(fd);
+
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+
+}  // namespace
+
+
+bool LogRateLimit::allow(unsigned int &suppressedCount) {
+	uint64_t now = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	uint64_t next = nextAllowed.load(std::memory_order_relaxed);
+	if (now < next || !nextAllowed.compare_exchange_strong(next, now + 1000, std::memory_order_relaxed)) {
+		suppressed.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	suppressedCount = suppressed.exchange(0, std::memory_order_relaxed);
+	return true;
+}
+
 
 void logInit() {
 	assert(!logFile);
+	assert(!logRunning);
 
 	char *logFilePath = SDL_GetPrefPath("", "SMAADemo");
 	std::string logFileName(logFilePath);
 	SDL_free(logFilePath);
 	logFileName += "logfile.txt";
 	logFile = fopen(logFileName.c_str(), "wb");
+
+	for (int sig : crashSignals) {
+		signal(sig, crashHandler);
+	}
+
+	writerQuit   = false;
+	writerThread = std::thread(writerThreadFunc);
+	logRunning.store(true, std::memory_order_release);
 }
 
 
-void logWrite(const char* message, ...) {
+void logWrite(LogLevel level, const char* message, ...) {
+	if (level < logLevel.load(std::memory_order_relaxed)) {
+		return;
+	}
+
 	va_list argp;
 	va_start(argp, message);
-	
-	if (logFile) {
-		vfprintf(logFile, message, argp);
-	} else {
-		// Write to console if opening log file failed
+
+	if (!logRunning.load(std::memory_order_acquire)) {
+		// Write to console if logging is not running
+		fputs(levelPrefix(level), stdout);
 		vprintf(message, argp);
+		va_end(argp);
+		return;
 	}
 
+	char buf[1024];
+	std::vector<char> bigBuf;
+	const char *text = buf;
+
+	va_list argpCopy;
+	va_copy(argpCopy, argp);
+	int result = vsnprintf(buf, sizeof(buf), message, argp);
 	va_end(argp);
+
+	if (result < 0) {
+		va_end(argpCopy);
+		return;
+	}
+
+	uint32_t length = static_cast<uint32_t>(result);
+	if (length >= sizeof(buf)) {
+		// rare, only validation layer messages get this long
+		bigBuf.resize(length + 1);
+		vsnprintf(&bigBuf[0], bigBuf.size(), message, argpCopy);
+		text = &bigBuf[0];
+	}
+	va_end(argpCopy);
+
+	// must fit in the ring with a wrap marker in front
+	const uint32_t maxLength = logRingSize / 2 - sizeof(LogEntryHeader);
+	length = std::min(length, maxLength);
+
+	LogRing *ring = threadRing.ring;
+	if (!ring) {
+		ring = registerLogRing();
+		threadRing.ring = ring;
+	}
+
+	uint64_t head      = ring->head.load(std::memory_order_relaxed);
+	uint64_t tail      = ring->tail.load(std::memory_order_acquire);
+	unsigned int need  = (sizeof(LogEntryHeader) + length + logEntryAlign - 1) & ~(logEntryAlign - 1);
+	unsigned int toEnd = logRingSize - head % logRingSize;
+	unsigned int total = (need > toEnd) ? (toEnd + need) : need;
+
+	if (head + total - tail > logRingSize) {
+		// never wait for the writer, it might be stuck on disk
+		ring->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	if (need > toEnd) {
+		LogEntryHeader *wrap = reinterpret_cast<LogEntryHeader *>(&ring->data[head % logRingSize]);
+		wrap->length = logWrapMarker;
+		head += toEnd;
+	}
+
+	LogEntryHeader *header = reinterpret_cast<LogEntryHeader *>(&ring->data[head % logRingSize]);
+	header->sequence = logSequence.fetch_add(1, std::memory_order_relaxed);
+	header->length   = length;
+	header->level    = level;
+	memcpy(reinterpret_cast<char *>(header) + sizeof(LogEntryHeader), text, length);
+	ring->head.store(head + need, std::memory_order_release);
+
+	if (level == LogLevel::Error || head + need - tail > logRingSize / 2) {
+		writerCV.notify_one();
+	}
+}
+
+
+void logSetLevel(LogLevel level) {
+	logLevel.store(level, std::memory_order_relaxed);
 }
 
 
 void logShutdown() {
-	assert(logFile);
+	assert(logRunning);
+
+	logRunning.store(false, std::memory_order_release);
+
+	{
+		std::lock_guard<std::mutex> lock(writerMutex);
+		writerQuit = true;
+	}
+	writerCV.notify_one();
+	writerThread.join();
+
+	for (int sig : crashSignals) {
+		signal(sig, SIG_DFL);
+	}
 
-	fflush(logFile);
-	fclose(logFile);
-	logFile = nullptr;
+	std::lock_guard<std::mutex> lock(drainMutex);
+	if (logFile) {
+		drainRings(logFile);
+		fflush(logFile);
+		fclose(logFile);
+		logFile = nullptr;
+	} else {
+		drainRings(stdout);
+		fflush(stdout);
+	}
 }
 
 
 void logFlush() {
-	assert(logFile);
+	// also fine when the writer isn't running, then there's nothing to drain
+	std::lock_guard<std::mutex> lock(drainMutex);
+	FILE *f = logFile ? logFile : stdout;
+	drainRings(f);
+	fflush(f);
+}
+
+
+#ifdef _WIN32
+
+
+struct MappedFile::Mapping {
+	HANDLE  file;
+	HANDLE  mapping;
+	void   *view;
+
+
+	Mapping()
+	: file(INVALID_HANDLE_VALUE)
+	, mapping(nullptr)
+	, view(nullptr)
+	{
+	}
+
+
+	~Mapping() {
+		if (view) {
+			UnmapViewOfFile(view);
+		}
+		if (mapping) {
+			CloseHandle(mapping);
+		}
+		if (file != INVALID_HANDLE_VALUE) {
+			CloseHandle(file);
+		}
+	}
+
+
+	Mapping(const Mapping &)            = delete;
+	Mapping &operator=(const Mapping &) = delete;
+	Mapping(Mapping &&)                 = delete;
+	Mapping &operator=(Mapping &&)      = delete;
+};
+
 
-	fflush(logFile);
+MappedFile::MappedFile(const std::string &filename)
+: data_(nullptr)
+, size_(0)
+{
+	auto m = std::make_shared<Mapping>();
+
+	m->file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m->file == INVALID_HANDLE_VALUE) {
+		// TODO: better exception
+		throw std::runtime_error("file not found " + filename);
+	}
+
+	LARGE_INTEGER filesize;
+	if (!GetFileSizeEx(m->file, &filesize)) {
+		// TODO: better exception
+		throw std::runtime_error("GetFileSizeEx failed");
+	}
+
+	if (static_cast<uint64_t>(filesize.QuadPart) > SIZE_MAX) {
+		throw std::runtime_error("file too large to map " + filename);
+	}
+
+	// can't map empty files
+	if (filesize.QuadPart == 0) {
+		return;
+	}
+
+	m->mapping = CreateFileMappingA(m->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!m->mapping) {
+		// TODO: better exception
+		throw std::runtime_error("CreateFileMapping failed " + filename);
+	}
+
+	m->view = MapViewOfFile(m->mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!m->view) {
+		// TODO: better exception
+		throw std::runtime_error("MapViewOfFile failed " + filename);
+	}
+
+	data_   = reinterpret_cast<const char *>(m->view);
+	size_   = static_cast<size_t>(filesize.QuadPart);
+	mapping = std::move(m);
 }
 
 
+#else  // _WIN32
+
+
+struct MappedFile::Mapping {
+	void   *addr;
+	size_t  length;
+
+
+	Mapping(void *addr_, size_t length_)
+	: addr(addr_)
+	, length(length_)
+	{
+	}
+
+
+	~Mapping() {
+		munmap(addr, length);
+	}
+
+
+	Mapping(const Mapping &)            = delete;
+	Mapping &operator=(const Mapping &) = delete;
+	Mapping(Mapping &&)                 = delete;
+	Mapping &operator=(Mapping &&)      = delete;
+};
+
+
+MappedFile::MappedFile(const std::string &filename)
+: data_(nullptr)
+, size_(0)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		// TODO: better exception
+		throw std::runtime_error("file not found " + filename);
+	}
+
+	struct stat statbuf;
+	memset(&statbuf, 0, sizeof(struct stat));
+	if (fstat(fd, &statbuf) < 0) {
+		close(fd);
+		// TODO: better exception
+		throw std::runtime_error("fstat failed");
+	}
+
+	if (static_cast<uint64_t>(statbuf.st_size) > SIZE_MAX) {
+		close(fd);
+		throw std::runtime_error("file too large to map " + filename);
+	}
+	size_t filesize = static_cast<size_t>(statbuf.st_size);
+
+	// can't map empty files
+	if (filesize == 0) {
+		close(fd);
+		return;
+	}
+
+	void *addr = mmap(nullptr, filesize, PROT_READ, MAP_PRIVATE, fd, 0);
+	// the mapping keeps the file alive
+	close(fd);
+	if (addr == MAP_FAILED) {
+		// TODO: better exception
+		throw std::runtime_error("mmap failed " + filename);
+	}
+
+	mapping = std::make_shared<Mapping>(addr, filesize);
+	data_   = reinterpret_cast<const char *>(addr);
+	size_   = filesize;
+}
+
+
+#endif  // _WIN32
+
+
 std::vector<char> readTextFile(std::string filename) {
 	std::unique_ptr<FILE, FILEDeleter> file(fopen(filename.c_str(), "rb"));
 
@@ -102,7 +734,7 @@ std::vector<char> readTextFile(std::string filename) {
 		throw std::runtime_error("fstat failed");
 	}
 
-	unsigned int filesize = static_cast<unsigned int>(statbuf.st_size);
+	size_t filesize = static_cast<size_t>(statbuf.st_size);
 	// ensure NUL -termination
 	std::vector<char> buf(filesize + 1, '\0');
 
@@ -139,7 +771,7 @@ std::vector<char> readFile(std::string filename) {
 		throw std::runtime_error("fstat failed");
 	}
 
-	unsigned int filesize = static_cast<unsigned int>(statbuf.st_size);
+	size_t filesize = static_cast<size_t>(statbuf.st_size);
 	std::vector<char> buf(filesize, '\0');
 
 	size_t ret = fread(&buf[0], 1, filesize, file.get());
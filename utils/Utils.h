@@ -27,6 +27,7 @@ THE SOFTWARE.
 
 #include <cinttypes>
 
+#include <atomic>
 #include <memory>
 #include <string>
 #include <vector>
@@ -113,13 +114,146 @@ namespace std {
 #endif
 
 
-#define LOG(msg, ...) logWrite(msg, ##__VA_ARGS__)
+enum class LogLevel : uint8_t {
+	  Debug
+	, Info
+	, Warning
+	, Error
+};
 
+
+#define LOG(msg, ...)          logWrite(LogLevel::Info,    msg, ##__VA_ARGS__)
+#define LOG_DEBUG(msg, ...)    logWrite(LogLevel::Debug,   msg, ##__VA_ARGS__)
+#define LOG_WARNING(msg, ...)  logWrite(LogLevel::Warning, msg, ##__VA_ARGS__)
+#define LOG_ERROR(msg, ...)    logWrite(LogLevel::Error,   msg, ##__VA_ARGS__)
+
+
+// for messages which can repeat every frame
+// lets one through per call site per second and counts the rest
+class LogRateLimit {
+	std::atomic<uint64_t>      nextAllowed;
+	std::atomic<unsigned int>  suppressed;
+
+
+public:
+
+	LogRateLimit()
+	: nextAllowed(0)
+	, suppressed(0)
+	{
+	}
+
+
+	// if true the message should be written
+	// and suppressedCount is how many were dropped since last time
+	bool allow(unsigned int &suppressedCount);
+
+
+	LogRateLimit(const LogRateLimit &)            = delete;
+	LogRateLimit &operator=(const LogRateLimit &) = delete;
+	LogRateLimit(LogRateLimit &&)                 = delete;
+	LogRateLimit &operator=(LogRateLimit &&)      = delete;
+};
+
+
+#define LOG_RATELIMITED(level, msg, ...) \
+	do { \
+		static LogRateLimit logRateLimit_; \
+		unsigned int logSuppressed_ = 0; \
+		if (logRateLimit_.allow(logSuppressed_)) { \
+			if (logSuppressed_ > 0) { \
+				logWrite(level, "(%u similar messages suppressed)\n", logSuppressed_); \
+			} \
+			logWrite(level, msg, ##__VA_ARGS__); \
+		} \
+	} while (0)
+
+
+// logWrite only formats the message into a per-thread ring buffer
+// a background thread started by logInit writes them to the log file
+// messages written before logInit or after logShutdown go to stdout
 void logInit();
-void logWrite(const char* message, ...) PRINTF(1, 2);
+void logWrite(LogLevel level, const char* message, ...) PRINTF(2, 3);
+// messages below this level are discarded without formatting
+void logSetLevel(LogLevel level);
 void logShutdown();
+// blocks until everything logged so far is in the file
 void logFlush();
 
+// read-only memory mapping of a whole file
+// copies share the same mapping, it's unmapped when the last one goes away
+// keep mappings short-lived: if the file is truncated while mapped
+// reading past the new end raises SIGBUS on POSIX,
+// and on Windows the file can't be deleted or replaced while mapped
+class MappedFile {
+	struct Mapping;
+
+	std::shared_ptr<const Mapping>  mapping;
+	const char                     *data_;
+	size_t                          size_;
+
+
+public:
+
+	MappedFile()
+	: data_(nullptr)
+	, size_(0)
+	{
+	}
+
+	// throws std::runtime_error if the file can't be opened or mapped
+	explicit MappedFile(const std::string &filename);
+
+	MappedFile(const MappedFile &)            = default;
+	MappedFile &operator=(const MappedFile &) = default;
+
+	MappedFile(MappedFile &&other)
+	: mapping(std::move(other.mapping))
+	, data_(other.data_)
+	, size_(other.size_)
+	{
+		other.data_ = nullptr;
+		other.size_ = 0;
+	}
+
+	MappedFile &operator=(MappedFile &&other) {
+		if (this != &other) {
+			mapping     = std::move(other.mapping);
+			data_       = other.data_;
+			size_       = other.size_;
+			other.data_ = nullptr;
+			other.size_ = 0;
+		}
+		return *this;
+	}
+
+	~MappedFile() {}
+
+
+	// not NUL-terminated
+	// nullptr for empty files
+	const char *data() const {
+		return data_;
+	}
+
+	size_t size() const {
+		return size_;
+	}
+
+	bool empty() const {
+		return size_ == 0;
+	}
+
+	const char *begin() const {
+		return data_;
+	}
+
+	const char *end() const {
+		return data_ + size_;
+	}
+};
+
+
 std::vector<char> readTextFile(std::string filename);
 std::vector<char> readFile(std::string filename);
 void writeFile(const std::string &filename, const void *contents, size_t size);
@@ -4,6 +4,10 @@ d              := $(dir)
 
 
 FILES:= \
+	Allocations.cpp \
+	Arena.cpp \
+	JobSystem.cpp \
+	Profiler.cpp \
 	Utils.cpp \
 	# empty line
 